@@ -0,0 +1,4 @@
+#!/bin/bash
+
+mkdir -p bin
+gcc -std=c11 -O2 compiler/ibsallocator.c compiler/ibsdictionary.c benchmarks/ibsdictbench.c -o bin/ibsdictbench
@@ -0,0 +1,171 @@
+#include "../compiler/ibscommon.h"
+#include "../compiler/ibsdictionary.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * Compares trie and hash dictionary on identifier sets that look like the ones
+ * found in real code: short loop variables, camelCase names built from common
+ * words, names with numeric suffixes and builtin type names. Lookups follow Zipf
+ * distribution since few identifiers are used far more often than others and
+ * lookup keys are separate copies of names same as token reprs are.
+ */
+
+#define LOOKUP_COUNT (2 * 1000 * 1000)
+#define COPIES_PER_IDENT 4
+#define SCOPE_VARS 8
+#define SCOPE_LOOKUPS 40
+
+static const char* shortNames[] = {
+	"i", "j", "k", "n", "x", "y", "z", "a", "b", "c", "t", "res", "tmp", "val", "len", "idx",
+	"int8", "int16", "int32", "int64", "uint8", "uint16", "uint32", "uint64", "float32", "float64", "bool",
+};
+
+static const char* words[] = {
+	"get", "set", "is", "has", "create", "parse", "process", "read", "write", "find", "node", "token",
+	"value", "count", "index", "buffer", "name", "type", "expr", "stmt", "block", "scope", "decl", "func",
+	"param", "result", "left", "right", "next", "prev", "first", "last", "cur", "new", "old", "file",
+	"line", "pos", "size", "length", "item", "list", "data", "info", "state", "kind", "flag", "error",
+};
+
+static uint64_t rngState = 0x9E3779B97F4A7C15ull;
+
+static uint32_t nextRandom(void) {
+	// xorshift64*
+	rngState ^= rngState >> 12;
+	rngState ^= rngState << 25;
+	rngState ^= rngState >> 27;
+	return (uint32_t)((rngState * 2685821657736338717ull) >> 32);
+}
+
+static double getTime(void) {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static char* generateIdent(PIbsAllocator a, int index) {
+	char buf[128];
+	int shortCount = sizeof(shortNames) / sizeof(shortNames[0]);
+	int wordCount = sizeof(words) / sizeof(words[0]);
+	if (index < shortCount) {
+		strcpy(buf, shortNames[index]);
+	} else {
+		int len = 0;
+		int parts = 1 + nextRandom() % 3;
+		for (int i = 0; i < parts; i++) {
+			const char* word = words[nextRandom() % wordCount];
+			len += sprintf(&buf[len], "%s", word);
+			if (i > 0) buf[len - strlen(word)] -= 'a' - 'A';
+		}
+		// Make sure the name is unique
+		sprintf(&buf[len], "%d", index);
+	}
+	size_t len = strlen(buf);
+	char* res = ibsAlloc(a, len + 1);
+	memcpy(res, buf, len);
+	return res;
+}
+
+static char* copyString(PIbsAllocator a, const char* str) {
+	size_t len = strlen(str);
+	char* res = ibsAlloc(a, len + 1);
+	memcpy(res, str, len);
+	return res;
+}
+
+/**
+ * Returns an array of LOOKUP_COUNT keys chosen with Zipf distribution
+ */
+static const char** generateLookups(PIbsAllocator a, char** idents, int count) {
+	char** copies = ibsAlloc(a, count * COPIES_PER_IDENT * sizeof(char*));
+	for (int i = 0; i < count * COPIES_PER_IDENT; i++) {
+		copies[i] = copyString(a, idents[i / COPIES_PER_IDENT]);
+	}
+	double* cumulative = ibsAlloc(a, count * sizeof(double));
+	double sum = 0;
+	for (int i = 0; i < count; i++) {
+		sum += 1.0 / (i + 1);
+		cumulative[i] = sum;
+	}
+	const char** lookups = ibsAlloc(a, LOOKUP_COUNT * sizeof(char*));
+	for (int i = 0; i < LOOKUP_COUNT; i++) {
+		double r = (double)nextRandom() / UINT32_MAX * sum;
+		int lo = 0;
+		int hi = count - 1;
+		while (lo < hi) {
+			int mid = (lo + hi) / 2;
+			if (cumulative[mid] < r) lo = mid + 1;
+			else hi = mid;
+		}
+		lookups[i] = copies[lo * COPIES_PER_IDENT + nextRandom() % COPIES_PER_IDENT];
+	}
+	return lookups;
+}
+
+struct BenchResult {
+	double insert;
+	double lookup;
+	double scopes;
+};
+
+static struct BenchResult runBench(PIbsDict dict, char** idents, int count, const char** lookups) {
+	struct BenchResult res;
+	double start = getTime();
+	for (int i = 0; i < count; i++) {
+		ibsDictPut(dict, idents[i], idents[i]);
+	}
+	res.insert = (getTime() - start) * 1e9 / count;
+
+	size_t found = 0;
+	start = getTime();
+	for (int i = 0; i < LOOKUP_COUNT; i++) {
+		found += ibsDictGet(dict, lookups[i]) != NULL;
+	}
+	res.lookup = (getTime() - start) * 1e9 / LOOKUP_COUNT;
+	if (found != LOOKUP_COUNT) printf("ERROR: Found only %zu of %d keys\n", found, LOOKUP_COUNT);
+
+	// Simulates entering a block that declares a few variables that shadow
+	// outer ones, uses some identifiers and then exits
+	int ops = 0;
+	start = getTime();
+	for (int i = 0; i + SCOPE_LOOKUPS <= LOOKUP_COUNT; i += SCOPE_LOOKUPS) {
+		for (int j = 0; j < SCOPE_VARS; j++) {
+			ibsDictPush(dict, lookups[i + j], idents[0]);
+		}
+		for (int j = 0; j < SCOPE_LOOKUPS; j++) {
+			found += ibsDictGet(dict, lookups[i + j]) != NULL;
+		}
+		for (int j = 0; j < SCOPE_VARS; j++) {
+			ibsDictPop(dict, lookups[i + j]);
+		}
+		ops += 2 * SCOPE_VARS + SCOPE_LOOKUPS;
+	}
+	res.scopes = (getTime() - start) * 1e9 / ops;
+	return res;
+}
+
+int main(void) {
+	int sizes[] = { 100, 1000, 10000, 100000 };
+	printf("%8s %-8s %12s %12s %8s\n", "Idents", "Op", "Trie ns/op", "Hash ns/op", "Speedup");
+	for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+		int count = sizes[s];
+		PIbsAllocator a = ibsChunkedAllocatorCreate("bench", 16 * 1024 * 1024);
+		char** idents = ibsAlloc(a, count * sizeof(char*));
+		for (int i = 0; i < count; i++) {
+			idents[i] = generateIdent(a, i);
+		}
+		const char** lookups = generateLookups(a, idents, count);
+
+		struct BenchResult trie = runBench(ibsDictCreate(a), idents, count, lookups);
+		struct BenchResult hash = runBench(ibsHashDictCreate(a), idents, count, lookups);
+
+		printf("%8d %-8s %12.1f %12.1f %7.2fx\n", count, "insert", trie.insert, hash.insert, trie.insert / hash.insert);
+		printf("%8d %-8s %12.1f %12.1f %7.2fx\n", count, "lookup", trie.lookup, hash.lookup, trie.lookup / hash.lookup);
+		printf("%8d %-8s %12.1f %12.1f %7.2fx\n", count, "scopes", trie.scopes, hash.scopes, trie.scopes / hash.scopes);
+		ibsSimpleAllocatorFree(a);
+	}
+	return 0;
+}
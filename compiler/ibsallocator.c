@@ -6,6 +6,13 @@
 #include <string.h>
 #include <stdio.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <stdatomic.h>
+#include <sys/mman.h>
+#endif
+
 /********************************************************
 Private
 *********************************************************/
@@ -14,6 +21,48 @@ Private
 #define MEM_ALIGN 0x7
 // Round allocator size to 4KB multipliers
 #define ALLOCATOR_ALING 0xfff
+// Chunks in chunked mode stop growing once they reach this size
+#define MAX_CHUNK_SIZE (64 * 1024 * 1024)
+// Allocations bigger than chunkSize / OVERSIZED_RATIO get a chunk of their own
+#define OVERSIZED_RATIO 4
+// Virtual allocators commit memory in steps of this size
+#define COMMIT_STEP (64 * 1024)
+#define HUGE_PAGE_COMMIT_STEP (2 * 1024 * 1024)
+// We assume all platforms we support have at most this big pages
+#define PAGE_ALIGN 0xfff
+
+struct IbsAllocatorChunk {
+	struct IbsAllocatorChunk* prev;
+	size_t size;
+};
+
+#define CHUNK_HEADER_SIZE ((sizeof(struct IbsAllocatorChunk) + MEM_ALIGN) & ~MEM_ALIGN)
+
+// Allocations with tags above this count are all recorded under the last tag
+#define MAX_PROFILE_TAGS 128
+
+struct IbsAllocatorTagStats {
+	const char* tag;
+	size_t count;
+	size_t bytes;
+	size_t waste;
+};
+
+struct IbsAllocatorProfile {
+	struct IbsAllocatorProfile* next;
+	char* name;
+	int tagCount;
+	int lastTag;
+	struct IbsAllocatorTagStats tags[MAX_PROFILE_TAGS];
+};
+
+// All profiles are kept until program exit, even those of already freed allocators.
+// Allocators can be created on any thread so new profiles are pushed atomically.
+#ifdef _WIN32
+static struct IbsAllocatorProfile* volatile profiles;
+#else
+static _Atomic(struct IbsAllocatorProfile*) profiles;
+#endif
 
 static void abortWithAllocError(const char* msg, const char* allocatorName, size_t size, const int line) {
 	printf("Compiler Error (at %s:%d): %s %s; requested size %zu\n", __FILE__, line, msg, allocatorName, size);
@@ -31,6 +80,211 @@ static void printSize(const char* name, size_t size) {
 
 }
 
+static int compareTagStats(const void* a, const void* b) {
+	size_t aBytes = ((const struct IbsAllocatorTagStats*)a)->bytes;
+	size_t bBytes = ((const struct IbsAllocatorTagStats*)b)->bytes;
+	if (aBytes == bBytes) return 0;
+	return aBytes < bBytes ? 1 : -1;
+}
+
+static void printProfiles(void) {
+	for (struct IbsAllocatorProfile* profile = profiles; profile; profile = profile->next) {
+		if (profile->tagCount == 0) continue;
+		qsort(profile->tags, profile->tagCount, sizeof(struct IbsAllocatorTagStats), compareTagStats);
+		fprintf(stderr, "\nAllocations in %s\n", profile->name);
+		fprintf(stderr, "%-24s %12s %14s %12s\n", "Tag", "Count", "Bytes", "Waste");
+		for (int i = 0; i < profile->tagCount; i++) {
+			struct IbsAllocatorTagStats* stats = &profile->tags[i];
+			fprintf(stderr, "%-24s %12zu %14zu %12zu\n", stats->tag, stats->count, stats->bytes, stats->waste);
+		}
+	}
+}
+
+static bool isProfilingEnabled(void) {
+#ifdef IBS_ALLOC_PROFILE
+	return true;
+#else
+	const char* env = getenv("IBS_ALLOC_PROFILE");
+	return env && env[0] && strcmp(env, "0") != 0;
+#endif
+}
+
+static struct IbsAllocatorProfile* createProfile(const char* name) {
+	if (!isProfilingEnabled()) return NULL;
+	size_t nameLength = strlen(name);
+	struct IbsAllocatorProfile* profile = calloc(1, sizeof(struct IbsAllocatorProfile) + nameLength + 1);
+	if (!profile) return NULL;
+	profile->name = (char*)(profile + 1);
+	memcpy(profile->name, name, nameLength);
+	struct IbsAllocatorProfile* first = NULL;
+#ifdef _WIN32
+	for (;;) {
+		profile->next = first;
+		struct IbsAllocatorProfile* old = InterlockedCompareExchangePointer((PVOID volatile*)&profiles, profile, first);
+		if (old == first) break;
+		first = old;
+	}
+#else
+	do {
+		profile->next = first;
+	} while (!atomic_compare_exchange_weak(&profiles, &first, profile));
+#endif
+	// Only the one that pushed the first profile registers printing
+	if (!profile->next) atexit(printProfiles);
+	return profile;
+}
+
+static void recordAlloc(struct IbsAllocatorProfile* profile, const char* tag, size_t size, size_t alignedSize) {
+	if (!tag) tag = "untagged";
+	int i = profile->lastTag;
+	if (i >= profile->tagCount || profile->tags[i].tag != tag) {
+		for (i = 0; i < profile->tagCount; i++) {
+			if (profile->tags[i].tag == tag || strcmp(profile->tags[i].tag, tag) == 0) break;
+		}
+		if (i == MAX_PROFILE_TAGS) {
+			i = MAX_PROFILE_TAGS - 1;
+		} else if (i == profile->tagCount) {
+			// Last slot is reserved for all the tags that don't fit
+			profile->tags[i].tag = (i == MAX_PROFILE_TAGS - 1) ? "other" : tag;
+			profile->tagCount++;
+		}
+		profile->lastTag = i;
+	}
+	profile->tags[i].count++;
+	profile->tags[i].bytes += size;
+	profile->tags[i].waste += alignedSize - size;
+}
+
+static size_t getHeaderSize(const char* name) {
+	size_t skipBytes = sizeof(struct IbsAllocator);
+	skipBytes = (skipBytes + MEM_ALIGN) & ~MEM_ALIGN;
+	skipBytes += (strlen(name) + 1 + MEM_ALIGN) & ~MEM_ALIGN;
+	return skipBytes;
+}
+
+static uint8_t* allocChunk(PIbsAllocator a, size_t size) {
+	struct IbsAllocatorChunk* chunk = (struct IbsAllocatorChunk*)calloc(1, CHUNK_HEADER_SIZE + size);
+	if (!chunk) {
+		ibsSimpleAllocatorPrintInfo(a);
+		abortWithAllocError("Failed allocating new chunk in allocator", a->name, size, __LINE__);
+	}
+	chunk->prev = a->chunks;
+	chunk->size = size;
+	a->chunks = chunk;
+	a->totalSize += size;
+	if (a->totalSize > a->peakSize) a->peakSize = a->totalSize;
+	return (uint8_t*)chunk + CHUNK_HEADER_SIZE;
+}
+
+/**
+ * Makes a new chunk of at least minSize bytes the current one. Whatever was
+ * left free in the previous chunk is abandoned.
+ */
+static void startNewChunk(PIbsAllocator a, size_t minSize) {
+	size_t size = a->chunkSize;
+	if (size < minSize) size = (minSize + ALLOCATOR_ALING) & ~ALLOCATOR_ALING;
+	a->memory = allocChunk(a, size);
+	a->size = size;
+	a->free = size;
+	a->dirty = 0;
+	if (a->chunkSize < MAX_CHUNK_SIZE) a->chunkSize <<= 1;
+}
+
+static void* reserveVirtualMemory(size_t size, bool useHugePages) {
+#ifdef _WIN32
+	return VirtualAlloc(NULL, size, MEM_RESERVE, PAGE_NOACCESS);
+#else
+	void* res = mmap(NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (res == MAP_FAILED) return NULL;
+#ifdef MADV_HUGEPAGE
+	if (useHugePages) madvise(res, size, MADV_HUGEPAGE);
+#endif
+	return res;
+#endif
+}
+
+static bool commitVirtualMemory(void* start, size_t size) {
+#ifdef _WIN32
+	return VirtualAlloc(start, size, MEM_COMMIT, PAGE_READWRITE) != NULL;
+#else
+	return mprotect(start, size, PROT_READ | PROT_WRITE) == 0;
+#endif
+}
+
+/**
+ * Gives the physical pages back to the OS. Memory stays accessible on Linux
+ * and reading it returns zeros while on Windows it needs to be committed again.
+ */
+static bool dropVirtualMemory(void* start, size_t size) {
+#ifdef _WIN32
+	VirtualFree(start, size, MEM_DECOMMIT);
+	return false;
+#else
+	madvise(start, size, MADV_DONTNEED);
+	return true;
+#endif
+}
+
+static void freeVirtualMemory(void* start, size_t size) {
+#ifdef _WIN32
+	VirtualFree(start, 0, MEM_RELEASE);
+#else
+	munmap(start, size);
+#endif
+}
+
+/**
+ * Makes sure that first end bytes of virtual allocator memory are committed
+ */
+static void commitUpTo(PIbsAllocator a, size_t end) {
+	end += a->memory - (uint8_t*)a;
+	if (end <= a->committed) return;
+	size_t mapEnd = a->totalSize + (a->memory - (uint8_t*)a);
+	size_t newCommitted = (end + a->commitStep - 1) / a->commitStep * a->commitStep;
+	if (newCommitted > mapEnd) newCommitted = mapEnd;
+	if (!commitVirtualMemory((uint8_t*)a + a->committed, newCommitted - a->committed)) {
+		ibsSimpleAllocatorPrintInfo(a);
+		abortWithAllocError("Failed committing memory in allocator", a->name, newCommitted - a->committed, __LINE__);
+	}
+	a->committed = newCommitted;
+	if (a->committed > a->peakSize) a->peakSize = a->committed;
+}
+
+static void resetVirtualAllocator(PIbsAllocator a) {
+	size_t headerSize = a->memory - (uint8_t*)a;
+	size_t firstPageEnd = (headerSize + PAGE_ALIGN) & ~PAGE_ALIGN;
+	if (a->committed <= firstPageEnd) {
+		memset(a->memory, 0, a->committed - headerSize);
+		return;
+	}
+	memset(a->memory, 0, firstPageEnd - headerSize);
+	if (!dropVirtualMemory((uint8_t*)a + firstPageEnd, a->committed - firstPageEnd)) {
+		a->committed = firstPageEnd;
+	}
+}
+
+/**
+ * Zeroes dirty memory left by ibsRelease in the given range that is about to be used
+ */
+static void clearDirty(PIbsAllocator a, size_t pos, size_t size) {
+	size_t end = pos + size;
+	if (end >= a->dirty) {
+		end = a->dirty;
+		a->dirty = 0;
+	}
+	memset(&a->memory[pos], 0, end - pos);
+}
+
+static void freeChunks(PIbsAllocator a) {
+	struct IbsAllocatorChunk* chunk = a->chunks;
+	while (chunk) {
+		struct IbsAllocatorChunk* prev = chunk->prev;
+		free(chunk);
+		chunk = prev;
+	}
+	a->chunks = NULL;
+}
+
 /********************************************************
 Public
 *********************************************************/
@@ -41,61 +295,183 @@ PIbsAllocator ibsSimpleAllocatorCreate(const char * name, size_t size) {
 	if (!ibsAllocator) {
 		abortWithAllocError("Failed creating allocator", name, size, __LINE__);
 	}
-	size_t skipBytes = sizeof(struct IbsAllocator);
-	skipBytes = (skipBytes + MEM_ALIGN) & ~MEM_ALIGN;
-	ibsAllocator->name = (char*)ibsAllocator + skipBytes;
+	size_t skipBytes = getHeaderSize(name);
+	if (skipBytes >= size) {
+		abortWithAllocError("Requested size too small for allocator", name, size, __LINE__);
+	}
+	ibsAllocator->name = (char*)ibsAllocator + ((sizeof(struct IbsAllocator) + MEM_ALIGN) & ~MEM_ALIGN);
 	strcpy(ibsAllocator->name, name);
-	skipBytes += (strlen(name) + 1 + MEM_ALIGN) & ~MEM_ALIGN;
 	ibsAllocator->size = size - skipBytes;
 	ibsAllocator->memory = (uint8_t*)ibsAllocator + skipBytes;
 	ibsAllocator->free = ibsAllocator->size;
+	ibsAllocator->firstSize = ibsAllocator->size;
+	ibsAllocator->totalSize = ibsAllocator->size;
+	ibsAllocator->peakSize = ibsAllocator->size;
+	ibsAllocator->profile = createProfile(name);
 	//We make sure we did setup everything so next mem alloc starts from aligned address
 	assert(((uintptr_t)ibsAllocator->memory & MEM_ALIGN) == 0);
 	return ibsAllocator;
 }
 
+PIbsAllocator ibsChunkedAllocatorCreate(const char* name, size_t chunkSize) {
+	if (chunkSize < IBS_MIN_START_ALLOC_SIZE) chunkSize = IBS_MIN_START_ALLOC_SIZE;
+	PIbsAllocator a = ibsSimpleAllocatorCreate(name, chunkSize + getHeaderSize(name));
+	a->kind = ibsAllocatorChunked;
+	a->chunkSize = a->size * 2;
+	return a;
+}
+
+PIbsAllocator ibsVirtualAllocatorCreate(const char* name, size_t maxSize, bool useHugePages) {
+	size_t commitStep = useHugePages ? HUGE_PAGE_COMMIT_STEP : COMMIT_STEP;
+	maxSize = (maxSize + commitStep - 1) / commitStep * commitStep;
+	PIbsAllocator a = (PIbsAllocator)reserveVirtualMemory(maxSize, useHugePages);
+	size_t skipBytes = getHeaderSize(name);
+	if (!a || !commitVirtualMemory(a, commitStep)) {
+		abortWithAllocError("Failed creating allocator", name, maxSize, __LINE__);
+	}
+	a->name = (char*)a + ((sizeof(struct IbsAllocator) + MEM_ALIGN) & ~MEM_ALIGN);
+	strcpy(a->name, name);
+	a->kind = ibsAllocatorVirtual;
+	a->size = maxSize - skipBytes;
+	a->memory = (uint8_t*)a + skipBytes;
+	a->free = a->size;
+	a->totalSize = a->size;
+	a->committed = commitStep;
+	a->commitStep = commitStep;
+	a->peakSize = commitStep;
+	a->profile = createProfile(name);
+	assert(((uintptr_t)a->memory & MEM_ALIGN) == 0);
+	return a;
+}
+
 void ibsSimpleAllocatorFree(PIbsAllocator a) {
+	if (a->kind == ibsAllocatorVirtual) {
+		freeVirtualMemory(a, a->totalSize + (a->memory - (uint8_t*)a));
+		return;
+	}
+	freeChunks(a);
 	free(a);
 }
 
 void ibsSimpleAllocatorReset(PIbsAllocator a) {
+	if (a->kind == ibsAllocatorVirtual) {
+		resetVirtualAllocator(a);
+		a->free = a->size;
+		a->used = 0;
+		a->dirty = 0;
+		return;
+	}
+	if (a->chunks) {
+		freeChunks(a);
+		a->memory = (uint8_t*)a + getHeaderSize(a->name);
+		a->size = a->firstSize;
+		a->totalSize = a->firstSize;
+	}
 	memset(a->memory, 0, a->size);
 	a->free = a->size;
 	a->used = 0;
+	a->dirty = 0;
 }
 
 void ibsSimpleAllocatorPrintInfo(const PIbsAllocator a) {
 	printf("\nAllocator %s ", a->name);
-	printSize("Size", a->size);
+	printSize("Size", a->totalSize);
+	if (a->kind == ibsAllocatorVirtual) printSize("Committed", a->committed);
+	if (a->kind != ibsAllocatorFixed) printSize("Peak", a->peakSize);
 	printSize("Used", a->used);
-	printSize("Wasted", a->size - a->free - a->used);
+	printSize("Wasted", a->totalSize - a->free - a->used);
 	printSize("Free", a->free);
+	if (a->kind == ibsAllocatorChunked) {
+		int count = 1;
+		for (struct IbsAllocatorChunk* chunk = a->chunks; chunk; chunk = chunk->prev) count++;
+		printf("Chunks=%d", count);
+	}
 	puts("");
 }
 
 void* ibsAlloc(PIbsAllocator a, size_t size) {
+	return ibsAllocTagged(a, size, NULL);
+}
+
+void* ibsAllocTagged(PIbsAllocator a, size_t size, const char* tag) {
 	if (size == 0) return NULL;
 	a->used += size;
+	size_t requestedSize = size;
 	size = (size + MEM_ALIGN) & ~MEM_ALIGN;
+	if (a->profile) recordAlloc(a->profile, tag, requestedSize, size);
 	if (size > a->free) {
-		ibsSimpleAllocatorPrintInfo(a);
-		abortWithAllocError("Failed allocating memory in allocator", a->name, size, __LINE__);
+		if (a->kind != ibsAllocatorChunked) {
+			ibsSimpleAllocatorPrintInfo(a);
+			abortWithAllocError("Failed allocating memory in allocator", a->name, size, __LINE__);
+		}
+		if (size > a->chunkSize / OVERSIZED_RATIO) {
+			// Current chunk stays current since the whole new chunk is used up
+			return allocChunk(a, size);
+		}
+		startNewChunk(a, size);
 	}
 	size_t pos = a->size - a->free;
 	void* location = &a->memory[pos];
 	a->free -= size;
+	if (a->kind == ibsAllocatorVirtual) commitUpTo(a, pos + size);
+	if (pos < a->dirty) clearDirty(a, pos, size);
 	return location;
 }
 
 void* ibsStartAlloc(PIbsAllocator a) {
+	if (a->kind == ibsAllocatorChunked && a->free < IBS_MIN_START_ALLOC_SIZE) {
+		startNewChunk(a, IBS_MIN_START_ALLOC_SIZE);
+	} else if (a->kind == ibsAllocatorVirtual) {
+		size_t end = a->size - a->free + IBS_MIN_START_ALLOC_SIZE;
+		commitUpTo(a, end < a->size ? end : a->size);
+	}
 	assert(a->free > 0);
+	size_t pos = a->size - a->free;
+	if (pos < a->dirty) clearDirty(a, pos, a->dirty - pos);
 	a->reserved = a->free;
 	a->free = 0;
-	return &a->memory[a->size - a->reserved];
+	return &a->memory[pos];
 }
 
 void ibsEndAlloc(PIbsAllocator a, size_t size) {
+	ibsEndAllocTagged(a, size, NULL);
+}
+
+void ibsEndAllocTagged(PIbsAllocator a, size_t size, const char* tag) {
 	a->free = a->reserved;
 	a->reserved = 0;
-	ibsAlloc(a, size);
+	ibsAllocTagged(a, size, tag);
+}
+
+struct IbsAllocatorMark ibsMark(PIbsAllocator a) {
+	assert(a->reserved == 0 && "Can't mark allocator between ibsStartAlloc and ibsEndAlloc");
+	struct IbsAllocatorMark mark = { a->memory, a->size, a->free, a->used, a->chunks };
+	return mark;
+}
+
+void ibsRelease(PIbsAllocator a, struct IbsAllocatorMark mark) {
+	assert(a->reserved == 0 && "Can't release allocator between ibsStartAlloc and ibsEndAlloc");
+	assert(mark.free >= a->free || mark.memory != a->memory);
+	while (a->chunks != mark.chunks) {
+		struct IbsAllocatorChunk* chunk = a->chunks;
+		assert(chunk && "Releasing a mark that was already released");
+		a->chunks = chunk->prev;
+		a->totalSize -= chunk->size;
+		free(chunk);
+	}
+	// Everything after mark position up to dirty needs to be zeroed before reuse
+	size_t dirty = mark.size;
+	if (mark.memory == a->memory) {
+		dirty = a->size - a->free;
+		if (dirty < a->dirty) dirty = a->dirty;
+	}
+	a->memory = mark.memory;
+	a->size = mark.size;
+	a->free = mark.free;
+	a->used = mark.used;
+	a->dirty = dirty;
+#ifndef NDEBUG
+	size_t pos = a->size - a->free;
+	memset(&a->memory[pos], IBS_POISON_BYTE, a->dirty - pos);
+#endif
 }
@@ -11,12 +11,43 @@
  * duration of the program and malloc is known to be slow for such use case. We also
  * get the benefit of quickly zeroing all that memory at once.
  *
+ * Simple Allocator can also work in chunked mode in which case it never runs out of
+ * memory. Once the current chunk is full a new one is linked in, each new chunk being
+ * twice as big as the previous one up to a limit. Allocations that are too big
+ * compared to the chunk size get a separate chunk of their own so they don't waste
+ * the rest of the current chunk.
+ *
+ * Virtual Allocator only reserves a big range of address space and commits memory
+ * pages as allocations reach them, so the real memory usage follows what is actually
+ * allocated and not the reserved size. On reset it gives the touched pages back to
+ * the OS which will give us new zeroed pages only when we touch them again.
+ *
+ * Any allocator can also be used for short lived data by taking a mark of its
+ * current position with ibsMark and later releasing everything allocated after
+ * it with ibsRelease. Released memory is zeroed again only once it gets reused.
+ *
+ * If the program is compiled with IBS_ALLOC_PROFILE defined or IBS_ALLOC_PROFILE
+ * environment variable is set to something other than 0 all allocators will
+ * record count, size and alignment waste of allocations per tag given to
+ * ibsAllocTagged. Collected tables are printed to stderr at program exit.
  */
 
 #include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
+// Minimal free space chunked and virtual allocators guarantee after ibsStartAlloc
+#define IBS_MIN_START_ALLOC_SIZE (64 * 1024)
+// Address space reserved for virtual allocators used for temporary data
+#define IBS_DEFAULT_VIRTUAL_SIZE (sizeof(void*) * 128 * 1024 * 1024)
+// Value released memory is filled with in debug builds
+#define IBS_POISON_BYTE 0xCD
+
+typedef enum { ibsAllocatorFixed, ibsAllocatorChunked, ibsAllocatorVirtual } IbsAllocatorKind;
+
+struct IbsAllocatorChunk;
+struct IbsAllocatorProfile;
+
 /* All fields must be treated as readonly in order for allocator functions to work */
 struct IbsAllocator {
 	char* name;
@@ -25,14 +56,49 @@ struct IbsAllocator {
 	size_t used;
 	size_t reserved;
 	uint8_t* memory;
+	size_t totalSize; // Size of all currently allocated chunks or reserved size of virtual allocator
+	size_t peakSize;  // The biggest totalSize since the allocator was created
+	size_t dirty;     // Memory from current position to this offset may need zeroing after ibsRelease
+	IbsAllocatorKind kind;
+	// Fields used only in chunked mode
+	struct IbsAllocatorChunk* chunks; // Additionally allocated chunks, the latest one first
+	size_t firstSize; // Size of the chunk that was allocated together with the allocator
+	size_t chunkSize; // Size of the next regular chunk
+	// Fields used only by virtual allocator
+	size_t committed; // Bytes from the start of allocator that are available for use
+	size_t commitStep; // Memory is committed in multiples of this
+	struct IbsAllocatorProfile* profile; // Allocation stats if profiling is enabled
 };
 typedef struct IbsAllocator* PIbsAllocator;
 
+/* Position in allocator as returned by ibsMark */
+struct IbsAllocatorMark {
+	uint8_t* memory;
+	size_t size;
+	size_t free;
+	size_t used;
+	struct IbsAllocatorChunk* chunks;
+};
+
 /**
  * Creates a new allocator with requested size rounded up to 4KB chunks.
  * A certain number of starting bytes is occupied to keep allocator metadata.
  */
 PIbsAllocator ibsSimpleAllocatorCreate(const char* name, size_t size);
+
+/**
+ * Creates a new allocator in chunked mode. Given chunkSize is used for the first
+ * chunk and it is doubled for each next chunk.
+ */
+PIbsAllocator ibsChunkedAllocatorCreate(const char* name, size_t chunkSize);
+
+/**
+ * Creates a new allocator that reserves maxSize bytes of address space but only
+ * commits memory as it is needed. If useHugePages is true it will ask the OS to
+ * back the memory with transparent huge pages if that is supported.
+ */
+PIbsAllocator ibsVirtualAllocatorCreate(const char* name, size_t maxSize, bool useHugePages);
+
 void ibsSimpleAllocatorFree(PIbsAllocator a);
 void ibsSimpleAllocatorReset(PIbsAllocator a);
 void ibsSimpleAllocatorPrintInfo(const PIbsAllocator allocator);
@@ -42,12 +108,21 @@ void ibsSimpleAllocatorPrintInfo(const PIbsAllocator allocator);
  */
 void* ibsAlloc(PIbsAllocator a, size_t size);
 
+/**
+ * Same as ibsAlloc but if profiling is enabled allocation will be recorded under
+ * the given tag. Tag should be a string literal or some other string that lives
+ * until program exit.
+ */
+void* ibsAllocTagged(PIbsAllocator a, size_t size, const char* tag);
+
 /**
  * Just returns the next avaiable memory address but before calling any ibsAlloc
  * you must call ibsEndAlloc to tell the allocator how much memory you ended up
  * occupying. This is useful when you need string buffers for formatting and you
  * don't know the needed length of result string in advance. You must only use
- * this if you are sure the resulting size will be available though.
+ * this if you are sure the resulting size will be available though. Chunked
+ * and virtual allocators guarantee that at least IBS_MIN_START_ALLOC_SIZE bytes are
+ * available.
  */
 void* ibsStartAlloc(PIbsAllocator a);
 
@@ -55,3 +130,19 @@ void* ibsStartAlloc(PIbsAllocator a);
  * This needs to be called after ibsStartAlloc
  */
 void ibsEndAlloc(PIbsAllocator a, size_t size);
+void ibsEndAllocTagged(PIbsAllocator a, size_t size, const char* tag);
+
+/**
+ * Returns the current position of allocator so all allocations made after
+ * this call can later be released with ibsRelease. Marks must be released in
+ * reverse order of creation and none can be taken between ibsStartAlloc and
+ * ibsEndAlloc.
+ */
+struct IbsAllocatorMark ibsMark(PIbsAllocator a);
+
+/**
+ * Returns allocator to the position of the given mark. In chunked mode all the
+ * chunks allocated after the mark are freed. In debug builds released memory
+ * is filled with IBS_POISON_BYTE so using it after release is easier to catch.
+ */
+void ibsRelease(PIbsAllocator a, struct IbsAllocatorMark mark);
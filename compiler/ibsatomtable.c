@@ -0,0 +1,110 @@
+#include "ibscommon.h"
+#include "ibsatomtable.h"
+
+#include <assert.h>
+#include <string.h>
+
+/********************************************************
+Private
+*********************************************************/
+
+// Must be power of 2
+#define INITIAL_SLOT_COUNT 1024
+#define INITIAL_ATOM_CAPACITY 512
+
+static void* growArray(PIbsAllocator a, void* old, size_t oldSize, size_t newSize) {
+	void* res = ibsAllocTagged(a, newSize, "atom table");
+	if (old) memcpy(res, old, oldSize);
+	return res;
+}
+
+static uint32_t* findSlot(PIbsAtomTable table, const char* str, size_t length, uint32_t hash) {
+	uint32_t index = hash & table->slotMask;
+	while (true) {
+		uint32_t* slot = &table->slots[index];
+		uint32_t atom = *slot;
+		if (atom == 0) return slot;
+		if (table->hashes[atom] == hash && table->lengths[atom] == length && memcmp(table->names[atom], str, length) == 0) {
+			return slot;
+		}
+		index = (index + 1) & table->slotMask;
+	}
+}
+
+static void growSlots(PIbsAtomTable table) {
+	uint32_t newMask = table->slotMask * 2 + 1;
+	uint32_t* newSlots = ibsAllocTagged(table->a, (newMask + 1) * sizeof(uint32_t), "atom table");
+	for (uint32_t atom = 1; atom < table->count; atom++) {
+		uint32_t index = table->hashes[atom] & newMask;
+		while (newSlots[index]) index = (index + 1) & newMask;
+		newSlots[index] = atom;
+	}
+	table->slots = newSlots;
+	table->slotMask = newMask;
+}
+
+static void growAtoms(PIbsAtomTable table) {
+	uint32_t oldCapacity = table->capacity;
+	uint32_t newCapacity = oldCapacity * 2;
+	PIbsAllocator a = table->a;
+	table->names = growArray(a, table->names, oldCapacity * sizeof(char*), newCapacity * sizeof(char*));
+	table->lengths = growArray(a, table->lengths, oldCapacity * sizeof(uint32_t), newCapacity * sizeof(uint32_t));
+	table->hashes = growArray(a, table->hashes, oldCapacity * sizeof(uint32_t), newCapacity * sizeof(uint32_t));
+	table->capacity = newCapacity;
+}
+
+/********************************************************
+Public
+*********************************************************/
+
+PIbsAtomTable ibsAtomTableCreate(PIbsAllocator a) {
+	PIbsAtomTable table = ibsAllocTagged(a, sizeof(struct IbsAtomTable), "atom table");
+	table->a = a;
+	table->capacity = INITIAL_ATOM_CAPACITY / 2;
+	growAtoms(table);
+	table->count = 1;
+	table->names[0] = "";
+	table->slots = ibsAllocTagged(a, INITIAL_SLOT_COUNT * sizeof(uint32_t), "atom table");
+	table->slotMask = INITIAL_SLOT_COUNT - 1;
+	return table;
+}
+
+uint32_t ibsAtomHash(const char* str, size_t length) {
+	// FNV-1a
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < length; i++) {
+		hash ^= (uint8_t)str[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+uint32_t ibsAtomIntern(PIbsAtomTable table, const char* str, size_t length, uint32_t hash) {
+	uint32_t* slot = findSlot(table, str, length, hash);
+	if (*slot) return *slot;
+
+	if (table->count == table->capacity) growAtoms(table);
+	uint32_t atom = table->count++;
+	char* name = ibsAllocTagged(table->a, length + 1, "atom name");
+	memcpy(name, str, length);
+	table->names[atom] = name;
+	table->lengths[atom] = (uint32_t)length;
+	table->hashes[atom] = hash;
+
+	// We keep the load of slots under 75%
+	if (table->count * 4 > (table->slotMask + 1) * 3) {
+		growSlots(table);
+	} else {
+		*slot = atom;
+	}
+	return atom;
+}
+
+uint32_t ibsAtomFind(PIbsAtomTable table, const char* str, size_t length, uint32_t hash) {
+	return *findSlot(table, str, length, hash);
+}
+
+const char* ibsAtomName(PIbsAtomTable table, uint32_t atom) {
+	assert(atom < table->count);
+	return table->names[atom];
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+/**
+ * Atom table interns strings and gives each distinct string a dense 32-bit id
+ * called atom. Atoms are given in order starting from 1 so 0 can be used to
+ * mean "no atom". Since there is only one copy of each string and each atom
+ * can be used as an index into an array, comparing names becomes an integer
+ * compare and symbol lookups don't need to look at string characters at all.
+ *
+ * Strings are hashed by the caller so the hash can be calculated while the
+ * string is being scanned. Table is implemented as an open addressing hash
+ * table of atoms with linear probing.
+ */
+
+#include "ibsallocator.h"
+
+/* All fields must be treated as readonly in order for atom table functions to work */
+struct IbsAtomTable {
+	PIbsAllocator a;
+	const char** names;  // Zero terminated strings indexed by atom
+	uint32_t* lengths;   // Indexed by atom
+	uint32_t* hashes;    // Indexed by atom
+	uint32_t count;      // Number of atoms including the unused atom 0
+	uint32_t capacity;   // Number of atoms arrays above can hold
+	uint32_t* slots;     // Hash table of atoms where 0 means empty slot
+	uint32_t slotMask;
+};
+typedef struct IbsAtomTable* PIbsAtomTable;
+
+PIbsAtomTable ibsAtomTableCreate(PIbsAllocator a);
+
+/**
+ * Hash function that should be used for calculating hash of strings before
+ * they are given to atom table.
+ */
+uint32_t ibsAtomHash(const char* str, size_t length);
+
+/**
+ * Returns the atom for the given string interning it if it wasn't already
+ * interned. String doesn't need to be zero terminated since table keeps its
+ * own copy.
+ */
+uint32_t ibsAtomIntern(PIbsAtomTable table, const char* str, size_t length, uint32_t hash);
+
+/**
+ * Returns the atom for the given string or 0 if it was never interned
+ */
+uint32_t ibsAtomFind(PIbsAtomTable table, const char* str, size_t length, uint32_t hash);
+
+/**
+ * Returns zero terminated string the given atom represents.
+ */
+const char* ibsAtomName(PIbsAtomTable table, uint32_t atom);
@@ -44,6 +44,11 @@
 
 #else
 
+// Needed for mmap flags and similar when compiling with -std=c11
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #pragma GCC diagnostic ignored "-Wunknown-pragmas"
 #pragma GCC diagnostic ignored "-Wimplicit-fallthrough"
 
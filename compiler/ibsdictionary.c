@@ -6,27 +6,123 @@
 Private
 *********************************************************/
 
-PIbsDictEntry createNewEntry(PIbsAllocator a, const char* key, void* value) {
-	PIbsDictEntry newElem = ibsAlloc(a, sizeof(struct IbsDictEntry));
+static PIbsDictEntry createNewEntry(PIbsAllocator a, const char* key, void* value) {
+	PIbsDictEntry newElem = ibsAllocTagged(a, sizeof(struct IbsDictEntry), "dict entry");
 	newElem->keyPart = key;
 	newElem->keyPartLength = strlen(key);
-	newElem->values = ibsAlloc(a, sizeof(struct IbsDictEntryValue));
+	newElem->values = ibsAllocTagged(a, sizeof(struct IbsDictEntryValue), "dict value");
 	newElem->values->value = value;
 	return newElem;
 }
 
+// Initial number of buckets in hash dict. It must be a power of 2
+#define INITIAL_BUCKET_COUNT 16
+#define CACHE_LINE_ALIGN 63
+
+static struct IbsDictBucket* allocBuckets(PIbsAllocator a, uint32_t count) {
+	size_t size = count * sizeof(struct IbsDictBucket) + CACHE_LINE_ALIGN;
+	uintptr_t buckets = (uintptr_t)ibsAllocTagged(a, size, "dict buckets");
+	buckets = (buckets + CACHE_LINE_ALIGN) & ~(uintptr_t)CACHE_LINE_ALIGN;
+	return (struct IbsDictBucket*)buckets;
+}
+
+/**
+ * Puts the entry in the first free slot starting from the bucket hash points to
+ */
+static void insertHashed(struct IbsDictBucket* buckets, uint32_t bucketMask, uint32_t hash, PIbsDictEntry entry) {
+	uint32_t index = hash & bucketMask;
+	while (true) {
+		struct IbsDictBucket* bucket = &buckets[index];
+		for (int i = 0; i < IBS_DICT_BUCKET_SIZE; i++) {
+			if (bucket->hashes[i] == 0) {
+				bucket->hashes[i] = hash;
+				bucket->entries[i] = entry;
+				return;
+			}
+		}
+		bucket->hasOverflowed = true;
+		index = (index + 1) & bucketMask;
+	}
+}
+
+static void growBuckets(PIbsDict dict) {
+	uint32_t oldCount = dict->bucketMask + 1;
+	uint32_t newMask = oldCount * 2 - 1;
+	struct IbsDictBucket* newBuckets = allocBuckets(dict->a, oldCount * 2);
+	for (uint32_t b = 0; b < oldCount; b++) {
+		struct IbsDictBucket* bucket = &dict->buckets[b];
+		for (int i = 0; i < IBS_DICT_BUCKET_SIZE && bucket->hashes[i]; i++) {
+			insertHashed(newBuckets, newMask, bucket->hashes[i], bucket->entries[i]);
+		}
+	}
+	dict->buckets = newBuckets;
+	dict->bucketMask = newMask;
+}
+
+static PIbsDictEntry hashGetEntry(PIbsDict dict, const char* key, uint32_t hash) {
+	uint32_t index = hash & dict->bucketMask;
+	while (true) {
+		struct IbsDictBucket* bucket = &dict->buckets[index];
+		for (int i = 0; i < IBS_DICT_BUCKET_SIZE; i++) {
+			if (bucket->hashes[i] == hash && strcmp(bucket->entries[i]->keyPart, key) == 0) {
+				return bucket->entries[i];
+			}
+			if (bucket->hashes[i] == 0) return NULL;
+		}
+		if (!bucket->hasOverflowed) return NULL;
+		index = (index + 1) & dict->bucketMask;
+	}
+}
+
+static void hashPut(PIbsDict dict, const char* key, void* value) {
+	uint32_t hash = ibsDictHash(key);
+	PIbsDictEntry entry = hashGetEntry(dict, key, hash);
+	if (entry) {
+		if (!entry->values) {
+			entry->values = ibsAllocTagged(dict->a, sizeof(struct IbsDictEntryValue), "dict value");
+		}
+		entry->values->value = value;
+		return;
+	}
+	// We keep the load under 80%
+	if ((dict->count + 1) * 5 > (dict->bucketMask + 1) * IBS_DICT_BUCKET_SIZE * 4) {
+		growBuckets(dict);
+	}
+	insertHashed(dict->buckets, dict->bucketMask, hash, createNewEntry(dict->a, key, value));
+	dict->count++;
+}
+
 /********************************************************
 Public
 *********************************************************/
 
+uint32_t ibsDictHash(const char* key) {
+	// FNV-1a
+	uint32_t hash = 2166136261u;
+	while (*key) {
+		hash ^= (uint8_t)*key;
+		hash *= 16777619u;
+		key++;
+	}
+	return hash ? hash : 1;
+}
+
 PIbsDict ibsDictCreate(PIbsAllocator a) {
-	PIbsDict dict = ibsAlloc(a, sizeof(struct IbsDict));
+	PIbsDict dict = ibsAllocTagged(a, sizeof(struct IbsDict), "dict");
 	dict->a = a;
 	return dict;
 }
 
+PIbsDict ibsHashDictCreate(PIbsAllocator a) {
+	PIbsDict dict = ibsDictCreate(a);
+	dict->buckets = allocBuckets(a, INITIAL_BUCKET_COUNT);
+	dict->bucketMask = INITIAL_BUCKET_COUNT - 1;
+	return dict;
+}
+
 PIbsDictEntry ibsDictGetEntry(PIbsDict dict, const char * key) {
 	if (key == NULL || key[0] == 0) return NULL;
+	if (dict->buckets) return hashGetEntry(dict, key, ibsDictHash(key));
 	if (dict->lastKey && (key == dict->lastKey || strcmp(key, dict->lastKey) == 0)) {
 		return dict->lastEntry;
 	}
@@ -79,6 +175,10 @@ void* ibsDictGet(PIbsDict dict, const char * key) {
 
 void ibsDictPut(PIbsDict dict, const char* key, void* value) {
 	if (key == NULL || key[0] == 0) return;
+	if (dict->buckets) {
+		hashPut(dict, key, value);
+		return;
+	}
 
 	PIbsDictEntry* el = &dict->entries;
 	PIbsDictEntry entry;
@@ -95,14 +195,14 @@ void ibsDictPut(PIbsDict dict, const char* key, void* value) {
 			if (entry->keyPartLength == i) {
 				// Existing key so create a value if it doesn't exist and return it
 				if (!entry->values) {
-					entry->values = ibsAlloc(dict->a, sizeof(struct IbsDictEntryValue));
+					entry->values = ibsAllocTagged(dict->a, sizeof(struct IbsDictEntryValue), "dict value");
 				}
 				entry->values->value = value;
 				dict->lastEntry = entry;
 				return;
 			}
 			// We got a key that is a part of existing key so we need to split existing into parts
-			PIbsDictEntry newElem = ibsAlloc(dict->a, sizeof(struct IbsDictEntry));
+			PIbsDictEntry newElem = ibsAllocTagged(dict->a, sizeof(struct IbsDictEntry), "dict entry");
 			newElem->keyPart = &entry->keyPart[i];
 			newElem->keyPartLength = entry->keyPartLength - i;
 			newElem->values = entry->values;
@@ -110,7 +210,7 @@ void ibsDictPut(PIbsDict dict, const char* key, void* value) {
 			entry->children = newElem;
 			entry->keyPartLength = i;
 			if (key[i] == 0) {
-				entry->values = ibsAlloc(dict->a, sizeof(struct IbsDictEntryValue));
+				entry->values = ibsAllocTagged(dict->a, sizeof(struct IbsDictEntryValue), "dict value");
 				entry->values->value = value;
 				dict->lastEntry = entry;
 				return;
@@ -150,7 +250,7 @@ void ibsDictPush(PIbsDict dict, const char* key, void* value) {
 		return;
 	}
 
-	PIbsDictEntryValue newVal = ibsAlloc(dict->a, sizeof(struct IbsDictEntryValue));
+	PIbsDictEntryValue newVal = ibsAllocTagged(dict->a, sizeof(struct IbsDictEntryValue), "dict value");
 	newVal->value = value;
 	newVal->next = entry->values;
 	entry->values = newVal;
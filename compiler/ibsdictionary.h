@@ -3,7 +3,13 @@
 /**
  * Defines structures and methods for working with dictionary.
  *
- * Dictionary is implemented as a variation on Trie (https://en.wikipedia.org/wiki/Trie)
+ * Default dictionary is implemented as a variation on Trie (https://en.wikipedia.org/wiki/Trie)
+ *
+ * Dictionary can also be created as a hash table with open addressing. Its buckets
+ * fit in one cache line and keep hashes of up to IBS_DICT_BUCKET_SIZE keys so
+ * most of the time we only compare strings of keys that really match. Buckets
+ * are never removed from so we don't need tombstones. Both kinds of dictionary
+ * are used through the same functions.
  */
 
 #include "ibsallocator.h"
@@ -24,12 +30,25 @@ struct IbsDictEntry {
 	PIbsDictEntry next;
 };
 
+#define IBS_DICT_BUCKET_SIZE 5
+
+/* On 64bit systems this takes exactly 64 bytes */
+struct IbsDictBucket {
+	uint32_t hashes[IBS_DICT_BUCKET_SIZE]; // Zero means the slot is empty
+	uint32_t hasOverflowed; // If true some keys belonging to this bucket are in following buckets
+	PIbsDictEntry entries[IBS_DICT_BUCKET_SIZE];
+};
+
 /* All fields must be treated as readonly in order for allocator functions to work */
 struct IbsDict {
 	PIbsAllocator a;
 	PIbsDictEntry entries;
 	const char* lastKey;
 	PIbsDictEntry lastEntry;
+	// Fields used only by hash dictionary
+	struct IbsDictBucket* buckets;
+	uint32_t bucketMask;
+	uint32_t count;
 };
 typedef struct IbsDict* PIbsDict;
 
@@ -39,6 +58,18 @@ typedef struct IbsDict* PIbsDict;
  * allocator is cleaned then this dictinary will be full of dead pointers.
  */
 PIbsDict ibsDictCreate(PIbsAllocator allocator);
+
+/**
+ * Creates a new dictionary implemented as a hash table. It should be used
+ * when we expect a lot of keys.
+ */
+PIbsDict ibsHashDictCreate(PIbsAllocator allocator);
+
+/**
+ * Hash function used by hash dictionary. It never returns zero.
+ */
+uint32_t ibsDictHash(const char* key);
+
 PIbsDictEntry ibsDictGetEntry(PIbsDict dict, const char* key);
 void* ibsDictGet(PIbsDict dict, const char* key);
 void ibsDictPut(PIbsDict dict, const char* key, void* value);
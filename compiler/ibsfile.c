@@ -0,0 +1,129 @@
+#include "ibscommon.h"
+#include "ibsfile.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/********************************************************
+Private
+*********************************************************/
+
+#define READ_BUFFER_SIZE (64 * 1024)
+
+/**
+ * Maps the file and returns true on success. Mapping is one page larger than
+ * the file so there is always a zero after file content since OS fills the
+ * rest of the last page with zeros.
+ */
+static bool mapFile(const char* filename, PIbsFile file) {
+#ifdef _WIN32
+	HANDLE f = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (f == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER size;
+	bool res = false;
+	if (GetFileType(f) == FILE_TYPE_DISK && GetFileSizeEx(f, &size) && size.QuadPart > 0) {
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		// On Windows we can't place a zero page after the view so we only map
+		// files that don't end on a page boundary
+		if (size.QuadPart % info.dwPageSize != 0) {
+			HANDLE mapping = CreateFileMappingA(f, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (mapping) {
+				file->data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+				CloseHandle(mapping);
+				file->size = (size_t)size.QuadPart;
+				file->mappedSize = file->size;
+				res = file->data != NULL;
+			}
+		}
+	}
+	CloseHandle(f);
+	return res;
+#else
+	int fd = open(filename, O_RDONLY);
+	if (fd == -1) return false;
+	struct stat st;
+	bool res = false;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+		size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+		size_t size = (size_t)st.st_size;
+		size_t mappedSize = (size / pageSize + 1) * pageSize;
+		char* mem = mmap(NULL, mappedSize, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (mem != MAP_FAILED) {
+			if (mmap(mem, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) != MAP_FAILED) {
+				file->data = mem;
+				file->size = size;
+				file->mappedSize = mappedSize;
+				res = true;
+			} else {
+				munmap(mem, mappedSize);
+			}
+		}
+	}
+	close(fd);
+	return res;
+#endif
+}
+
+static bool readFile(const char* filename, PIbsFile file, PIbsAllocator a) {
+	FILE* f = fopen(filename, "rb");
+	if (!f) return false;
+	size_t capacity = READ_BUFFER_SIZE;
+	char* data = ibsAllocTagged(a, capacity + 1, "file data");
+	size_t size = 0;
+	size_t read;
+	while ((read = fread(&data[size], 1, capacity - size, f)) > 0) {
+		size += read;
+		if (size == capacity) {
+			char* newData = ibsAllocTagged(a, capacity * 2 + 1, "file data");
+			memcpy(newData, data, size);
+			data = newData;
+			capacity *= 2;
+		}
+	}
+	fclose(f);
+	file->data = data;
+	file->size = size;
+	return true;
+}
+
+/********************************************************
+Public
+*********************************************************/
+
+PIbsFile ibsFileOpen(const char* filename, PIbsAllocator a) {
+	PIbsFile file = ibsAllocTagged(a, sizeof(struct IbsFile), "file");
+	if (mapFile(filename, file)) {
+		file->isMapped = true;
+		return file;
+	}
+	if (readFile(filename, file, a)) return file;
+	return NULL;
+}
+
+void ibsFileClose(PIbsFile file) {
+	if (!file->isMapped) return;
+#ifdef _WIN32
+	UnmapViewOfFile(file->data);
+#else
+	munmap(file->data, file->mappedSize);
+#endif
+	file->isMapped = false;
+	file->data = NULL;
+}
+
+bool ibsFileWrite(const char* filename, const char* data) {
+	FILE* out = fopen(filename, "wb");
+	if (!out) return false;
+	fputs(data, out);
+	return fclose(out) == 0;
+}
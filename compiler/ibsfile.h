@@ -0,0 +1,35 @@
+#pragma once
+
+/**
+ * Gives access to the whole content of a file. Regular files are mapped into
+ * memory so there is no copying and their size is only limited by address
+ * space. Other files, like pipes, are read into memory from the given
+ * allocator. In both cases content is followed by a zero byte so it can be
+ * scanned as a zero terminated string.
+ */
+
+#include "ibsallocator.h"
+
+struct IbsFile {
+	char* data; // If file is mapped data is read only
+	size_t size;
+	size_t mappedSize;
+	bool isMapped;
+};
+typedef struct IbsFile* PIbsFile;
+
+/**
+ * Returns the content of the given file or NULL if file can't be opened.
+ */
+PIbsFile ibsFileOpen(const char* filename, PIbsAllocator a);
+
+/**
+ * Unmaps the file if it was mapped. File data must not be used after this.
+ */
+void ibsFileClose(PIbsFile file);
+
+/**
+ * Writes the zero terminated data to the file, replacing its content, and
+ * returns false if file can't be written.
+ */
+bool ibsFileWrite(const char* filename, const char* data);
@@ -0,0 +1,27 @@
+#pragma once
+
+/**
+ * Locale independent functions for converting number literals to values.
+ */
+
+#include <stdint.h>
+
+/**
+ * Converts the float literal at str to the nearest double, rounding ties to
+ * even. Accepted format is digits[.digits][(e|E)[+|-]digits] and end is set
+ * to the first char after the literal or to str if there is no literal.
+ * Values too big for double become infinity and values too small become 0.
+ */
+double ibsParseDouble(const char* str, const char** end);
+
+/**
+ * Returns the value of exactly 8 decimal digits starting at str. All 8 bytes
+ * must be valid digits.
+ */
+uint32_t ibsParseEightDigits(const char* str);
+
+/**
+ * Returns the value of exactly 8 hex digits starting at str. All 8 bytes
+ * must be valid hex digits in upper or lower case.
+ */
+uint32_t ibsParseEightHexDigits(const char* str);
@@ -0,0 +1,410 @@
+#include "ibscommon.h"
+#include "ibsscan.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <stdatomic.h>
+#endif
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define SCAN_X64
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define AVX2_TARGET
+#else
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+/********************************************************
+Type Definitions
+*********************************************************/
+
+struct ScanFuncs {
+	IbsScanImpl impl;
+	const char* (*whitespace)(const char* p);
+	const char* (*alNum)(const char* p);
+	const char* (*lineEnd)(const char* p);
+	const char* (*stringPart)(const char* p, char termChar);
+	uint32_t (*countChar)(const char* start, const char* end, char c);
+};
+
+/********************************************************
+Private
+*********************************************************/
+
+// Lexers on different threads all use the same implementation so it is only
+// ever switched as a whole through one atomic pointer
+#ifdef _WIN32
+static const struct ScanFuncs* volatile funcs;
+#else
+static _Atomic(const struct ScanFuncs*) funcs;
+#endif
+
+static uint32_t firstBit(uint32_t mask) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+static uint32_t bitCount(uint32_t mask) {
+#ifdef _MSC_VER
+	// __popcnt instruction isn't supported by all processors that have SSE2
+	mask = mask - ((mask >> 1) & 0x55555555);
+	mask = (mask & 0x33333333) + ((mask >> 2) & 0x33333333);
+	return (((mask + (mask >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+#else
+	return __builtin_popcount(mask);
+#endif
+}
+
+static bool isWhite(char c) {
+	return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static bool isAlNum(char c) {
+	char lower = c | 0x20;
+	return (c >= '0' && c <= '9') || (lower >= 'a' && lower <= 'z');
+}
+
+static const char* scalarWhitespace(const char* p) {
+	while (isWhite(*p)) p++;
+	return p;
+}
+
+static const char* scalarAlNum(const char* p) {
+	while (isAlNum(*p)) p++;
+	return p;
+}
+
+static const char* scalarLineEnd(const char* p) {
+	while (*p && *p != '\n') p++;
+	return p;
+}
+
+static const char* scalarStringPart(const char* p, char termChar) {
+	while (*p && *p != termChar && *p != '\\' && *p != '\n' && *p != '\r') p++;
+	return p;
+}
+
+static uint32_t scalarCountChar(const char* start, const char* end, char c) {
+	uint32_t count = 0;
+	for (const char* p = start; p < end; p++) {
+		if (*p == c) count++;
+	}
+	return count;
+}
+
+static const struct ScanFuncs scalarFuncs = {
+	ibsScanScalar, scalarWhitespace, scalarAlNum, scalarLineEnd, scalarStringPart, scalarCountChar
+};
+
+#ifdef SCAN_X64
+
+/**
+ * All SSE2 and AVX2 functions below start with the aligned block that
+ * contains p and ignore the bytes in it that are before p. Masks of stop
+ * bytes always include zero so loops always end on the terminating zero.
+ */
+
+static __m128i sse2InRange(__m128i v, char low, char high) {
+	return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(low - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8(high + 1)));
+}
+
+static uint32_t sse2NotWhiteMask(const char* block) {
+	__m128i v = _mm_load_si128((const __m128i*)block);
+	__m128i white = _mm_or_si128(sse2InRange(v, '\t', '\r'), _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+	return ~(uint32_t)_mm_movemask_epi8(white) & 0xFFFF;
+}
+
+static uint32_t sse2NotAlNumMask(const char* block) {
+	__m128i v = _mm_load_si128((const __m128i*)block);
+	__m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+	__m128i alNum = _mm_or_si128(sse2InRange(lower, 'a', 'z'), sse2InRange(v, '0', '9'));
+	return ~(uint32_t)_mm_movemask_epi8(alNum) & 0xFFFF;
+}
+
+static uint32_t sse2LineEndMask(const char* block) {
+	__m128i v = _mm_load_si128((const __m128i*)block);
+	__m128i stop = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_setzero_si128()), _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+	return (uint32_t)_mm_movemask_epi8(stop);
+}
+
+static uint32_t sse2StringPartMask(const char* block, char termChar) {
+	__m128i v = _mm_load_si128((const __m128i*)block);
+	__m128i stop = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_setzero_si128()), _mm_cmpeq_epi8(v, _mm_set1_epi8(termChar)));
+	stop = _mm_or_si128(stop, _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+	stop = _mm_or_si128(stop, _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+	stop = _mm_or_si128(stop, _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+	return (uint32_t)_mm_movemask_epi8(stop);
+}
+
+static const char* sse2Whitespace(const char* p) {
+	uintptr_t offset = (uintptr_t)p & 15;
+	const char* block = p - offset;
+	uint32_t mask = sse2NotWhiteMask(block) & (0xFFFFFFFFu << offset);
+	while (!mask) {
+		block += 16;
+		mask = sse2NotWhiteMask(block);
+	}
+	return block + firstBit(mask);
+}
+
+static const char* sse2AlNum(const char* p) {
+	uintptr_t offset = (uintptr_t)p & 15;
+	const char* block = p - offset;
+	uint32_t mask = sse2NotAlNumMask(block) & (0xFFFFFFFFu << offset);
+	while (!mask) {
+		block += 16;
+		mask = sse2NotAlNumMask(block);
+	}
+	return block + firstBit(mask);
+}
+
+static const char* sse2LineEnd(const char* p) {
+	uintptr_t offset = (uintptr_t)p & 15;
+	const char* block = p - offset;
+	uint32_t mask = sse2LineEndMask(block) & (0xFFFFFFFFu << offset);
+	while (!mask) {
+		block += 16;
+		mask = sse2LineEndMask(block);
+	}
+	return block + firstBit(mask);
+}
+
+static const char* sse2StringPart(const char* p, char termChar) {
+	uintptr_t offset = (uintptr_t)p & 15;
+	const char* block = p - offset;
+	uint32_t mask = sse2StringPartMask(block, termChar) & (0xFFFFFFFFu << offset);
+	while (!mask) {
+		block += 16;
+		mask = sse2StringPartMask(block, termChar);
+	}
+	return block + firstBit(mask);
+}
+
+static uint32_t sse2CountChar(const char* start, const char* end, char c) {
+	if (start >= end) return 0;
+	__m128i needle = _mm_set1_epi8(c);
+	uintptr_t offset = (uintptr_t)start & 15;
+	const char* block = start - offset;
+	uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128((const __m128i*)block), needle));
+	mask &= 0xFFFFFFFFu << offset;
+	uint32_t count = 0;
+	while (block + 16 < end) {
+		count += bitCount(mask);
+		block += 16;
+		mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128((const __m128i*)block), needle));
+	}
+	uint32_t tail = (uint32_t)(end - block);
+	if (tail < 16) mask &= (1u << tail) - 1;
+	return count + bitCount(mask);
+}
+
+static const struct ScanFuncs sse2Funcs = {
+	ibsScanSSE2, sse2Whitespace, sse2AlNum, sse2LineEnd, sse2StringPart, sse2CountChar
+};
+
+AVX2_TARGET static __m256i avx2InRange(__m256i v, char low, char high) {
+	return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(low - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8(high + 1), v));
+}
+
+AVX2_TARGET static uint32_t avx2NotWhiteMask(const char* block) {
+	__m256i v = _mm256_load_si256((const __m256i*)block);
+	__m256i white = _mm256_or_si256(avx2InRange(v, '\t', '\r'), _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+	return ~(uint32_t)_mm256_movemask_epi8(white);
+}
+
+AVX2_TARGET static uint32_t avx2NotAlNumMask(const char* block) {
+	__m256i v = _mm256_load_si256((const __m256i*)block);
+	__m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+	__m256i alNum = _mm256_or_si256(avx2InRange(lower, 'a', 'z'), avx2InRange(v, '0', '9'));
+	return ~(uint32_t)_mm256_movemask_epi8(alNum);
+}
+
+AVX2_TARGET static uint32_t avx2LineEndMask(const char* block) {
+	__m256i v = _mm256_load_si256((const __m256i*)block);
+	__m256i stop = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_setzero_si256()), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+	return (uint32_t)_mm256_movemask_epi8(stop);
+}
+
+AVX2_TARGET static uint32_t avx2StringPartMask(const char* block, char termChar) {
+	__m256i v = _mm256_load_si256((const __m256i*)block);
+	__m256i stop = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_setzero_si256()), _mm256_cmpeq_epi8(v, _mm256_set1_epi8(termChar)));
+	stop = _mm256_or_si256(stop, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+	stop = _mm256_or_si256(stop, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+	stop = _mm256_or_si256(stop, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+	return (uint32_t)_mm256_movemask_epi8(stop);
+}
+
+AVX2_TARGET static const char* avx2Whitespace(const char* p) {
+	uintptr_t offset = (uintptr_t)p & 31;
+	const char* block = p - offset;
+	uint32_t mask = avx2NotWhiteMask(block) & (0xFFFFFFFFu << offset);
+	while (!mask) {
+		block += 32;
+		mask = avx2NotWhiteMask(block);
+	}
+	return block + firstBit(mask);
+}
+
+AVX2_TARGET static const char* avx2AlNum(const char* p) {
+	uintptr_t offset = (uintptr_t)p & 31;
+	const char* block = p - offset;
+	uint32_t mask = avx2NotAlNumMask(block) & (0xFFFFFFFFu << offset);
+	while (!mask) {
+		block += 32;
+		mask = avx2NotAlNumMask(block);
+	}
+	return block + firstBit(mask);
+}
+
+AVX2_TARGET static const char* avx2LineEnd(const char* p) {
+	uintptr_t offset = (uintptr_t)p & 31;
+	const char* block = p - offset;
+	uint32_t mask = avx2LineEndMask(block) & (0xFFFFFFFFu << offset);
+	while (!mask) {
+		block += 32;
+		mask = avx2LineEndMask(block);
+	}
+	return block + firstBit(mask);
+}
+
+AVX2_TARGET static const char* avx2StringPart(const char* p, char termChar) {
+	uintptr_t offset = (uintptr_t)p & 31;
+	const char* block = p - offset;
+	uint32_t mask = avx2StringPartMask(block, termChar) & (0xFFFFFFFFu << offset);
+	while (!mask) {
+		block += 32;
+		mask = avx2StringPartMask(block, termChar);
+	}
+	return block + firstBit(mask);
+}
+
+AVX2_TARGET static uint32_t avx2CountChar(const char* start, const char* end, char c) {
+	if (start >= end) return 0;
+	__m256i needle = _mm256_set1_epi8(c);
+	uintptr_t offset = (uintptr_t)start & 31;
+	const char* block = start - offset;
+	uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256((const __m256i*)block), needle));
+	mask &= 0xFFFFFFFFu << offset;
+	uint32_t count = 0;
+	while (block + 32 < end) {
+		count += bitCount(mask);
+		block += 32;
+		mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256((const __m256i*)block), needle));
+	}
+	uint32_t tail = (uint32_t)(end - block);
+	if (tail < 32) mask &= (1u << tail) - 1;
+	return count + bitCount(mask);
+}
+
+static const struct ScanFuncs avx2Funcs = {
+	ibsScanAVX2, avx2Whitespace, avx2AlNum, avx2LineEnd, avx2StringPart, avx2CountChar
+};
+
+static bool cpuHasAVX2(void) {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+	__cpuid(info, 1);
+	// OS must support AVX and save YMM registers on context switch
+	bool hasAVX = (info[2] & (1 << 27)) && (info[2] & (1 << 28));
+	if (!hasAVX || (_xgetbv(0) & 6) != 6) return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // SCAN_X64
+
+static void selectBestImpl(void) {
+	if (ibsScanSetImpl(ibsScanAVX2)) return;
+	if (ibsScanSetImpl(ibsScanSSE2)) return;
+	ibsScanSetImpl(ibsScanScalar);
+}
+
+static void storeFuncs(const struct ScanFuncs* newFuncs) {
+#ifdef _WIN32
+	InterlockedExchangePointer((PVOID volatile*)&funcs, (PVOID)newFuncs);
+#else
+	atomic_store_explicit(&funcs, newFuncs, memory_order_relaxed);
+#endif
+}
+
+/**
+ * Tables of functions are constant so we don't need any ordering here, only
+ * that the pointer itself is never seen half written.
+ */
+static const struct ScanFuncs* getFuncs(void) {
+#ifdef _WIN32
+	const struct ScanFuncs* res = funcs;
+#else
+	const struct ScanFuncs* res = atomic_load_explicit(&funcs, memory_order_relaxed);
+#endif
+	if (res) return res;
+	// If several threads get here they all select the same implementation
+	selectBestImpl();
+	return getFuncs();
+}
+
+/********************************************************
+Public
+*********************************************************/
+
+IbsScanImpl ibsScanGetImpl(void) {
+	return getFuncs()->impl;
+}
+
+bool ibsScanSetImpl(IbsScanImpl impl) {
+	switch (impl) {
+	case ibsScanScalar:
+		storeFuncs(&scalarFuncs);
+		break;
+#ifdef SCAN_X64
+	case ibsScanSSE2:
+		storeFuncs(&sse2Funcs);
+		break;
+	case ibsScanAVX2:
+		if (!cpuHasAVX2()) return false;
+		storeFuncs(&avx2Funcs);
+		break;
+#endif
+	default:
+		return false;
+	}
+	return true;
+}
+
+const char* ibsScanWhitespace(const char* p) {
+	return getFuncs()->whitespace(p);
+}
+
+const char* ibsScanAlNum(const char* p) {
+	return getFuncs()->alNum(p);
+}
+
+const char* ibsScanLineEnd(const char* p) {
+	return getFuncs()->lineEnd(p);
+}
+
+const char* ibsScanStringPart(const char* p, char termChar) {
+	return getFuncs()->stringPart(p, termChar);
+}
+
+uint32_t ibsScanCountChar(const char* start, const char* end, char c) {
+	return getFuncs()->countChar(start, end, c);
+}
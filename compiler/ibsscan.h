@@ -0,0 +1,52 @@
+#pragma once
+
+/**
+ * Functions for quickly finding the first byte of a given class in a zero
+ * terminated buffer. On x64 they check 16 or 32 bytes at a time using SSE2
+ * or AVX2, depending on what the processor supports, and on other platforms
+ * they fall back to checking byte by byte.
+ *
+ * SIMD versions only do aligned loads so they may read past the terminating
+ * zero but never past the end of the memory page it is in.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum { ibsScanScalar, ibsScanSSE2, ibsScanAVX2 } IbsScanImpl;
+
+/**
+ * Returns the implementation that is currently used.
+ */
+IbsScanImpl ibsScanGetImpl(void);
+
+/**
+ * Forces the use of the given implementation. Returns false and doesn't
+ * change anything if processor doesn't support it. Used for testing.
+ */
+bool ibsScanSetImpl(IbsScanImpl impl);
+
+/**
+ * Returns the first byte that is not space, tab, \v, \f, \r or \n.
+ */
+const char* ibsScanWhitespace(const char* p);
+
+/**
+ * Returns the first byte that is not an ascii letter or digit.
+ */
+const char* ibsScanAlNum(const char* p);
+
+/**
+ * Returns the first \n or terminating zero.
+ */
+const char* ibsScanLineEnd(const char* p);
+
+/**
+ * Returns the first byte that is termChar, \, \r, \n or terminating zero.
+ */
+const char* ibsScanStringPart(const char* p, char termChar);
+
+/**
+ * Returns the number of times given char appears between start and end.
+ */
+uint32_t ibsScanCountChar(const char* start, const char* end, char c);
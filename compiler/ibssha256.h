@@ -0,0 +1,27 @@
+#pragma once
+
+/**
+ * SHA-256 hash for when we need a key that identifies content, like the
+ * key of compile cache entries, where collisions must never happen in
+ * practice. Data can be given in any number of pieces.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define IBS_SHA256_SIZE 32
+
+struct IbsSha256 {
+	uint32_t state[8];
+	uint64_t size; // Number of bytes hashed so far
+	uint8_t block[64]; // Bytes of the current incomplete block
+};
+
+void ibsSha256Init(struct IbsSha256* sha);
+void ibsSha256Update(struct IbsSha256* sha, const void* data, size_t size);
+
+/**
+ * Writes the hash of all the data given so far. Sha must be initialized
+ * again before it is used for something else.
+ */
+void ibsSha256Final(struct IbsSha256* sha, uint8_t hash[IBS_SHA256_SIZE]);
@@ -0,0 +1,83 @@
+#include "ibscommon.h"
+#include "ibssymtable.h"
+
+#include <assert.h>
+#include <string.h>
+
+/********************************************************
+Private
+*********************************************************/
+
+#define INITIAL_CAPACITY 256
+#define INITIAL_LOG_CAPACITY 256
+
+static void growValues(PIbsSymTable table, uint32_t atom) {
+	uint32_t newCapacity = table->capacity * 2;
+	while (atom >= newCapacity) newCapacity *= 2;
+	void** newValues = ibsAllocTagged(table->a, newCapacity * sizeof(void*), "symtable values");
+	memcpy(newValues, table->values, table->capacity * sizeof(void*));
+	table->values = newValues;
+	table->capacity = newCapacity;
+}
+
+static void growLog(PIbsSymTable table) {
+	uint32_t newCapacity = table->logCapacity * 2;
+	struct IbsSymTableUndo* newLog = ibsAllocTagged(table->a, newCapacity * sizeof(struct IbsSymTableUndo), "symtable log");
+	memcpy(newLog, table->log, table->logCount * sizeof(struct IbsSymTableUndo));
+	table->log = newLog;
+	table->logCapacity = newCapacity;
+}
+
+/********************************************************
+Public
+*********************************************************/
+
+PIbsSymTable ibsSymTableCreate(PIbsAllocator a) {
+	PIbsSymTable table = ibsAllocTagged(a, sizeof(struct IbsSymTable), "symtable");
+	table->a = a;
+	table->values = ibsAllocTagged(a, INITIAL_CAPACITY * sizeof(void*), "symtable values");
+	table->capacity = INITIAL_CAPACITY;
+	table->log = ibsAllocTagged(a, INITIAL_LOG_CAPACITY * sizeof(struct IbsSymTableUndo), "symtable log");
+	table->logCapacity = INITIAL_LOG_CAPACITY;
+	return table;
+}
+
+PIbsSymTable ibsSymTableCopy(PIbsSymTable table, PIbsAllocator a) {
+	PIbsSymTable copy = ibsAllocTagged(a, sizeof(struct IbsSymTable), "symtable");
+	copy->a = a;
+	copy->values = ibsAllocTagged(a, table->capacity * sizeof(void*), "symtable values");
+	memcpy(copy->values, table->values, table->capacity * sizeof(void*));
+	copy->capacity = table->capacity;
+	copy->log = ibsAllocTagged(a, INITIAL_LOG_CAPACITY * sizeof(struct IbsSymTableUndo), "symtable log");
+	copy->logCapacity = INITIAL_LOG_CAPACITY;
+	return copy;
+}
+
+void* ibsSymTableGet(PIbsSymTable table, uint32_t atom) {
+	if (atom >= table->capacity) return NULL;
+	return table->values[atom];
+}
+
+void ibsSymTableBind(PIbsSymTable table, uint32_t atom, void* value) {
+	if (atom == 0) return;
+	if (atom >= table->capacity) growValues(table, atom);
+	if (table->logCount == table->logCapacity) growLog(table);
+	struct IbsSymTableUndo* undo = &table->log[table->logCount++];
+	undo->atom = atom;
+	undo->prevValue = table->values[atom];
+	table->values[atom] = value;
+}
+
+uint32_t ibsSymTableMark(PIbsSymTable table) {
+	return table->logCount;
+}
+
+void ibsSymTableRestore(PIbsSymTable table, uint32_t mark) {
+	assert(mark <= table->logCount);
+	struct IbsSymTableUndo* log = table->log;
+	void** values = table->values;
+	for (uint32_t i = table->logCount; i > mark; i--) {
+		values[log[i - 1].atom] = log[i - 1].prevValue;
+	}
+	table->logCount = mark;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+/**
+ * Symbol table maps atoms (see ibsatomtable.h) to values that are currently
+ * bound to them. Each binding remembers the value it shadowed in an undo log
+ * so leaving a scope doesn't need to know which symbols were declared in it.
+ * We just take a mark when entering a scope and restore to it when leaving
+ * which unwinds the log in one tight loop without any lookups.
+ */
+
+#include "ibsallocator.h"
+
+struct IbsSymTableUndo {
+	uint32_t atom;
+	void* prevValue;
+};
+
+/* All fields must be treated as readonly in order for symbol table functions to work */
+struct IbsSymTable {
+	PIbsAllocator a;
+	void** values; // Currently bound values indexed by atom
+	uint32_t capacity;
+	uint32_t logCount;
+	uint32_t logCapacity;
+	struct IbsSymTableUndo* log;
+};
+typedef struct IbsSymTable* PIbsSymTable;
+
+PIbsSymTable ibsSymTableCreate(PIbsAllocator a);
+
+/**
+ * Returns a new table with all the values currently bound in the given one.
+ * Undo log is not copied so the copy can't be restored to marks taken on
+ * the original. This is how another thread can get its own table that starts
+ * with the same bindings.
+ */
+PIbsSymTable ibsSymTableCopy(PIbsSymTable table, PIbsAllocator a);
+
+/**
+ * Returns the value currently bound to the given atom or NULL.
+ */
+void* ibsSymTableGet(PIbsSymTable table, uint32_t atom);
+
+/**
+ * Binds the value to the given atom shadowing the previous value until
+ * table is restored to a mark taken before this call.
+ */
+void ibsSymTableBind(PIbsSymTable table, uint32_t atom, void* value);
+
+/**
+ * Returns the mark that can later be given to ibsSymTableRestore. Usually
+ * taken when entering a new scope.
+ */
+uint32_t ibsSymTableMark(PIbsSymTable table);
+
+/**
+ * Undoes all the bindings done after the given mark was taken.
+ */
+void ibsSymTableRestore(PIbsSymTable table, uint32_t mark);
@@ -0,0 +1,306 @@
+#include "ibscommon.h"
+#include "ibsthread.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#endif
+
+#include <stdlib.h>
+
+/********************************************************
+Private
+*********************************************************/
+
+#define MAX_THREADS 64
+// Number of times we check the ring again before yielding
+#define RING_SPIN_COUNT 64
+// Ring indexes are kept on separate cache lines so two threads don't fight over one line
+#define CACHE_LINE_SIZE 64
+
+#ifdef _WIN32
+typedef volatile LONG AtomicIndex;
+#else
+typedef atomic_uint AtomicIndex;
+#endif
+
+struct IbsThread {
+#ifdef _WIN32
+	HANDLE handle;
+#else
+	pthread_t handle;
+#endif
+	IbsThreadFunc func;
+	void* data;
+};
+
+struct IbsMutex {
+#ifdef _WIN32
+	CRITICAL_SECTION section;
+#else
+	pthread_mutex_t handle;
+#endif
+};
+
+/**
+ * Head is the count of items ever pushed and tail the count of items ever
+ * popped. They are only ever increased so ring is empty when they are equal
+ * and index of a slot is a count masked by capacity - 1.
+ */
+struct IbsSpscRing {
+	AtomicIndex head;
+	uint8_t headPadding[CACHE_LINE_SIZE - sizeof(AtomicIndex)];
+	AtomicIndex tail;
+	uint8_t tailPadding[CACHE_LINE_SIZE - sizeof(AtomicIndex)];
+	uint8_t* items;
+	uint32_t itemSize;
+	uint32_t mask;
+};
+
+struct ParallelFor {
+	IbsTaskFunc func;
+	void* data;
+	uint32_t count;
+	AtomicIndex nextIndex;
+};
+
+static uint32_t takeNextIndex(struct ParallelFor* pf) {
+#ifdef _WIN32
+	return (uint32_t)InterlockedIncrement(&pf->nextIndex) - 1;
+#else
+	return atomic_fetch_add(&pf->nextIndex, 1);
+#endif
+}
+
+static void runTasks(struct ParallelFor* pf) {
+	uint32_t index = takeNextIndex(pf);
+	while (index < pf->count) {
+		pf->func(pf->data, index);
+		index = takeNextIndex(pf);
+	}
+}
+
+#ifdef _WIN32
+static DWORD WINAPI parallelForMain(LPVOID arg) {
+	runTasks(arg);
+	return 0;
+}
+
+static DWORD WINAPI threadMain(LPVOID arg) {
+	PIbsThread thread = arg;
+	thread->func(thread->data);
+	return 0;
+}
+#else
+static void* parallelForMain(void* arg) {
+	runTasks(arg);
+	return NULL;
+}
+
+static void* threadMain(void* arg) {
+	PIbsThread thread = arg;
+	thread->func(thread->data);
+	return NULL;
+}
+#endif
+
+/**
+ * Loads the index so that everything the other thread wrote before storing
+ * it is visible to us.
+ */
+static uint32_t loadAcquire(AtomicIndex* index) {
+#ifdef _WIN32
+	return (uint32_t)InterlockedCompareExchange(index, 0, 0);
+#else
+	return atomic_load_explicit(index, memory_order_acquire);
+#endif
+}
+
+/**
+ * Stores the index so everything we wrote before is visible to the thread
+ * that loads it.
+ */
+static void storeRelease(AtomicIndex* index, uint32_t value) {
+#ifdef _WIN32
+	InterlockedExchange(index, (LONG)value);
+#else
+	atomic_store_explicit(index, value, memory_order_release);
+#endif
+}
+
+/**
+ * Only the thread that stores the index may read it this way.
+ */
+static uint32_t loadOwn(AtomicIndex* index) {
+#ifdef _WIN32
+	return (uint32_t)*index;
+#else
+	return atomic_load_explicit(index, memory_order_relaxed);
+#endif
+}
+
+static void waitForOtherThread(uint32_t* spins) {
+	if (++*spins >= RING_SPIN_COUNT) {
+		ibsThreadYield();
+		*spins = 0;
+	}
+}
+
+/********************************************************
+Public
+*********************************************************/
+
+uint32_t ibsCpuCount(void) {
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	long count = (long)info.dwNumberOfProcessors;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	return count > 0 ? (uint32_t)count : 1;
+}
+
+void ibsParallelFor(uint32_t count, uint32_t threadCount, IbsTaskFunc func, void* data) {
+	struct ParallelFor pf = { func, data, count };
+	if (threadCount == 0) threadCount = ibsCpuCount();
+	if (threadCount > count) threadCount = count;
+	if (threadCount > MAX_THREADS) threadCount = MAX_THREADS;
+
+	// Calling thread is one of the workers so we start one less thread.
+	// If a thread can't be started the remaining ones just do more work.
+	uint32_t started = 0;
+#ifdef _WIN32
+	HANDLE threads[MAX_THREADS];
+	for (uint32_t i = 1; i < threadCount; i++) {
+		threads[started] = CreateThread(NULL, 0, parallelForMain, &pf, 0, NULL);
+		if (threads[started]) started++;
+	}
+	runTasks(&pf);
+	for (uint32_t i = 0; i < started; i++) {
+		WaitForSingleObject(threads[i], INFINITE);
+		CloseHandle(threads[i]);
+	}
+#else
+	pthread_t threads[MAX_THREADS];
+	for (uint32_t i = 1; i < threadCount; i++) {
+		if (pthread_create(&threads[started], NULL, parallelForMain, &pf) == 0) started++;
+	}
+	runTasks(&pf);
+	for (uint32_t i = 0; i < started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+#endif
+}
+
+PIbsThread ibsThreadStart(IbsThreadFunc func, void* data) {
+	PIbsThread thread = malloc(sizeof(struct IbsThread));
+	if (!thread) return NULL;
+	thread->func = func;
+	thread->data = data;
+#ifdef _WIN32
+	thread->handle = CreateThread(NULL, 0, threadMain, thread, 0, NULL);
+	if (thread->handle) return thread;
+#else
+	if (pthread_create(&thread->handle, NULL, threadMain, thread) == 0) return thread;
+#endif
+	free(thread);
+	return NULL;
+}
+
+void ibsThreadJoin(PIbsThread thread) {
+#ifdef _WIN32
+	WaitForSingleObject(thread->handle, INFINITE);
+	CloseHandle(thread->handle);
+#else
+	pthread_join(thread->handle, NULL);
+#endif
+	free(thread);
+}
+
+void ibsThreadYield(void) {
+#ifdef _WIN32
+	SwitchToThread();
+#else
+	sched_yield();
+#endif
+}
+
+PIbsMutex ibsMutexCreate(void) {
+	PIbsMutex mutex = malloc(sizeof(struct IbsMutex));
+	if (!mutex) return NULL;
+#ifdef _WIN32
+	InitializeCriticalSection(&mutex->section);
+#else
+	if (pthread_mutex_init(&mutex->handle, NULL) != 0) {
+		free(mutex);
+		return NULL;
+	}
+#endif
+	return mutex;
+}
+
+void ibsMutexFree(PIbsMutex mutex) {
+#ifdef _WIN32
+	DeleteCriticalSection(&mutex->section);
+#else
+	pthread_mutex_destroy(&mutex->handle);
+#endif
+	free(mutex);
+}
+
+void ibsMutexLock(PIbsMutex mutex) {
+#ifdef _WIN32
+	EnterCriticalSection(&mutex->section);
+#else
+	pthread_mutex_lock(&mutex->handle);
+#endif
+}
+
+void ibsMutexUnlock(PIbsMutex mutex) {
+#ifdef _WIN32
+	LeaveCriticalSection(&mutex->section);
+#else
+	pthread_mutex_unlock(&mutex->handle);
+#endif
+}
+
+PIbsSpscRing ibsSpscRingCreate(uint32_t itemSize, uint32_t capacity, PIbsAllocator a) {
+	uint32_t size = 1;
+	while (size < capacity) size *= 2;
+	PIbsSpscRing ring = ibsAlloc(a, sizeof(struct IbsSpscRing));
+	ring->items = ibsAlloc(a, (size_t)size * itemSize);
+	ring->itemSize = itemSize;
+	ring->mask = size - 1;
+	return ring;
+}
+
+void* ibsSpscRingPushStart(PIbsSpscRing ring) {
+	uint32_t head = loadOwn(&ring->head);
+	uint32_t spins = 0;
+	while (head - loadAcquire(&ring->tail) > ring->mask) {
+		waitForOtherThread(&spins);
+	}
+	return &ring->items[(size_t)(head & ring->mask) * ring->itemSize];
+}
+
+void ibsSpscRingPushEnd(PIbsSpscRing ring) {
+	storeRelease(&ring->head, loadOwn(&ring->head) + 1);
+}
+
+void* ibsSpscRingPopStart(PIbsSpscRing ring) {
+	uint32_t tail = loadOwn(&ring->tail);
+	uint32_t spins = 0;
+	while (loadAcquire(&ring->head) == tail) {
+		waitForOtherThread(&spins);
+	}
+	return &ring->items[(size_t)(tail & ring->mask) * ring->itemSize];
+}
+
+void ibsSpscRingPopEnd(PIbsSpscRing ring) {
+	storeRelease(&ring->tail, loadOwn(&ring->tail) + 1);
+}
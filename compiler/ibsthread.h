@@ -0,0 +1,95 @@
+#pragma once
+
+/**
+ * Minimal portable support for running work on multiple threads. It uses
+ * Windows threads on Windows and pthreads everywhere else.
+ *
+ * There is also a plain mutex for rare cases where threads do need to wait
+ * for each other.
+ *
+ * It also contains a lock free single producer single consumer ring buffer
+ * through which one thread can pass items to another without locking. Both
+ * sides reserve a slot, fill or read it in place and then release it, and
+ * if the ring is full or empty they spin for a while and then yield.
+ */
+
+#include "ibsallocator.h"
+#include <stdint.h>
+
+/**
+ * Function that does one piece of work. It gets the data given to
+ * ibsParallelFor and the index of the piece.
+ */
+typedef void(*IbsTaskFunc)(void* data, uint32_t index);
+
+/**
+ * Returns the number of logical processors or 1 if it can't be determined.
+ */
+uint32_t ibsCpuCount(void);
+
+/**
+ * Calls func for each index from 0 to count - 1 on the given number of
+ * threads, or on one thread per processor if threadCount is 0. Each thread
+ * takes the next index that wasn't taken yet so pieces of different sizes
+ * are balanced. Calling thread also does the work and the function returns
+ * once all the pieces are done.
+ */
+void ibsParallelFor(uint32_t count, uint32_t threadCount, IbsTaskFunc func, void* data);
+
+typedef void(*IbsThreadFunc)(void* data);
+typedef struct IbsThread* PIbsThread;
+
+/**
+ * Starts a new thread that calls func with the given data. Returns NULL if
+ * the thread can't be started.
+ */
+PIbsThread ibsThreadStart(IbsThreadFunc func, void* data);
+
+/**
+ * Waits for the thread to finish and frees its handle.
+ */
+void ibsThreadJoin(PIbsThread thread);
+
+/**
+ * Gives the rest of the current time slice to other threads.
+ */
+void ibsThreadYield(void);
+
+typedef struct IbsMutex* PIbsMutex;
+
+/**
+ * Creates a mutex or returns NULL if it can't be created. It has to be
+ * freed with ibsMutexFree.
+ */
+PIbsMutex ibsMutexCreate(void);
+void ibsMutexFree(PIbsMutex mutex);
+
+/**
+ * Waits until no other thread holds the mutex and takes it.
+ */
+void ibsMutexLock(PIbsMutex mutex);
+void ibsMutexUnlock(PIbsMutex mutex);
+
+typedef struct IbsSpscRing* PIbsSpscRing;
+
+/**
+ * Creates a ring of items of the given size. Capacity is rounded up to a
+ * power of 2.
+ */
+PIbsSpscRing ibsSpscRingCreate(uint32_t itemSize, uint32_t capacity, PIbsAllocator a);
+
+/**
+ * Returns the next free slot, waiting while the ring is full. Slot is given
+ * to the consumer only when ibsSpscRingPushEnd is called. Only the producer
+ * thread may call this.
+ */
+void* ibsSpscRingPushStart(PIbsSpscRing ring);
+void ibsSpscRingPushEnd(PIbsSpscRing ring);
+
+/**
+ * Returns the oldest pushed slot, waiting while the ring is empty. Slot can
+ * be reused by the producer only after ibsSpscRingPopEnd is called. Only the
+ * consumer thread may call this.
+ */
+void* ibsSpscRingPopStart(PIbsSpscRing ring);
+void ibsSpscRingPopEnd(PIbsSpscRing ring);
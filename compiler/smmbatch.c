@@ -0,0 +1,147 @@
+#include "smmbatch.h"
+#include "ibsdictionary.h"
+#include "ibsthread.h"
+#include "smmllvmcodegen.h"
+
+#include <string.h>
+#include <time.h>
+
+/********************************************************
+Private
+*********************************************************/
+
+struct BatchData {
+	PSmmBatchFile files;
+	PSmmCompileOptions options; // Module name is set for each file
+	PSmmCache cache;
+};
+
+static double getSeconds(void) {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const char* getOutFile(const char* inFile, const char* outDir, PIbsAllocator a) {
+	const char* name = inFile;
+	size_t dirLength = 0;
+	if (outDir) {
+		for (const char* c = inFile; *c; c++) {
+			if (*c == '/' || *c == '\\') name = c + 1;
+		}
+		dirLength = strlen(outDir);
+	}
+	size_t nameLength = strlen(name);
+	if (nameLength > 4 && strcmp(name + nameLength - 4, ".smm") == 0) nameLength -= 4;
+	char* outFile = ibsAlloc(a, dirLength + nameLength + 5);
+	char* cur = outFile;
+	if (outDir) {
+		memcpy(cur, outDir, dirLength);
+		cur += dirLength;
+		*cur++ = '/';
+	}
+	memcpy(cur, name, nameLength);
+	strcpy(cur + nameLength, ".ll");
+	return outFile;
+}
+
+static void compileBatchFile(void* data, uint32_t index) {
+	struct BatchData* batch = data;
+	PSmmBatchFile file = &batch->files[index];
+	double start = getSeconds();
+	PIbsAllocator a = ibsChunkedAllocatorCreate(file->inFile, 1024 * 1024);
+	file->msgsAllocator = ibsChunkedAllocatorCreate("msgs", 4 * 1024);
+
+	PIbsFile src = ibsFileOpen(file->inFile, a);
+	if (!src) {
+		file->error = "Can't find file";
+	} else {
+		struct SmmCompileOptions options = *batch->options;
+		options.moduleName = file->inFile;
+		struct SmmCacheEntry result;
+		file->cached = smmCompileFile(&options, batch->cache, src, &result, a);
+		size_t msgsSize = strlen(result.msgs) + 1;
+		file->msgs = ibsAlloc(file->msgsAllocator, msgsSize);
+		memcpy(file->msgs, result.msgs, msgsSize);
+		if (result.errorCount > 0) {
+			file->failed = true;
+		} else if (!result.ir) {
+			file->error = "Module compilation failed";
+		} else if (!ibsFileWrite(file->outFile, result.ir)) {
+			file->error = "Failed to open output file for writing";
+		}
+		ibsFileClose(src);
+	}
+	file->failed = file->failed || file->error;
+	ibsSimpleAllocatorFree(a);
+	file->seconds = getSeconds() - start;
+}
+
+/********************************************************
+Public
+*********************************************************/
+
+bool smmCompileFile(PSmmCompileOptions options, PSmmCache cache, PIbsFile file, PSmmCacheEntry result, PIbsAllocator a) {
+	struct SmmCacheKey key;
+	if (cache) {
+		key = smmCacheGetKey(cache, options, file->data, file->size);
+		if (smmCacheGet(cache, &key, result, a)) return true;
+	}
+
+	struct SmmMsgs msgs = { 0 };
+	msgs.a = a;
+	PIbsAllocator lexerAllocator = NULL;
+	if (options->useLexerThread) lexerAllocator = ibsChunkedAllocatorCreate("lexer", 1024 * 1024);
+	PSmmAst module = smmCheckSource(file->data, options, lexerAllocator, &msgs, a);
+	result->msgs = smmFormatMessages(&msgs, a);
+	result->errorCount = msgs.errorCount;
+	result->ir = NULL;
+	if (module) {
+		if (!smmHadErrors(&msgs)) result->ir = smmGenerateLLVMIR(module, NULL, NULL, a);
+		smmFreeAst(module);
+	}
+	if (lexerAllocator) ibsSimpleAllocatorFree(lexerAllocator);
+
+	// Failed code generation is not cached so it is reported the same way next time
+	if (cache && (result->errorCount > 0 || result->ir)) smmCachePut(cache, &key, result);
+	return false;
+}
+
+PSmmBatchFile smmCreateBatch(const char** inFiles, uint32_t fileCount, const char* outDir, PIbsAllocator a) {
+	PSmmBatchFile files = ibsAlloc(a, fileCount * sizeof(struct SmmBatchFile));
+	memset(files, 0, fileCount * sizeof(struct SmmBatchFile));
+	for (uint32_t i = 0; i < fileCount; i++) {
+		files[i].inFile = inFiles[i];
+		files[i].outFile = getOutFile(inFiles[i], outDir, a);
+	}
+	return files;
+}
+
+bool smmFindSameOutFiles(PSmmBatchFile files, uint32_t fileCount, uint32_t* first, uint32_t* second, PIbsAllocator a) {
+	PIbsDict outFiles = ibsHashDictCreate(a);
+	for (uint32_t i = 0; i < fileCount; i++) {
+		// Index is stored increased by one since NULL means the key is not there
+		uintptr_t prevIndex = (uintptr_t)ibsDictGet(outFiles, files[i].outFile);
+		if (prevIndex) {
+			*first = (uint32_t)(prevIndex - 1);
+			*second = i;
+			return true;
+		}
+		ibsDictPut(outFiles, files[i].outFile, (void*)(uintptr_t)(i + 1));
+	}
+	return false;
+}
+
+double smmCompileBatch(PSmmBatchFile files, uint32_t fileCount, PSmmCompileOptions options, PSmmCache cache,
+		uint32_t jobCount) {
+	struct BatchData batch = { files, options, cache };
+	double start = getSeconds();
+	ibsParallelFor(fileCount, jobCount, compileBatchFile, &batch);
+	return getSeconds() - start;
+}
+
+void smmFreeBatch(PSmmBatchFile files, uint32_t fileCount) {
+	for (uint32_t i = 0; i < fileCount; i++) {
+		if (files[i].msgsAllocator) ibsSimpleAllocatorFree(files[i].msgsAllocator);
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+/**
+* Compiles many files at once, each as a separate task on a number of threads.
+* Each task has its own allocators and its own LLVM context, created by the
+* code gen pass, so tasks share nothing except the optional compile cache.
+* Results are kept for each file so the caller can report them in the order
+* in which files were given once all of them are compiled.
+*/
+
+#include "ibscommon.h"
+#include "ibsallocator.h"
+#include "ibsfile.h"
+#include "smmcompiler.h"
+#include "smmcache.h"
+
+/**
+* Everything needed to compile one file of a batch. Messages are kept in
+* their own allocator so they can be printed after all files are compiled
+* while everything else is freed as soon as the file is done.
+*/
+struct SmmBatchFile {
+	const char* inFile;
+	const char* outFile;
+	const char* error; // Set if file failed for reasons other than errors in it
+	PIbsAllocator msgsAllocator;
+	char* msgs;
+	double seconds;
+	bool failed;
+	bool cached;
+};
+typedef struct SmmBatchFile* PSmmBatchFile;
+
+/**
+* Fills the result with formatted messages and generated IR, taking them
+* from the cache, if it is given and they are there, so none of the passes
+* are executed. Returns true on a cache hit.
+*/
+bool smmCompileFile(PSmmCompileOptions options, PSmmCache cache, PIbsFile file, PSmmCacheEntry result, PIbsAllocator a);
+
+/**
+* Returns batch files for the given inputs. Output of each goes into outDir,
+* if it is given, or next to the input file otherwise, with .smm extension
+* replaced by .ll.
+*/
+PSmmBatchFile smmCreateBatch(const char** inFiles, uint32_t fileCount, const char* outDir, PIbsAllocator a);
+
+/**
+* Returns true if two files of the batch would write the same output, like
+* a/x.smm and b/x.smm compiled into one outDir, and sets first and second
+* to their indexes. Such a batch must not be compiled since one output would
+* be lost.
+*/
+bool smmFindSameOutFiles(PSmmBatchFile files, uint32_t fileCount, uint32_t* first, uint32_t* second, PIbsAllocator a);
+
+/**
+* Compiles each file and writes its output using jobCount threads, where 0
+* means one thread per processor. Module name of each file is its input path
+* and the rest of the options are the same for all. Returns the number of
+* seconds it took.
+*/
+double smmCompileBatch(PSmmBatchFile files, uint32_t fileCount, PSmmCompileOptions options, PSmmCache cache,
+	uint32_t jobCount);
+
+/**
+* Frees messages of all the files.
+*/
+void smmFreeBatch(PSmmBatchFile files, uint32_t fileCount);
@@ -0,0 +1,516 @@
+#include "smmcache.h"
+#include "ibsthread.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/utime.h>
+#else
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <time.h>
+#include <utime.h>
+#endif
+
+#ifdef __APPLE__
+#include <mach-o/dyld.h>
+#endif
+
+#include "llvm/Config/llvm-config.h"
+
+/********************************************************
+Private
+*********************************************************/
+
+#define ENTRY_MAGIC 0x43434d53
+#define ENTRY_EXT ".smmc"
+#define STATS_FILE_NAME "stats"
+#define MAX_PATH_SIZE 4096
+// Longest name in cache directory is hash in hex, dot, "tmp" and two numbers
+#define MAX_NAME_SIZE 100
+// Cleanup deletes entries until cache is at most this full
+#define CLEANUP_TARGET_PERCENT 80
+// Part of names of files that are being written and are renamed when done
+#define TMP_INFIX ".tmp."
+// Temporary files this old are left by processes that died while writing them
+#define TMP_FILE_MAX_AGE_SECONDS 600
+#define READ_BUFFER_SIZE (64 * 1024)
+
+// Key flags for the modes in which func bodies are processed
+#define KEY_FLAG_LAZY_BODIES 1
+#define KEY_FLAG_PARALLEL_PASSES 2
+
+struct EntryHeader {
+	uint32_t magic;
+	uint32_t errorCount;
+	uint32_t msgsSize;
+	uint32_t irSize;
+	uint32_t hasIR;
+};
+
+struct SmmCache {
+	char* dir;
+	uint64_t maxSize;
+	PIbsMutex lock; // Taken while stats are changed or written
+	struct SmmCacheStats fileStats; // As they were when stats file was last read
+	struct SmmCacheStats stats; // Of this process since stats were last written
+	int64_t sizeDelta; // Bytes added and deleted by this process since stats were last written
+	uint32_t tmpCounter;
+	uint8_t buildId[IBS_SHA256_SIZE];
+};
+
+struct FileInfo {
+	uint64_t time; // In units of getTimeNow
+	uint64_t size;
+	bool isTmp;
+	char name[MAX_NAME_SIZE];
+};
+
+static void getPath(PSmmCache cache, const char* name, char* path) {
+	snprintf(path, MAX_PATH_SIZE, "%s/%s", cache->dir, name);
+}
+
+static void getEntryName(PSmmCacheKey key, char* name) {
+	for (int i = 0; i < IBS_SHA256_SIZE; i++) {
+		sprintf(name + i * 2, "%02x", key->hash[i]);
+	}
+	strcpy(name + IBS_SHA256_SIZE * 2, ENTRY_EXT);
+}
+
+static uint32_t getProcessId(void) {
+#ifdef _WIN32
+	return (uint32_t)_getpid();
+#else
+	return (uint32_t)getpid();
+#endif
+}
+
+/**
+ * Build ID is SHA-256 of the running executable, which contains the
+ * compiler, and of the LLVM version it was built with, so it changes
+ * whenever either of them does but is the same for identical builds.
+ */
+static bool getBuildId(uint8_t* buildId) {
+	char path[MAX_PATH_SIZE];
+#ifdef _WIN32
+	DWORD pathLength = GetModuleFileNameA(NULL, path, MAX_PATH_SIZE);
+	if (pathLength == 0 || pathLength >= MAX_PATH_SIZE) return false;
+#elif defined(__APPLE__)
+	uint32_t pathSize = MAX_PATH_SIZE;
+	if (_NSGetExecutablePath(path, &pathSize) != 0) return false;
+#else
+	strcpy(path, "/proc/self/exe");
+#endif
+	FILE* f = fopen(path, "rb");
+	if (!f) return false;
+	char* buffer = malloc(READ_BUFFER_SIZE);
+	if (!buffer) {
+		fclose(f);
+		return false;
+	}
+	struct IbsSha256 sha;
+	ibsSha256Init(&sha);
+	ibsSha256Update(&sha, LLVM_VERSION_STRING, sizeof(LLVM_VERSION_STRING));
+	size_t size;
+	while ((size = fread(buffer, 1, READ_BUFFER_SIZE, f)) > 0) {
+		ibsSha256Update(&sha, buffer, size);
+	}
+	bool ok = !ferror(f);
+	fclose(f);
+	free(buffer);
+	ibsSha256Final(&sha, buildId);
+	return ok;
+}
+
+static bool makeDir(const char* dir) {
+#ifdef _WIN32
+	return _mkdir(dir) == 0 || GetFileAttributesA(dir) & FILE_ATTRIBUTE_DIRECTORY;
+#else
+	if (mkdir(dir, 0777) == 0) return true;
+	struct stat st;
+	return errno == EEXIST && stat(dir, &st) == 0 && S_ISDIR(st.st_mode);
+#endif
+}
+
+/**
+ * Renames the file replacing the destination if it exists. On both systems
+ * other processes see either the old or the new file and never a mix.
+ */
+static bool replaceFile(const char* from, const char* to) {
+#ifdef _WIN32
+	return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return rename(from, to) == 0;
+#endif
+}
+
+/**
+ * Returns current time in the same units as file times from listFiles.
+ */
+static uint64_t getTimeNow(void) {
+#ifdef _WIN32
+	FILETIME now;
+	GetSystemTimeAsFileTime(&now);
+	return (uint64_t)now.dwHighDateTime << 32 | now.dwLowDateTime;
+#else
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static uint64_t secondsToTime(uint64_t seconds) {
+#ifdef _WIN32
+	return seconds * 10000000;
+#else
+	return seconds * 1000000000;
+#endif
+}
+
+static bool getOpenFileSize(FILE* f, uint64_t* size) {
+#ifdef _WIN32
+	struct _stat64 st;
+	if (_fstat64(_fileno(f), &st) != 0) return false;
+#else
+	struct stat st;
+	if (fstat(fileno(f), &st) != 0) return false;
+#endif
+	*size = (uint64_t)st.st_size;
+	return true;
+}
+
+/**
+ * Returns true for entry files and temporary files, setting isTmp for the
+ * latter, and false for everything else in the cache directory.
+ */
+static bool isCacheFile(const char* name, bool* isTmp) {
+	size_t nameLength = strlen(name);
+	size_t extLength = strlen(ENTRY_EXT);
+	*isTmp = strstr(name, TMP_INFIX) != NULL;
+	return *isTmp || (nameLength > extLength && strcmp(name + nameLength - extLength, ENTRY_EXT) == 0);
+}
+
+static void touchFile(const char* path) {
+#ifdef _WIN32
+	_utime(path, NULL);
+#else
+	utime(path, NULL);
+#endif
+}
+
+/**
+ * Returns all entry files and temporary files in the cache directory. Array
+ * is allocated with malloc and count is set to the number of its items.
+ */
+static struct FileInfo* listFiles(PSmmCache cache, uint32_t* count) {
+	uint32_t capacity = 256;
+	struct FileInfo* files = malloc(capacity * sizeof(struct FileInfo));
+	*count = 0;
+	if (!files) return NULL;
+	char path[MAX_PATH_SIZE];
+	bool isTmp;
+#ifdef _WIN32
+	getPath(cache, "*", path);
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileA(path, &data);
+	if (find == INVALID_HANDLE_VALUE) return files;
+	do {
+		const char* name = data.cFileName;
+		if (!isCacheFile(name, &isTmp)) continue;
+		uint64_t time = (uint64_t)data.ftLastWriteTime.dwHighDateTime << 32 | data.ftLastWriteTime.dwLowDateTime;
+		uint64_t size = (uint64_t)data.nFileSizeHigh << 32 | data.nFileSizeLow;
+#else
+	DIR* dir = opendir(cache->dir);
+	if (!dir) return files;
+	struct dirent* dirEntry;
+	while ((dirEntry = readdir(dir)) != NULL) {
+		const char* name = dirEntry->d_name;
+		if (!isCacheFile(name, &isTmp)) continue;
+		struct stat st;
+		getPath(cache, name, path);
+		if (stat(path, &st) != 0) continue;
+#ifdef __APPLE__
+		uint64_t time = (uint64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+		uint64_t time = (uint64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+		uint64_t size = (uint64_t)st.st_size;
+#endif
+		if (strlen(name) >= MAX_NAME_SIZE) continue;
+		if (*count == capacity) {
+			capacity *= 2;
+			struct FileInfo* newFiles = realloc(files, capacity * sizeof(struct FileInfo));
+			if (!newFiles) break;
+			files = newFiles;
+		}
+		files[*count].time = time;
+		files[*count].size = size;
+		files[*count].isTmp = isTmp;
+		strcpy(files[*count].name, name);
+		(*count)++;
+#ifdef _WIN32
+	} while (FindNextFileA(find, &data));
+	FindClose(find);
+#else
+	}
+	closedir(dir);
+#endif
+	return files;
+}
+
+static int compareFileTimes(const void* a, const void* b) {
+	uint64_t aTime = ((const struct FileInfo*)a)->time;
+	uint64_t bTime = ((const struct FileInfo*)b)->time;
+	if (aTime == bTime) return 0;
+	return aTime < bTime ? -1 : 1;
+}
+
+static void readStats(PSmmCache cache, struct SmmCacheStats* stats) {
+	char path[MAX_PATH_SIZE];
+	getPath(cache, STATS_FILE_NAME, path);
+	memset(stats, 0, sizeof(struct SmmCacheStats));
+	FILE* f = fopen(path, "rb");
+	if (!f) return;
+	unsigned long long values[5] = { 0 };
+	if (fscanf(f, "hits %llu\nmisses %llu\nstores %llu\nevictions %llu\nsize %llu",
+			&values[0], &values[1], &values[2], &values[3], &values[4]) == 5) {
+		stats->hits = values[0];
+		stats->misses = values[1];
+		stats->stores = values[2];
+		stats->evictions = values[3];
+		stats->size = values[4];
+	}
+	fclose(f);
+}
+
+/**
+ * Must be called while holding the lock. Adds stats of this process to
+ * those in the stats file and writes them back. If realSize is not negative
+ * it is written as the size of the cache.
+ */
+static void writeStats(PSmmCache cache, int64_t realSize) {
+	struct SmmCacheStats stats;
+	readStats(cache, &stats);
+	stats.hits += cache->stats.hits;
+	stats.misses += cache->stats.misses;
+	stats.stores += cache->stats.stores;
+	stats.evictions += cache->stats.evictions;
+	if (realSize >= 0) {
+		stats.size = realSize;
+	} else if (cache->sizeDelta < 0 && (uint64_t)-cache->sizeDelta > stats.size) {
+		stats.size = 0;
+	} else {
+		stats.size += cache->sizeDelta;
+	}
+
+	char tmpName[MAX_NAME_SIZE];
+	char tmpPath[MAX_PATH_SIZE];
+	char path[MAX_PATH_SIZE];
+	snprintf(tmpName, MAX_NAME_SIZE, STATS_FILE_NAME TMP_INFIX "%u.%u", getProcessId(), cache->tmpCounter++);
+	getPath(cache, tmpName, tmpPath);
+	getPath(cache, STATS_FILE_NAME, path);
+	FILE* f = fopen(tmpPath, "wb");
+	if (!f) return;
+	fprintf(f, "hits %llu\nmisses %llu\nstores %llu\nevictions %llu\nsize %llu\n",
+		(unsigned long long)stats.hits, (unsigned long long)stats.misses, (unsigned long long)stats.stores,
+		(unsigned long long)stats.evictions, (unsigned long long)stats.size);
+	if (fclose(f) != 0 || !replaceFile(tmpPath, path)) {
+		remove(tmpPath);
+		return;
+	}
+	cache->fileStats = stats;
+	memset(&cache->stats, 0, sizeof(struct SmmCacheStats));
+	cache->sizeDelta = 0;
+}
+
+/**
+ * Must be called while holding the lock. Deletes temporary files left by
+ * processes that died while writing them and least recently used entries
+ * until the cache is small enough.
+ */
+static void cleanup(PSmmCache cache) {
+	uint32_t count;
+	struct FileInfo* files = listFiles(cache, &count);
+	if (!files) return;
+	uint64_t size = 0;
+	uint64_t tmpDeadline = getTimeNow() - secondsToTime(TMP_FILE_MAX_AGE_SECONDS);
+	char path[MAX_PATH_SIZE];
+	for (uint32_t i = 0; i < count; i++) {
+		if (!files[i].isTmp) {
+			size += files[i].size;
+		} else if (files[i].time < tmpDeadline) {
+			getPath(cache, files[i].name, path);
+			remove(path);
+		}
+	}
+	qsort(files, count, sizeof(struct FileInfo), compareFileTimes);
+	uint64_t targetSize = cache->maxSize / 100 * CLEANUP_TARGET_PERCENT;
+	for (uint32_t i = 0; i < count && size > targetSize; i++) {
+		if (files[i].isTmp) continue;
+		getPath(cache, files[i].name, path);
+		if (remove(path) == 0) {
+			size -= files[i].size;
+			cache->stats.evictions++;
+		}
+	}
+	free(files);
+	writeStats(cache, (int64_t)size);
+}
+
+/********************************************************
+Public
+*********************************************************/
+
+PSmmCache smmCacheOpen(const char* dir, uint64_t maxSize) {
+	size_t dirLength = strlen(dir);
+	if (dirLength + MAX_NAME_SIZE + 1 >= MAX_PATH_SIZE || !makeDir(dir)) return NULL;
+	PSmmCache cache = calloc(1, sizeof(struct SmmCache) + dirLength + 1);
+	if (!cache) return NULL;
+	cache->dir = (char*)(cache + 1);
+	memcpy(cache->dir, dir, dirLength);
+	cache->maxSize = maxSize;
+	if (!getBuildId(cache->buildId)) {
+		free(cache);
+		return NULL;
+	}
+	cache->lock = ibsMutexCreate();
+	if (!cache->lock) {
+		free(cache);
+		return NULL;
+	}
+	readStats(cache, &cache->fileStats);
+	return cache;
+}
+
+void smmCacheClose(PSmmCache cache) {
+	ibsMutexLock(cache->lock);
+	writeStats(cache, -1);
+	ibsMutexUnlock(cache->lock);
+	ibsMutexFree(cache->lock);
+	free(cache);
+}
+
+struct SmmCacheKey smmCacheGetKey(PSmmCache cache, PSmmCompileOptions options, const char* src, size_t len) {
+	uint32_t flags = 0;
+	if (options->parallelPasses) flags = KEY_FLAG_PARALLEL_PASSES;
+	else if (options->lazyFuncBodies) flags = KEY_FLAG_LAZY_BODIES;
+	struct IbsSha256 sha;
+	ibsSha256Init(&sha);
+	ibsSha256Update(&sha, cache->buildId, IBS_SHA256_SIZE);
+	uint8_t flagBytes[4] = { (uint8_t)flags, (uint8_t)(flags >> 8), (uint8_t)(flags >> 16), (uint8_t)(flags >> 24) };
+	ibsSha256Update(&sha, flagBytes, sizeof(flagBytes));
+	// Zero terminator is included so different splits of the same bytes give different keys
+	ibsSha256Update(&sha, options->moduleName, strlen(options->moduleName) + 1);
+	ibsSha256Update(&sha, src, len);
+	struct SmmCacheKey key;
+	ibsSha256Final(&sha, key.hash);
+	return key;
+}
+
+bool smmCacheGet(PSmmCache cache, PSmmCacheKey key, PSmmCacheEntry entry, PIbsAllocator a) {
+	char name[MAX_NAME_SIZE];
+	char path[MAX_PATH_SIZE];
+	getEntryName(key, name);
+	getPath(cache, name, path);
+
+	bool found = false;
+	bool deleted = false;
+	uint64_t fileSize = 0;
+	FILE* f = fopen(path, "rb");
+	if (f) {
+		struct EntryHeader header;
+		// Sizes are checked against the file before anything is allocated for them
+		// so a truncated or corrupt entry can't ask for more memory than it takes
+		bool valid = getOpenFileSize(f, &fileSize) && fread(&header, sizeof(header), 1, f) == 1 &&
+			header.magic == ENTRY_MAGIC && (header.hasIR || header.irSize == 0) &&
+			(uint64_t)header.msgsSize + header.irSize == fileSize - sizeof(header);
+		if (valid) {
+			char* msgs = ibsAlloc(a, header.msgsSize + 1);
+			char* ir = header.hasIR ? ibsAlloc(a, header.irSize + 1) : NULL;
+			found = fread(msgs, 1, header.msgsSize, f) == header.msgsSize &&
+				(!ir || fread(ir, 1, header.irSize, f) == header.irSize);
+			entry->msgs = msgs;
+			entry->ir = ir;
+			entry->errorCount = header.errorCount;
+		}
+		fclose(f);
+		if (found) {
+			// Entry is now the most recently used one
+			touchFile(path);
+		} else {
+			// Bad entry is deleted so it isn't read again
+			deleted = remove(path) == 0;
+		}
+	}
+
+	ibsMutexLock(cache->lock);
+	if (found) {
+		cache->stats.hits++;
+	} else {
+		cache->stats.misses++;
+		if (deleted) cache->sizeDelta -= fileSize;
+	}
+	ibsMutexUnlock(cache->lock);
+	return found;
+}
+
+void smmCachePut(PSmmCache cache, PSmmCacheKey key, PSmmCacheEntry entry) {
+	char name[MAX_NAME_SIZE];
+	char tmpName[MAX_NAME_SIZE];
+	char path[MAX_PATH_SIZE];
+	char tmpPath[MAX_PATH_SIZE];
+	getEntryName(key, name);
+	getPath(cache, name, path);
+
+	ibsMutexLock(cache->lock);
+	uint32_t counter = cache->tmpCounter++;
+	ibsMutexUnlock(cache->lock);
+	// Name doesn't end with entry extension so cleanup never sees partially written entries
+	snprintf(tmpName, MAX_NAME_SIZE, "%.*s" TMP_INFIX "%u.%u", IBS_SHA256_SIZE * 2, name, getProcessId(), counter);
+	getPath(cache, tmpName, tmpPath);
+
+	struct EntryHeader header = { 0 };
+	header.magic = ENTRY_MAGIC;
+	header.errorCount = entry->errorCount;
+	header.msgsSize = (uint32_t)strlen(entry->msgs);
+	if (entry->ir) {
+		header.hasIR = 1;
+		header.irSize = (uint32_t)strlen(entry->ir);
+	}
+	FILE* f = fopen(tmpPath, "wb");
+	if (!f) return;
+	bool written = fwrite(&header, sizeof(header), 1, f) == 1 &&
+		fwrite(entry->msgs, 1, header.msgsSize, f) == header.msgsSize &&
+		(!entry->ir || fwrite(entry->ir, 1, header.irSize, f) == header.irSize);
+	if (fclose(f) != 0 || !written || !replaceFile(tmpPath, path)) {
+		remove(tmpPath);
+		return;
+	}
+
+	ibsMutexLock(cache->lock);
+	cache->stats.stores++;
+	cache->sizeDelta += sizeof(header) + header.msgsSize + header.irSize;
+	if (cache->fileStats.size + cache->sizeDelta > cache->maxSize) cleanup(cache);
+	ibsMutexUnlock(cache->lock);
+}
+
+struct SmmCacheStats smmCacheGetStats(PSmmCache cache) {
+	ibsMutexLock(cache->lock);
+	struct SmmCacheStats stats = cache->fileStats;
+	stats.hits += cache->stats.hits;
+	stats.misses += cache->stats.misses;
+	stats.stores += cache->stats.stores;
+	stats.evictions += cache->stats.evictions;
+	stats.size += cache->sizeDelta;
+	ibsMutexUnlock(cache->lock);
+	return stats;
+}
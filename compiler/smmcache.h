@@ -0,0 +1,82 @@
+#pragma once
+
+/**
+* Cache of compile results on disk so files that were already compiled with
+* the same compiler don't have to go through any of the passes again. Each
+* result is stored in its own file named by SHA-256 of the compiler build ID,
+* options that change the output, module name and source. Build ID is a hash
+* of the running executable and LLVM version so rebuilt compiler never uses
+* results of the old one while identical builds share them. Files are written
+* under a temporary name and renamed into place so other processes never see
+* a partially written entry.
+*
+* When total size of entries goes over the given maximum the least recently
+* used ones are deleted until the cache is at most 80% full. Use is tracked
+* by modification times of entry files which are updated on each hit. The
+* same cleanup deletes temporary files older than 10 minutes, which were left
+* by processes that died while writing them. Entries that are truncated or
+* corrupt are deleted when they are read.
+*
+* Numbers of hits, misses, stores and evictions, along with the size of
+* entries, are kept in a stats file in the cache directory. They are updated
+* when the cache is closed and can be off a bit when many processes use the
+* same cache at once. One cache can be used from multiple threads.
+*/
+
+#include "ibscommon.h"
+#include "ibsallocator.h"
+#include "ibssha256.h"
+#include "smmcompiler.h"
+
+typedef struct SmmCache* PSmmCache;
+
+struct SmmCacheKey {
+	uint8_t hash[IBS_SHA256_SIZE];
+};
+typedef struct SmmCacheKey* PSmmCacheKey;
+
+struct SmmCacheEntry {
+	const char* msgs; // Formatted as smmFlushMessages prints them
+	const char* ir; // NULL if code had errors
+	uint32_t errorCount;
+};
+typedef struct SmmCacheEntry* PSmmCacheEntry;
+
+struct SmmCacheStats {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t stores;
+	uint64_t evictions;
+	uint64_t size; // Bytes taken by all entries
+};
+
+/**
+* Opens the cache in the given directory, creating the directory if needed.
+* Returns NULL if directory can't be created or the executable can't be read
+* to get the build ID.
+*/
+PSmmCache smmCacheOpen(const char* dir, uint64_t maxSize);
+
+/**
+* Adds stats of this process to the stats file and frees the cache.
+*/
+void smmCacheClose(PSmmCache cache);
+
+/**
+* Key depends on the module name and on the mode in which func bodies are
+* processed since lazy bodies skip errors in funcs that are never called.
+* Options that don't change the output, like the lexer thread, are ignored.
+*/
+struct SmmCacheKey smmCacheGetKey(PSmmCache cache, PSmmCompileOptions options, const char* src, size_t len);
+
+/**
+* Returns true and fills the entry with strings taken from the given
+* allocator if result for the key is stored.
+*/
+bool smmCacheGet(PSmmCache cache, PSmmCacheKey key, PSmmCacheEntry entry, PIbsAllocator a);
+void smmCachePut(PSmmCache cache, PSmmCacheKey key, PSmmCacheEntry entry);
+
+/**
+* Returns stats from the stats file together with those of this process.
+*/
+struct SmmCacheStats smmCacheGetStats(PSmmCache cache);
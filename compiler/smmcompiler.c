@@ -0,0 +1,117 @@
+#include "smmcompiler.h"
+#include "ibsallocator.h"
+#include "smmlexer.h"
+#include "smmparser.h"
+#include "smmtypeinference.h"
+#include "smmsempass.h"
+#include "smmparallelpasses.h"
+#include "smmllvmcodegen.h"
+#include "llvm-c/Core.h"
+#include "llvm-c/TargetMachine.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define CONTEXT_ALLOCATOR_SIZE (1024 * 1024)
+
+struct SmmContext {
+	PIbsAllocator a; // Reset at the start of each compile
+	PIbsAllocator lexerAllocator; // Keeps tokens when lexer runs on its own thread
+	LLVMContextRef llvmContext;
+	char* triple;
+};
+
+/********************************************************
+Public
+*********************************************************/
+
+PSmmAst smmParseSource(char* src, PSmmCompileOptions options, PIbsAllocator lexerAllocator, PSmmMsgs msgs, PIbsAllocator a) {
+	PSmmLexer lex = smmCreateLexer(src, options->moduleName, msgs, a);
+	PSmmParser parser;
+	PSmmTokenPipe pipe = NULL;
+	if (lexerAllocator) {
+		pipe = smmCreateTokenPipe(lex, msgs, lexerAllocator, a);
+		parser = smmCreateParserFromPipe(lex, pipe, msgs, a);
+	} else {
+		uint32_t tokenCount;
+		PSmmToken tokens = smmTokenize(lex, a, &tokenCount);
+		parser = smmCreateParserFromTokens(lex, tokens, tokenCount, msgs, a);
+	}
+	// Parallel passes parse func bodies themselves so parser should only skip them
+	parser->lazyFuncBodies = options->lazyFuncBodies || options->parallelPasses;
+	PSmmAst module = smmParse(parser);
+	if (pipe) smmCloseTokenPipe(pipe);
+	return module;
+}
+
+PSmmAst smmCheckSource(char* src, PSmmCompileOptions options, PIbsAllocator lexerAllocator, PSmmMsgs msgs, PIbsAllocator a) {
+	PSmmAst module = smmParseSource(src, options, lexerAllocator, msgs, a);
+	if (!module) return NULL;
+	if (options->parallelPasses) {
+		smmExecuteParallelPasses(module, msgs, options->threadCount, a);
+	} else {
+		smmExecuteTypeInferencePass(module, msgs, a);
+		smmExecuteSemPass(module, msgs, a);
+	}
+	return module;
+}
+
+PSmmContext smmContextCreate(void) {
+	PSmmContext ctx = malloc(sizeof(struct SmmContext));
+	if (!ctx) return NULL;
+	ctx->a = ibsChunkedAllocatorCreate("compileContext", CONTEXT_ALLOCATOR_SIZE);
+	ctx->lexerAllocator = ibsChunkedAllocatorCreate("compileContextLexer", CONTEXT_ALLOCATOR_SIZE);
+	ctx->llvmContext = LLVMContextCreate();
+	ctx->triple = LLVMGetDefaultTargetTriple();
+	return ctx;
+}
+
+void smmContextFree(PSmmContext ctx) {
+	LLVMDisposeMessage(ctx->triple);
+	LLVMContextDispose(ctx->llvmContext);
+	ibsSimpleAllocatorFree(ctx->lexerAllocator);
+	ibsSimpleAllocatorFree(ctx->a);
+	free(ctx);
+}
+
+void smmContextReset(PSmmContext ctx) {
+	ibsSimpleAllocatorReset(ctx->a);
+	ibsSimpleAllocatorReset(ctx->lexerAllocator);
+	LLVMContextDispose(ctx->llvmContext);
+	ctx->llvmContext = LLVMContextCreate();
+}
+
+bool smmCompileBuffer(PSmmContext ctx, const char* src, size_t len, PSmmCompileOptions options, PSmmCompileResult out) {
+	struct SmmCompileOptions defaultOptions = { "buffer" };
+	if (!options) options = &defaultOptions;
+	ibsSimpleAllocatorReset(ctx->a);
+	ibsSimpleAllocatorReset(ctx->lexerAllocator);
+	PIbsAllocator a = ctx->a;
+	memset(out, 0, sizeof(struct SmmCompileResult));
+	out->msgs.a = a;
+	if (options->lazyFuncBodies && options->parallelPasses) return false;
+
+	// Lexer needs zero terminated buffer. Name is copied since messages keep pointing to it.
+	char* buffer = ibsAlloc(a, len + 1);
+	memcpy(buffer, src, len);
+	buffer[len] = 0;
+	size_t nameLength = strlen(options->moduleName) + 1;
+	char* moduleName = ibsAlloc(a, nameLength);
+	memcpy(moduleName, options->moduleName, nameLength);
+
+	struct SmmCompileOptions nameOptions = *options;
+	nameOptions.moduleName = moduleName;
+	PIbsAllocator lexerAllocator = options->useLexerThread ? ctx->lexerAllocator : NULL;
+	PSmmAst module = smmCheckSource(buffer, &nameOptions, lexerAllocator, &out->msgs, a);
+	if (!module) return false;
+
+	if (!smmHadErrors(&out->msgs)) {
+		char* ir = smmGenerateLLVMIR(module, ctx->llvmContext, ctx->triple, a);
+		if (ir) {
+			out->ir = ir;
+			out->irSize = strlen(ir);
+		}
+	}
+	smmFreeAst(module);
+	return out->ir != NULL;
+}
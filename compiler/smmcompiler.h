@@ -0,0 +1,74 @@
+#pragma once
+
+/**
+* Library interface for compiling summus code from memory without starting a
+* new process for each file. All the passes are run on the given source and
+* result is LLVM assembly and the messages about the code.
+*
+* Context keeps everything that can be reused between compilations: memory
+* of its allocator, which is only reset and never freed between compiles,
+* and LLVM context with the target triple. One context must only be used by
+* one thread at a time but different contexts can be used on different
+* threads at once.
+*/
+
+#include "ibscommon.h"
+#include "ibsallocator.h"
+#include "smmmsgs.h"
+#include "smmparser.h"
+
+typedef struct SmmContext* PSmmContext;
+
+struct SmmCompileOptions {
+	const char* moduleName; // Used in messages and for LLVM module name
+	bool lazyFuncBodies; // Only parse bodies of called funcs (see SmmParser.lazyFuncBodies)
+	bool parallelPasses; // Process all func bodies in parallel, can't be used with lazyFuncBodies
+	uint32_t threadCount; // Used with parallelPasses, 0 means one thread per processor
+	bool useLexerThread; // Run lexer on its own thread while parser takes tokens from it
+};
+typedef struct SmmCompileOptions* PSmmCompileOptions;
+
+/**
+* Result of one compilation. Everything in it lives in the context and stays
+* valid only until the next compile or reset of that context.
+*/
+struct SmmCompileResult {
+	const char* ir; // Zero terminated LLVM assembly or NULL if compilation failed
+	size_t irSize;
+	struct SmmMsgs msgs;
+};
+typedef struct SmmCompileResult* PSmmCompileResult;
+
+PSmmContext smmContextCreate(void);
+void smmContextFree(PSmmContext ctx);
+
+/**
+* Compiles given source which doesn't have to be zero terminated. Options can
+* be NULL in which case module is named "buffer" and everything is done on
+* calling thread. Returns false if there were errors in code, in which case
+* they are in out->msgs, if the source is empty or if both lazyFuncBodies
+* and parallelPasses are set.
+*/
+bool smmCompileBuffer(PSmmContext ctx, const char* src, size_t len, PSmmCompileOptions options, PSmmCompileResult out);
+
+/**
+* Frees memory taken by all previous compilations except the first chunk of
+* the allocator and starts a new LLVM context, since types and constants of
+* all generated modules stay in the old one until it is disposed.
+*/
+void smmContextReset(PSmmContext ctx);
+
+/**
+* Lexes and parses the given zero terminated source the way options say,
+* naming it options->moduleName. If lexerAllocator is given the lexer runs on
+* a separate thread and keeps tokens in it so it must not be freed before the
+* returned AST. Returns NULL if the source is empty.
+*/
+PSmmAst smmParseSource(char* src, PSmmCompileOptions options, PIbsAllocator lexerAllocator, PSmmMsgs msgs, PIbsAllocator a);
+
+/**
+* Parses the source as smmParseSource does and runs type inference and
+* semantic pass on it so the returned AST is ready for code generation
+* unless there were errors.
+*/
+PSmmAst smmCheckSource(char* src, PSmmCompileOptions options, PIbsAllocator lexerAllocator, PSmmMsgs msgs, PIbsAllocator a);
@@ -1,8 +1,12 @@
 #include "ibscommon.h"
 #include "smmlexer.h"
+#include "ibsscan.h"
+#include "ibsnumbers.h"
+#include "ibsthread.h"
 
 #include <assert.h>
 #include <string.h>
+#include <stdlib.h>
 #include <ctype.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -11,9 +15,15 @@
 #define STDIN_BUFFER_LENGTH 64 * 1024
 #define MAX_HEX_DIGITS 16
 #define MAX_OCTAL_DIGITS 21
+#define MIN_TOKEN_ARRAY_CAPACITY 1024
+// Smaller sources are always lexed on one thread
+#define PARALLEL_LEX_MIN_SIZE (1024 * 1024)
+#define PARALLEL_LEX_CHUNK_SIZE (256 * 1024)
+#define MAX_PARALLEL_LEX_CHUNKS 64
+#define LEX_CHUNK_ALLOCATOR_SIZE (1024 * 1024)
+// Number of tokens lexer thread can be ahead of the parser
+#define TOKEN_PIPE_CAPACITY 1024
 
-#define MAX_MANTISSA_FOR_FAST_CONVERSION 0x20000000000000
-#define MAX_EXP_FOR_FAST_CONVERSION 22
 
 static const char* tokenTypeToString[] = {
 	"identifier",
@@ -26,36 +36,98 @@ static const char* tokenTypeToString[] = {
 	"eof"
 };
 
-static char decimalSeparator;
 
-typedef enum {octalNumber = 3, hexNumber = 4} BinNumberKind;
 
 /********************************************************
 Type Definitions
 *********************************************************/
 
-struct Symbol {
+struct Keyword {
 	const char* name;
-	int kind;
+	uint32_t length;
+	uint32_t kind;
+};
+
+/**
+ * Perfect hash table of keywords indexed by keywordHash. Multipliers in the
+ * hash are chosen so that no two keywords fall into the same slot so if you
+ * add a keyword you must check that is still true or find new multipliers.
+ */
+static const struct Keyword keywords[32] = {
+	[2] = { "false", 5, tkSmmBool },
+	[7] = { "or", 2, tkSmmOrOp },
+	[8] = { "true", 4, tkSmmBool },
+	[9] = { "and", 3, tkSmmAndOp },
+	[12] = { "then", 4, tkSmmThen },
+	[16] = { "do", 2, tkSmmDo },
+	[17] = { "if", 2, tkSmmIf },
+	[19] = { "while", 5, tkSmmWhile },
+	[20] = { "div", 3, tkSmmIntDiv },
+	[21] = { "mod", 3, tkSmmIntMod },
+	[22] = { "not", 3, tkSmmNot },
+	[24] = { "xor", 3, tkSmmXorOp },
+	[25] = { "else", 4, tkSmmElse },
+	[26] = { "return", 6, tkSmmReturn },
 };
-typedef struct Symbol* PSymbol;
 
 struct PrivLexer {
 	struct SmmLexer lex;
 	PSmmMsgs msgs;
 	PIbsAllocator a;
-	PIbsAllocator tmpa; // Used for symTable allocations
 	void(*skipWhitespace)(const PSmmLexer);
-	PIbsDict symTable;
 };
 typedef struct PrivLexer* PPrivLexer;
 
+struct TokenArray {
+	PIbsAllocator a;
+	PSmmToken items;
+	uint32_t count;
+	uint32_t capacity;
+};
+
+/**
+ * Part of the source that is lexed on its own thread. It gets its own lexer,
+ * allocator and messages so nothing is shared while chunks are lexed.
+ */
+struct LexChunk {
+	struct PrivLexer privLex;
+	struct SmmMsgs msgs;
+	struct TokenArray tokens;
+	struct SmmToken guessToken; // Token we guess is in front of the chunk
+	PIbsAllocator a;
+	uint32_t start;
+	uint32_t end;
+};
+
+/**
+ * Item lexer thread passes to the consumer. Besides the token it hands over
+ * everything consumer needs to post its own messages and to merge lexer's.
+ */
+struct PipedToken {
+	struct SmmToken token;
+	const uint32_t* lineStarts; // Lexer's line starts when token was pushed
+	uint32_t lineCount;
+	struct SmmMsgs msgs; // Messages lexer posted while scanning the token
+};
+
+struct SmmTokenPipe {
+	PPrivLexer privLex;
+	PSmmMsgs msgs;
+	PIbsAllocator a;
+	PIbsSpscRing ring;
+	PIbsThread thread;
+	struct SmmLineIndex lines; // Line starts handed over so far which msgs use
+	struct SmmMsgs lexerMsgs; // Messages lexer thread posts
+	struct SmmToken lastPushed; // Copy of the last token lexer pushed
+	PSmmToken lastToken; // Last token consumer got
+	bool started;
+};
+
 /********************************************************
 Private Functions
 *********************************************************/
 
 static char moveFor(const PSmmLexer lex, int move) {
-	lex->filePos.lineOffset += move;
 	lex->curChar += move;
 	lex->scanCount += move;
 	return *lex->curChar;
@@ -65,30 +137,37 @@ static char nextChar(const PSmmLexer lex) {
 	return moveFor(lex, 1);
 }
 
-static void skipWhitespaceFromBuffer(const PSmmLexer lex) {
-	char cc = *lex->curChar;
-	bool thereMayBeMoreWhites;
-	do {
-		thereMayBeMoreWhites = false;
-		while (cc == '\t' || cc == ' ' || cc == '\v' || cc == '\f') {
-			cc = nextChar(lex);
-			thereMayBeMoreWhites = true;
-		}
-		if (cc == '/' && lex->curChar[1] == '/') {
-			while (cc != 0 && cc != '\n') {
-				cc = nextChar(lex);
-				thereMayBeMoreWhites = true;
+/**
+ * Moves lexer to the given end of whitespace adding starts of all the lines
+ * in it to the line index. Only if there are some \r chars we go char by
+ * char since both \r\n and \n\r count as one newline.
+ */
+static void moveOverWhitespace(const PSmmLexer lex, char* end) {
+	char* start = lex->curChar;
+	if (ibsScanCountChar(start, end, '\r') > 0) {
+		for (char* cc = start; cc < end; cc++) {
+			if (*cc == '\r' || *cc == '\n') {
+				if (cc + 1 < end && cc[0] + cc[1] == '\r' + '\n') cc++;
+				smmAddLineStart(&lex->lines, lex->scanCount + (uint32_t)(cc + 1 - start));
 			}
 		}
-		if (cc == 0) return;
-		if (cc == '\r' || cc == '\n') {
-			if (cc + lex->curChar[1] == '\r' + '\n') nextChar(lex);
-			cc = nextChar(lex);
-			lex->filePos.lineNumber++;
-			lex->filePos.lineOffset = 1;
-			thereMayBeMoreWhites = true;
+	} else {
+		char* cc = memchr(start, '\n', end - start);
+		while (cc) {
+			smmAddLineStart(&lex->lines, lex->scanCount + (uint32_t)(cc + 1 - start));
+			cc = memchr(cc + 1, '\n', end - cc - 1);
 		}
-	} while (thereMayBeMoreWhites);
+	}
+	lex->scanCount += (uint32_t)(end - start);
+	lex->curChar = end;
+}
+
+static void skipWhitespaceFromBuffer(const PSmmLexer lex) {
+	while (true) {
+		moveOverWhitespace(lex, (char*)ibsScanWhitespace(lex->curChar));
+		if (lex->curChar[0] != '/' || lex->curChar[1] != '/') return;
+		moveFor(lex, (int)((char*)ibsScanLineEnd(lex->curChar) - lex->curChar));
+	}
 }
 
 static void skipWhitespaceFromStdIn(const PSmmLexer lex) {
@@ -112,120 +191,113 @@ static void skipWhitespaceFromStdIn(const PSmmLexer lex) {
 			fgets(lex->buffer, STDIN_BUFFER_LENGTH, stdin);
 			lex->curChar = lex->buffer;
 			cc = *lex->curChar;
-			lex->filePos.lineNumber++;
-			lex->filePos.lineOffset = 1;
+			smmAddLineStart(&lex->lines, lex->scanCount);
 			thereMayBeMoreWhites = true;
 		}
 	} while (thereMayBeMoreWhites);
 }
 
 static void skipAlNum(PSmmLexer lex) {
-	char cc;
-	do {
-		cc = nextChar(lex);
-	} while (isalnum(cc));
+	moveFor(lex, (int)((char*)ibsScanAlNum(lex->curChar + 1) - lex->curChar));
 }
 
-static void initSymTableWithKeywords(PPrivLexer lex) {
-	static struct Symbol keywords[] = {
-		{ "div", tkSmmIntDiv },{ "mod", tkSmmIntMod },{ "not", tkSmmNot },
-		{ "and", tkSmmAndOp },{ "or", tkSmmOrOp },{ "xor", tkSmmXorOp },
-		{ "return", tkSmmReturn },{ "while", tkSmmWhile },{ "do", tkSmmDo },
-		{ "if", tkSmmIf },{ "then", tkSmmThen },{ "else", tkSmmElse },
-		{ "false", tkSmmBool },{ "true", tkSmmBool },
-	};
-
-	int count = sizeof(keywords) / sizeof(struct Symbol);
-	for (int i = 0; i < count; i++) {
-		ibsDictPut(lex->symTable, keywords[i].name, &keywords[i]);
-	}
+static uint32_t keywordHash(char first, char last, uint32_t length) {
+	return (first + (last << 2) + (length << 3)) & 31;
 }
 
 static bool parseIdent(PPrivLexer privLex, PSmmToken token) {
-	char* cc = privLex->lex.curChar;
-	char* ident = cc;
-	int i = 0;
-	do {
-		i++;
-	} while (isalnum(cc[i]));
-	cc += i;
+	char* ident = privLex->lex.curChar;
+	char* cc = (char*)ibsScanAlNum(ident + 1);
+	int i = (int)(cc - ident);
 	privLex->lex.curChar = cc;
-	privLex->lex.filePos.lineOffset += i;
 	privLex->lex.scanCount += i;
 
-	char oldChar = *cc;
-	*cc = 0;
-	PSymbol symbol = ibsDictGet(privLex->symTable, ident);
-	*cc = oldChar;
-	if (!symbol) {
-		symbol = ibsAlloc(privLex->a, sizeof(struct Symbol));
-		symbol->kind = tkSmmIdent;
-		char* name = ibsAlloc(privLex->a, i + 1);
-		strncpy(name, ident, i);
-		symbol->name = name;
-		ibsDictPut(privLex->symTable, name, symbol);
+	const struct Keyword* keyword = &keywords[keywordHash(ident[0], ident[i - 1], i)];
+	if (keyword->length == (uint32_t)i && memcmp(keyword->name, ident, i) == 0) {
+		token->kind = keyword->kind;
+		if (token->kind == tkSmmBool) {
+			token->boolVal = ident[0] == 't';
+		}
+		token->repr = keyword->name;
+		return true;
 	}
 
-	token->kind = symbol->kind;
-	if (token->kind == tkSmmBool) {
-		token->boolVal = ident[0] == 't';
-	}
-	token->repr = symbol->name;
+	PIbsAtomTable atoms = privLex->lex.atoms;
+	token->kind = tkSmmIdent;
+	token->atom = ibsAtomIntern(atoms, ident, i, ibsAtomHash(ident, i));
+	token->repr = ibsAtomName(atoms, token->atom);
 	return true;
 }
 
-static uint64_t parseBinNumber(PPrivLexer privLex, BinNumberKind bitsPerDigit) {
+static uint64_t parseOctalNumber(PPrivLexer privLex) {
 	PSmmLexer lex = &privLex->lex;
-	int64_t res = 0;
-	int digitsLeft = MAX_HEX_DIGITS;
-	int maxDigit = '9';
-	if (bitsPerDigit == octalNumber) {
-		digitsLeft = lex->curChar[0] == '1' ? MAX_OCTAL_DIGITS + 1 : MAX_OCTAL_DIGITS;
-		maxDigit = '7';
-	}
+	uint64_t res = 0;
+	int digitsLeft = lex->curChar[0] == '1' ? MAX_OCTAL_DIGITS + 1 : MAX_OCTAL_DIGITS;
 	char cc = *lex->curChar;
 	do {
-		if (cc >= '0' && cc <= maxDigit) {
-			res = (res << bitsPerDigit) + cc - '0';
-		} else if (bitsPerDigit == octalNumber && isalnum(cc)) {
-			smmPostMessage(privLex->msgs, errSmmInvalidDigit, lex->filePos, "octal");
+		if (cc >= '0' && cc <= '7') {
+			res = (res << 3) + cc - '0';
+		} else if (isalnum(cc)) {
+			smmPostMessage(privLex->msgs, errSmmInvalidDigit, lex->scanCount, "octal");
 			skipAlNum(lex);
 			return 0;
 		} else {
-			cc |= 0x20; //to lowercase
-			if (cc >= 'a' && cc <= 'f') {
-				res = (res << 4) + cc - 'a' + 10;
-			} else if (cc > 'f' && cc < 'z') {
-				smmPostMessage(privLex->msgs, errSmmInvalidDigit, lex->filePos, "hex");
-				skipAlNum(lex);
-				return 0;
-			} else {
-				break;
-			}
+			break;
 		}
 		cc = nextChar(lex);
 		digitsLeft--;
 	} while (digitsLeft > 0);
 
 	if (digitsLeft == 0 && isalnum(*lex->curChar)) {
-		smmPostMessage(privLex->msgs, errSmmIntTooBig, lex->filePos);
+		smmPostMessage(privLex->msgs, errSmmIntTooBig, lex->scanCount);
 		skipAlNum(lex);
 		return 0;
 	}
 	return res;
 }
 
+static uint64_t parseHexNumber(PPrivLexer privLex) {
+	PSmmLexer lex = &privLex->lex;
+	const char* start = lex->curChar;
+	int count = 0;
+	while (count <= MAX_HEX_DIGITS && isxdigit(start[count])) {
+		count++;
+	}
+	moveFor(lex, count > MAX_HEX_DIGITS ? MAX_HEX_DIGITS : count);
+	if (count >= MAX_HEX_DIGITS && isalnum(*lex->curChar)) {
+		smmPostMessage(privLex->msgs, errSmmIntTooBig, lex->scanCount);
+		skipAlNum(lex);
+		return 0;
+	}
+	char cc = *lex->curChar | 0x20; //to lowercase
+	if (cc > 'f' && cc < 'z') {
+		smmPostMessage(privLex->msgs, errSmmInvalidDigit, lex->scanCount, "hex");
+		skipAlNum(lex);
+		return 0;
+	}
+
+	// Now that we know where digits end we can convert 8 at a time
+	uint64_t res = 0;
+	int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		res = (res << 32) | ibsParseEightHexDigits(start + i);
+	}
+	for (; i < count; i++) {
+		cc = start[i] | 0x20;
+		res = (res << 4) + (cc <= '9' ? cc - '0' : cc - 'a' + 10);
+	}
+	return res;
+}
+
 static void parseNumber(PPrivLexer privLex, PSmmToken token) {
 	PSmmLexer lex = &privLex->lex;
 	token->kind = tkSmmUInt;
 	int i = 0;
-	char* dot = NULL;
 	while ('0' <= lex->curChar[i] && lex->curChar[i] <= '9') {
 		i++;
 	}
 	int sigDigits = i;
 	if (lex->curChar[i] == '.') {
-		dot = &lex->curChar[i];
 		token->kind = tkSmmFloat;
 		i++;
 		while ('0' <= lex->curChar[i] && lex->curChar[i] <= '9') {
@@ -233,7 +305,7 @@ static void parseNumber(PPrivLexer privLex, PSmmToken token) {
 		}
 		if (i - sigDigits == 1) {
 			// Non digit after dot
-			smmPostMessage(privLex->msgs, errSmmInvalidNumber, lex->filePos);
+			smmPostMessage(privLex->msgs, errSmmInvalidNumber, lex->scanCount);
 			moveFor(lex, i);
 			skipAlNum(lex);
 			return;
@@ -244,7 +316,7 @@ static void parseNumber(PPrivLexer privLex, PSmmToken token) {
 		i++;
 		if (lex->curChar[i] == '-' || lex->curChar[i] == '+') i++;
 		if (!('0' <= lex->curChar[i] && lex->curChar[i] <= '9')) {
-			smmPostMessage(privLex->msgs, errSmmInvalidFloatExponent, lex->filePos);
+			smmPostMessage(privLex->msgs, errSmmInvalidFloatExponent, lex->scanCount);
 			moveFor(lex, i);
 			skipAlNum(lex);
 			return;
@@ -255,17 +327,22 @@ static void parseNumber(PPrivLexer privLex, PSmmToken token) {
 	}
 
 	uint64_t res = 0;
-	char* pc = lex->curChar;
+	const char* pc = lex->curChar;
 	moveFor(lex, i);
 	if (token->kind == tkSmmUInt) {
 		if (sigDigits > 20) {
-			smmPostMessage(privLex->msgs, errSmmIntTooBig, lex->filePos);
+			smmPostMessage(privLex->msgs, errSmmIntTooBig, lex->scanCount);
 			return;
 		}
+		// 16 digits can't overflow so we convert them 8 at a time
+		for (int chunks = 0; chunks < 2 && lex->curChar - pc >= 8; chunks++) {
+			res = res * 100000000 + ibsParseEightDigits(pc);
+			pc += 8;
+		}
 		while (pc < lex->curChar) {
 			int d = *pc - '0';
 			if (res > ((UINT64_MAX - d) / 10)) {
-				smmPostMessage(privLex->msgs, errSmmIntTooBig, lex->filePos);
+				smmPostMessage(privLex->msgs, errSmmIntTooBig, lex->scanCount);
 				return;
 			}
 			res = res * 10 + d;
@@ -275,15 +352,10 @@ static void parseNumber(PPrivLexer privLex, PSmmToken token) {
 		return;
 	}
 
-	// We are here if it is float and we just use strtod since correctly parsing float is extremly complicated
-	// (even strtod on some compilers isn't completely correct). For more info read:
-	// http://www.exploringbinary.com/how-strtod-works-and-sometimes-doesnt/
-	char* end = NULL;
-	if (dot) *dot = decimalSeparator;
-	token->floatVal = strtod(pc, &end);
-	if (dot) *dot = '.';
+	const char* end = NULL;
+	token->floatVal = ibsParseDouble(pc, &end);
 	if (end != lex->curChar) {
-		smmPostMessage(privLex->msgs, errSmmInvalidNumber, lex->filePos);
+		smmPostMessage(privLex->msgs, errSmmInvalidNumber, lex->scanCount);
 	}
 }
 
@@ -292,33 +364,41 @@ static void parseZeroNumber(PPrivLexer privLex, PSmmToken token) {
 	PSmmLexer lex = &privLex->lex;
 	if (lex->curChar[1] == 'x') {
 		moveFor(lex, 2);
-		token->uintVal = parseBinNumber(privLex, hexNumber);
+		token->uintVal = parseHexNumber(privLex);
 	} else if (lex->curChar[1] == '.') {
 		parseNumber(privLex, token);
 	} else if ('1' <= lex->curChar[1] && lex->curChar[1] <= '7') {
 		nextChar(lex);
-		token->uintVal = parseBinNumber(privLex, octalNumber);
+		token->uintVal = parseOctalNumber(privLex);
 	} else if (!isalnum(lex->curChar[1])) {
 		// It is just 0
 		nextChar(lex);
 	} else {
-		smmPostMessage(privLex->msgs, errSmmInvalid0Number, lex->filePos);
+		smmPostMessage(privLex->msgs, errSmmInvalid0Number, lex->scanCount);
 		skipAlNum(lex);
 	}
 }
 
+/**
+ * Returns true if token of the given kind can end an operand so minus after
+ * it is a binary operator and not a sign of a number.
+ */
+static bool isOperandEnd(uint32_t kind) {
+	switch (kind) {
+	case tkSmmBool: case tkSmmErr: case tkSmmFloat: case tkSmmIdent:
+	case tkSmmInt: case tkSmmUInt: case ')':
+		return true;
+	default: return false;
+	}
+}
+
 static bool isUnaryOpOnNumber(PPrivLexer privLex) {
 	char* cc = privLex->lex.curChar;
 	while (*cc == '\t' || *cc == ' ' || *cc == '\v' || *cc == '\f') {
 		cc++;
 	}
 	if (!isdigit(*cc)) return false;
-	switch (privLex->lex.lastToken->kind) {
-	case tkSmmBool: case tkSmmErr: case tkSmmFloat: case tkSmmIdent:
-	case tkSmmInt: case tkSmmUInt: case ')':
-		return false;
-	default: return true;
-	}
+	return !privLex->lex.lastToken || !isOperandEnd(privLex->lex.lastToken->kind);
 }
 
 static char* parseEscapeChar(PPrivLexer privLex, char* str) {
@@ -338,7 +418,7 @@ static char* parseEscapeChar(PPrivLexer privLex, char* str) {
 	case 'x':
 		if (!isxdigit(lex->curChar[1]) || !isxdigit(lex->curChar[2])) {
 			*str = '?';
-			smmPostMessage(privLex->msgs, errSmmBadStringEscape, lex->filePos);
+			smmPostMessage(privLex->msgs, errSmmBadStringEscape, lex->scanCount);
 		} else {
 			nextChar(lex);
 			char r = lex->curChar[0] < 'A' ? lex->curChar[0] - '0' : (lex->curChar[0] | 0x20) - 'a' + 10;
@@ -364,7 +444,7 @@ static char* parseEscapeChar(PPrivLexer privLex, char* str) {
 		}
 		break;
 	default:
-		smmPostMessage(privLex->msgs, errSmmBadStringEscape, lex->filePos);
+		smmPostMessage(privLex->msgs, errSmmBadStringEscape, lex->scanCount);
 		*str = '?';
 		break;
 	}
@@ -382,16 +462,7 @@ API Functions
 * "Enter - CTRL+Z - Enter" on Windows and CTRL+D on *nix systems
 */
 PSmmLexer smmCreateLexer(char* buffer, const char* filename, PSmmMsgs msgs, PIbsAllocator a) {
-	if (!decimalSeparator) {
-		char* end = NULL;
-		if (strtod("0,5", &end) == 0.5) decimalSeparator = ',';
-		else decimalSeparator = '.';
-	}
-
 	PPrivLexer privLex = ibsAlloc(a, sizeof(struct PrivLexer));
-	char symaName[1004] = { 'l', 'e', 'x' };
-	strncpy(&symaName[3], filename, 1000);
-	privLex->tmpa = ibsSimpleAllocatorCreate(symaName, a->size);
 
 	if (!buffer) {
 		buffer = ibsAlloc(a, STDIN_BUFFER_LENGTH);
@@ -399,41 +470,34 @@ PSmmLexer smmCreateLexer(char* buffer, const char* filename, PSmmMsgs msgs, PIbs
 		privLex->skipWhitespace = skipWhitespaceFromStdIn;
 	} else {
 		privLex->skipWhitespace = skipWhitespaceFromBuffer;
-		privLex->lex.filePos.filename = filename;
+		privLex->lex.lines.filename = filename;
 	}
 	privLex->msgs = msgs;
 	privLex->a = a;
 	privLex->lex.buffer = buffer;
 	privLex->lex.curChar = buffer;
-	privLex->lex.filePos.lineNumber = 1;
-	privLex->lex.filePos.lineOffset = 1;
-	privLex->symTable = ibsDictCreate(privLex->tmpa);
-	initSymTableWithKeywords(privLex);
+	privLex->lex.lines.a = a;
+	smmAddLineStart(&privLex->lex.lines, 0);
+	msgs->lines = &privLex->lex.lines;
+	privLex->lex.atoms = ibsAtomTableCreate(a);
 	return &privLex->lex;
 }
 
-PSmmToken smmGetNextToken(PSmmLexer lex) {
-	PPrivLexer privLex = (PPrivLexer)lex;
-	uint32_t lastLine = lex->filePos.lineNumber;
-	privLex->skipWhitespace(lex);
-	if (lex->curChar[0] == 0 && lex->lastToken->kind == tkSmmEof) {
-		return lex->lastToken;
-	}
-	PIbsAllocator a = privLex->a;
-
-	uint64_t pos = lex->scanCount;
-	PSmmToken token = ibsAlloc(a, sizeof(struct SmmToken));
-	token->filePos = lex->filePos;
+/**
+ * Scans the token at current position, after whitespace was skipped, into
+ * given zeroed token.
+ */
+static void scanToken(PPrivLexer privLex, PSmmToken token, uint32_t lastLineCount) {
+	PSmmLexer lex = &privLex->lex;
+	token->offset = lex->scanCount;
 	// It should be false for first token on first line, but true for first token on following lines
-	token->isFirstOnLine = lastLine != lex->filePos.lineNumber;
+	token->isFirstOnLine = lastLineCount != lex->lines.count;
 	char* firstChar = lex->curChar;
 
 	switch (*firstChar) {
 	case 0:
 		token->kind = tkSmmEof;
-		ibsSimpleAllocatorFree(privLex->tmpa);
-		privLex->tmpa = NULL;
-		return token;
+		return;
 	case '-':
 		nextChar(lex);
 		if (lex->curChar[0] == '>') {
@@ -453,7 +517,7 @@ PSmmToken smmGetNextToken(PSmmLexer lex) {
 			if (token->kind == tkSmmUInt) {
 				token->kind = tkSmmInt;
 				if (token->uintVal > 0x8000000000000000) {
-					smmPostMessage(privLex->msgs, errSmmIntTooBig, token->filePos);
+					smmPostMessage(privLex->msgs, errSmmIntTooBig, token->offset);
 				}
 				if (token->uintVal == 0x8000000000000000) token->sintVal = INT64_MIN;
 				else token->sintVal = -(int64_t)token->uintVal;
@@ -517,7 +581,7 @@ PSmmToken smmGetNextToken(PSmmLexer lex) {
 			token->sintVal = soSmmCollapseIdent;
 			nextChar(lex);
 		} else {
-			smmPostMessage(privLex->msgs, errSmmInvalidCharacter, lex->filePos);
+			smmPostMessage(privLex->msgs, errSmmInvalidCharacter, lex->scanCount);
 		}
 		break;
 	case '0':
@@ -534,22 +598,314 @@ PSmmToken smmGetNextToken(PSmmLexer lex) {
 		if (isalpha(*firstChar)) {
 			parseIdent(privLex, token);
 		} else {
-			smmPostMessage(privLex->msgs, errSmmInvalidCharacter, lex->filePos);
+			smmPostMessage(privLex->msgs, errSmmInvalidCharacter, lex->scanCount);
 			nextChar(lex);
 		}
 		break;
 	}
 
-	if (!token->repr) {
-		int cnt = (int)(lex->scanCount - pos);
-		char* repr = ibsAlloc(privLex->a, cnt + 1);
-		strncpy(repr, firstChar, cnt);
-		token->repr = repr;
+	// Identifiers and keywords already point to zero terminated names
+	if (!token->repr) token->repr = firstChar;
+	token->length = lex->scanCount - token->offset;
+}
+
+static PSmmToken newArrayToken(struct TokenArray* tokens) {
+	if (tokens->count == tokens->capacity) {
+		// Allocator can't grow blocks in place so we just copy to a twice bigger one
+		uint32_t newCapacity = tokens->capacity ? tokens->capacity * 2 : MIN_TOKEN_ARRAY_CAPACITY;
+		PSmmToken newItems = ibsAllocTagged(tokens->a, newCapacity * sizeof(struct SmmToken), "token array");
+		if (tokens->count) memcpy(newItems, tokens->items, tokens->count * sizeof(struct SmmToken));
+		tokens->items = newItems;
+		tokens->capacity = newCapacity;
+	}
+	return &tokens->items[tokens->count++];
+}
+
+/**
+ * Adds tokens to the array until eof or until a token would start at or
+ * after the end offset. If startsOnNewLine is true the first token is
+ * marked as first on line even if there is no newline in front of it.
+ */
+static void tokenizeRange(PPrivLexer privLex, struct TokenArray* tokens, uint32_t end, bool startsOnNewLine) {
+	PSmmLexer lex = &privLex->lex;
+	uint32_t lastLineCount = startsOnNewLine ? UINT32_MAX : lex->lines.count;
+	while (true) {
+		privLex->skipWhitespace(lex);
+		if (lex->scanCount >= end) return;
+		PSmmToken token = newArrayToken(tokens);
+		scanToken(privLex, token, lastLineCount);
+		// Previous token decides if minus is a binary operator or part of a number
+		lex->lastToken = token;
+		if (token->kind == tkSmmEof) return;
+		lastLineCount = lex->lines.count;
+	}
+}
+
+/**
+ * Returns the offset of the first line start after the given offset or size
+ * if there is no such line. Lines starting with \r are skipped because \n\r
+ * counts as a single newline.
+ */
+static uint32_t findChunkStart(const char* buffer, uint32_t offset, uint32_t size) {
+	while (offset < size) {
+		const char* nl = memchr(&buffer[offset], '\n', size - offset);
+		if (!nl) return size;
+		offset = (uint32_t)(nl - buffer) + 1;
+		if (buffer[offset] != '\r') return offset;
+	}
+	return size;
+}
+
+static void lexChunk(void* data, uint32_t index) {
+	struct LexChunk* chunk = &((struct LexChunk*)data)[index];
+	tokenizeRange(&chunk->privLex, &chunk->tokens, chunk->end, index > 0);
+}
+
+/**
+ * Every chunk but the first is lexed guessing that it starts on a new line
+ * after a token that doesn't end an operand. Returns false if tokens before
+ * the chunk show that the guess was wrong.
+ */
+static bool isChunkGuessRight(PSmmLexer lex, struct TokenArray* tokens, struct LexChunk* chunk) {
+	PSmmToken last = tokens->count ? &tokens->items[tokens->count - 1] : NULL;
+	// Newline in front of the chunk must not be a part of the previous token
+	if (last && last->offset + last->length >= chunk->start) return false;
+	if (smmGetFilePos(&lex->lines, chunk->start).lineOffset != 1) return false;
+	if (chunk->tokens.count == 0) return true;
+	PSmmToken first = &chunk->tokens.items[0];
+	bool isSignedNumber = (first->kind == tkSmmInt || first->kind == tkSmmFloat || first->kind == tkSmmErr)
+		&& first->repr[0] == '-';
+	return !isSignedNumber || !last || !isOperandEnd(last->kind);
+}
+
+/**
+ * Appends tokens, line starts and messages of a correctly guessed chunk.
+ * Identifiers from the chunk are interned in the lexer's atom table in the
+ * order they first appeared so atoms are the same as if lexed sequentially.
+ */
+static void appendChunk(PPrivLexer privLex, struct TokenArray* tokens, struct LexChunk* chunk) {
+	PSmmLexer lex = &privLex->lex;
+	PIbsAtomTable chunkAtoms = chunk->privLex.lex.atoms;
+	uint32_t* atomMap = ibsAlloc(chunk->a, chunkAtoms->count * sizeof(uint32_t));
+	for (uint32_t i = 1; i < chunkAtoms->count; i++) {
+		atomMap[i] = ibsAtomIntern(lex->atoms, chunkAtoms->names[i], chunkAtoms->lengths[i], chunkAtoms->hashes[i]);
+	}
+	for (uint32_t i = 0; i < chunk->tokens.count; i++) {
+		PSmmToken token = newArrayToken(tokens);
+		*token = chunk->tokens.items[i];
+		if (token->kind == tkSmmIdent) {
+			token->atom = atomMap[token->atom];
+			token->repr = ibsAtomName(lex->atoms, token->atom);
+		}
+	}
+
+	PSmmLineIndex chunkLines = &chunk->privLex.lex.lines;
+	for (uint32_t i = 1; i < chunkLines->count; i++) {
+		// Whitespace at the end of a chunk is also skipped by the next one
+		if (chunkLines->starts[i] > lex->lines.starts[lex->lines.count - 1]) {
+			smmAddLineStart(&lex->lines, chunkLines->starts[i]);
+		}
+	}
+
+	uint32_t lineDelta = smmGetFilePos(&lex->lines, chunk->start).lineNumber - 1;
+	smmMoveMessages(privLex->msgs, &chunk->msgs, lineDelta);
+}
+
+/**
+ * Lexes the chunk again starting from the end of the last token we have.
+ * Line starts after that token are removed since lexer will add them again.
+ */
+static void relexChunk(PPrivLexer privLex, struct TokenArray* tokens, struct LexChunk* chunk) {
+	PSmmLexer lex = &privLex->lex;
+	PSmmToken last = tokens->count ? &tokens->items[tokens->count - 1] : NULL;
+	uint32_t start = last ? last->offset + last->length : 0;
+	while (lex->lines.count > 1 && lex->lines.starts[lex->lines.count - 1] > start) {
+		lex->lines.count--;
 	}
-	lex->lastToken = token;
+	lex->curChar = lex->buffer + start;
+	lex->scanCount = start;
+	lex->lastToken = last;
+	tokenizeRange(privLex, tokens, chunk->end, false);
+}
+
+/**
+ * Splits the buffer on line starts and lexes the chunks in parallel, each
+ * with its own allocator, atom table, line index and messages. Contents of
+ * string literals are not scanned here so the only state that crosses lines
+ * is the previous token. Each chunk guesses it and if the guess turns out
+ * wrong while chunks are stitched together in order that chunk is lexed
+ * again. If the buffer can't be split nothing is added to tokens.
+ */
+static void tokenizeInParallel(PPrivLexer privLex, struct TokenArray* tokens, uint32_t size) {
+	PSmmLexer lex = &privLex->lex;
+	uint32_t chunkCount = size / PARALLEL_LEX_CHUNK_SIZE;
+	if (chunkCount > MAX_PARALLEL_LEX_CHUNKS) chunkCount = MAX_PARALLEL_LEX_CHUNKS;
+	uint32_t chunkSize = size / chunkCount;
+	struct LexChunk* chunks = ibsAlloc(privLex->a, chunkCount * sizeof(struct LexChunk));
+	uint32_t count = 0;
+	uint32_t start = 0;
+	for (uint32_t i = 1; i < chunkCount; i++) {
+		uint32_t end = findChunkStart(lex->buffer, i * chunkSize > start ? i * chunkSize : start, size);
+		if (end >= size) break;
+		chunks[count].start = start;
+		chunks[count].end = end;
+		count++;
+		start = end;
+	}
+	if (count == 0) return;
+	chunks[count].start = start;
+	chunks[count].end = UINT32_MAX;
+	count++;
+
+	// Allocators and scan functions set some global state when they are first
+	// used so we prepare everything before other threads start
+	ibsScanGetImpl();
+	for (uint32_t i = 0; i < count; i++) {
+		struct LexChunk* chunk = &chunks[i];
+		chunk->a = ibsChunkedAllocatorCreate("lexer chunk", LEX_CHUNK_ALLOCATOR_SIZE);
+		chunk->msgs.a = chunk->a;
+		chunk->msgs.lines = &chunk->privLex.lex.lines;
+		chunk->tokens.a = chunk->a;
+		chunk->guessToken.kind = ';';
+		PPrivLexer chunkLex = &chunk->privLex;
+		chunkLex->msgs = &chunk->msgs;
+		chunkLex->a = chunk->a;
+		chunkLex->skipWhitespace = skipWhitespaceFromBuffer;
+		chunkLex->lex.buffer = lex->buffer;
+		chunkLex->lex.curChar = lex->buffer + chunk->start;
+		chunkLex->lex.scanCount = chunk->start;
+		chunkLex->lex.lastToken = i > 0 ? &chunk->guessToken : NULL;
+		chunkLex->lex.lines.a = chunk->a;
+		chunkLex->lex.lines.filename = lex->lines.filename;
+		smmAddLineStart(&chunkLex->lex.lines, chunk->start);
+		chunkLex->lex.atoms = ibsAtomTableCreate(chunk->a);
+	}
+
+	ibsParallelFor(count, 0, lexChunk, chunks);
+
+	for (uint32_t i = 0; i < count; i++) {
+		if (i == 0 || isChunkGuessRight(lex, tokens, &chunks[i])) {
+			appendChunk(privLex, tokens, &chunks[i]);
+		} else {
+			relexChunk(privLex, tokens, &chunks[i]);
+		}
+		ibsSimpleAllocatorFree(chunks[i].a);
+	}
+	lex->curChar = lex->buffer + size;
+	lex->scanCount = size;
+}
+
+/**
+ * Lexes the next token and pushes it to the pipe. Returns false after eof
+ * is pushed.
+ */
+static bool pushNextToken(PSmmTokenPipe pipe) {
+	PPrivLexer privLex = pipe->privLex;
+	PSmmLexer lex = &privLex->lex;
+	uint32_t lastLineCount = lex->lines.count;
+	privLex->skipWhitespace(lex);
+	struct PipedToken* item = ibsSpscRingPushStart(pipe->ring);
+	memset(item, 0, sizeof(struct PipedToken));
+	scanToken(privLex, &item->token, lastLineCount);
+	// Item belongs to consumer once it is pushed so lexer keeps its own copy
+	pipe->lastPushed = item->token;
+	lex->lastToken = &pipe->lastPushed;
+	item->lineStarts = lex->lines.starts;
+	item->lineCount = lex->lines.count;
+	item->msgs = pipe->lexerMsgs;
+	pipe->lexerMsgs.items = NULL;
+	pipe->lexerMsgs.errorCount = pipe->lexerMsgs.warningCount = pipe->lexerMsgs.hintCount = 0;
+	ibsSpscRingPushEnd(pipe->ring);
+	return pipe->lastPushed.kind != tkSmmEof;
+}
+
+static void lexerThreadMain(void* data) {
+	while (pushNextToken(data));
+}
+
+PSmmToken smmGetNextToken(PSmmLexer lex) {
+	PPrivLexer privLex = (PPrivLexer)lex;
+	uint32_t lastLineCount = lex->lines.count;
+	privLex->skipWhitespace(lex);
+	if (lex->curChar[0] == 0 && lex->lastToken->kind == tkSmmEof) {
+		return lex->lastToken;
+	}
+
+	PSmmToken token = ibsAllocTagged(privLex->a, sizeof(struct SmmToken), "token");
+	scanToken(privLex, token, lastLineCount);
+	if (token->kind != tkSmmEof) lex->lastToken = token;
 	return token;
 }
 
+PSmmToken smmTokenize(PSmmLexer lex, PIbsAllocator a, uint32_t* count) {
+	PPrivLexer privLex = (PPrivLexer)lex;
+	struct TokenArray tokens = { a };
+	if (privLex->skipWhitespace == skipWhitespaceFromBuffer && lex->scanCount == 0) {
+		size_t size = strlen(lex->curChar);
+		if (size >= PARALLEL_LEX_MIN_SIZE && size < UINT32_MAX) {
+			tokenizeInParallel(privLex, &tokens, (uint32_t)size);
+		}
+	}
+	if (tokens.count == 0) tokenizeRange(privLex, &tokens, UINT32_MAX, false);
+	lex->lastToken = &tokens.items[tokens.count - 1];
+	*count = tokens.count;
+	return tokens.items;
+}
+
+PSmmTokenPipe smmCreateTokenPipe(PSmmLexer lex, PSmmMsgs msgs, PIbsAllocator lexerAllocator, PIbsAllocator a) {
+	assert(!lex->lastToken && "Lexer already returned some tokens");
+	PPrivLexer privLex = (PPrivLexer)lex;
+	PSmmTokenPipe pipe = ibsAlloc(a, sizeof(struct SmmTokenPipe));
+	pipe->privLex = privLex;
+	pipe->msgs = msgs;
+	pipe->a = a;
+	pipe->ring = ibsSpscRingCreate(sizeof(struct PipedToken), TOKEN_PIPE_CAPACITY, a);
+
+	// From now on lexer uses only its own allocator, line index and messages
+	privLex->a = lexerAllocator;
+	lex->atoms = ibsAtomTableCreate(lexerAllocator);
+	lex->lines.a = lexerAllocator;
+	pipe->lexerMsgs.a = lexerAllocator;
+	pipe->lexerMsgs.lines = &lex->lines;
+	privLex->msgs = &pipe->lexerMsgs;
+
+	pipe->lines.a = a;
+	pipe->lines.filename = lex->lines.filename;
+	smmAddLineStart(&pipe->lines, 0);
+	msgs->lines = &pipe->lines;
+	return pipe;
+}
+
+PSmmToken smmGetNextPipedToken(PSmmTokenPipe pipe) {
+	if (pipe->lastToken && pipe->lastToken->kind == tkSmmEof) return pipe->lastToken;
+	if (!pipe->started) {
+		pipe->started = true;
+		pipe->thread = ibsThreadStart(lexerThreadMain, pipe);
+	}
+	// If thread couldn't be started we lex each token just before we take it
+	if (!pipe->thread) pushNextToken(pipe);
+
+	struct PipedToken* item = ibsSpscRingPopStart(pipe->ring);
+	for (uint32_t i = pipe->lines.count; i < item->lineCount; i++) {
+		smmAddLineStart(&pipe->lines, item->lineStarts[i]);
+	}
+	if (item->msgs.items) smmMoveMessages(pipe->msgs, &item->msgs, 0);
+	PSmmToken token = ibsAllocTagged(pipe->a, sizeof(struct SmmToken), "token");
+	*token = item->token;
+	ibsSpscRingPopEnd(pipe->ring);
+
+	if (token->kind == tkSmmEof && pipe->thread) {
+		ibsThreadJoin(pipe->thread);
+		pipe->thread = NULL;
+	}
+	pipe->lastToken = token;
+	return token;
+}
+
+void smmCloseTokenPipe(PSmmTokenPipe pipe) {
+	while (smmGetNextPipedToken(pipe)->kind != tkSmmEof);
+}
+
 PSmmToken smmGetNextStringToken(PSmmLexer lex, char termChar, SmmStringParseOption option) {
 	PPrivLexer privLex = (PPrivLexer)lex;
 	if (lex->curChar[0] == 0 && lex->lastToken->kind == tkSmmEof) {
@@ -558,19 +914,35 @@ PSmmToken smmGetNextStringToken(PSmmLexer lex, char termChar, SmmStringParseOpti
 	PIbsAllocator a = privLex->a;
 
 	int identSize = -1;
-	uint64_t pos = lex->scanCount;
-	PSmmToken token = ibsAlloc(a, sizeof(struct SmmToken));
-	token->filePos = lex->filePos;
-	char* str = (char*)ibsStartAlloc(privLex->tmpa);
+	PSmmToken token = ibsAllocTagged(a, sizeof(struct SmmToken), "token");
+	token->offset = lex->scanCount;
+	// Decoded string is never longer than its source so we can allocate it upfront
+	char* end = (char*)ibsScanStringPart(lex->curChar, termChar);
+	while (*end && *end != termChar) {
+		if (*end == '\\' && end[1] && (termChar == '"' || end[1] == termChar)) end++;
+		end = (char*)ibsScanStringPart(end + 1, termChar);
+	}
+	char* str = ibsAllocTagged(a, end - lex->curChar + 1, "string literal");
 	token->stringVal = str;
 	char* firstChar = lex->curChar;
 	while (*lex->curChar && *lex->curChar != termChar) {
+		if (option != soSmmCollapseWhitespace) {
+			// Copy everything up to the next char that needs special handling at once
+			char* partEnd = (char*)ibsScanStringPart(lex->curChar, termChar);
+			size_t partLength = partEnd - lex->curChar;
+			if (partLength > 0) {
+				memcpy(str, lex->curChar, partLength);
+				str += partLength;
+				moveFor(lex, (int)partLength);
+				continue;
+			}
+		}
 		if (*lex->curChar == '\\' && (termChar == '"' || lex->curChar[1] == termChar)) {
 			nextChar(lex);
 			str = parseEscapeChar(privLex, str);
 		} else if (*lex->curChar == '\n' || *lex->curChar == '\r') {
 			if (option == soSmmCollapseWhitespace) {
-				if (str[-1] != ' ') {
+				if (str == token->stringVal || str[-1] != ' ') {
 					*str = ' ';
 					str++;
 				}
@@ -581,8 +953,7 @@ PSmmToken smmGetNextStringToken(PSmmLexer lex, char termChar, SmmStringParseOpti
 			if (lex->curChar[0] + lex->curChar[1] == '\n' + '\r') {
 				nextChar(lex);
 			}
-			lex->filePos.lineNumber++;
-			lex->filePos.lineOffset = 0;
+			smmAddLineStart(&lex->lines, lex->scanCount + 1);
 			if (option == soSmmCollapseIdent) {
 				if (identSize == -1) {
 					identSize = 0;
@@ -597,7 +968,7 @@ PSmmToken smmGetNextStringToken(PSmmLexer lex, char termChar, SmmStringParseOpti
 				}
 			}
 		} else if (option == soSmmCollapseWhitespace && isspace(*lex->curChar)) {
-			if (str[-1] != ' ') {
+			if (str == token->stringVal || str[-1] != ' ') {
 				*str = ' ';
 				str++;
 			}
@@ -610,32 +981,35 @@ PSmmToken smmGetNextStringToken(PSmmLexer lex, char termChar, SmmStringParseOpti
 		}
 		nextChar(lex);
 	}
-	size_t length = str + 1 - token->stringVal;
-	str = ibsAlloc(a, length);
-	strncpy(str, token->stringVal, length);
-	memset(token->stringVal, 0, length);
-	token->stringVal = str;
-	ibsEndAlloc(privLex->tmpa, 0);
 	
 	if (!*lex->curChar) {
-		smmPostMessage(privLex->msgs, errSmmUnclosedString, token->filePos, token->filePos.lineNumber);
+		uint32_t lineNumber = smmGetFilePos(&lex->lines, token->offset).lineNumber;
+		smmPostMessage(privLex->msgs, errSmmUnclosedString, token->offset, lineNumber);
 	}
 	token->kind = tkSmmString;
-	int cnt = (int)(lex->scanCount - pos);
-	char* repr = ibsAlloc(privLex->a, cnt + 1);
-	strncpy(repr, firstChar, cnt);
-	token->repr = repr;
+	token->repr = firstChar;
+	token->length = lex->scanCount - token->offset;
 	return token;
 }
 
 /**
-* Given the token and 4 element buffer returns token's string representation.
-* The buffer is needed in case token is a single character token so we can just
-* put "<quote>char<quote><null>" into the buffer and return it.
+* Given the token and SMM_TOKEN_STRING_BUF_SIZE element buffer returns token's
+* string representation. The buffer is needed in case token is a single
+* character token so we can just put "<quote>char<quote><null>" into the buffer
+* and return it or if it is a literal whose repr is not zero terminated so we
+* copy it into the buffer, shortening it if it doesn't fit.
 */
 const char* smmTokenToString(PSmmToken token, char* buf) {
 	if ((token->kind >= tkSmmInt && token->kind <= tkSmmBool) || token->kind == tkSmmErr) {
-		return token->repr;
+		uint32_t length = token->length;
+		if (length >= SMM_TOKEN_STRING_BUF_SIZE) {
+			length = SMM_TOKEN_STRING_BUF_SIZE - 4;
+			strcpy(&buf[length], "...");
+		} else {
+			buf[length] = 0;
+		}
+		memcpy(buf, token->repr, length);
+		return buf;
 	}
 	if (token->kind > 255) {
 		return tokenTypeToString[token->kind - 256];
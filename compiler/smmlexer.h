@@ -14,7 +14,10 @@
 
 #include "smmmsgs.h"
 #include "ibsallocator.h"
-#include "ibsdictionary.h"
+#include "ibsatomtable.h"
+
+// Size of the buffer smmTokenToString needs
+#define SMM_TOKEN_STRING_BUF_SIZE 64
 
 /********************************************************
 Type Definitions
@@ -46,18 +49,28 @@ typedef struct SmmToken* PSmmToken;
 struct SmmLexer {
 	char* buffer;
 	char* curChar;
-	uint64_t scanCount;
+	uint32_t scanCount; // Offset of curChar from the start of the source
 	PSmmToken lastToken;
-	struct SmmFilePos filePos;
+	struct SmmLineIndex lines;
+	PIbsAtomTable atoms; // All identifiers are interned here
 };
 typedef struct SmmLexer* PSmmLexer;
 
+/**
+* Token is a 32 byte record. Text and literal value are kept in the token
+* itself rather than in a side table since AST nodes point to their tokens
+* and all passes read and rewrite names and values through that pointer.
+*/
 struct SmmToken {
-	uint32_t kind;
-	uint32_t isFirstOnLine : 1;
-	uint32_t canBeNewSymbol : 1;
+	uint16_t kind;
+	uint16_t isFirstOnLine : 1;
+	uint16_t canBeNewSymbol : 1;
+	uint32_t atom; // Set only for identifiers and points to the same string as repr
+	// Text of the token. Only names of identifiers and keywords are zero terminated,
+	// for other tokens it points into the source buffer so length must be used.
 	const char* repr;
-	struct SmmFilePos filePos;
+	uint32_t length;
+	uint32_t offset; // Use smmGetFilePos with lexer's lines to get line and column
 	union {
 		char* stringVal;
 		uint64_t uintVal;
@@ -71,11 +84,47 @@ struct SmmToken {
 /**
 * Returns a new instance of SmmLexer that will scan the given buffer or stdin
 * if given buffer is null. When scanning stdin end of file is signaled using
-* "Enter, CTRL+Z, Enter" on Windows and CTRL+D on *nix systems
+* "Enter, CTRL+Z, Enter" on Windows and CTRL+D on *nix systems. Given buffer
+* must be zero terminated and lexer never writes to it so it can be read only.
 */
 PSmmLexer smmCreateLexer(char* buffer, const char* filename, PSmmMsgs msgs, PIbsAllocator a);
 
 PSmmToken smmGetNextToken(PSmmLexer lex);
 PSmmToken smmGetNextStringToken(PSmmLexer lex, char termChar, SmmStringParseOption option);
 
+/**
+* Scans the whole input in one go and returns a contiguous array of all the
+* tokens that smmGetNextToken would return, ending with tkSmmEof token.
+* Contents of string literals are not scanned since that is only done on
+* request by smmGetNextStringToken. Token array is taken from the given
+* allocator and it must live as long as anything that points to its tokens.
+*/
+PSmmToken smmTokenize(PSmmLexer lex, PIbsAllocator a, uint32_t* count);
+
+typedef struct SmmTokenPipe* PSmmTokenPipe;
+
+/**
+* Prepares lexing on a separate thread that passes tokens to the consumer
+* through a lock free ring of limited size so lexing can overlap with
+* parsing. Thread starts when the first token is requested so nothing else
+* may intern atoms in lexer's atom table after that. From now on lexer only
+* uses lexerAllocator which must live as long as identifier names are used.
+* Lexer thread posts messages to its own list and line index and they are
+* handed over to msgs, whose line index is replaced by the pipe's own copy,
+* as tokens are taken. Given lexer must not have returned any tokens yet.
+*/
+PSmmTokenPipe smmCreateTokenPipe(PSmmLexer lex, PSmmMsgs msgs, PIbsAllocator lexerAllocator, PIbsAllocator a);
+
+/**
+* Returns the next token lexer thread produced, waiting for it if needed.
+* Tokens are copied out of the ring into allocator given to the pipe.
+*/
+PSmmToken smmGetNextPipedToken(PSmmTokenPipe pipe);
+
+/**
+* Takes all the remaining tokens so all lexer messages are handed over and
+* lexer thread is finished.
+*/
+void smmCloseTokenPipe(PSmmTokenPipe pipe);
+
 const char* smmTokenToString(PSmmToken token, char* buf);
@@ -5,13 +5,18 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
 
 struct SmmLLVMCodeGenData {
+	PSmmAst ast;
+	LLVMContextRef context; // Never shared between threads so modules can be generated in parallel
 	LLVMModuleRef llvmModule;
-	PIbsDict localVars;
+	PIbsSymTable localVars;
+	PIbsDict funcs; // Keyed by mangled function names
 	LLVMBuilderRef builder;
 	LLVMValueRef curFunc;
 	LLVMBasicBlockRef endBlock; // Used for logical expressions
+	PIbsAllocator scratch; // For data needed only while one call or function is generated
 };
 typedef struct SmmLLVMCodeGenData* PSmmLLVMCodeGenData;
 
@@ -26,19 +31,19 @@ struct LogicalExprData {
 };
 typedef struct LogicalExprData* PLogicalExprData;
 
-static LLVMValueRef processExpression(PSmmLLVMCodeGenData data, PSmmAstNode expr, PIbsAllocator a);
-static void processBlock(PSmmLLVMCodeGenData data, PSmmAstBlockNode block, PIbsAllocator a);
-static void processStatement(PSmmLLVMCodeGenData data, PSmmAstNode stmt, PIbsAllocator a);
+static LLVMValueRef processExpression(PSmmLLVMCodeGenData data, SmmAstNode expr, PIbsAllocator a);
+static void processBlock(PSmmLLVMCodeGenData data, SmmAstNode block, PIbsAllocator a);
+static void processStatement(PSmmLLVMCodeGenData data, SmmAstNode stmt, PIbsAllocator a);
 
-static LLVMTypeRef getLLVMType(PSmmTypeInfo type) {
-	if (!type) return LLVMVoidType();
+static LLVMTypeRef getLLVMType(PSmmLLVMCodeGenData data, PSmmTypeInfo type) {
 	switch (type->kind) {
+	case tiSmmNone: return LLVMVoidTypeInContext(data->context);
 	case tiSmmInt8: case tiSmmInt16: case tiSmmInt32: case tiSmmInt64:
 	case tiSmmUInt8: case tiSmmUInt16: case tiSmmUInt32: case tiSmmUInt64:
-		return LLVMIntType(type->sizeInBytes << 3);
-	case tiSmmFloat32: return LLVMFloatType();
-	case tiSmmFloat64: return LLVMDoubleType();
-	case tiSmmBool: return LLVMInt1Type();
+		return LLVMIntTypeInContext(data->context, type->sizeInBytes << 3);
+	case tiSmmFloat32: return LLVMFloatTypeInContext(data->context);
+	case tiSmmFloat64: return LLVMDoubleTypeInContext(data->context);
+	case tiSmmBool: return LLVMInt1TypeInContext(data->context);
 	default:
 		// custom types should be handled here
 		assert(false && "Custom types are not yet supported");
@@ -50,16 +55,16 @@ static LLVMValueRef getCastInstruction(PSmmLLVMCodeGenData data, PSmmTypeInfo dt
 	if (dtype->isInt && stype->isFloat) {
 		//if dest is int and node is float
 		if (dtype->isUnsigned) {
-			return LLVMBuildFPToUI(data->builder, val, getLLVMType(dtype), "");
+			return LLVMBuildFPToUI(data->builder, val, getLLVMType(data, dtype), "");
 		}
-		return LLVMBuildFPToSI(data->builder, val, getLLVMType(dtype), "");
+		return LLVMBuildFPToSI(data->builder, val, getLLVMType(data, dtype), "");
 	}
 	if ((dtype->isFloat) && (stype->isInt)) {
 		//if dest is float and node is int
 		if (stype->isUnsigned) {
-			return LLVMBuildUIToFP(data->builder, val, getLLVMType(dtype), "");
+			return LLVMBuildUIToFP(data->builder, val, getLLVMType(data, dtype), "");
 		}
-		return LLVMBuildSIToFP(data->builder, val, getLLVMType(dtype), "");
+		return LLVMBuildSIToFP(data->builder, val, getLLVMType(data, dtype), "");
 	}
 
 	bool dstIsInt = dtype->isInt || dtype->isBool;
@@ -67,72 +72,78 @@ static LLVMValueRef getCastInstruction(PSmmLLVMCodeGenData data, PSmmTypeInfo dt
 	bool differentSize = dtype->sizeInBytes != stype->sizeInBytes || dtype->kind == tiSmmBool;
 	if (dstIsInt && srcIsInt && differentSize) {
 		if ((stype->isUnsigned && dtype->sizeInBytes > stype->sizeInBytes) || stype->kind == tiSmmBool) {
-			return LLVMBuildZExt(data->builder, val, getLLVMType(dtype), "");
+			return LLVMBuildZExt(data->builder, val, getLLVMType(data, dtype), "");
 		}
-		return LLVMBuildIntCast(data->builder, val, getLLVMType(dtype), "");
+		return LLVMBuildIntCast(data->builder, val, getLLVMType(data, dtype), "");
 	}
 
 	if (dtype->isFloat && stype->isFloat && dtype->sizeInBytes != stype->sizeInBytes) {
-		return LLVMBuildFPCast(data->builder, val, getLLVMType(dtype), "");
+		return LLVMBuildFPCast(data->builder, val, getLLVMType(data, dtype), "");
 	}
 
 	return val;
 }
 
-static LLVMValueRef processAndOrInstr(PLogicalExprData ledata, PSmmAstNode node,
+static LLVMValueRef processAndOrInstr(PLogicalExprData ledata, SmmAstNode node,
 		LLVMBasicBlockRef trueBlock, LLVMBasicBlockRef falseBlock, PIbsAllocator a) {
-	LLVMBasicBlockRef newRightBlock = LLVMInsertBasicBlock(ledata->lastCreatedBlock, "");
+	PSmmAst ast = ledata->data->ast;
+	LLVMBasicBlockRef newRightBlock = LLVMInsertBasicBlockInContext(ledata->data->context, ledata->lastCreatedBlock, "");
 	LLVMBasicBlockRef prevLastBlock = ledata->lastCreatedBlock;
 	ledata->lastCreatedBlock = newRightBlock;
 	LLVMBasicBlockRef nextTrue = trueBlock;
 	LLVMBasicBlockRef nextFalse = falseBlock;
 
-	if (node->kind == nkSmmAndOp) {
+	if (ast->kinds[node] == nkSmmAndOp) {
 		nextTrue = newRightBlock;
 	} else {
 		nextFalse = newRightBlock;
 	}
 
 	LLVMValueRef left = NULL;
-	switch (node->left->kind) {
-	case nkSmmAndOp: case nkSmmOrOp: left = processAndOrInstr(ledata, node->left, nextTrue, nextFalse, a); break;
-	default: left = processExpression(ledata->data, node->left, a); break;
+	switch (ast->kinds[ast->lefts[node]]) {
+	case nkSmmAndOp: case nkSmmOrOp: left = processAndOrInstr(ledata, ast->lefts[node], nextTrue, nextFalse, a); break;
+	default: left = processExpression(ledata->data, ast->lefts[node], a); break;
 	}
 
 	LLVMBuildCondBr(ledata->data->builder, left, nextTrue, nextFalse);
 	if (ledata->data->endBlock == nextTrue || ledata->data->endBlock == nextFalse) {
 		if (ledata->blockCount >= MAX_LOGICAL_EXPR_DEPTH - 1) { // We are leaving one for the end block
 			char msg[500] = { 0 };
-			snprintf(msg, 500, "Logical expression at %s:%d too complicated", node->token->filePos.filename, node->token->filePos.lineNumber);
+			size_t nameLength;
+			const char* moduleName = LLVMGetModuleIdentifier(ledata->data->llvmModule, &nameLength);
+			snprintf(msg, 500, "Logical expression at %.*s offset %u too complicated", (int)nameLength, moduleName, ast->tokens[node]->offset);
 			smmAbortWithMessage(msg, __FILE__, __LINE__);
 		}
 		ledata->incomeBlocks[ledata->blockCount] = LLVMGetInsertBlock(ledata->data->builder);
-		ledata->incomeValues[ledata->blockCount] = LLVMConstInt(LLVMInt1Type(), ledata->data->endBlock == nextTrue, false);
+		ledata->incomeValues[ledata->blockCount] = LLVMConstInt(LLVMInt1TypeInContext(ledata->data->context), ledata->data->endBlock == nextTrue, false);
 		ledata->blockCount++;
 	}
 
 	LLVMPositionBuilderAtEnd(ledata->data->builder, newRightBlock);
 	ledata->lastCreatedBlock = prevLastBlock;
 
-	switch (node->right->kind) {
+	switch (ast->kinds[ast->rights[node]]) {
 	case nkSmmAndOp: case nkSmmOrOp:
-		return processAndOrInstr(ledata, node->right, trueBlock, falseBlock, a);
-	default: return processExpression(ledata->data, node->right, a);
+		return processAndOrInstr(ledata, ast->rights[node], trueBlock, falseBlock, a);
+	default: return processExpression(ledata->data, ast->rights[node], a);
 	}
 }
 
-static LLVMValueRef processExpression(PSmmLLVMCodeGenData data, PSmmAstNode expr, PIbsAllocator a) {
+static LLVMValueRef processExpression(PSmmLLVMCodeGenData data, SmmAstNode expr, PIbsAllocator a) {
 	assert(LLVMFRem - LLVMAdd == nkSmmFRem - nkSmmAdd);
+	PSmmAst ast = data->ast;
 	LLVMValueRef res = NULL;
+	PSmmTypeInfo type = &builtInTypes[ast->types[expr]];
+	PSmmToken token = ast->tokens[expr];
 
-	switch (expr->kind) {
+	switch (ast->kinds[expr]) {
 	case nkSmmAdd: case nkSmmFAdd: case nkSmmSub: case nkSmmFSub:
 	case nkSmmMul: case nkSmmFMul: case nkSmmUDiv: case nkSmmSDiv: case nkSmmFDiv:
 	case nkSmmURem: case nkSmmSRem: case nkSmmFRem:
 		{
-			LLVMValueRef left = processExpression(data, expr->left, a);
-			LLVMValueRef right = processExpression(data, expr->right, a);
-			res = LLVMBuildBinOp(data->builder, expr->kind - nkSmmAdd + LLVMAdd, left, right, "");
+			LLVMValueRef left = processExpression(data, ast->lefts[expr], a);
+			LLVMValueRef right = processExpression(data, ast->rights[expr], a);
+			res = LLVMBuildBinOp(data->builder, ast->kinds[expr] - nkSmmAdd + LLVMAdd, left, right, "");
 			break;
 		}
 	case nkSmmAndOp: case nkSmmOrOp:
@@ -140,9 +151,9 @@ static LLVMValueRef processExpression(PSmmLLVMCodeGenData data, PSmmAstNode expr
 			// We initialize data.endBlock with new block
 			LLVMBasicBlockRef lastEndBlock = data->endBlock;
 			if (lastEndBlock) {
-				data->endBlock = LLVMInsertBasicBlock(lastEndBlock, "");
+				data->endBlock = LLVMInsertBasicBlockInContext(data->context, lastEndBlock, "");
 			} else {
-				data->endBlock = LLVMAppendBasicBlock(data->curFunc, "");
+				data->endBlock = LLVMAppendBasicBlockInContext(data->context, data->curFunc, "");
 			}
 			struct LogicalExprData logicalExprData = { data, data->endBlock };
 
@@ -153,7 +164,7 @@ static LLVMValueRef processExpression(PSmmLLVMCodeGenData data, PSmmAstNode expr
 			LLVMBuildBr(data->builder, data->endBlock);
 
 			LLVMPositionBuilderAtEnd(data->builder, data->endBlock);
-			res = LLVMBuildPhi(data->builder, LLVMInt1Type(), "");
+			res = LLVMBuildPhi(data->builder, LLVMInt1TypeInContext(data->context), "");
 			LLVMAddIncoming(res, logicalExprData.incomeValues, logicalExprData.incomeBlocks, logicalExprData.blockCount);
 
 			data->endBlock = lastEndBlock;
@@ -163,21 +174,22 @@ static LLVMValueRef processExpression(PSmmLLVMCodeGenData data, PSmmAstNode expr
 	case nkSmmXorOp:
 	case nkSmmEq: case nkSmmNotEq: case nkSmmGt: case nkSmmGtEq: case nkSmmLt: case nkSmmLtEq:
 		{
-			LLVMValueRef left = processExpression(data, expr->left, a);
-			LLVMValueRef right = processExpression(data, expr->right, a);
-			if (expr->left->type->isInt || expr->left->type->kind == tiSmmBool) {
+			LLVMValueRef left = processExpression(data, ast->lefts[expr], a);
+			LLVMValueRef right = processExpression(data, ast->rights[expr], a);
+			PSmmTypeInfo leftType = &builtInTypes[ast->types[ast->lefts[expr]]];
+			if (leftType->isInt || leftType->kind == tiSmmBool) {
 				LLVMIntPredicate op;
-				if (expr->kind == nkSmmXorOp) op = LLVMIntNE;
+				if (ast->kinds[expr] == nkSmmXorOp) op = LLVMIntNE;
 				else {
-					op = expr->kind - nkSmmEq + LLVMIntEQ;
-					if (op >= LLVMIntUGT && !expr->left->type->isUnsigned) {
+					op = ast->kinds[expr] - nkSmmEq + LLVMIntEQ;
+					if (op >= LLVMIntUGT && !leftType->isUnsigned) {
 						op = op - LLVMIntUGT + LLVMIntSGT;
 					}
 				}
 				res = LLVMBuildICmp(data->builder, op, left, right, "");
-			} else if (expr->left->type->isFloat) {
+			} else if (leftType->isFloat) {
 				LLVMRealPredicate op = LLVMRealUNE; // For '!=', it can't be xor here because we add != 0 on float operands for xor
-				switch (expr->kind) {
+				switch (ast->kinds[expr]) {
 				case nkSmmEq: op = LLVMRealOEQ; break;
 				case nkSmmGt: op = LLVMRealOGT; break;
 				case nkSmmGtEq: op = LLVMRealOGE; break;
@@ -196,64 +208,64 @@ static LLVMValueRef processExpression(PSmmLLVMCodeGenData data, PSmmAstNode expr
 		}
 	case nkSmmNeg:
 		{
-			LLVMValueRef operand = processExpression(data, expr->left, a);
+			LLVMValueRef operand = processExpression(data, ast->lefts[expr], a);
 			res = LLVMBuildNeg(data->builder, operand, ""); 
 			break;
 		}
 	case nkSmmNot:
 		{
-			LLVMValueRef operand = processExpression(data, expr->left, a);
+			LLVMValueRef operand = processExpression(data, ast->lefts[expr], a);
 			res = LLVMBuildNot(data->builder, operand, "");
 			break;
 		}
 	case nkSmmCast:
 		{
-			LLVMValueRef operand = processExpression(data, expr->left, a);
-			res = getCastInstruction(data, expr->type, expr->left->type, operand);
+			LLVMValueRef operand = processExpression(data, ast->lefts[expr], a);
+			res = getCastInstruction(data, type, &builtInTypes[ast->types[ast->lefts[expr]]], operand);
 			break;
 		}
 	case nkSmmCall:
 		{
-			PSmmAstCallNode callNode = (PSmmAstCallNode)expr;
-			LLVMValueRef func = ibsDictGet(data->localVars, callNode->token->stringVal);
+			LLVMValueRef func = ibsDictGet(data->funcs, token->stringVal);
 			LLVMValueRef* args = NULL;
 			size_t argCount = 0;
-			if (callNode->params) {
-				argCount = callNode->params->count;
-				PSmmAstNode astArg = callNode->args;
-				args = ibsAlloc(a, argCount * sizeof(args[0]));
+			struct IbsAllocatorMark mark = ibsMark(data->scratch);
+			argCount = ast->extras[ast->args[expr]];
+			if (argCount > 0) {
+				SmmAstNode* astArgs = &ast->extras[ast->args[expr] + 1];
+				args = ibsAlloc(data->scratch, argCount * sizeof(args[0]));
 				for (size_t i = 0; i < argCount; i++) {
-					args[i] = processExpression(data, astArg, a);
-					astArg = astArg->next;
+					args[i] = processExpression(data, astArgs[i], a);
 				}
 			}
 			res = LLVMBuildCall(data->builder, func, args, (unsigned)argCount, "");
+			ibsRelease(data->scratch, mark);
 			break;
 		}
 	case nkSmmParam: case nkSmmIdent:
-		res = ibsDictGet(data->localVars, expr->token->repr);
+		res = ibsSymTableGet(data->localVars, token->atom);
 		res = LLVMBuildLoad(data->builder, res, "");
-		LLVMSetAlignment(res, expr->type->sizeInBytes);
+		LLVMSetAlignment(res, type->sizeInBytes);
 		break;
 	case nkSmmConst:
-		res = ibsDictGet(data->localVars, expr->token->repr);
+		res = ibsSymTableGet(data->localVars, token->atom);
 		break;
 	case nkSmmInt:
 		{
-			bool signExtend = !expr->type->isUnsigned;
-			LLVMTypeRef intType = LLVMIntType(expr->type->sizeInBytes << 3);
-			res = LLVMConstInt(intType, expr->token->uintVal, signExtend);
+			bool signExtend = !type->isUnsigned;
+			LLVMTypeRef intType = LLVMIntTypeInContext(data->context, type->sizeInBytes << 3);
+			res = LLVMConstInt(intType, token->uintVal, signExtend);
 			break;
 		}
 	case nkSmmFloat:
-		if (expr->type->kind == tiSmmFloat32) {
-			res = LLVMConstReal(LLVMFloatType(), expr->token->floatVal);
+		if (type->kind == tiSmmFloat32) {
+			res = LLVMConstReal(LLVMFloatTypeInContext(data->context), token->floatVal);
 		} else {
-			res = LLVMConstReal(LLVMDoubleType(), expr->token->floatVal);
+			res = LLVMConstReal(LLVMDoubleTypeInContext(data->context), token->floatVal);
 		}
 		break;
 	case nkSmmBool:
-		res = LLVMConstInt(LLVMInt1Type(), expr->token->boolVal, false);
+		res = LLVMConstInt(LLVMInt1TypeInContext(data->context), token->boolVal, false);
 		break;
 	default:
 		assert(false && "Got unexpected node type in processExpression");
@@ -262,238 +274,272 @@ static LLVMValueRef processExpression(PSmmLLVMCodeGenData data, PSmmAstNode expr
 	return res;
 }
 
-static void processLocalSymbols(PSmmLLVMCodeGenData data, PSmmAstDeclNode decl, PIbsAllocator a) {
+static void processLocalSymbols(PSmmLLVMCodeGenData data, SmmAstNode decl, PIbsAllocator a) {
+	PSmmAst ast = data->ast;
 	while (decl) {
-		LLVMTypeRef type = getLLVMType(decl->left->type);
-
-		LLVMValueRef var = NULL;
-		PSmmToken varToken = decl->left->left->token;
-
-		if (decl->left->left->kind == nkSmmIdent) {
-			var = LLVMBuildAlloca(data->builder, type, varToken->repr);
-			LLVMSetAlignment(var, decl->left->left->type->sizeInBytes);
-		} else if (decl->left->left->kind == nkSmmConst) {
-			var = processExpression(data, decl->left->right, a);
+		SmmAstNode assignment = ast->lefts[decl];
+		SmmAstNode var = ast->lefts[assignment];
+		LLVMTypeRef type = getLLVMType(data, &builtInTypes[ast->types[assignment]]);
+
+		LLVMValueRef llvmVar = NULL;
+		PSmmToken varToken = ast->tokens[var];
+
+		if (ast->kinds[var] == nkSmmIdent) {
+			llvmVar = LLVMBuildAlloca(data->builder, type, varToken->repr);
+			LLVMSetAlignment(llvmVar, builtInTypes[ast->types[var]].sizeInBytes);
+		} else if (ast->kinds[var] == nkSmmConst) {
+			llvmVar = processExpression(data, ast->rights[assignment], a);
 		} else {
 			assert(false && "Declaration of unknown node kind");
 		}
 
-		ibsDictPut(data->localVars, varToken->repr, var);
+		ibsSymTableBind(data->localVars, varToken->atom, llvmVar);
 
-		decl = decl->nextDecl;
+		decl = ast->nextDecls[decl];
 	}
 }
 
-static void processAssignment(PSmmLLVMCodeGenData data, PSmmAstNode stmt, PIbsAllocator a) {
-	LLVMValueRef val = processExpression(data, stmt->right, a);
-	LLVMValueRef left = ibsDictGet(data->localVars, stmt->left->token->repr);
+static void processAssignment(PSmmLLVMCodeGenData data, SmmAstNode stmt, PIbsAllocator a) {
+	PSmmAst ast = data->ast;
+	SmmAstNode lval = ast->lefts[stmt];
+	LLVMValueRef val = processExpression(data, ast->rights[stmt], a);
+	LLVMValueRef left = ibsSymTableGet(data->localVars, ast->tokens[lval]->atom);
 	LLVMValueRef res = LLVMBuildStore(data->builder, val, left);
-	LLVMSetAlignment(res, stmt->left->type->sizeInBytes);
+	LLVMSetAlignment(res, builtInTypes[ast->types[lval]].sizeInBytes);
 }
 
-static void processReturn(PSmmLLVMCodeGenData data, PSmmAstNode stmt, PIbsAllocator a) {
-	if (stmt->left) {
-		LLVMValueRef val = processExpression(data, stmt->left, a);
+static void processReturn(PSmmLLVMCodeGenData data, SmmAstNode stmt, PIbsAllocator a) {
+	SmmAstNode expr = data->ast->lefts[stmt];
+	if (expr) {
+		LLVMValueRef val = processExpression(data, expr, a);
 		LLVMBuildRet(data->builder, val);
 	} else LLVMBuildRetVoid(data->builder);
 }
 
-static void processIf(PSmmLLVMCodeGenData data, PSmmAstIfWhileNode stmt, PIbsAllocator a) {
-	LLVMBasicBlockRef trueBlock = LLVMAppendBasicBlock(data->curFunc, "if.then");
+static void processIf(PSmmLLVMCodeGenData data, SmmAstNode stmt, PIbsAllocator a) {
+	PSmmAst ast = data->ast;
+	SmmAstNode cond = ast->conds[stmt];
+	SmmAstNode* branches = &ast->extras[ast->branches[stmt]];
+	LLVMBasicBlockRef trueBlock = LLVMAppendBasicBlockInContext(data->context, data->curFunc, "if.then");
 	LLVMBasicBlockRef falseBlock;
 	LLVMBasicBlockRef endBlock;
-	if (stmt->elseBody) {
-		falseBlock = LLVMAppendBasicBlock(data->curFunc, "if.else");
-		endBlock = LLVMAppendBasicBlock(data->curFunc, "if.end");
+	if (branches[1]) {
+		falseBlock = LLVMAppendBasicBlockInContext(data->context, data->curFunc, "if.else");
+		endBlock = LLVMAppendBasicBlockInContext(data->context, data->curFunc, "if.end");
 	} else {
-		falseBlock = LLVMAppendBasicBlock(data->curFunc, "if.end");
+		falseBlock = LLVMAppendBasicBlockInContext(data->context, data->curFunc, "if.end");
 		endBlock = falseBlock;
 	}
 	LLVMValueRef res;
 	data->endBlock = trueBlock;
-	if (stmt->cond->kind == nkSmmAndOp || stmt->cond->kind == nkSmmOrOp) {
+	if (ast->kinds[cond] == nkSmmAndOp || ast->kinds[cond] == nkSmmOrOp) {
 		struct LogicalExprData logicalExprData = { data, data->endBlock };
-		res = processAndOrInstr(&logicalExprData, stmt->cond, trueBlock, falseBlock, a);
+		res = processAndOrInstr(&logicalExprData, cond, trueBlock, falseBlock, a);
 	} else {
-		res = processExpression(data, stmt->cond, a);
+		res = processExpression(data, cond, a);
 	}
 	data->endBlock = NULL;
 	LLVMBuildCondBr(data->builder, res, trueBlock, falseBlock);
 
 	LLVMPositionBuilderAtEnd(data->builder, trueBlock);
 
-	processStatement(data, stmt->body, a);
+	processStatement(data, branches[0], a);
 	LLVMBuildBr(data->builder, falseBlock);
 	LLVMPositionBuilderAtEnd(data->builder, falseBlock);
-	if (stmt->elseBody) {
-		processStatement(data, stmt->elseBody, a);
+	if (branches[1]) {
+		processStatement(data, branches[1], a);
 		LLVMBuildBr(data->builder, endBlock);
 		LLVMPositionBuilderAtEnd(data->builder, endBlock);
 	}
 }
 
-static void processWhile(PSmmLLVMCodeGenData data, PSmmAstIfWhileNode stmt, PIbsAllocator a) {
-	LLVMBasicBlockRef condBlock = LLVMAppendBasicBlock(data->curFunc, "while.cond");
-	LLVMBasicBlockRef trueBlock = LLVMAppendBasicBlock(data->curFunc, "while.body");
-	LLVMBasicBlockRef falseBlock = LLVMAppendBasicBlock(data->curFunc, "while.end");
+static void processWhile(PSmmLLVMCodeGenData data, SmmAstNode stmt, PIbsAllocator a) {
+	PSmmAst ast = data->ast;
+	SmmAstNode cond = ast->conds[stmt];
+	LLVMBasicBlockRef condBlock = LLVMAppendBasicBlockInContext(data->context, data->curFunc, "while.cond");
+	LLVMBasicBlockRef trueBlock = LLVMAppendBasicBlockInContext(data->context, data->curFunc, "while.body");
+	LLVMBasicBlockRef falseBlock = LLVMAppendBasicBlockInContext(data->context, data->curFunc, "while.end");
 	LLVMBuildBr(data->builder, condBlock);
 	LLVMPositionBuilderAtEnd(data->builder, condBlock);
 	LLVMValueRef res;
 	data->endBlock = trueBlock; // We initialize data.endBlock with new block
-	if (stmt->cond->kind == nkSmmAndOp || stmt->cond->kind == nkSmmOrOp) {
+	if (ast->kinds[cond] == nkSmmAndOp || ast->kinds[cond] == nkSmmOrOp) {
 		struct LogicalExprData logicalExprData = { data, data->endBlock };
-		res = processAndOrInstr(&logicalExprData, stmt->cond, trueBlock, falseBlock, a);
+		res = processAndOrInstr(&logicalExprData, cond, trueBlock, falseBlock, a);
 	} else {
-		res = processExpression(data, stmt->cond, a);
+		res = processExpression(data, cond, a);
 	}
 	data->endBlock = NULL;
 	LLVMBuildCondBr(data->builder, res, trueBlock, falseBlock);
 
 	LLVMPositionBuilderAtEnd(data->builder, trueBlock);
 
-	processStatement(data, stmt->body, a);
+	processStatement(data, ast->extras[ast->branches[stmt]], a);
 	LLVMBuildBr(data->builder, condBlock);
 	LLVMPositionBuilderAtEnd(data->builder, falseBlock);
 }
 
-static void processStatement(PSmmLLVMCodeGenData data, PSmmAstNode stmt, PIbsAllocator a) {
-	switch (stmt->kind) {
+static void processStatement(PSmmLLVMCodeGenData data, SmmAstNode stmt, PIbsAllocator a) {
+	PSmmAst ast = data->ast;
+	switch (ast->kinds[stmt]) {
 	case nkSmmBlock:
 		{
-			PSmmAstBlockNode newBlock = (PSmmAstBlockNode)stmt;
-			processLocalSymbols(data, newBlock->scope->decls, a);
-			processBlock(data, newBlock, a);
+			uint32_t scopeMark = ibsSymTableMark(data->localVars);
+			processLocalSymbols(data, ast->decls[ast->scopes[stmt]], a);
+			processBlock(data, stmt, a);
+			ibsSymTableRestore(data->localVars, scopeMark);
 			break;
 		}
 	case nkSmmAssignment: processAssignment(data, stmt, a); break;
-	case nkSmmIf: processIf(data, &stmt->asIfWhile, a); break;
-	case nkSmmWhile: processWhile(data, &stmt->asIfWhile, a); break;
+	case nkSmmIf: processIf(data, stmt, a); break;
+	case nkSmmWhile: processWhile(data, stmt, a); break;
 	case nkSmmDecl:
-		if (stmt->left->left->asIdent.level == 0) {
-			LLVMTypeRef type = getLLVMType(stmt->left->type);
-			LLVMValueRef globalVar = LLVMAddGlobal(data->llvmModule, type, stmt->left->left->token->repr);
-			LLVMSetGlobalConstant(globalVar, false);
-			LLVMSetInitializer(globalVar, processExpression(data, stmt->left->right, a));
-		} else {
-			processAssignment(data, stmt->left, a);
+		{
+			SmmAstNode assignment = ast->lefts[stmt];
+			SmmAstNode var = ast->lefts[assignment];
+			if (ast->levels[var] == 0) {
+				LLVMTypeRef type = getLLVMType(data, &builtInTypes[ast->types[assignment]]);
+				LLVMValueRef globalVar = LLVMAddGlobal(data->llvmModule, type, ast->tokens[var]->repr);
+				LLVMSetGlobalConstant(globalVar, false);
+				LLVMSetInitializer(globalVar, processExpression(data, ast->rights[assignment], a));
+			} else {
+				processAssignment(data, assignment, a);
+			}
+			break;
 		}
-		break;
 	case nkSmmReturn: processReturn(data, stmt, a); break;
 	default:
 		processExpression(data, stmt, a); break;
 	}
 }
 
-static void processBlock(PSmmLLVMCodeGenData data, PSmmAstBlockNode block, PIbsAllocator a) {
-	PSmmAstNode stmt = block->stmts;
-	while (stmt) {
-		processStatement(data, stmt, a);
-		stmt = stmt->next;
+static void processBlock(PSmmLLVMCodeGenData data, SmmAstNode block, PIbsAllocator a) {
+	uint32_t stmtCount = data->ast->extras[data->ast->stmts[block]];
+	SmmAstNode* stmts = &data->ast->extras[data->ast->stmts[block] + 1];
+	for (uint32_t i = 0; i < stmtCount; i++) {
+		processStatement(data, stmts[i], a);
 	}
 }
 
-static LLVMValueRef createFunc(PSmmLLVMCodeGenData data, PSmmAstFuncDefNode astFunc, PIbsAllocator a) {
-	LLVMTypeRef returnType = getLLVMType(astFunc->returnType);
+static LLVMValueRef createFunc(PSmmLLVMCodeGenData data, SmmAstNode astFunc) {
+	PSmmAst ast = data->ast;
+	LLVMTypeRef returnType = getLLVMType(data, &builtInTypes[ast->types[astFunc]]);
 	LLVMTypeRef* params = NULL;
 	size_t paramsCount = 0;
-	if (astFunc->params) {
-		PSmmAstParamNode param = astFunc->params;
-		paramsCount = param->count;
-		params = ibsAlloc(a, paramsCount * sizeof(LLVMTypeRef));
+	struct IbsAllocatorMark mark = ibsMark(data->scratch);
+	paramsCount = ast->extras[ast->params[astFunc]];
+	if (paramsCount > 0) {
+		SmmAstNode* astParams = &ast->extras[ast->params[astFunc] + 1];
+		params = ibsAlloc(data->scratch, paramsCount * sizeof(LLVMTypeRef));
 		for (size_t i = 0; i < paramsCount; i++) {
-			params[i] = getLLVMType(param->type);
-			param = param->next;
+			params[i] = getLLVMType(data, &builtInTypes[ast->types[astParams[i]]]);
 		}
 	}
 	LLVMTypeRef funcType = LLVMFunctionType(returnType, params, (unsigned)paramsCount, false);
-	LLVMValueRef func = LLVMAddFunction(data->llvmModule, astFunc->token->stringVal, funcType);
-	ibsDictPush(data->localVars, astFunc->token->stringVal, func);
+	ibsRelease(data->scratch, mark);
+	const char* name = ast->tokens[astFunc]->stringVal;
+	LLVMValueRef func = LLVMAddFunction(data->llvmModule, name, funcType);
+	ibsDictPush(data->funcs, name, func);
 	return func;
 }
 
-static void processGlobalSymbols(PSmmLLVMCodeGenData data, PSmmAstDeclNode decl, PIbsAllocator a) {
+static void processGlobalSymbols(PSmmLLVMCodeGenData data, SmmAstNode decl, PIbsAllocator a) {
+	PSmmAst ast = data->ast;
 	while (decl) {
+		SmmAstNode declared = ast->lefts[decl];
 
-		if (decl->left->kind == nkSmmFunc) {
-			PSmmAstFuncDefNode funcNode = (PSmmAstFuncDefNode)decl->left;
+		if (ast->flags[declared] & nfSmmLazyBody) {
+			// Body was never parsed because func is never called so we don't need it at all
+		} else if (ast->kinds[declared] == nkSmmFunc) {
+			LLVMValueRef func = createFunc(data, declared);
+			SmmAstNode body = ast->bodies[declared];
 
-			LLVMValueRef func = createFunc(data, (PSmmAstFuncDefNode)decl->left, a);
-
-			if (funcNode->body) {
+			if (body) {
 				LLVMBasicBlockRef prevBlock = LLVMGetInsertBlock(data->builder);
 				LLVMValueRef prevFunc = data->curFunc;
 				data->curFunc = func;
-				LLVMBasicBlockRef entry = LLVMAppendBasicBlock(func, "entry");
+				LLVMBasicBlockRef entry = LLVMAppendBasicBlockInContext(data->context, func, "entry");
 				LLVMPositionBuilderAtEnd(data->builder, entry);
 				size_t paramsCount = 0;
 				LLVMValueRef* paramAllocs = NULL;
 				LLVMValueRef* paramVals = NULL;
+				struct IbsAllocatorMark mark = ibsMark(data->scratch);
+				uint32_t scopeMark = ibsSymTableMark(data->localVars);
 
-				if (funcNode->params) {
-					paramsCount = funcNode->params->count;
-					paramAllocs = ibsAlloc(a, paramsCount * sizeof(LLVMValueRef));
-					paramVals = ibsAlloc(a, paramsCount * sizeof(LLVMValueRef));
+				paramsCount = ast->extras[ast->params[declared]];
+				if (paramsCount > 0) {
+					SmmAstNode* astParams = &ast->extras[ast->params[declared] + 1];
+					paramAllocs = ibsAlloc(data->scratch, paramsCount * sizeof(LLVMValueRef));
+					paramVals = ibsAlloc(data->scratch, paramsCount * sizeof(LLVMValueRef));
 					LLVMGetParams(func, paramVals);
-					PSmmAstParamNode param = funcNode->params;
 					for (size_t i = 0; i < paramsCount; i++) {
-						LLVMSetValueName(paramVals[i], param->token->repr);
+						PSmmToken paramToken = ast->tokens[astParams[i]];
+						LLVMSetValueName(paramVals[i], paramToken->repr);
 						paramAllocs[i] = LLVMBuildAlloca(data->builder, LLVMTypeOf(paramVals[i]), "");
-						ibsDictPush(data->localVars, param->token->repr, paramAllocs[i]);
-						param = param->next;
+						ibsSymTableBind(data->localVars, paramToken->atom, paramAllocs[i]);
 					}
 				}
 
-				processLocalSymbols(data, funcNode->body->scope->decls, a);
+				processLocalSymbols(data, ast->decls[ast->scopes[body]], a);
 				if (paramsCount > 0) {
 					for (size_t i = 0; i < paramsCount; i++) {
 						LLVMBuildStore(data->builder, paramVals[i], paramAllocs[i]);
 					}
 				}
 
-				processBlock(data, funcNode->body, a);
+				processBlock(data, body, a);
 
-				PSmmAstParamNode param = funcNode->params;
-				while (param) {
-					ibsDictPop(data->localVars, param->token->repr);
-					param = param->next;
-				}
+				ibsSymTableRestore(data->localVars, scopeMark);
 
 				LLVMPositionBuilderAtEnd(data->builder, prevBlock);
 				data->curFunc = prevFunc;
+				ibsRelease(data->scratch, mark);
 
 				LLVMVerifyFunction(func, LLVMPrintMessageAction);
 			}
-		} else if (decl->left->kind == nkSmmConst) {
-			assert(decl->left->right && "Global var must have initializer");
-			LLVMValueRef globalConst = processExpression(data, decl->left->right, a);
+		} else if (ast->kinds[declared] == nkSmmConst) {
+			assert(ast->rights[declared] && "Global var must have initializer");
+			LLVMValueRef globalConst = processExpression(data, ast->rights[declared], a);
 
-			PSmmToken varToken = decl->left->token;
-			ibsDictPut(data->localVars, varToken->repr, globalConst);
+			PSmmToken varToken = ast->tokens[declared];
+			ibsSymTableBind(data->localVars, varToken->atom, globalConst);
 		}
-		decl = decl->nextDecl;
+		decl = ast->nextDecls[decl];
 	}
 }
 
-bool smmExecuteLLVMCodeGenPass(PSmmAstNode module, FILE* out, PIbsAllocator a) {
-	PIbsAllocator la = ibsSimpleAllocatorCreate("llvmTempAllocator", a->size);
+char* smmGenerateLLVMIR(PSmmAst ast, LLVMContextRef context, const char* triple, PIbsAllocator a) {
+	if (!context) {
+		context = LLVMContextCreate();
+		char* defaultTriple = LLVMGetDefaultTargetTriple();
+		char* res = smmGenerateLLVMIR(ast, context, defaultTriple, a);
+		LLVMDisposeMessage(defaultTriple);
+		LLVMContextDispose(context);
+		return res;
+	}
+	PIbsAllocator la = ibsVirtualAllocatorCreate("llvmTempAllocator", IBS_DEFAULT_VIRTUAL_SIZE, false);
 	PSmmLLVMCodeGenData data = ibsAlloc(la, sizeof(struct SmmLLVMCodeGenData));
-	data->localVars = ibsDictCreate(la);
+	data->ast = ast;
+	data->context = context;
+	data->localVars = ibsSymTableCreate(la);
+	data->funcs = ibsHashDictCreate(la);
+	data->scratch = ibsVirtualAllocatorCreate("llvmScratch", IBS_DEFAULT_VIRTUAL_SIZE, false);
 
-	data->llvmModule = LLVMModuleCreateWithName(module->token->repr);
+	data->llvmModule = LLVMModuleCreateWithNameInContext(ast->tokens[ast->program]->repr, data->context);
 	LLVMSetDataLayout(data->llvmModule, "");
-	LLVMSetTarget(data->llvmModule, LLVMGetDefaultTargetTriple());
+	LLVMSetTarget(data->llvmModule, triple);
 
-	data->builder = LLVMCreateBuilder();
+	data->builder = LLVMCreateBuilderInContext(data->context);
 
-	PSmmAstBlockNode globalBlock = (PSmmAstBlockNode)module->next;
-	assert(globalBlock->kind == nkSmmBlock);
-	processGlobalSymbols(data, globalBlock->scope->decls, la);
+	SmmAstNode globalBlock = ast->nexts[ast->program];
+	assert(ast->kinds[globalBlock] == nkSmmBlock);
+	processGlobalSymbols(data, ast->decls[ast->scopes[globalBlock]], la);
 
-	LLVMTypeRef funcType = LLVMFunctionType(LLVMInt32Type(), NULL, 0, 0);
+	LLVMTypeRef funcType = LLVMFunctionType(LLVMInt32TypeInContext(data->context), NULL, 0, 0);
 	LLVMValueRef mainfunc = LLVMAddFunction(data->llvmModule, "main", funcType);
 	data->curFunc = mainfunc;
 
-	LLVMBasicBlockRef entry = LLVMAppendBasicBlock(mainfunc, "entry");
+	LLVMBasicBlockRef entry = LLVMAppendBasicBlockInContext(data->context, mainfunc, "entry");
 	LLVMPositionBuilderAtEnd(data->builder, entry);
 	processBlock(data, globalBlock, la);
 
@@ -501,11 +547,25 @@ bool smmExecuteLLVMCodeGenPass(PSmmAstNode module, FILE* out, PIbsAllocator a) {
 	bool isInvalid = LLVMVerifyModule(data->llvmModule, LLVMAbortProcessAction, &error);
 	LLVMDisposeMessage(error);
 
+	char* res = NULL;
 	if (!isInvalid) {
 		char* outData = LLVMPrintModuleToString(data->llvmModule);
-		fputs(outData, out);
+		size_t size = strlen(outData) + 1;
+		res = ibsAlloc(a, size);
+		memcpy(res, outData, size);
 		LLVMDisposeMessage(outData);
 	}
+	LLVMDisposeBuilder(data->builder);
+	LLVMDisposeModule(data->llvmModule);
+	ibsSimpleAllocatorFree(data->scratch);
 	ibsSimpleAllocatorFree(la);
-	return !isInvalid;
+	return res;
+}
+
+bool smmExecuteLLVMCodeGenPass(PSmmAst ast, FILE* out, PIbsAllocator a) {
+	struct IbsAllocatorMark mark = ibsMark(a);
+	char* ir = smmGenerateLLVMIR(ast, NULL, NULL, a);
+	if (ir) fputs(ir, out);
+	ibsRelease(a, mark);
+	return ir != NULL;
 }
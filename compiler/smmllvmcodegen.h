@@ -4,9 +4,24 @@
 #include "ibscommon.h"
 #include "ibsallocator.h"
 #include "smmparser.h"
+#include "llvm-c/Types.h"
 
 #include <stdio.h>
 
-bool smmExecuteLLVMCodeGenPass(PSmmAstNode module, FILE* out, PIbsAllocator a);
+/**
+ * Generates LLVM module in its own LLVM context and writes it to out as LLVM
+ * assembly. Returns false if generated module is invalid.
+ */
+bool smmExecuteLLVMCodeGenPass(PSmmAst ast, FILE* out, PIbsAllocator a);
+
+/**
+ * Generates LLVM module in the given context and returns it as zero
+ * terminated LLVM assembly taken from the given allocator, or NULL if module
+ * is invalid. Module itself is disposed but types and constants stay in the
+ * context so a context that is reused for many modules keeps growing. One
+ * context must not be used on two threads at once. If context is NULL a new
+ * one is created just for this module and default target triple is used.
+ */
+char* smmGenerateLLVMIR(PSmmAst ast, LLVMContextRef context, const char* triple, PIbsAllocator a);
 
 #endif
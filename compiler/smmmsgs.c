@@ -1,11 +1,14 @@
 #include "smmmsgs.h"
 
+#include <assert.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 
 #define WARNING_START wrnSmmConversionDataLoss
 #define MSG_BUFFER_MAX_LENGTH 2000
+#define MIN_LINE_INDEX_CAPACITY 1024
 
 static const char* msgTypeToString[] = {
 	"unknown error",
@@ -46,38 +49,20 @@ static const char* msgTypeToString[] = {
 	"comparing signed and unsigned values can have unpredictable results. Add explicit casts to avoid this warning",
 };
 
-void smmPostMessage(PSmmMsgs msgs, SmmMsgType msgType, struct SmmFilePos filePos, ...) {
-	if (msgType < WARNING_START) {
-		msgs->errorCount++;
-	} else {
-		msgs->warningCount++;
-	}
-	PSmmMsg msg = ibsAlloc(msgs->a, sizeof(struct SmmMsg));
-	msg->type = msgType;
-	msg->filePos = filePos;
-	msg->text = ibsStartAlloc(msgs->a);
-
-	va_list argList;
-	va_start(argList, filePos);
-	int written = vsnprintf(msg->text, MSG_BUFFER_MAX_LENGTH, msgTypeToString[msgType], argList);
-	if (written >= MSG_BUFFER_MAX_LENGTH) written = MSG_BUFFER_MAX_LENGTH - 1;
-	va_end(argList);
-
-	ibsEndAlloc(msgs->a, written + 1);
-
+static void insertMessage(PSmmMsgs msgs, PSmmMsg msg) {
 	// We keep the messages sorted by filepos because different compiler passes can report
 	// errors in various positions out of order.
 	PSmmMsg* curMsgField = &msgs->items;
 	while (
 		*curMsgField
-		&& (*curMsgField)->filePos.lineNumber < filePos.lineNumber
+		&& (*curMsgField)->filePos.lineNumber < msg->filePos.lineNumber
 	) {
 		curMsgField = &(*curMsgField)->next;
 	}
 	while (
 		*curMsgField
-		&& (*curMsgField)->filePos.lineNumber == filePos.lineNumber
-		&& (*curMsgField)->filePos.lineOffset < filePos.lineOffset
+		&& (*curMsgField)->filePos.lineNumber == msg->filePos.lineNumber
+		&& (*curMsgField)->filePos.lineOffset < msg->filePos.lineOffset
 	) {
 		curMsgField = &(*curMsgField)->next;
 	}
@@ -86,55 +71,119 @@ void smmPostMessage(PSmmMsgs msgs, SmmMsgType msgType, struct SmmFilePos filePos
 	*curMsgField = msg;
 }
 
-void smmPostGotUnexpectedToken(PSmmMsgs msgs, struct SmmFilePos filePos, const char* expected, const char* got) {
-	smmPostMessage(msgs, errSmmGotUnexpectedToken, filePos, expected, got);
+void smmPostMessage(PSmmMsgs msgs, SmmMsgType msgType, uint32_t offset, ...) {
+	assert(msgs->lines && "Messages can only be posted after lexer was created");
+	struct SmmFilePos filePos = smmGetFilePos(msgs->lines, offset);
+	if (msgType < WARNING_START) {
+		msgs->errorCount++;
+	} else {
+		msgs->warningCount++;
+	}
+	PSmmMsg msg = ibsAllocTagged(msgs->a, sizeof(struct SmmMsg), "message");
+	msg->type = msgType;
+	msg->filePos = filePos;
+	msg->text = ibsStartAlloc(msgs->a);
+
+	va_list argList;
+	va_start(argList, offset);
+	int written = vsnprintf(msg->text, MSG_BUFFER_MAX_LENGTH, msgTypeToString[msgType], argList);
+	if (written >= MSG_BUFFER_MAX_LENGTH) written = MSG_BUFFER_MAX_LENGTH - 1;
+	va_end(argList);
+
+	ibsEndAllocTagged(msgs->a, written + 1, "message text");
+
+	insertMessage(msgs, msg);
 }
 
-void smmPostIdentTaken(PSmmMsgs msgs, struct SmmFilePos filePos, const char* identifier, const char* takenAs) {
-	smmPostMessage(msgs, errSmmIdentTaken, filePos, identifier, takenAs);
+void smmPostGotUnexpectedToken(PSmmMsgs msgs, uint32_t offset, const char* expected, const char* got) {
+	smmPostMessage(msgs, errSmmGotUnexpectedToken, offset, expected, got);
 }
 
-void smmPostGotBadOperands(PSmmMsgs msgs, struct SmmFilePos filePos, const char* operator, const char* gotType) {
-	smmPostMessage(msgs, errSmmBadOperandsType, filePos, operator, gotType);
+void smmPostIdentTaken(PSmmMsgs msgs, uint32_t offset, const char* identifier, const char* takenAs) {
+	smmPostMessage(msgs, errSmmIdentTaken, offset, identifier, takenAs);
 }
 
-void smmPostGotBadArgs(PSmmMsgs msgs, struct SmmFilePos filePos, const char* gotSig, const char* expectedSigs) {
-	smmPostMessage(msgs, errSmmGotBadArgs, filePos, gotSig, expectedSigs);
+void smmPostGotBadOperands(PSmmMsgs msgs, uint32_t offset, const char* operator, const char* gotType) {
+	smmPostMessage(msgs, errSmmBadOperandsType, offset, operator, gotType);
 }
 
-void smmPostGotBadReturnType(PSmmMsgs msgs, struct SmmFilePos filePos, const char* gotType, const char* expectedType) {
-	smmPostMessage(msgs, errSmmBadReturnStmtType, filePos, gotType, expectedType);
+void smmPostGotBadArgs(PSmmMsgs msgs, uint32_t offset, const char* gotSig, const char* expectedSigs) {
+	smmPostMessage(msgs, errSmmGotBadArgs, offset, gotSig, expectedSigs);
 }
 
-void smmPostConversionLoss(PSmmMsgs msgs, struct SmmFilePos filePos, const char* fromType, const char* toType) {
-	smmPostMessage(msgs, wrnSmmConversionDataLoss, filePos, fromType, toType);
+void smmPostGotBadReturnType(PSmmMsgs msgs, uint32_t offset, const char* gotType, const char* expectedType) {
+	smmPostMessage(msgs, errSmmBadReturnStmtType, offset, gotType, expectedType);
 }
 
-void smmFlushMessages(PSmmMsgs msgs) {
-	PSmmMsg curMsg = msgs->items;
-
-	while (curMsg) {
-		const char* lvl;
-		if (curMsg->type < WARNING_START) {
-			lvl = "ERROR";
-		} else {
-			lvl = "WARNING";
-		}
-
-		if (curMsg->filePos.filename) {
-			printf("%s (at %s:%d:%d): %s\n", lvl,
-				curMsg->filePos.filename,
-				curMsg->filePos.lineNumber,
-				curMsg->filePos.lineOffset,
-				curMsg->text);
-		} else {
-			printf("%s (at %d:%d): %s\n", lvl,
-				curMsg->filePos.lineNumber,
-				curMsg->filePos.lineOffset,
-				curMsg->text);
-		}
-		curMsg = curMsg->next;
+void smmPostConversionLoss(PSmmMsgs msgs, uint32_t offset, const char* fromType, const char* toType) {
+	smmPostMessage(msgs, wrnSmmConversionDataLoss, offset, fromType, toType);
+}
+
+void smmMoveMessages(PSmmMsgs msgs, PSmmMsgs from, uint32_t lineDelta) {
+	// Messages with the same position are kept in reverse order of posting so we
+	// reverse the list first in order to insert them in the order they were posted
+	PSmmMsg reversed = NULL;
+	while (from->items) {
+		PSmmMsg next = from->items->next;
+		from->items->next = reversed;
+		reversed = from->items;
+		from->items = next;
+	}
+	for (PSmmMsg curMsg = reversed; curMsg; curMsg = curMsg->next) {
+		PSmmMsg msg = ibsAllocTagged(msgs->a, sizeof(struct SmmMsg), "message");
+		msg->type = curMsg->type;
+		msg->filePos = curMsg->filePos;
+		msg->filePos.lineNumber += lineDelta;
+		size_t size = strlen(curMsg->text) + 1;
+		msg->text = ibsAllocTagged(msgs->a, size, "message text");
+		memcpy(msg->text, curMsg->text, size);
+		insertMessage(msgs, msg);
+	}
+	msgs->errorCount += from->errorCount;
+	msgs->warningCount += from->warningCount;
+	msgs->hintCount += from->hintCount;
+	from->errorCount = from->warningCount = from->hintCount = 0;
+}
+
+static int formatMessage(PSmmMsg msg, char* buf, size_t size) {
+	const char* lvl;
+	if (msg->type < WARNING_START) {
+		lvl = "ERROR";
+	} else {
+		lvl = "WARNING";
+	}
+
+	if (msg->filePos.filename) {
+		return snprintf(buf, size, "%s (at %s:%d:%d): %s\n", lvl,
+			msg->filePos.filename,
+			msg->filePos.lineNumber,
+			msg->filePos.lineOffset,
+			msg->text);
 	}
+	return snprintf(buf, size, "%s (at %d:%d): %s\n", lvl,
+		msg->filePos.lineNumber,
+		msg->filePos.lineOffset,
+		msg->text);
+}
+
+char* smmFormatMessages(PSmmMsgs msgs, PIbsAllocator a) {
+	size_t size = 1;
+	for (PSmmMsg curMsg = msgs->items; curMsg; curMsg = curMsg->next) {
+		size += formatMessage(curMsg, NULL, 0);
+	}
+	char* res = ibsAllocTagged(a, size, "message text");
+	char* cur = res;
+	for (PSmmMsg curMsg = msgs->items; curMsg; curMsg = curMsg->next) {
+		cur += formatMessage(curMsg, cur, size - (cur - res));
+	}
+	return res;
+}
+
+void smmFlushMessages(PSmmMsgs msgs) {
+	if (!msgs->items) return;
+	struct IbsAllocatorMark mark = ibsMark(msgs->a);
+	fputs(smmFormatMessages(msgs, msgs->a), stdout);
+	ibsRelease(msgs->a, mark);
 }
 
 void smmAbortWithMessage(const char * msg, const char * filename, const int line) {
@@ -146,3 +195,29 @@ bool smmHadErrors(PSmmMsgs msgs) {
 	return msgs->errorCount > 0;
 }
 
+void smmAddLineStart(PSmmLineIndex lines, uint32_t offset) {
+	assert(lines->count == 0 || lines->starts[lines->count - 1] < offset);
+	if (lines->count == lines->capacity) {
+		uint32_t newCapacity = lines->capacity ? lines->capacity * 2 : MIN_LINE_INDEX_CAPACITY;
+		uint32_t* newStarts = ibsAllocTagged(lines->a, newCapacity * sizeof(uint32_t), "line starts");
+		if (lines->count) memcpy(newStarts, lines->starts, lines->count * sizeof(uint32_t));
+		lines->starts = newStarts;
+		lines->capacity = newCapacity;
+	}
+	lines->starts[lines->count++] = offset;
+}
+
+struct SmmFilePos smmGetFilePos(PSmmLineIndex lines, uint32_t offset) {
+	assert(lines->count > 0 && lines->starts[0] <= offset);
+	// Find the last line that starts at or before the offset
+	uint32_t low = 0;
+	uint32_t high = lines->count;
+	while (high - low > 1) {
+		uint32_t mid = low + (high - low) / 2;
+		if (lines->starts[mid] <= offset) low = mid;
+		else high = mid;
+	}
+	struct SmmFilePos res = { lines->filename, low + 1, offset - lines->starts[low] + 1 };
+	return res;
+}
+
@@ -38,6 +38,20 @@ struct SmmFilePos {
 };
 typedef struct SmmFilePos* PSmmFilePos;
 
+/**
+* Offsets at which lines of a source file start. Everything else only keeps byte
+* offsets into the source and this is used to get line and column from them
+* when they are actually needed, like when a message is posted.
+*/
+struct SmmLineIndex {
+	PIbsAllocator a;
+	const char* filename;
+	uint32_t* starts;
+	uint32_t count;
+	uint32_t capacity;
+};
+typedef struct SmmLineIndex* PSmmLineIndex;
+
 typedef struct SmmMsg* PSmmMsg;
 struct SmmMsg {
 	SmmMsgType type;
@@ -48,6 +62,7 @@ struct SmmMsg {
 
 struct SmmMsgs {
 	PIbsAllocator a;
+	PSmmLineIndex lines; // Used to get file positions of posted offsets
 	PSmmMsg items;
 	uint16_t errorCount;
 	uint16_t warningCount;
@@ -55,18 +70,40 @@ struct SmmMsgs {
 };
 typedef struct SmmMsgs* PSmmMsgs;
 
-void smmPostMessage(PSmmMsgs msgs, SmmMsgType msgType, struct SmmFilePos filePos, ...);
+void smmPostMessage(PSmmMsgs msgs, SmmMsgType msgType, uint32_t offset, ...);
 
 // We define separate functions for all messages that take two or more params so autocomplete
 // can help us avoid confusion what are the params and in which order should they be given
-void smmPostGotUnexpectedToken(PSmmMsgs msgs, struct SmmFilePos filePos, const char* expected, const char* got);
-void smmPostIdentTaken(PSmmMsgs msgs, struct SmmFilePos filePos, const char* identifier, const char* takenAs);
-void smmPostGotBadOperands(PSmmMsgs msgs, struct SmmFilePos filePos, const char* operator, const char* gotType);
-void smmPostGotBadArgs(PSmmMsgs msgs, struct SmmFilePos filePos, const char* gotSig, const char* expectedSigs);
-void smmPostGotBadReturnType(PSmmMsgs msgs, struct SmmFilePos filePos, const char* gotType, const char* expectedType);
-void smmPostConversionLoss(PSmmMsgs msgs, struct SmmFilePos filePos, const char* fromType, const char* toType);
+void smmPostGotUnexpectedToken(PSmmMsgs msgs, uint32_t offset, const char* expected, const char* got);
+void smmPostIdentTaken(PSmmMsgs msgs, uint32_t offset, const char* identifier, const char* takenAs);
+void smmPostGotBadOperands(PSmmMsgs msgs, uint32_t offset, const char* operator, const char* gotType);
+void smmPostGotBadArgs(PSmmMsgs msgs, uint32_t offset, const char* gotSig, const char* expectedSigs);
+void smmPostGotBadReturnType(PSmmMsgs msgs, uint32_t offset, const char* gotType, const char* expectedType);
+void smmPostConversionLoss(PSmmMsgs msgs, uint32_t offset, const char* fromType, const char* toType);
+
+/**
+* Copies all the messages from one list into the given one and empties the
+* first list. Line numbers of copied messages are increased by lineDelta so
+* messages posted with a line index of only a part of a file can be merged.
+*/
+void smmMoveMessages(PSmmMsgs msgs, PSmmMsgs from, uint32_t lineDelta);
 
+/**
+* Returns all the messages as zero terminated text, one per line, the same
+* way smmFlushMessages prints them.
+*/
+char* smmFormatMessages(PSmmMsgs msgs, PIbsAllocator a);
 void smmFlushMessages(PSmmMsgs msgs);
+
+/**
+* Adds the offset of the next line. Lines must be added in order.
+*/
+void smmAddLineStart(PSmmLineIndex lines, uint32_t offset);
+
+/**
+* Returns the line and column of the given offset using binary search.
+*/
+struct SmmFilePos smmGetFilePos(PSmmLineIndex lines, uint32_t offset);
 void smmAbortWithMessage(const char* msg, const char* filename, const int line);
 
 bool smmHadErrors(PSmmMsgs msgs);
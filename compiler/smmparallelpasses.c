@@ -0,0 +1,64 @@
+#include "smmparallelpasses.h"
+#include "ibsthread.h"
+#include "smmtypeinference.h"
+#include "smmsempass.h"
+
+#include <assert.h>
+
+struct FuncTask {
+	SmmAstNode func;
+	PSmmAst view;
+	struct SmmMsgs msgs;
+};
+
+struct FuncTasks {
+	struct FuncTask* items;
+	PSmmParser parser; // Parser that skipped func bodies or NULL if it didn't
+	PIbsSymTable globals;
+};
+
+static void runFuncTask(void* data, uint32_t index) {
+	struct FuncTasks* tasks = data;
+	struct FuncTask* task = &tasks->items[index];
+	PSmmAst view = task->view;
+	if (view->flags[task->func] & nfSmmLazyBody) {
+		PSmmParser parser = smmCreateFuncBodyParser(tasks->parser, view, &task->msgs, view->a);
+		smmParseFuncBody(parser, task->func);
+	}
+	smmExecuteFuncTypeInference(view, task->func, tasks->globals, &task->msgs, view->a);
+	smmExecuteFuncSemPass(view, task->func, &task->msgs, view->a);
+}
+
+void smmExecuteParallelPasses(PSmmAst ast, PSmmMsgs msgs, uint32_t threadCount, PIbsAllocator a) {
+	struct FuncTasks tasks = { NULL, ast->parser };
+	tasks.globals = smmExecuteGlobalTypeInference(ast, msgs, a);
+
+	// Type inference left only valid funcs in global decls and put them after vars and consts
+	SmmAstNode globalBlock = ast->nexts[ast->program];
+	SmmAstNode firstDecl = ast->decls[ast->scopes[globalBlock]];
+	uint32_t funcCount = 0;
+	for (SmmAstNode decl = firstDecl; decl; decl = ast->nextDecls[decl]) {
+		if (ast->kinds[ast->lefts[decl]] == nkSmmFunc) funcCount++;
+	}
+
+	if (funcCount > 0) {
+		tasks.items = ibsAlloc(a, funcCount * sizeof(struct FuncTask));
+		uint32_t i = 0;
+		for (SmmAstNode decl = firstDecl; decl; decl = ast->nextDecls[decl]) {
+			if (ast->kinds[ast->lefts[decl]] != nkSmmFunc) continue;
+			struct FuncTask* task = &tasks.items[i++];
+			task->func = ast->lefts[decl];
+			task->view = smmCreateAstView(ast);
+			task->msgs.a = task->view->a;
+			task->msgs.lines = msgs->lines;
+		}
+
+		ibsParallelFor(funcCount, threadCount, runFuncTask, &tasks);
+
+		for (i = 0; i < funcCount; i++) {
+			smmMoveMessages(msgs, &tasks.items[i].msgs, 0);
+		}
+	}
+
+	smmExecuteGlobalSemPass(ast, msgs, a);
+}
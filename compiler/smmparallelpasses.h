@@ -0,0 +1,23 @@
+#pragma once
+
+/**
+* Runs type inference and semantic pass with bodies of global funcs processed
+* in parallel. Global symbols and main code are processed first on the calling
+* thread so signatures of all funcs, their overloads and types of all globals
+* are known before any body is touched. After that each func is a separate
+* task that parses its body, if parser skipped it, and runs both passes on it
+* using its own AST view, allocator and messages. Tasks are taken by threads
+* as they become free so a few big funcs don't hold up the rest. Messages of
+* tasks are merged in the order of funcs so the result doesn't depend on the
+* number of threads.
+*/
+
+#include "ibscommon.h"
+#include "ibsallocator.h"
+#include "smmmsgs.h"
+#include "smmparser.h"
+
+/**
+* If threadCount is 0 one thread per processor is used.
+*/
+void smmExecuteParallelPasses(PSmmAst ast, PSmmMsgs msgs, uint32_t threadCount, PIbsAllocator a);
@@ -2,11 +2,22 @@
 #include "ibsdictionary.h"
 
 #include <assert.h>
+#include <stdio.h>
+#include <string.h>
 
 /********************************************************
 Type Definitions
 *********************************************************/
 
+// Nodes are added to AST arrays in steps of this many nodes
+#define AST_GROW_COUNT 4096
+// Address space reserved for each AST array is enough for this many items
+#define AST_MAX_NODES (16 * 1024 * 1024)
+// Views reserve nodes and extras from their AST in ranges of this many items
+#define AST_VIEW_RANGE_COUNT 512
+// Size of the first chunk of each view allocator
+#define AST_VIEW_ALLOCATOR_SIZE (64 * 1024)
+
 // There should be one string corresponding to each value of SmmAstNodeKind enum
 const char* nodeKindToString[] = {
 	"error", "Program", "func",
@@ -25,7 +36,8 @@ const char* nodeKindToString[] = {
 	"if", "while",
 };
 
-struct SmmTypeInfo builtInTypes[] = {
+const struct SmmTypeInfo builtInTypes[] = {
+	{ tiSmmNone, 0, "/none/" },
 	{ tiSmmUnknown, 0, "/unknown/" },{ tiSmmVoid, 0, "/void/" },
 	{ tiSmmBool, 1, "bool", 0, 0, 0, 1 },
 	{ tiSmmUInt8, 1, "uint8", 1, 1 },{ tiSmmUInt16, 2, "uint16", 1, 1 },
@@ -36,38 +48,154 @@ struct SmmTypeInfo builtInTypes[] = {
 	{ tiSmmSoftFloat64, 8, "/sfloat64/", 0, 0, 1 },
 };
 
-static int binOpPrecs[128] = { 0 };
+// Names of AST arrays in the order their allocators are kept in SmmAst
+static const char* astArrayNames[] = {
+	"AST kinds", "AST flags", "AST types", "AST tokens",
+	"AST nexts", "AST lefts", "AST rights", "AST extras",
+};
+
+// Binary operator precedences. Index is tokenKind & 0x7f so its value must be less then 289
+// which is after this operation equal to '!', first operator character in ascii map.
+// Table is constant so parsers on different threads can share it.
+static const int binOpPrecs[128] = {
+	['+'] = 100,
+	['-'] = 100,
+
+	['*'] = 120,
+	['/'] = 120,
+	[tkSmmIntDiv & 0x7f] = 120,
+	[tkSmmIntMod & 0x7f] = 120,
+
+	[tkSmmEq & 0x7f] = 110,
+	[tkSmmNotEq & 0x7f] = 110,
+	['>'] = 110,
+	[tkSmmGtEq & 0x7f] = 110,
+	['<'] = 110,
+	[tkSmmLtEq & 0x7f] = 110,
+
+	[tkSmmAndOp & 0x7f] = 90,
+	[tkSmmXorOp & 0x7f] = 80,
+	[tkSmmOrOp & 0x7f] = 80,
+};
 
-static union SmmAstNode errorNode = { { nkSmmError, 0, 0, 0, NULL, &builtInTypes[0] } };
+// Every AST has this node created first and set to nkSmmError kind and unknown type
+static const SmmAstNode errorNode = 1;
 
 /********************************************************
 Private Functions
 *********************************************************/
 
-static PSmmAstNode parseExpression(PSmmParser parser);
-static PSmmAstNode parseStatement(PSmmParser parser);
+static SmmAstNode parseExpression(PSmmParser parser);
+static SmmAstNode parseStatement(PSmmParser parser);
 
-static PSmmToken newToken(int kind, const char* repr, struct SmmFilePos filePos, PIbsAllocator a) {
-	PSmmToken res = ibsAlloc(a, sizeof(struct SmmToken));
+static PSmmToken newToken(int kind, const char* repr, uint32_t offset, PIbsAllocator a) {
+	PSmmToken res = ibsAllocTagged(a, sizeof(struct SmmToken), "token");
 	res->kind = kind;
 	res->repr = repr;
-	res->filePos = filePos;
+	res->length = (uint32_t)strlen(repr);
+	res->offset = offset;
 	return res;
 }
 
-static PSmmAstScopeNode newScopeNode(PSmmParser parser) {
-	PSmmAstScopeNode scope = smmNewAstNode(nkSmmScope, parser->a);
-	scope->level = parser->curScope->level + 1;
-	scope->prevScope = parser->curScope;
-	scope->lastDecl = (PSmmAstDeclNode)scope;
-	scope->returnType = parser->curScope->returnType;
+static uint32_t getLineNumber(PSmmParser parser, uint32_t offset) {
+	return smmGetFilePos(parser->msgs->lines, offset).lineNumber;
+}
+
+static uint32_t internName(PIbsAtomTable atoms, const char* name) {
+	size_t length = strlen(name);
+	return ibsAtomIntern(atoms, name, length, ibsAtomHash(name, length));
+}
+
+static SmmAstNode getIdent(PSmmParser parser, uint32_t atom) {
+	return (SmmAstNode)(uintptr_t)ibsSymTableGet(parser->idents, atom);
+}
+
+static void bindIdent(PSmmParser parser, uint32_t atom, SmmAstNode node) {
+	ibsSymTableBind(parser->idents, atom, (void*)(uintptr_t)node);
+}
+
+static void* growAstArray(PSmmAst ast, int index, void* array, uint32_t capacity, size_t itemSize) {
+	// Tag must outlive the allocator so it is the static name and not the allocator's copy
+	uint8_t* res = ibsAllocTagged(ast->arrays[index], AST_GROW_COUNT * itemSize, astArrayNames[index]);
+	// Allocations from virtual allocator follow each other so the array just gets longer
+	assert(!array || res == (uint8_t*)array + capacity * itemSize);
+	return array ? array : res;
+}
+
+static void growAst(PSmmAst ast) {
+	uint32_t cap = ast->capacity;
+	ast->kinds = growAstArray(ast, 0, ast->kinds, cap, sizeof(ast->kinds[0]));
+	ast->flags = growAstArray(ast, 1, ast->flags, cap, sizeof(ast->flags[0]));
+	ast->types = growAstArray(ast, 2, ast->types, cap, sizeof(ast->types[0]));
+	ast->tokens = growAstArray(ast, 3, ast->tokens, cap, sizeof(ast->tokens[0]));
+	ast->nexts = growAstArray(ast, 4, ast->nexts, cap, sizeof(ast->nexts[0]));
+	ast->lefts = growAstArray(ast, 5, ast->lefts, cap, sizeof(ast->lefts[0]));
+	ast->rights = growAstArray(ast, 6, ast->rights, cap, sizeof(ast->rights[0]));
+	ast->capacity += AST_GROW_COUNT;
+}
+
+/**
+* Gives the view a new range of at least count nodes or, if extras is set,
+* extras. Rest of the previous range is just left unused.
+*/
+static void reserveViewRange(PSmmAst view, uint32_t count, bool extras) {
+	PSmmAst ast = view->owner;
+	if (count < AST_VIEW_RANGE_COUNT) count = AST_VIEW_RANGE_COUNT;
+	ibsMutexLock(ast->lock);
+	if (extras) {
+		view->extraCount = smmNewAstExtras(ast, count);
+		view->extraCapacity = view->extraCount + count;
+	} else {
+		while (ast->count + count > ast->capacity) growAst(ast);
+		view->count = ast->count;
+		view->capacity = ast->count + count;
+		ast->count += count;
+	}
+	ibsMutexUnlock(ast->lock);
+}
+
+static SmmAstNode newScopeNode(PSmmParser parser) {
+	PSmmAst ast = parser->ast;
+	SmmAstNode scope = smmNewAstNode(ast, nkSmmScope);
+	ast->prevScopes[scope] = parser->curScope;
+	ast->lastDecls[scope] = scope;
+	ast->types[scope] = ast->types[parser->curScope];
 	parser->curScope = scope;
+	parser->curLevel++;
 	return scope;
 }
 
+static void pushChild(PSmmParser parser, SmmAstNode node) {
+	if (parser->childCount == parser->childCapacity) {
+		uint32_t newCapacity = parser->childCapacity ? parser->childCapacity * 2 : 256;
+		SmmAstNode* newChildren = ibsAllocTagged(parser->a, newCapacity * sizeof(SmmAstNode), "AST children");
+		if (parser->childCount) memcpy(newChildren, parser->children, parser->childCount * sizeof(SmmAstNode));
+		parser->children = newChildren;
+		parser->childCapacity = newCapacity;
+	}
+	parser->children[parser->childCount++] = node;
+}
+
+/**
+* Moves all the children pushed since childCount was equal to firstChild into
+* a new list in ast extras and returns index of that list.
+*/
+static uint32_t popChildren(PSmmParser parser, uint32_t firstChild) {
+	uint32_t count = parser->childCount - firstChild;
+	parser->childCount = firstChild;
+	return smmNewAstList(parser->ast, &parser->children[firstChild], count);
+}
 static void getNextToken(PSmmParser parser) {
 	parser->prevToken = parser->curToken;
-	parser->curToken = smmGetNextToken(parser->lex);
+	if (parser->tokens) {
+		// Last token is always eof so we just stay on it
+		if (parser->cursor + 1 < parser->tokenCount) parser->cursor++;
+		parser->curToken = &parser->tokens[parser->cursor];
+	} else if (parser->pipe) {
+		parser->curToken = smmGetNextPipedToken(parser->pipe);
+	} else {
+		parser->curToken = smmGetNextToken(parser->lex);
+	}
 }
 
 static bool isTerminatingToken(int tokenKind) {
@@ -105,21 +233,21 @@ static int findEitherToken(PSmmParser parser, int tokenKind1, int tokenKind2) {
 
 static PSmmToken expect(PSmmParser parser, uint32_t kind) {
 	PSmmToken token = parser->curToken;
-	struct SmmFilePos filePos = token->filePos;
+	uint32_t offset = token->offset;
 	if (token->kind != kind) {
-		if (token->kind != tkSmmErr && token->filePos.lineNumber != parser->lastErrorLine) {
+		if (token->kind != tkSmmErr && getLineNumber(parser, offset) != parser->lastErrorLine) {
 			// If it is smmErr, lexer already reported the error
-			char expBuf[4];
+			char expBuf[SMM_TOKEN_STRING_BUF_SIZE];
 			char tmpRepr[2] = { (char)kind, 0 };
 			struct SmmToken tmpToken = { kind };
 			tmpToken.repr = tmpRepr;
 			const char* expected = smmTokenToString(&tmpToken, expBuf);
 			if (token->isFirstOnLine && parser->prevToken) {
-				filePos = parser->prevToken->filePos;
+				offset = parser->prevToken->offset;
 			}
-			smmPostMessage(parser->msgs, errSmmNoExpectedToken, filePos, expected);
+			smmPostMessage(parser->msgs, errSmmNoExpectedToken, offset, expected);
 		}
-		parser->lastErrorLine = filePos.lineNumber;
+		parser->lastErrorLine = getLineNumber(parser, offset);
 		return NULL;
 	}
 	getNextToken(parser);
@@ -130,34 +258,35 @@ static PSmmTypeInfo parseType(PSmmParser parser) {
 	PSmmTypeInfo typeInfo = NULL;
 	if (parser->curToken->kind != tkSmmIdent) {
 		if (parser->curToken->kind != tkSmmErr) {
-			char gotBuf[4];
+			char gotBuf[SMM_TOKEN_STRING_BUF_SIZE];
 			const char* got = smmTokenToString(parser->curToken, gotBuf);
-			smmPostMessage(parser->msgs, errSmmGotUnexpectedToken, parser->curToken->filePos, "type", got);
+			smmPostMessage(parser->msgs, errSmmGotUnexpectedToken, parser->curToken->offset, "type", got);
 		}
 		typeInfo = &builtInTypes[tiSmmUnknown];
 	} else {
-		PSmmAstNode typeInfoNode = ibsDictGet(parser->idents, parser->curToken->repr);
-		if (!typeInfoNode || typeInfoNode->kind != nkSmmType) {
-			smmPostMessage(parser->msgs, errSmmUnknownType, parser->curToken->filePos, parser->curToken->repr);
+		SmmAstNode typeInfoNode = getIdent(parser, parser->curToken->atom);
+		if (!typeInfoNode || parser->ast->kinds[typeInfoNode] != nkSmmType) {
+			smmPostMessage(parser->msgs, errSmmUnknownType, parser->curToken->offset, parser->curToken->repr);
 			typeInfo = &builtInTypes[tiSmmUnknown];
 		} else {
-			typeInfo = typeInfoNode->type;
+			typeInfo = &builtInTypes[parser->ast->types[typeInfoNode]];
 		}
 		getNextToken(parser);
 	}
 	return typeInfo;
 }
 
-static PSmmAstNode createNewIdent(PSmmParser parser, PSmmToken identToken) {
+static SmmAstNode createNewIdent(PSmmParser parser, PSmmToken identToken) {
 	if (!identToken->canBeNewSymbol) {
-		smmPostMessage(parser->msgs, errSmmGotUnexpectedToken, parser->curToken->filePos, "operator", "':'");
-		return &errorNode;
+		smmPostMessage(parser->msgs, errSmmGotUnexpectedToken, parser->curToken->offset, "operator", "':'");
+		return errorNode;
 	}
-	PSmmAstIdentNode var = smmNewAstNode(nkSmmIdent, parser->a);
-	var->isIdent = true;
-	var->token = identToken;
-	var->level = parser->curScope->level;
-	return (PSmmAstNode)var;
+	PSmmAst ast = parser->ast;
+	SmmAstNode var = smmNewAstNode(ast, nkSmmIdent);
+	ast->flags[var] = nfSmmIdent;
+	ast->tokens[var] = identToken;
+	ast->levels[var] = parser->curLevel;
+	return var;
 }
 
 static PSmmTypeInfo getLiteralTokenType(PSmmToken token) {
@@ -181,73 +310,79 @@ static PSmmTypeInfo getLiteralTokenType(PSmmToken token) {
 	}
 }
 
-static PSmmAstNode getLiteralNode(PSmmParser parser) {
-	PSmmAstNode res = smmNewAstNode(nkSmmError, parser->a);
-	res->type = getLiteralTokenType(parser->curToken);
-	if (res->type->isInt) res->kind = nkSmmInt;
-	else if (res->type->isFloat) res->kind = nkSmmFloat;
-	else if (res->type->isBool) res->kind = nkSmmBool;
+static SmmAstNode getLiteralNode(PSmmParser parser) {
+	PSmmTypeInfo type = getLiteralTokenType(parser->curToken);
+	SmmAstNodeKind kind = nkSmmError;
+	if (type->isInt) kind = nkSmmInt;
+	else if (type->isFloat) kind = nkSmmFloat;
+	else if (type->isBool) kind = nkSmmBool;
 	else assert(false && "Got unimplemented literal type");
-	res->token = parser->curToken;
-	res->isConst = true;
+	PSmmAst ast = parser->ast;
+	SmmAstNode res = smmNewAstNode(ast, kind);
+	ast->types[res] = type->kind;
+	ast->tokens[res] = parser->curToken;
+	ast->flags[res] = nfSmmConst;
 	getNextToken(parser);
 	return res;
 }
 
-static PSmmAstNode parseIdentFactor(PSmmParser parser) {
-	PSmmAstNode res = &errorNode;
+static SmmAstNode parseIdentFactor(PSmmParser parser) {
+	PSmmAst ast = parser->ast;
+	SmmAstNode res = errorNode;
 	PSmmToken identToken = parser->curToken;
 	getNextToken(parser);
-	PSmmAstIdentNode var = ibsDictGet(parser->idents, identToken->repr);
+	SmmAstNode var = getIdent(parser, identToken->atom);
 
 	if (parser->curToken->kind == ':') {
 		// This is declaration
 		if (var) {
-			if (var->kind == nkSmmType) {
+			if (ast->kinds[var] == nkSmmType) {
 				// If type identifier was used as variable identifier
-				const char* tokenStr = nodeKindToString[var->kind];
-				smmPostMessage(parser->msgs, errSmmIdentTaken, identToken->filePos, identToken->repr, tokenStr);
-			} else if (var->level < parser->curScope->level) {
+				const char* tokenStr = nodeKindToString[ast->kinds[var]];
+				smmPostMessage(parser->msgs, errSmmIdentTaken, identToken->offset, identToken->repr, tokenStr);
+			} else if (ast->levels[var] < parser->curLevel) {
 				res = createNewIdent(parser, identToken);
-			} else if (var->kind == nkSmmFunc) {
+			} else if (ast->kinds[var] == nkSmmFunc) {
 				//Posible overload
 				res = createNewIdent(parser, identToken);
 			} else {
-				smmPostMessage(parser->msgs, errSmmRedefinition, identToken->filePos, identToken->repr);
+				smmPostMessage(parser->msgs, errSmmRedefinition, identToken->offset, identToken->repr);
 			}
 		} else {
 			res = createNewIdent(parser, identToken);
 		}
 	} else if (parser->curToken->kind == '(') {
 		getNextToken(parser);
-		if (var && var->kind == nkSmmType) {
+		if (var && ast->kinds[var] == nkSmmType) {
 			// This is a cast
-			PSmmAstNode expr = parseExpression(parser);
-			if (expr == &errorNode) {
+			SmmAstNode expr = parseExpression(parser);
+			if (expr == errorNode) {
 				if (findToken(parser, ')')) getNextToken(parser);
 				return expr;
 			}
 			expect(parser, ')');
-			res = smmNewAstNode(nkSmmCast, parser->a);
-			res->left = expr;
-			res->token = identToken;
-			res->type = var->type;
+			res = smmNewAstNode(ast, nkSmmCast);
+			ast->lefts[res] = expr;
+			ast->tokens[res] = identToken;
+			ast->types[res] = ast->types[var];
 		} else {
-			PSmmAstNode resCall = smmNewAstNode(nkSmmCall, parser->a);
-			resCall->isIdent = true;
-			resCall->token = identToken;
+			SmmAstNode resCall = smmNewAstNode(ast, nkSmmCall);
+			ast->flags[resCall] = nfSmmIdent;
+			ast->tokens[resCall] = identToken;
 			if (parser->curToken->kind != ')') {
-				PSmmAstNode lastArg = parseExpression(parser);
-				resCall->asCall.args = lastArg;
-				if (lastArg == &errorNode) resCall->kind = nkSmmError;
+				uint32_t firstArg = parser->childCount;
+				SmmAstNode arg = parseExpression(parser);
+				pushChild(parser, arg);
+				if (arg == errorNode) ast->kinds[resCall] = nkSmmError;
 				while (parser->curToken->kind == ',') {
 					getNextToken(parser);
-					lastArg->next = parseExpression(parser);
-					lastArg = lastArg->next;
-					if (lastArg == &errorNode) resCall->kind = nkSmmError;
+					arg = parseExpression(parser);
+					pushChild(parser, arg);
+					if (arg == errorNode) ast->kinds[resCall] = nkSmmError;
 				}
+				ast->args[resCall] = popChildren(parser, firstArg);
 			}
-			if (!expect(parser, ')') || resCall->kind == nkSmmError) {
+			if (!expect(parser, ')') || ast->kinds[resCall] == nkSmmError) {
 				findToken(parser, ')');
 			} else {
 				res = resCall;
@@ -255,44 +390,47 @@ static PSmmAstNode parseIdentFactor(PSmmParser parser) {
 		}
 	} else {
 		if (var) {
-			if (var->kind == nkSmmType || !var->isIdent) {
+			if (ast->kinds[var] == nkSmmType || !(ast->flags[var] & nfSmmIdent)) {
 				// if type or keyword is used in place of variable
-				const char* tokenStr = nodeKindToString[var->kind];
-				smmPostMessage(parser->msgs, errSmmIdentTaken, identToken->filePos, identToken->repr, tokenStr);
-			} else if (var->kind == nkSmmFunc) {
-				smmPostMessage(parser->msgs, errSmmGotUnexpectedToken, parser->curToken->filePos, "(", parser->curToken->repr);
+				const char* tokenStr = nodeKindToString[ast->kinds[var]];
+				smmPostMessage(parser->msgs, errSmmIdentTaken, identToken->offset, identToken->repr, tokenStr);
+			} else if (ast->kinds[var] == nkSmmFunc) {
+				PSmmToken got = parser->curToken;
+				char gotBuf[SMM_TOKEN_STRING_BUF_SIZE];
+				snprintf(gotBuf, sizeof(gotBuf), "%.*s", (int)got->length, got->repr);
+				smmPostMessage(parser->msgs, errSmmGotUnexpectedToken, got->offset, "(", gotBuf);
 			} else {
-				res = smmNewAstNode(nkSmmIdent, parser->a);
-				*res = *(PSmmAstNode)var;
-				res->token = identToken;
+				res = smmNewAstNode(ast, nkSmmIdent);
+				smmCopyAstNode(ast, res, var);
+				ast->tokens[res] = identToken;
 			}
 		} else {
-			res = smmNewAstNode(nkSmmIdent, parser->a);
-			res->isIdent = true;
-			res->token = identToken;
+			res = smmNewAstNode(ast, nkSmmIdent);
+			ast->flags[res] = nfSmmIdent;
+			ast->tokens[res] = identToken;
 		}
 	}
 
 	return res;
 }
 
-static PSmmAstNode parseFuncParams(PSmmParser parser, PSmmAstParamNode firstParam) {
-	assert(firstParam != NULL);
+static SmmAstNode parseFuncParams(PSmmParser parser, SmmAstNode firstParam) {
+	assert(firstParam != 0);
 	assert(parser->curToken->kind == ':');
 
 	getNextToken(parser); //skip ':'
 
 	PSmmTypeInfo typeInfo = parseType(parser);
-	if (typeInfo->kind == tiSmmUnknown && !findEitherToken(parser, ',', ')')) return &errorNode;
-
-	int paramCount = 1;
-	firstParam->kind = nkSmmParamDefinition;
-	firstParam->type = typeInfo;
-	firstParam->isIdent = true;
-	firstParam->level = parser->curScope->level + 1;
-	ibsDictPush(parser->idents, firstParam->token->repr, firstParam);
+	if (typeInfo->kind == tiSmmUnknown && !findEitherToken(parser, ',', ')')) return errorNode;
 
-	PSmmAstParamNode param = firstParam;
+	PSmmAst ast = parser->ast;
+	uint32_t firstChild = parser->childCount;
+	pushChild(parser, firstParam);
+	ast->kinds[firstParam] = nkSmmParamDefinition;
+	ast->types[firstParam] = typeInfo->kind;
+	ast->flags[firstParam] |= nfSmmIdent;
+	ast->levels[firstParam] = parser->curLevel + 1;
+	bindIdent(parser, ast->tokens[firstParam]->atom, firstParam);
 
 	while (parser->curToken->kind == ',') {
 		getNextToken(parser);
@@ -309,38 +447,37 @@ static PSmmAstNode parseFuncParams(PSmmParser parser, PSmmAstParamNode firstPara
 		if (paramTypeInfo->kind == tiSmmUnknown) {
 			findEitherToken(parser, ',', ')');
 		}
-		PSmmAstParamNode newParam = ibsDictGet(parser->idents, paramName->repr);
+		SmmAstNode newParam = getIdent(parser, paramName->atom);
 		if (newParam) {
-			if (newParam->level == parser->curScope->level + 1) {
-				smmPostMessage(parser->msgs, errSmmRedefinition, paramName->filePos, paramName->repr);
+			if (ast->levels[newParam] == parser->curLevel + 1) {
+				smmPostMessage(parser->msgs, errSmmRedefinition, paramName->offset, paramName->repr);
 				continue;
-			} else if (!newParam->isIdent) {
-				const char* tokenStr = nodeKindToString[newParam->kind];
-				smmPostMessage(parser->msgs, errSmmIdentTaken, paramName->filePos, paramName->repr, tokenStr);
+			} else if (!(ast->flags[newParam] & nfSmmIdent)) {
+				const char* tokenStr = nodeKindToString[ast->kinds[newParam]];
+				smmPostMessage(parser->msgs, errSmmIdentTaken, paramName->offset, paramName->repr, tokenStr);
 				continue;
 			}
 		}
-		paramCount++;
-		newParam = smmNewAstNode(nkSmmParam, parser->a);
-		newParam->isIdent = true;
-		newParam->level = parser->curScope->level + 1;
-		newParam->token = paramName;
-		newParam->type = paramTypeInfo;
-		ibsDictPush(parser->idents, paramName->repr, newParam);
-		param->next = newParam;
-		param = newParam;
+		newParam = smmNewAstNode(ast, nkSmmParam);
+		ast->flags[newParam] = nfSmmIdent;
+		ast->levels[newParam] = parser->curLevel + 1;
+		ast->tokens[newParam] = paramName;
+		ast->types[newParam] = paramTypeInfo->kind;
+		bindIdent(parser, paramName->atom, newParam);
+		pushChild(parser, newParam);
 	}
 
-	firstParam->count = paramCount;
+	// Until the func node is created the first param keeps the list of all params
+	ast->params[firstParam] = popChildren(parser, firstChild);
 
-	return (PSmmAstNode)firstParam;
+	return firstParam;
 }
 
 static PSmmToken getUnaryOperator(PSmmParser parser) {
 	PSmmToken res;
 	switch (parser->curToken->kind) {
 	case '!':
-		smmPostMessage(parser->msgs, errSmmBangUsedAsNot, parser->curToken->filePos);
+		smmPostMessage(parser->msgs, errSmmBangUsedAsNot, parser->curToken->offset);
 		parser->curToken->kind = tkSmmNot;
 		// fallthrough
 	case '-': case tkSmmNot: case '+':
@@ -354,8 +491,9 @@ static PSmmToken getUnaryOperator(PSmmParser parser) {
 	return res;
 }
 
-static PSmmAstNode parseFactor(PSmmParser parser) {
-	PSmmAstNode res = &errorNode;
+static SmmAstNode parseFactor(PSmmParser parser) {
+	PSmmAst ast = parser->ast;
+	SmmAstNode res = errorNode;
 	bool canBeFuncDefn = parser->prevToken && parser->prevToken->kind == ':';
 	PSmmToken unary = getUnaryOperator(parser);
 	canBeFuncDefn = canBeFuncDefn && !unary;
@@ -364,40 +502,36 @@ static PSmmAstNode parseFactor(PSmmParser parser) {
 		if (parser->curToken->kind == ')') {
 			getNextToken(parser);
 			if (canBeFuncDefn) {
-				PSmmAstNode param = smmNewAstNode(nkSmmParamDefinition, parser->a);
-				param->asParam.count = 0;
-				return param;
+				// Param definition without a params list for a func without params
+				return smmNewAstNode(ast, nkSmmParamDefinition);
 			}
-			smmPostMessage(parser->msgs, errSmmGotUnexpectedToken, parser->curToken->filePos, "expression", "')'");
+			smmPostMessage(parser->msgs, errSmmGotUnexpectedToken, parser->curToken->offset, "expression", "')'");
 			findToken(parser, ';');
-			return &errorNode;
+			return errorNode;
 		}
 		parser->curToken->canBeNewSymbol = canBeFuncDefn;
 		res = parseExpression(parser);
-		if (res == &errorNode) {
+		if (res == errorNode) {
 			if (findToken(parser, ')')) getNextToken(parser);
-			return &errorNode;
+			return errorNode;
 		}
+		uint32_t paramsMark = ibsSymTableMark(parser->idents);
 		// In case expression is followed by ':' it must be just ident and thus first param of func declaration
 		if (parser->curToken->kind == ':') {
-			assert(canBeFuncDefn && res->isIdent);
-			res = parseFuncParams(parser, &res->asParam);
+			assert(canBeFuncDefn && (ast->flags[res] & nfSmmIdent));
+			res = parseFuncParams(parser, res);
 		}
 		if (!expect(parser, ')')) {
 			int tk = parser->curToken->kind;
-			PSmmAstNode param = res;
-			switch (res->kind) {
+			switch (ast->kinds[res]) {
 			case nkSmmParamDefinition:
-				while (param) {
-					ibsDictPop(parser->idents, param->token->repr);
-					param = param->next;
-				}
+				ibsSymTableRestore(parser->idents, paramsMark);
 				// If it seems only ')' was forgotten in func definition we want to coninue parsing.
 				// Otherwise we want to fallthrough to error handling.
 				if (tk == tkSmmRArrow || tk == '{' || tk == ';') break;
 			default:
 				if (findToken(parser, ')')) getNextToken(parser);
-				return &errorNode;
+				return errorNode;
 			}
 		}
 	} else {
@@ -408,33 +542,33 @@ static PSmmAstNode parseFactor(PSmmParser parser) {
 			break;
 		default:
 			if (parser->curToken->kind != tkSmmErr) {
-				char gotBuf[4];
+				char gotBuf[SMM_TOKEN_STRING_BUF_SIZE];
 				const char* got = smmTokenToString(parser->curToken, gotBuf);
-				smmPostMessage(parser->msgs, errSmmGotUnexpectedToken, parser->curToken->filePos, "identifier or literal", got);
+				smmPostMessage(parser->msgs, errSmmGotUnexpectedToken, parser->curToken->offset, "identifier or literal", got);
 			}
 			break;
 		}
 	}
 
-	if (res == &errorNode || !unary) return res;
+	if (res == errorNode || !unary) return res;
 
 	switch (unary->kind) {
 	case '-':
-		if (res->kind == nkSmmInt || res->kind == nkSmmFloat) {
+		if (ast->kinds[res] == nkSmmInt || ast->kinds[res] == nkSmmFloat) {
 			assert(false && "Lexer should have handled this case!");
 		} else {
-			PSmmAstNode neg = smmNewAstNode(nkSmmNeg, parser->a);
-			neg->left = res;
-			neg->token = unary;
+			SmmAstNode neg = smmNewAstNode(ast, nkSmmNeg);
+			ast->lefts[neg] = res;
+			ast->tokens[neg] = unary;
 			res = neg;
 		}
 		break;
 	case tkSmmNot:
 		{
-			PSmmAstNode not = smmNewAstNode(nkSmmNot, parser->a);
-			not->left = res;
-			not->type = &builtInTypes[tiSmmBool];
-			not->token = unary;
+			SmmAstNode not = smmNewAstNode(ast, nkSmmNot);
+			ast->lefts[not] = res;
+			ast->types[not] = tiSmmBool;
+			ast->tokens[not] = unary;
 			res = not;
 			break;
 		}
@@ -442,7 +576,8 @@ static PSmmAstNode parseFactor(PSmmParser parser) {
 	return res;
 }
 
-static PSmmAstNode parseBinOp(PSmmParser parser, PSmmAstNode left, int prec) {
+static SmmAstNode parseBinOp(PSmmParser parser, SmmAstNode left, int prec) {
+	PSmmAst ast = parser->ast;
 	while (true) {
 		int precedence = binOpPrecs[parser->curToken->kind & 0x7f];
 		if (!precedence || precedence < prec) {
@@ -452,130 +587,182 @@ static PSmmAstNode parseBinOp(PSmmParser parser, PSmmAstNode left, int prec) {
 		PSmmToken opToken = parser->curToken;
 
 		getNextToken(parser);
-		PSmmAstNode right = parseFactor(parser);
-		if (right == &errorNode) return &errorNode;
+		SmmAstNode right = parseFactor(parser);
+		if (right == errorNode) return errorNode;
 
 		int nextPrecedence = binOpPrecs[parser->curToken->kind & 0x7f];
 		if (nextPrecedence && nextPrecedence > precedence) {
 			right = parseBinOp(parser, right, precedence + 1);
-			if (right == &errorNode) return &errorNode;
-		}
-
-		PSmmAstNode res = smmNewAstNode(nkSmmError, parser->a);
-		res->left = left;
-		res->right = right;
-		res->token = opToken;
-		res->isBinOp = true;
-
-		switch (res->token->kind) {
-		case tkSmmIntDiv: res->kind = nkSmmSDiv; break; // Second pass might change this to unsigned version
-		case tkSmmIntMod: res->kind = nkSmmSRem; break;
-		case '*': res->kind = nkSmmMul; break;
-		case '/': res->kind = nkSmmFDiv; break;
-		case '%': res->kind = nkSmmFRem; break;
-		case '+': res->kind = nkSmmAdd; break;
-		case '-': res->kind = nkSmmSub; break;
-		case '>': res->kind = nkSmmGt; break;
-		case '<': res->kind = nkSmmLt; break;
-		case tkSmmEq: res->kind = nkSmmEq; break;
-		case tkSmmNotEq: res->kind = nkSmmNotEq; break;
-		case tkSmmGtEq: res->kind = nkSmmGtEq; break;
-		case tkSmmLtEq: res->kind = nkSmmLtEq; break;
-		case tkSmmAndOp: res->kind = nkSmmAndOp; break;
-		case tkSmmXorOp: res->kind = nkSmmXorOp; break;
-		case tkSmmOrOp: res->kind = nkSmmOrOp; break;
+			if (right == errorNode) return errorNode;
+		}
+
+		SmmAstNodeKind kind = nkSmmError;
+		switch (opToken->kind) {
+		case tkSmmIntDiv: kind = nkSmmSDiv; break; // Second pass might change this to unsigned version
+		case tkSmmIntMod: kind = nkSmmSRem; break;
+		case '*': kind = nkSmmMul; break;
+		case '/': kind = nkSmmFDiv; break;
+		case '%': kind = nkSmmFRem; break;
+		case '+': kind = nkSmmAdd; break;
+		case '-': kind = nkSmmSub; break;
+		case '>': kind = nkSmmGt; break;
+		case '<': kind = nkSmmLt; break;
+		case tkSmmEq: kind = nkSmmEq; break;
+		case tkSmmNotEq: kind = nkSmmNotEq; break;
+		case tkSmmGtEq: kind = nkSmmGtEq; break;
+		case tkSmmLtEq: kind = nkSmmLtEq; break;
+		case tkSmmAndOp: kind = nkSmmAndOp; break;
+		case tkSmmXorOp: kind = nkSmmXorOp; break;
+		case tkSmmOrOp: kind = nkSmmOrOp; break;
 		default:
 			assert(false && "Got unexpected token for binary operation");
 			break;
 		}
 
-		switch (res->token->kind) {
+		SmmAstNode res = smmNewAstNode(ast, kind);
+		ast->lefts[res] = left;
+		ast->rights[res] = right;
+		ast->tokens[res] = opToken;
+		ast->flags[res] = nfSmmBinOp;
+
+		switch (opToken->kind) {
 		case tkSmmAndOp: case tkSmmXorOp: case tkSmmOrOp:
 		case tkSmmEq: case tkSmmNotEq: case tkSmmGtEq: case tkSmmLtEq:
 		case '>': case '<':
-			res->type = &builtInTypes[tiSmmBool];
+			ast->types[res] = tiSmmBool;
 			break;
 		}
 		left = res;
 	}
 }
 
-static PSmmAstNode parseExpression(PSmmParser parser) {
-	PSmmAstNode left = parseFactor(parser);
-	if (left != &errorNode && left->kind != nkSmmParamDefinition) {
+static SmmAstNode parseExpression(PSmmParser parser) {
+	SmmAstNode left = parseFactor(parser);
+	if (left != errorNode && parser->ast->kinds[left] != nkSmmParamDefinition) {
 		left = parseBinOp(parser, left, 0);
 	}
 	return left;
 }
 
-static void removeScopeVars(PSmmParser parser) {
-	PSmmAstDeclNode curDecl = parser->curScope->decls;
-	while (curDecl) {
-		ibsDictPop(parser->idents, curDecl->left->left->token->repr);
-		curDecl = curDecl->nextDecl;
-	}
-	PSmmAstScopeNode prevScope = parser->curScope->prevScope;
-	parser->curScope = prevScope;
+static void removeScopeVars(PSmmParser parser, uint32_t scopeMark) {
+	ibsSymTableRestore(parser->idents, scopeMark);
+	parser->curScope = parser->ast->prevScopes[parser->curScope];
+	parser->curLevel--;
 }
 
-static PSmmAstBlockNode parseBlock(PSmmParser parser, PSmmTypeInfo curFuncReturnType, bool isFuncBlock) {
+static SmmAstNode parseBlock(PSmmParser parser, PSmmTypeInfo curFuncReturnType, bool isFuncBlock) {
 	assert(parser->curToken->kind == '{');
 	getNextToken(parser); // Skip '{'
-	PSmmAstBlockNode block = smmNewAstNode(nkSmmBlock, parser->a);
-	block->scope = newScopeNode(parser);
-	block->scope->returnType = curFuncReturnType;
-	PSmmAstNode* nextStmt = &block->stmts;
-	PSmmAstNode curStmt = NULL;
+	PSmmAst ast = parser->ast;
+	SmmAstNode block = smmNewAstNode(ast, nkSmmBlock);
+	ast->scopes[block] = newScopeNode(parser);
+	uint32_t scopeMark = ibsSymTableMark(parser->idents);
+	ast->types[ast->scopes[block]] = curFuncReturnType->kind;
+	uint32_t firstStmt = parser->childCount;
+	SmmAstNode curStmt = 0;
 	while (parser->curToken->kind != tkSmmEof && parser->curToken->kind != '}') {
-		if (curStmt && curStmt->kind == nkSmmReturn) {
-			smmPostMessage(parser->msgs, errSmmUnreachableCode, parser->curToken->filePos);
+		if (curStmt && ast->kinds[curStmt] == nkSmmReturn) {
+			smmPostMessage(parser->msgs, errSmmUnreachableCode, parser->curToken->offset);
 		}
 		curStmt = parseStatement(parser);
-		if (curStmt != NULL && curStmt != &errorNode) {
-			*nextStmt = curStmt;
-			nextStmt = &curStmt->next;
+		if (curStmt && curStmt != errorNode) {
+			pushChild(parser, curStmt);
 		}
 	}
 
 	if (curStmt) {
-		bool isLastStmtReturn = curStmt->kind == nkSmmReturn;
-		bool isLastStmtReturningBlock = curStmt->kind == nkSmmBlock && curStmt->asBlock.endsWithReturn;
-		block->endsWithReturn = isLastStmtReturn || isLastStmtReturningBlock;
+		bool isLastStmtReturn = ast->kinds[curStmt] == nkSmmReturn;
+		bool isLastStmtReturningBlock = ast->kinds[curStmt] == nkSmmBlock && (ast->flags[curStmt] & nfSmmEndsWithReturn);
+		if (isLastStmtReturn || isLastStmtReturningBlock) ast->flags[block] |= nfSmmEndsWithReturn;
 	}
 
 	if (isFuncBlock) {
 		bool funcHasReturnType = curFuncReturnType->kind != tiSmmUnknown && curFuncReturnType->kind != tiSmmVoid;
-		if (funcHasReturnType && !block->endsWithReturn && curStmt != &errorNode) {
-			smmPostMessage(parser->msgs, errSmmFuncMustReturnValue, parser->curToken->filePos);
-		} else if (!funcHasReturnType && !block->endsWithReturn) {
+		bool endsWithReturn = ast->flags[block] & nfSmmEndsWithReturn;
+		if (funcHasReturnType && !endsWithReturn && curStmt != errorNode) {
+			smmPostMessage(parser->msgs, errSmmFuncMustReturnValue, parser->curToken->offset);
+		} else if (!funcHasReturnType && !endsWithReturn) {
 			// We add empty return statement
-			PSmmAstNode retNode = smmNewAstNode(nkSmmReturn, parser->a);
-			retNode->token = newToken(tkSmmReturn, "return", parser->curToken->filePos, parser->a);
-			retNode->type = curFuncReturnType;
-			*nextStmt = retNode;
+			SmmAstNode retNode = smmNewAstNode(ast, nkSmmReturn);
+			ast->tokens[retNode] = newToken(tkSmmReturn, "return", parser->curToken->offset, parser->a);
+			ast->types[retNode] = curFuncReturnType->kind;
+			pushChild(parser, retNode);
 		}
 	}
 
+	ast->stmts[block] = popChildren(parser, firstStmt);
 	expect(parser, '}');
-	removeScopeVars(parser);
+	removeScopeVars(parser, scopeMark);
 
 	return block;
 }
 
+static void pushSkippedToken(PSmmParser parser, PSmmToken token) {
+	if (parser->skippedTokenCount == parser->skippedTokenCapacity) {
+		uint32_t newCapacity = parser->skippedTokenCapacity ? parser->skippedTokenCapacity * 2 : 1024;
+		PSmmToken newTokens = ibsAllocTagged(parser->a, newCapacity * sizeof(struct SmmToken), "skipped tokens");
+		if (parser->skippedTokenCount) memcpy(newTokens, parser->skippedTokens, parser->skippedTokenCount * sizeof(struct SmmToken));
+		parser->skippedTokens = newTokens;
+		parser->skippedTokenCapacity = newCapacity;
+	}
+	parser->skippedTokens[parser->skippedTokenCount++] = *token;
+}
+
+/**
+* Skips all the tokens up to and including the '}' that matches the current
+* '{' and remembers where they are so smmParseFuncBody can parse them later.
+* Tokens that don't come from tokens array are copied since they can't be
+* read again otherwise.
+*/
+static void skipFuncBody(PSmmParser parser, SmmAstNode func) {
+	assert(parser->curToken->kind == '{');
+	if (parser->skippedBodyCount == parser->skippedBodyCapacity) {
+		uint32_t newCapacity = parser->skippedBodyCapacity ? parser->skippedBodyCapacity * 2 : 64;
+		struct SmmSkippedBody* newBodies = ibsAllocTagged(parser->a, newCapacity * sizeof(struct SmmSkippedBody), "skipped bodies");
+		if (parser->skippedBodyCount) memcpy(newBodies, parser->skippedBodies, parser->skippedBodyCount * sizeof(struct SmmSkippedBody));
+		parser->skippedBodies = newBodies;
+		parser->skippedBodyCapacity = newCapacity;
+	}
+	struct SmmSkippedBody* body = &parser->skippedBodies[parser->skippedBodyCount++];
+	assert(parser->skippedBodyCount == 1 || body[-1].func < func);
+	body->func = func;
+	body->firstToken = parser->tokens ? parser->cursor : parser->skippedTokenCount;
+	PSmmAst ast = parser->ast;
+	uint32_t params = ast->params[func];
+	body->bindParams = ast->extras[params] > 0 && getIdent(parser, ast->tokens[ast->extras[params + 1]]->atom) == ast->extras[params + 1];
+
+	uint32_t depth = 0;
+	uint32_t tokenCount = 0;
+	do {
+		int kind = parser->curToken->kind;
+		if (!parser->tokens) pushSkippedToken(parser, parser->curToken);
+		tokenCount++;
+		// Unclosed body ends with eof which we leave as current token
+		if (kind == tkSmmEof) break;
+		if (kind == '{') depth++;
+		else if (kind == '}') depth--;
+		getNextToken(parser);
+	} while (depth > 0);
+
+	body->tokenCount = tokenCount;
+	ast->flags[func] |= nfSmmLazyBody;
+}
+
 /**
 * This is called after we already parsed parameters so we expect optional
 * arrow and type and then also optional function body. Func node should
 * have kind, token and params set.
 */
-static PSmmAstNode parseFunction(PSmmParser parser, PSmmAstFuncDefNode func) {
-	assert(func->kind == nkSmmFunc && func->token);
+static SmmAstNode parseFunction(PSmmParser parser, SmmAstNode func) {
+	PSmmAst ast = parser->ast;
+	assert(ast->kinds[func] == nkSmmFunc && ast->tokens[func]);
 	bool ignoreMissingSemicolon = false;
 	int curKind = parser->curToken->kind;
 	if (curKind != tkSmmRArrow && curKind != '{' && curKind != ';') {
 		if (curKind != tkSmmErr) {
-			char gotBuf[4];
+			char gotBuf[SMM_TOKEN_STRING_BUF_SIZE];
 			const char* got = smmTokenToString(parser->curToken, gotBuf);
-			smmPostMessage(parser->msgs, errSmmGotUnexpectedToken, parser->curToken->filePos, "one of '->', '{' or ';'", got);
+			smmPostMessage(parser->msgs, errSmmGotUnexpectedToken, parser->curToken->offset, "one of '->', '{' or ';'", got);
 		}
 		if (!parser->curToken->isFirstOnLine) {
 			findToken(parser, tkSmmRArrow);
@@ -589,184 +776,199 @@ static PSmmAstNode parseFunction(PSmmParser parser, PSmmAstFuncDefNode func) {
 		getNextToken(parser);
 		typeInfo = parseType(parser);
 	}
-	func->returnType = typeInfo;
+	ast->types[func] = typeInfo->kind;
 	if (parser->curToken->kind == '{') {
-		func->body = parseBlock(parser, typeInfo, true);
+		if (parser->lazyFuncBodies && parser->curLevel == 0) {
+			skipFuncBody(parser, func);
+		} else {
+			ast->bodies[func] = parseBlock(parser, typeInfo, true);
+		}
 	} else if (parser->curToken->kind != ';') {
 		if (!ignoreMissingSemicolon && parser->curToken->kind != tkSmmErr) {
-			char gotBuf[4];
+			char gotBuf[SMM_TOKEN_STRING_BUF_SIZE];
 			const char* got = smmTokenToString(parser->curToken, gotBuf);
-			smmPostMessage(parser->msgs, errSmmGotUnexpectedToken, parser->curToken->filePos, "{ or ;", got);
+			smmPostMessage(parser->msgs, errSmmGotUnexpectedToken, parser->curToken->offset, "{ or ;", got);
 		}
 		if (!parser->curToken->isFirstOnLine) {
 			// if illegal token is in the same line then we will skip all until terminating token
 			findToken(parser, ';');
 		}
 		// Otherwise we assume ';' is forgotten so we don't do findToken here hoping normal stmt starts next
-		return &errorNode;
+		return errorNode;
 	}
-	PSmmAstParamNode param = func->params;
-	while (param) {
-		ibsDictPop(parser->idents, param->token->repr);
-		param = param->next;
+	uint32_t params = ast->params[func];
+	uint32_t paramCount = ast->extras[params];
+	// Params are the last symbols bound before the body so we just unwind that many bindings
+	// unless they were already unbound because of missing ')'
+	if (paramCount > 0 && getIdent(parser, ast->tokens[ast->extras[params + 1]]->atom) == ast->extras[params + 1]) {
+		ibsSymTableRestore(parser->idents, ibsSymTableMark(parser->idents) - paramCount);
 	}
-	return (PSmmAstNode)func;
+	return func;
 }
 
-static PSmmAstNode parseAssignment(PSmmParser parser, PSmmAstNode lval) {
+static SmmAstNode parseAssignment(PSmmParser parser, SmmAstNode lval) {
+	PSmmAst ast = parser->ast;
 	PSmmToken eqToken = parser->curToken;
 	getNextToken(parser);
-	PSmmAstNode val = parseExpression(parser);
-	if (val == &errorNode) {
+	SmmAstNode val = parseExpression(parser);
+	if (val == errorNode) {
 		findToken(parser, ';');
-		return &errorNode;
+		return errorNode;
 	}
 
-	if (val->kind == nkSmmParamDefinition) return val;
+	if (ast->kinds[val] == nkSmmParamDefinition) return val;
 
-	PSmmAstNode assignment = smmNewAstNode(nkSmmAssignment, parser->a);
-	assignment->left = lval;
-	assignment->right = val;
-	assignment->type = lval->type;
-	assignment->token = eqToken;
+	SmmAstNode assignment = smmNewAstNode(ast, nkSmmAssignment);
+	ast->lefts[assignment] = lval;
+	ast->rights[assignment] = val;
+	ast->types[assignment] = ast->types[lval];
+	ast->tokens[assignment] = eqToken;
 	return assignment;
 }
 
-static PSmmAstNode parseDeclaration(PSmmParser parser, PSmmAstNode lval) {
+static SmmAstNode parseDeclaration(PSmmParser parser, SmmAstNode lval) {
+	PSmmAst ast = parser->ast;
 	PSmmToken declToken = parser->curToken;
 	assert(parser->curToken->kind == ':');
 	getNextToken(parser);
 
 	if (parser->curToken->kind == tkSmmIdent) {
 		//Type is given in declaration so use it
-		lval->type = parseType(parser);
+		ast->types[lval] = parseType(parser)->kind;
 	} else if (parser->curToken->kind == ';') {
 		// In case of a statement like 'a :;'
-		smmPostMessage(parser->msgs, errSmmGotUnexpectedToken, parser->curToken->filePos, "type", "';'");
-		lval->type = &builtInTypes[tiSmmUnknown];
+		smmPostMessage(parser->msgs, errSmmGotUnexpectedToken, parser->curToken->offset, "type", "';'");
+		ast->types[lval] = tiSmmUnknown;
 	}
 
-	PSmmAstDeclNode spareNode = NULL;
-	PSmmAstNode expr = NULL;
+	SmmAstNode spareNode = 0;
+	SmmAstNode expr = 0;
 	if (parser->curToken->kind == '=') {
 		expr = parseAssignment(parser, lval);
 	} else if (parser->curToken->kind == ':') {
-		lval->kind = nkSmmConst;
-		lval->isConst = true;
+		ast->kinds[lval] = nkSmmConst;
+		ast->flags[lval] |= nfSmmConst;
 		expr = parseAssignment(parser, lval);
-		if (expr->kind == nkSmmParamDefinition) {
-			expr->kind = nkSmmParam;
-			if (parser->curScope->level > 0) {
-				smmPostMessage(parser->msgs, errSmmFuncUnderScope, lval->token->filePos, lval->token->repr);
+		if (ast->kinds[expr] == nkSmmParamDefinition) {
+			ast->kinds[expr] = nkSmmParam;
+			if (parser->curLevel > 0) {
+				smmPostMessage(parser->msgs, errSmmFuncUnderScope, ast->tokens[lval]->offset, ast->tokens[lval]->repr);
 			}
-			lval->kind = nkSmmFunc;
-			lval->asFunc.params = (PSmmAstParamNode)expr;
-			if (lval->asFunc.params->count == 0) {
-				spareNode = &expr->asDecl;
-				spareNode->kind = nkSmmDecl;
-				lval->asFunc.params = NULL;
+			ast->kinds[lval] = nkSmmFunc;
+			ast->params[lval] = ast->params[expr];
+			ast->params[expr] = 0;
+			if (ast->params[lval] == 0) {
+				// Func has no params so we reuse param definition node for decl
+				spareNode = expr;
+				ast->kinds[spareNode] = nkSmmDecl;
 			}
-			lval = parseFunction(parser, &lval->asFunc);
-			if (parser->curScope->level > 0) {
-				lval = &errorNode;
+			lval = parseFunction(parser, lval);
+			if (parser->curLevel > 0) {
+				lval = errorNode;
 			}
 			expr = lval;
 		}
 	} else if (parser->curToken->kind != ';') {
-		expr = &errorNode;
+		expr = errorNode;
 		if (parser->curToken->kind != tkSmmErr) {
-			char gotBuf[4];
+			char gotBuf[SMM_TOKEN_STRING_BUF_SIZE];
 			const char* got = smmTokenToString(parser->curToken, gotBuf);
-			smmPostMessage(parser->msgs, errSmmGotUnexpectedToken, parser->curToken->filePos, "':', '=' or type", got);
+			smmPostMessage(parser->msgs, errSmmGotUnexpectedToken, parser->curToken->offset, "':', '=' or type", got);
 		}
 		findToken(parser, ';');
 	}
 
-	if (lval == &errorNode) {
-		return &errorNode;
+	if (lval == errorNode) {
+		return errorNode;
 	}
 
-	PSmmAstNode existing = ibsDictGet(parser->idents, lval->token->repr);
-	if (existing && existing->asIdent.level == lval->asIdent.level && lval->kind != nkSmmFunc) {
-		assert(existing->kind == nkSmmFunc);
-		smmPostMessage(parser->msgs, errSmmRedefinition, lval->token->filePos, lval->token->repr);
-		return &errorNode;
+	PSmmToken lvalToken = ast->tokens[lval];
+	SmmAstNode existing = getIdent(parser, lvalToken->atom);
+	if (existing && ast->levels[existing] == ast->levels[lval] && ast->kinds[lval] != nkSmmFunc) {
+		assert(ast->kinds[existing] == nkSmmFunc);
+		smmPostMessage(parser->msgs, errSmmRedefinition, lvalToken->offset, lvalToken->repr);
+		return errorNode;
 	}
 
-	ibsDictPush(parser->idents, lval->token->repr, lval);
-	PSmmAstDeclNode decl = spareNode ? spareNode : smmNewAstNode(nkSmmDecl, parser->a);
-	decl->token = declToken;
-	if (expr == &errorNode) expr = NULL;
+	bindIdent(parser, lvalToken->atom, lval);
+	SmmAstNode decl = spareNode ? spareNode : smmNewAstNode(ast, nkSmmDecl);
+	ast->tokens[decl] = declToken;
+	if (expr == errorNode) expr = 0;
 
-	parser->curScope->lastDecl->nextDecl = decl;
-	parser->curScope->lastDecl = decl;
+	ast->nextDecls[ast->lastDecls[parser->curScope]] = decl;
+	ast->lastDecls[parser->curScope] = decl;
 
-	if (lval->kind == nkSmmFunc) {
-		decl->left = lval;
-		return NULL;
+	if (ast->kinds[lval] == nkSmmFunc) {
+		ast->lefts[decl] = lval;
+		return 0;
 	}
 
 	if (!expr) {
-		expr = smmNewAstNode(nkSmmAssignment, parser->a);
-		expr->left = lval;
-		expr->right = smmGetZeroValNode(parser->curToken->filePos, lval->type, parser->a);
-		expr->type = lval->type;
-		expr->token = ibsAlloc(parser->a, sizeof(struct SmmToken));
-		if (lval->isConst) {
-			expr->token->repr = ":";
+		expr = smmNewAstNode(ast, nkSmmAssignment);
+		ast->lefts[expr] = lval;
+		ast->rights[expr] = smmGetZeroValNode(ast, parser->curToken->offset, &builtInTypes[ast->types[lval]], parser->a);
+		ast->types[expr] = ast->types[lval];
+		PSmmToken token = ibsAllocTagged(parser->a, sizeof(struct SmmToken), "token");
+		if (ast->flags[lval] & nfSmmConst) {
+			token->repr = ":";
+			token->length = 1;
 		} else {
-			expr->token->repr = "=";
+			token->repr = "=";
+			token->length = 1;
 		}
-		expr->token->kind = expr->token->repr[0];
-		expr->token->filePos = parser->curToken->filePos;
+		token->kind = token->repr[0];
+		token->offset = parser->curToken->offset;
+		ast->tokens[expr] = token;
 	}
 
-	decl->left = expr;
+	ast->lefts[decl] = expr;
 
-	if (lval->isConst) return NULL;
+	if (ast->flags[lval] & nfSmmConst) return 0;
 
-	return (PSmmAstNode)decl;
+	return decl;
 }
 
-static PSmmAstNode parseReturnStmt(PSmmParser parser) {
+static SmmAstNode parseReturnStmt(PSmmParser parser) {
 	assert(parser->curToken->kind == tkSmmReturn);
 
-	PSmmAstNode expr = NULL;
+	SmmAstNode expr = 0;
 
 	PSmmToken retToken = parser->curToken;
 	getNextToken(parser);
 	if (parser->curToken->kind != ';') {
 		expr = parseExpression(parser);
-		if (expr == &errorNode) {
+		if (expr == errorNode) {
 			if (findToken(parser, ';')) getNextToken(parser);
-			return &errorNode;
+			return errorNode;
 		}
 	}
 
-	PSmmAstNode res = smmNewAstNode(nkSmmReturn, parser->a);
-	res->type = parser->curScope->returnType;
-	res->left = expr;
-	res->token = retToken;
+	PSmmAst ast = parser->ast;
+	SmmAstNode res = smmNewAstNode(ast, nkSmmReturn);
+	ast->types[res] = ast->types[parser->curScope];
+	ast->lefts[res] = expr;
+	ast->tokens[res] = retToken;
 	expect(parser, ';');
 	return res;
 }
 
-static PSmmAstNode parseExpressionStmt(PSmmParser parser) {
-	PSmmAstNode lval;
+static SmmAstNode parseExpressionStmt(PSmmParser parser) {
+	PSmmAst ast = parser->ast;
+	SmmAstNode lval;
 
-	struct SmmFilePos fpos = parser->curToken->filePos;
+	uint32_t offset = parser->curToken->offset;
 	parser->curToken->canBeNewSymbol = true;
 	lval = parseExpression(parser);
 
-	if (lval == &errorNode) {
+	if (lval == errorNode) {
 		if (findToken(parser, ';')) getNextToken(parser);
-		return &errorNode;
+		return errorNode;
 	}
 
-	if (!lval->isIdent && (parser->curToken->kind == ':' || parser->curToken->kind == '=')) {
-		smmPostMessage(parser->msgs, errSmmOperandMustBeLVal, fpos);
+	if (!(ast->flags[lval] & nfSmmIdent) && (parser->curToken->kind == ':' || parser->curToken->kind == '=')) {
+		smmPostMessage(parser->msgs, errSmmOperandMustBeLVal, offset);
 		if (findToken(parser, ';')) getNextToken(parser);
-		return &errorNode;
+		return errorNode;
 	}
 
 	if (parser->curToken->kind == ':') {
@@ -775,20 +977,21 @@ static PSmmAstNode parseExpressionStmt(PSmmParser parser) {
 		lval = parseAssignment(parser, lval);
 	}
 	if (lval) {
-		bool isJustIdent = lval->isIdent && (lval->kind != nkSmmCall) && (lval->kind != nkSmmError);
-		bool isAnyBinOpExceptLogical = lval->isBinOp && lval->kind != nkSmmAndOp && lval->kind != nkSmmOrOp;
+		SmmAstNodeKind kind = ast->kinds[lval];
+		bool isJustIdent = (ast->flags[lval] & nfSmmIdent) && (kind != nkSmmCall) && (kind != nkSmmError);
+		bool isAnyBinOpExceptLogical = (ast->flags[lval] & nfSmmBinOp) && kind != nkSmmAndOp && kind != nkSmmOrOp;
 		if (isJustIdent || isAnyBinOpExceptLogical) {
-			smmPostMessage(parser->msgs, wrnSmmNoEffectStmt, lval->token->filePos);
-			if (isJustIdent) lval = NULL;
+			smmPostMessage(parser->msgs, wrnSmmNoEffectStmt, ast->tokens[lval]->offset);
+			if (isJustIdent) lval = 0;
 		}
 	}
-	if (parser->prevToken->kind != '}' && (lval != &errorNode || parser->curToken->kind == ';')) {
+	if (parser->prevToken->kind != '}' && (lval != errorNode || parser->curToken->kind == ';')) {
 		expect(parser, ';');
 	}
 	return lval;
 }
 
-static PSmmAstNode parseIfWhileStmt(PSmmParser parser) {
+static SmmAstNode parseIfWhileStmt(PSmmParser parser) {
 	PSmmToken iftoken = parser->curToken;
 	SmmAstNodeKind kind = nkSmmIf;
 	int condTerm = tkSmmThen;
@@ -797,44 +1000,47 @@ static PSmmAstNode parseIfWhileStmt(PSmmParser parser) {
 		condTerm = tkSmmDo;
 	}
 	getNextToken(parser);
-	PSmmAstNode cond = parseExpression(parser);
+	SmmAstNode cond = parseExpression(parser);
 	expect(parser, condTerm);
-	PSmmAstNode body = parseStatement(parser);
-	PSmmAstIfWhileNode ifstmt = smmNewAstNode(kind, parser->a);
-	ifstmt->body = body;
-	ifstmt->cond = cond;
-	ifstmt->token = iftoken;
+	SmmAstNode body = parseStatement(parser);
+	PSmmAst ast = parser->ast;
+	SmmAstNode ifstmt = smmNewAstNode(ast, kind);
+	uint32_t branches = smmNewAstExtras(ast, 2);
+	ast->extras[branches] = body;
+	ast->branches[ifstmt] = branches;
+	ast->conds[ifstmt] = cond;
+	ast->tokens[ifstmt] = iftoken;
 	if (parser->curToken->kind == tkSmmElse) {
 		getNextToken(parser);
-		ifstmt->elseBody = parseStatement(parser);
+		ast->extras[branches + 1] = parseStatement(parser);
 	}
-	return (PSmmAstNode)ifstmt;
+	return ifstmt;
 }
 
-static PSmmAstNode parseStatement(PSmmParser parser) {
+static SmmAstNode parseStatement(PSmmParser parser) {
 	switch (parser->curToken->kind) {
 	case tkSmmReturn:
 		return parseReturnStmt(parser);
 	case '{':
-		return (PSmmAstNode)parseBlock(parser, parser->curScope->returnType, false);
+		return parseBlock(parser, &builtInTypes[parser->ast->types[parser->curScope]], false);
 	case tkSmmIdent: case '(': case '-': case '+': case tkSmmNot:
 	case tkSmmInt: case tkSmmFloat: case tkSmmBool:
 		return parseExpressionStmt(parser);
 	case tkSmmIf: case tkSmmWhile: return parseIfWhileStmt(parser);
 	case tkSmmErr:
 		if (findToken(parser, ';')) getNextToken(parser);
-		return NULL;
+		return 0;
 	case ';':
-		return NULL; // Just skip empty statements
+		return 0; // Just skip empty statements
 	default:
-		if (parser->lastErrorLine != parser->curToken->filePos.lineNumber) {
-			char gotBuf[4];
+		if (parser->lastErrorLine != getLineNumber(parser, parser->curToken->offset)) {
+			char gotBuf[SMM_TOKEN_STRING_BUF_SIZE];
 			const char* got = smmTokenToString(parser->curToken, gotBuf);
-			smmPostMessage(parser->msgs, errSmmGotUnexpectedToken, parser->curToken->filePos, "valid statement", got);
+			smmPostMessage(parser->msgs, errSmmGotUnexpectedToken, parser->curToken->offset, "valid statement", got);
 		}
 		getNextToken(parser); // Skip the bad character
 		if (findToken(parser, ';')) getNextToken(parser);
-		return &errorNode;
+		return errorNode;
 	}
 }
 
@@ -842,124 +1048,281 @@ static PSmmAstNode parseStatement(PSmmParser parser) {
 API Functions
 *********************************************************/
 
-PSmmAstNode smmGetZeroValNode(struct SmmFilePos filePos, PSmmTypeInfo varType, PIbsAllocator a) {
-	PSmmAstNode zero = smmNewAstNode(nkSmmInt, a);
-	if (!varType || varType->kind == tiSmmUnknown) varType = &builtInTypes[tiSmmInt32];
-	zero->isConst = true;
-	zero->type = varType;
-	zero->token = ibsAlloc(a, sizeof(struct SmmToken));
-	zero->token->filePos = filePos;
+PSmmAst smmCreateAst(PIbsAllocator a) {
+	PSmmAst ast = ibsAllocTagged(a, sizeof(struct SmmAst), "AST");
+	size_t itemSizes[] = {
+		sizeof(ast->kinds[0]), sizeof(ast->flags[0]), sizeof(ast->types[0]), sizeof(ast->tokens[0]),
+		sizeof(ast->nexts[0]), sizeof(ast->lefts[0]), sizeof(ast->rights[0]), sizeof(ast->extras[0]),
+	};
+	for (int i = 0; i < 8; i++) {
+		size_t size = AST_MAX_NODES * itemSizes[i] + IBS_MIN_START_ALLOC_SIZE;
+		ast->arrays[i] = ibsVirtualAllocatorCreate(astArrayNames[i], size, false);
+	}
+	// Node and extra value at index 0 are never used so 0 can mean none or an empty list
+	ast->count = 1;
+	smmNewAstExtras(ast, 1);
+	SmmAstNode error = smmNewAstNode(ast, nkSmmError);
+	ast->types[error] = tiSmmUnknown;
+	assert(error == errorNode);
+	return ast;
+}
+
+void smmFreeAst(PSmmAst ast) {
+	assert(!ast->owner && "Views are freed with their AST");
+	PSmmAst view = ast->views;
+	while (view) {
+		PSmmAst next = view->nextView;
+		ibsSimpleAllocatorFree(view->a);
+		view = next;
+	}
+	if (ast->lock) ibsMutexFree(ast->lock);
+	for (int i = 0; i < 8; i++) {
+		ibsSimpleAllocatorFree(ast->arrays[i]);
+	}
+}
+
+PSmmAst smmCreateAstView(PSmmAst ast) {
+	assert(!ast->owner && "Views can only be created from the AST");
+	if (!ast->lock) {
+		ast->lock = ibsMutexCreate();
+		if (!ast->lock) smmAbortWithMessage("Failed to create AST lock", __FILE__, __LINE__);
+	}
+	PIbsAllocator a = ibsChunkedAllocatorCreate("AST view", AST_VIEW_ALLOCATOR_SIZE);
+	PSmmAst view = ibsAllocTagged(a, sizeof(struct SmmAst), "AST");
+	*view = *ast;
+	// View starts with empty ranges so it reserves them only when it needs them
+	view->count = view->capacity = 0;
+	view->extraCount = view->extraCapacity = 0;
+	view->owner = ast;
+	view->views = NULL;
+	view->a = a;
+	view->lock = NULL;
+	view->nextView = ast->views;
+	ast->views = view;
+	return view;
+}
+
+SmmAstNode smmNewAstNode(PSmmAst ast, SmmAstNodeKind kind) {
+	if (ast->count >= ast->capacity) {
+		if (ast->owner) reserveViewRange(ast, 1, false);
+		else growAst(ast);
+	}
+	SmmAstNode res = ast->count++;
+	ast->kinds[res] = kind;
+	return res;
+}
+
+uint32_t smmNewAstList(PSmmAst ast, const SmmAstNode* nodes, uint32_t count) {
+	if (count == 0) return 0;
+	uint32_t res = smmNewAstExtras(ast, count + 1);
+	ast->extras[res] = count;
+	memcpy(&ast->extras[res + 1], nodes, count * sizeof(SmmAstNode));
+	return res;
+}
+
+uint32_t smmNewAstExtras(PSmmAst ast, uint32_t count) {
+	if (ast->owner && ast->extraCount + count > ast->extraCapacity) {
+		reserveViewRange(ast, count, true);
+	}
+	while (ast->extraCount + count > ast->extraCapacity) {
+		ast->extras = growAstArray(ast, 7, ast->extras, ast->extraCapacity, sizeof(ast->extras[0]));
+		ast->extraCapacity += AST_GROW_COUNT;
+	}
+	uint32_t res = ast->extraCount;
+	ast->extraCount += count;
+	return res;
+}
+
+void smmCopyAstNode(PSmmAst ast, SmmAstNode dst, SmmAstNode src) {
+	ast->kinds[dst] = ast->kinds[src];
+	ast->flags[dst] = ast->flags[src];
+	ast->types[dst] = ast->types[src];
+	ast->tokens[dst] = ast->tokens[src];
+	ast->nexts[dst] = ast->nexts[src];
+	ast->lefts[dst] = ast->lefts[src];
+	ast->rights[dst] = ast->rights[src];
+}
+
+SmmAstNode smmGetZeroValNode(PSmmAst ast, uint32_t offset, PSmmTypeInfo varType, PIbsAllocator a) {
+	SmmAstNode zero = smmNewAstNode(ast, nkSmmInt);
+	if (varType->kind == tiSmmNone || varType->kind == tiSmmUnknown) varType = &builtInTypes[tiSmmInt32];
+	ast->flags[zero] = nfSmmConst;
+	ast->types[zero] = varType->kind;
+	PSmmToken token = ibsAllocTagged(a, sizeof(struct SmmToken), "token");
+	ast->tokens[zero] = token;
+	token->offset = offset;
 	if (varType->isInt) {
-		zero->token->kind = tkSmmUInt;
-		zero->token->repr = "0";
+		token->kind = tkSmmUInt;
+		token->repr = "0";
+		token->length = 1;
 	} else if (varType->isFloat) {
-		zero->kind = nkSmmFloat;
-		zero->token->kind = tkSmmFloat;
-		zero->token->repr = "0";
+		ast->kinds[zero] = nkSmmFloat;
+		token->kind = tkSmmFloat;
+		token->repr = "0";
+		token->length = 1;
 	} else if (varType->isBool) {
-		zero->kind = nkSmmBool;
-		zero->token->kind = tkSmmBool;
-		zero->token->repr = "false";
+		ast->kinds[zero] = nkSmmBool;
+		token->kind = tkSmmBool;
+		token->repr = "false";
+		token->length = 5;
 	} else {
 		assert(false && "Unsupported variable type!");
 	}
 	return zero;
 }
 
-void* smmNewAstNode(SmmAstNodeKind kind, PIbsAllocator a) {
-	PSmmAstNode res = ibsAlloc(a, sizeof(union SmmAstNode));
-	res->kind = kind;
-	return res;
-}
-
-PSmmParser smmCreateParser(PSmmLexer lex, PSmmMsgs msgs, PIbsAllocator a) {
+static PSmmParser createParser(PSmmLexer lex, PSmmToken tokens, uint32_t tokenCount, PSmmTokenPipe pipe, PSmmMsgs msgs, PIbsAllocator a) {
 	assert(nodeKindToString[nkSmmTerminator - 1]); //Check if names for all node kinds are defined
 	PSmmParser parser = ibsAlloc(a, sizeof(struct SmmParser));
 	parser->lex = lex;
-	parser->curToken = smmGetNextToken(lex);
 	parser->a = a;
 	parser->msgs = msgs;
+	parser->ast = smmCreateAst(a);
+	PSmmAst ast = parser->ast;
 
 	// Init idents dict
-	parser->idents = ibsDictCreate(parser->a);
+	parser->idents = ibsSymTableCreate(parser->a);
 	int cnt = sizeof(builtInTypes) / sizeof(struct SmmTypeInfo);
 	for (int i = 0; i < cnt; i++) {
-		PSmmAstNode typeNode = smmNewAstNode(nkSmmType, parser->a);
-		typeNode->type = &builtInTypes[i];
-		ibsDictPut(parser->idents, typeNode->type->name, typeNode);
+		SmmAstNode typeNode = smmNewAstNode(ast, nkSmmType);
+		ast->types[typeNode] = builtInTypes[i].kind;
+		bindIdent(parser, internName(lex->atoms, builtInTypes[i].name), typeNode);
 	}
 
-	ibsDictPut(parser->idents, "int", ibsDictGet(parser->idents, "int32"));
-	ibsDictPut(parser->idents, "uint", ibsDictGet(parser->idents, "uint32"));
-	ibsDictPut(parser->idents, "float", ibsDictGet(parser->idents, "float32"));
-
-	static bool binOpsInitialized = false;
-	if (!binOpsInitialized) {
-		// Init binary operator precedences. Index is tokenKind & 0x7f so its value must be less then 289
-		// which is after this operation equal to '!', first operator character in ascii map
-
-		binOpsInitialized = true;
-		binOpPrecs['+'] = 100;
-		binOpPrecs['-'] = 100;
+	bindIdent(parser, internName(lex->atoms, "int"), getIdent(parser, internName(lex->atoms, "int32")));
+	bindIdent(parser, internName(lex->atoms, "uint"), getIdent(parser, internName(lex->atoms, "uint32")));
+	bindIdent(parser, internName(lex->atoms, "float"), getIdent(parser, internName(lex->atoms, "float32")));
+
+	// We take the first token only after built in names are interned since
+	// lexer thread of a token pipe interns identifiers from then on
+	if (tokens) {
+		assert(tokenCount > 0 && tokens[tokenCount - 1].kind == tkSmmEof);
+		parser->tokens = tokens;
+		parser->tokenCount = tokenCount;
+		parser->curToken = &tokens[0];
+	} else if (pipe) {
+		parser->pipe = pipe;
+		parser->curToken = smmGetNextPipedToken(pipe);
+	} else {
+		parser->curToken = smmGetNextToken(lex);
+	}
 
-		binOpPrecs['*'] = 120;
-		binOpPrecs['/'] = 120;
-		binOpPrecs[tkSmmIntDiv & 0x7f] = 120;
-		binOpPrecs[tkSmmIntMod & 0x7f] = 120;
+	return parser;
+}
 
-		binOpPrecs[tkSmmEq & 0x7f] = 110;
-		binOpPrecs[tkSmmNotEq & 0x7f] = 110;
-		binOpPrecs['>'] = 110;
-		binOpPrecs[tkSmmGtEq & 0x7f] = 110;
-		binOpPrecs['<'] = 110;
-		binOpPrecs[tkSmmLtEq & 0x7f] = 110;
+PSmmParser smmCreateParser(PSmmLexer lex, PSmmMsgs msgs, PIbsAllocator a) {
+	return createParser(lex, NULL, 0, NULL, msgs, a);
+}
 
-		binOpPrecs[tkSmmAndOp & 0x7f] = 90;
-		binOpPrecs[tkSmmXorOp & 0x7f] = 80;
-		binOpPrecs[tkSmmOrOp & 0x7f] = 80;
-	}
+PSmmParser smmCreateParserFromTokens(PSmmLexer lex, PSmmToken tokens, uint32_t tokenCount, PSmmMsgs msgs, PIbsAllocator a) {
+	return createParser(lex, tokens, tokenCount, NULL, msgs, a);
+}
 
-	return parser;
+PSmmParser smmCreateParserFromPipe(PSmmLexer lex, PSmmTokenPipe pipe, PSmmMsgs msgs, PIbsAllocator a) {
+	return createParser(lex, NULL, 0, pipe, msgs, a);
 }
 
-PSmmAstNode smmParse(PSmmParser parser) {
-	if (parser->curToken->kind == tkSmmEof) return NULL;
-	PSmmAstNode program = smmNewAstNode(nkSmmProgram, parser->a);
-	PSmmAstBlockNode block = smmNewAstNode(nkSmmBlock, parser->a);
-	parser->curScope = smmNewAstNode(nkSmmScope, parser->a);
-	parser->curScope->lastDecl = (PSmmAstDeclNode)parser->curScope;
-	parser->curScope->returnType = &builtInTypes[tiSmmInt32];
-	block->scope = parser->curScope;
-	program->next = (PSmmAstNode)block;
-	PSmmAstNode* nextStmt = &block->stmts;
+PSmmParser smmCreateFuncBodyParser(PSmmParser parser, PSmmAst view, PSmmMsgs msgs, PIbsAllocator a) {
+	assert(view->owner == parser->ast);
+	PSmmParser bodyParser = ibsAlloc(a, sizeof(struct SmmParser));
+	*bodyParser = *parser;
+	bodyParser->ast = view;
+	bodyParser->idents = ibsSymTableCopy(parser->idents, a);
+	bodyParser->children = NULL;
+	bodyParser->childCount = bodyParser->childCapacity = 0;
+	bodyParser->msgs = msgs;
+	bodyParser->a = a;
+	bodyParser->lastErrorLine = 0;
+	return bodyParser;
+}
 
-	PSmmAstNode curStmt = NULL;
+PSmmAst smmParse(PSmmParser parser) {
+	PSmmAst ast = parser->ast;
+	if (parser->curToken->kind == tkSmmEof) {
+		smmFreeAst(ast);
+		return NULL;
+	}
+	SmmAstNode program = smmNewAstNode(ast, nkSmmProgram);
+	SmmAstNode block = smmNewAstNode(ast, nkSmmBlock);
+	parser->curScope = smmNewAstNode(ast, nkSmmScope);
+	ast->lastDecls[parser->curScope] = parser->curScope;
+	ast->types[parser->curScope] = tiSmmInt32;
+	ast->scopes[block] = parser->curScope;
+	ast->nexts[program] = block;
+
+	uint32_t firstStmt = parser->childCount;
+	SmmAstNode curStmt = 0;
 	while (parser->curToken->kind != tkSmmEof) {
 		curStmt = parseStatement(parser);
-		if (curStmt != NULL && curStmt != &errorNode) {
-			*nextStmt = curStmt;
-			nextStmt = &curStmt->next;
+		if (curStmt && curStmt != errorNode) {
+			pushChild(parser, curStmt);
 		}
 	}
 
 	bool isReturnMissing = true;
 	if (curStmt) {
-		if (curStmt->kind == nkSmmBlock) isReturnMissing = !curStmt->asBlock.endsWithReturn;
-		else isReturnMissing = curStmt->kind != nkSmmReturn;
+		if (ast->kinds[curStmt] == nkSmmBlock) isReturnMissing = !(ast->flags[curStmt] & nfSmmEndsWithReturn);
+		else isReturnMissing = ast->kinds[curStmt] != nkSmmReturn;
 	}
 	// Add return stmt if missing
 	if (isReturnMissing) {
-		curStmt = smmNewAstNode(nkSmmReturn, parser->a);
-		struct SmmFilePos fp = parser->curToken->filePos;
-		fp.lineNumber++;
-		fp.lineOffset = 0;
-		curStmt->token = newToken(tkSmmReturn, "return", fp, parser->a);
-		curStmt->type = parser->curScope->returnType;
-		curStmt->left = smmGetZeroValNode(parser->curToken->filePos, curStmt->type, parser->a);
-		*nextStmt = curStmt;
-	}
-
-	program->token = ibsAlloc(parser->a, sizeof(struct SmmToken));
-	program->token->repr = parser->lex->filePos.filename;
-	return program;
+		uint32_t offset = parser->curToken->offset;
+		curStmt = smmNewAstNode(ast, nkSmmReturn);
+		ast->tokens[curStmt] = newToken(tkSmmReturn, "return", offset, parser->a);
+		ast->types[curStmt] = ast->types[parser->curScope];
+		ast->lefts[curStmt] = smmGetZeroValNode(ast, offset, &builtInTypes[ast->types[curStmt]], parser->a);
+		pushChild(parser, curStmt);
+	}
+	ast->stmts[block] = popChildren(parser, firstStmt);
+
+	PSmmToken programToken = ibsAllocTagged(parser->a, sizeof(struct SmmToken), "token");
+	programToken->repr = parser->lex->lines.filename;
+	if (programToken->repr) programToken->length = (uint32_t)strlen(programToken->repr);
+	ast->tokens[program] = programToken;
+	ast->program = program;
+	if (parser->skippedBodyCount > 0) ast->parser = parser;
+	return ast;
+}
+
+void smmParseFuncBody(PSmmParser parser, SmmAstNode func) {
+	PSmmAst ast = parser->ast;
+	assert(ast->flags[func] & nfSmmLazyBody);
+	// Skipped bodies are recorded in order of their func nodes
+	uint32_t low = 0;
+	uint32_t high = parser->skippedBodyCount;
+	while (low < high) {
+		uint32_t mid = (low + high) / 2;
+		if (parser->skippedBodies[mid].func < func) low = mid + 1;
+		else high = mid;
+	}
+	assert(low < parser->skippedBodyCount && parser->skippedBodies[low].func == func);
+	struct SmmSkippedBody* body = &parser->skippedBodies[low];
+
+	// Parser now reads only body tokens and stays on the last one which is '}' or eof
+	PSmmToken tokens = parser->tokens;
+	uint32_t tokenCount = parser->tokenCount;
+	uint32_t cursor = parser->cursor;
+	PSmmToken prevToken = parser->prevToken;
+	PSmmToken curToken = parser->curToken;
+	parser->tokens = (tokens ? tokens : parser->skippedTokens) + body->firstToken;
+	parser->tokenCount = body->tokenCount;
+	parser->cursor = 0;
+	parser->prevToken = NULL;
+	parser->curToken = &parser->tokens[0];
+
+	uint32_t paramsMark = ibsSymTableMark(parser->idents);
+	uint32_t paramCount = body->bindParams ? ast->extras[ast->params[func]] : 0;
+	SmmAstNode* params = &ast->extras[ast->params[func] + 1];
+	for (uint32_t i = 0; i < paramCount; i++) {
+		bindIdent(parser, ast->tokens[params[i]]->atom, params[i]);
+	}
+	ast->bodies[func] = parseBlock(parser, &builtInTypes[ast->types[func]], true);
+	ast->flags[func] &= ~nfSmmLazyBody;
+	ibsSymTableRestore(parser->idents, paramsMark);
+
+	parser->tokens = tokens;
+	parser->tokenCount = tokenCount;
+	parser->cursor = cursor;
+	parser->prevToken = prevToken;
+	parser->curToken = curToken;
 }
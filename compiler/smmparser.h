@@ -23,25 +23,49 @@
 
 #include "ibscommon.h"
 #include "smmlexer.h"
+#include "ibsdictionary.h"
+#include "ibssymtable.h"
+#include "ibsthread.h"
 
 typedef struct SmmParser* PSmmParser;
-typedef union SmmAstNode* PSmmAstNode;
+typedef struct SmmAst* PSmmAst;
 
-typedef struct SmmAstDeclNode* PSmmAstDeclNode;
-typedef struct SmmAstIdentNode* PSmmAstIdentNode;
-typedef struct SmmAstScopeNode* PSmmAstScopeNode;
-typedef struct SmmAstBlockNode* PSmmAstBlockNode;
-typedef struct SmmAstParamNode* PSmmAstParamNode;
-typedef struct SmmAstFuncDefNode* PSmmAstFuncDefNode;
-typedef struct SmmAstCallNode* PSmmAstCallNode;
-typedef struct SmmAstIfWhileNode* PSmmAstIfWhileNode;
+/**
+* Node of AST is just an index into arrays of SmmAst. Index 0 is never used
+* for a real node so it serves as null node.
+*/
+typedef uint32_t SmmAstNode;
+
+// Tokens of a func body whose parsing was skipped
+struct SmmSkippedBody {
+	SmmAstNode func;
+	uint32_t firstToken; // Index in parser tokens or in skippedTokens if tokens are not used
+	uint32_t tokenCount;
+	bool bindParams; // False if params were unbound before the body because of missing ')'
+};
 
 struct SmmParser {
 	PSmmLexer lex;
+	PSmmToken tokens; // If not null tokens are read from this array instead of from lexer
+	uint32_t tokenCount;
+	uint32_t cursor;
+	PSmmTokenPipe pipe; // If not null tokens are taken from lexer thread through this pipe
 	PSmmToken prevToken;
 	PSmmToken curToken;
-	PIbsDict idents;
-	PSmmAstScopeNode curScope;
+	PIbsSymTable idents;
+	PSmmAst ast;
+	SmmAstNode curScope;
+	uint32_t curLevel; // Nesting level of current scope
+	SmmAstNode* children; // Stack of child nodes collected until their parent is done
+	uint32_t childCount;
+	uint32_t childCapacity;
+	bool lazyFuncBodies; // If set bodies of global funcs are only parsed by smmParseFuncBody
+	struct SmmSkippedBody* skippedBodies; // Ordered by func node
+	uint32_t skippedBodyCount;
+	uint32_t skippedBodyCapacity;
+	struct SmmToken* skippedTokens; // Copies of skipped tokens if they didn't come from tokens array
+	uint32_t skippedTokenCount;
+	uint32_t skippedTokenCapacity;
 	PSmmMsgs msgs;
 	PIbsAllocator a;
 	uint32_t lastErrorLine;
@@ -75,11 +99,13 @@ extern const char* nodeKindToString[nkSmmTerminator];
 
 /**
 * Each built in type info kind should have coresponding type info defined in smmparser.c.
+* None is the type of nodes whose type is not yet known while Unknown is set on nodes
+* whose type couldn't be determined because of some error.
 * SoftFloat64 type is for literals that depending on the context could be interpreted as
 * Float32 or Float64 and will be converted to those types eventually.
 */
 typedef enum {
-	tiSmmUnknown, tiSmmVoid, tiSmmBool,
+	tiSmmNone, tiSmmUnknown, tiSmmVoid, tiSmmBool,
 	tiSmmUInt8, tiSmmUInt16, tiSmmUInt32, tiSmmUInt64,
 	tiSmmInt8, tiSmmInt16, tiSmmInt32, tiSmmInt64,
 	tiSmmFloat32, tiSmmFloat64, tiSmmSoftFloat64,
@@ -94,128 +120,153 @@ struct SmmTypeInfo {
 	uint32_t isFloat : 1;
 	uint32_t isBool : 1;
 };
-typedef struct SmmTypeInfo* PSmmTypeInfo;
+// Type infos are never changed so they can be shared by compilations on different threads
+typedef const struct SmmTypeInfo* PSmmTypeInfo;
+
+extern const struct SmmTypeInfo builtInTypes[];
 
-extern struct SmmTypeInfo builtInTypes[];
+typedef enum {
+	nfSmmIdent = 1, nfSmmConst = 2, nfSmmBinOp = 4,
+	nfSmmBeingProcessed = 8, nfSmmProcessed = 16, // Set only on decl and func nodes
+	nfSmmEndsWithReturn = 32, // Set only on block nodes
+	nfSmmLazyBody = 64, // Set only on func nodes whose body is not parsed yet
+} SmmAstNodeFlag;
 
 /**
-* SmmAstNode is base "class" of AstNodes so all following types of AstNodes
-* must have identical structure which is:
-* 1. SmmAstNodeKind kind;
-* 2. 32bit value
-* 3. pointer value that should point to token
-* 4. 4 more pointer values where first one should point to type
-* That way we can freely cast between these types although in a few situations
-* we need to be aware what field in "derived" type matches what field in AstNode.
+* SmmAst keeps all the nodes in a struct of arrays form so each array holds
+* one field of all the nodes. Kinds, flags and types are byte per node so
+* passes that mostly check those touch only a few cache lines. Every array
+* lives in its own virtual allocator so it never moves when new nodes are
+* added which means that a pointer to a field of a node, like &ast->lefts[node],
+* stays valid and can be used to replace the node in its parent.
+*
+* Links to other nodes are kept in three arrays with names depending on node
+* kind. Anonymous unions give these arrays additional names to make code
+* dealing with certain node kinds easier to follow:
+*
+*   kind            nexts      lefts       rights
+*   expressions     -          left        right
+*   Decl            -          left        nextDecl
+*   Ident, Const    -          -           level of scope it is declared in
+*   Param           -          -           level
+*   Scope           lastDecl   prevScope   decls       (type is return type)
+*   Block           -          scope       stmts
+*   Func            body       params      nextOverload (type is return type)
+*   Call            -          params      args         (type is return type)
+*   If, While       -          cond        branches
+*   Program         block
+*
+* Stmts, params and args are lists in extras: the value at the given index
+* is the number of nodes in the list and the nodes follow it. Since
+* extras[0] is always 0 index 0 is an empty list. If and While nodes keep
+* index into extras where their body and else body are.
+*
+* Views of an AST (see smmCreateAstView) share all its arrays but add new
+* nodes and extras into ranges they reserve from it so each thread can work
+* on its own view.
 */
-
-struct SmmAstDeclNode {
-	SmmAstNodeKind kind;
-	uint32_t isIdent : 1;
-	uint32_t isConst : 1;
-	uint32_t isBeingProcessed : 1;
-	uint32_t isProcessed : 1;
-	PSmmToken token;
-	PSmmTypeInfo zzNotUsed1;
-	PSmmAstNode nextStmt;
-	PSmmAstNode left;
-	PSmmAstDeclNode nextDecl;
-};
-
-struct SmmAstIdentNode {
-	SmmAstNodeKind kind;
-	uint32_t isIdent : 1;
-	uint32_t isConst : 1;
-	PSmmToken token;
-	PSmmTypeInfo type;
-	PSmmAstNode zzNotUsed1;
-	PSmmAstNode zzNotUsed2;
-	uintptr_t level; // Scope level ident is created in (must be int which is the same size as pointer)
-};
-
-struct SmmAstScopeNode {
-	SmmAstNodeKind kind;
-	uint32_t level; // Scope nesting level
-	PSmmToken zzNotUsed1;
-	PSmmTypeInfo returnType; // Return type of the function this scope is part of
-	PSmmAstDeclNode lastDecl; // Last decl in scope node so we can add new ones at the end
-	PSmmAstScopeNode prevScope;
-	PSmmAstDeclNode decls;
-};
-
-struct SmmAstBlockNode {
-	SmmAstNodeKind kind;
-	uint32_t endsWithReturn : 1;
-	PSmmToken token;
-	PSmmTypeInfo zzNotUsed1;
-	PSmmAstNode next;
-	PSmmAstScopeNode scope;
-	PSmmAstNode stmts;
-};
-
-struct SmmAstParamNode {
-	SmmAstNodeKind kind;
-	uint32_t isIdent : 1;
-	PSmmToken token;
-	PSmmTypeInfo type;
-	PSmmAstParamNode next;
-	uintptr_t count; // Set on first param in FuncDef to tell us how many params there are in total
-	uintptr_t level; // We need this so we can easily check if same param is defined twice
-};
-
-struct SmmAstFuncDefNode {
-	SmmAstNodeKind kind;
-	uint32_t isIdent : 1;
-	PSmmToken token;
-	PSmmTypeInfo returnType;
-	PSmmAstBlockNode body;
-	PSmmAstParamNode params;
-	PSmmAstFuncDefNode nextOverload;
+struct SmmAst {
+	uint8_t* kinds;
+	uint8_t* flags;
+	uint8_t* types;
+	PSmmToken* tokens;
+	union {
+		SmmAstNode* nexts;
+		SmmAstNode* lastDecls;
+		SmmAstNode* bodies;
+	};
+	union {
+		SmmAstNode* lefts;
+		SmmAstNode* prevScopes;
+		SmmAstNode* scopes;
+		uint32_t* params;
+		SmmAstNode* conds;
+	};
+	union {
+		SmmAstNode* rights;
+		SmmAstNode* nextDecls;
+		SmmAstNode* decls;
+		uint32_t* stmts;
+		SmmAstNode* nextOverloads;
+		uint32_t* args;
+		uint32_t* branches;
+		uint32_t* levels;
+	};
+	SmmAstNode* extras; // Nodes that don't fit in the fixed fields
+	uint32_t count;
+	uint32_t capacity;
+	uint32_t extraCount;
+	uint32_t extraCapacity;
+	SmmAstNode program;
+	PSmmParser parser; // Set if parser skipped func bodies so they can be parsed on demand
+	PIbsAllocator arrays[8];
+	PSmmAst owner; // Set only on views to the AST they reserve ranges from
+	PSmmAst views; // Views of this AST linked over nextView
+	PSmmAst nextView;
+	PIbsAllocator a; // Allocator of a view in which it and data of its new nodes are kept
+	PIbsMutex lock; // Taken while a view reserves a range
 };
 
-struct SmmAstCallNode {
-	SmmAstNodeKind kind;
-	uint32_t isIdent : 1;
-	PSmmToken token;
-	PSmmTypeInfo returnType;
-	PSmmAstNode zzNotUsed1;
-	PSmmAstParamNode params;
-	PSmmAstNode args;
-};
+PSmmAst smmCreateAst(PIbsAllocator a);
+/**
+* Frees AST arrays along with all the views of the AST.
+*/
+void smmFreeAst(PSmmAst ast);
+/**
+* Returns a view of the AST that can read and change all the nodes but adds
+* new nodes and extras into ranges reserved from the AST. That is the only
+* thing that needs locking so different threads can add nodes through their
+* own views at the same time. View gets its own allocator, kept in view->a,
+* that should be used for data of new nodes since it lives as long as the AST.
+* Views must be created from the AST and not from another view.
+*/
+PSmmAst smmCreateAstView(PSmmAst ast);
+SmmAstNode smmNewAstNode(PSmmAst ast, SmmAstNodeKind kind);
+/**
+* Returns the index of first of count new values in ast->extras.
+*/
+uint32_t smmNewAstExtras(PSmmAst ast, uint32_t count);
+/**
+* Copies count nodes to ast->extras after their count and returns index of
+* the count. If count is 0 it just returns 0 which is always an empty list.
+*/
+uint32_t smmNewAstList(PSmmAst ast, const SmmAstNode* nodes, uint32_t count);
+/**
+* Copies all the fields of src node to dst node.
+*/
+void smmCopyAstNode(PSmmAst ast, SmmAstNode dst, SmmAstNode src);
 
-struct SmmAstIfWhileNode {
-	SmmAstNodeKind kind;
-	uint32_t isIdent : 1;
-	PSmmToken token;
-	PSmmAstNode cond;
-	PSmmAstNode next;
-	PSmmAstNode body;
-	PSmmAstNode elseBody;
-};
+SmmAstNode smmGetZeroValNode(PSmmAst ast, uint32_t offset, PSmmTypeInfo varType, PIbsAllocator a);
+PSmmParser smmCreateParser(PSmmLexer lex, PSmmMsgs msgs, PIbsAllocator allocator);
+/**
+* Returns parser that reads tokens from the given array returned by
+* smmTokenize instead of getting them one by one from the lexer.
+*/
+PSmmParser smmCreateParserFromTokens(PSmmLexer lex, PSmmToken tokens, uint32_t tokenCount, PSmmMsgs msgs, PIbsAllocator allocator);
+/**
+* Returns parser that takes tokens from lexer thread through the given pipe.
+* Caller should close the pipe after parsing.
+*/
+PSmmParser smmCreateParserFromPipe(PSmmLexer lex, PSmmTokenPipe pipe, PSmmMsgs msgs, PIbsAllocator allocator);
+/**
+* Returns AST of the parsed module or NULL if the module is empty. Nodes
+* are kept in their own arrays that can be freed with smmFreeAst.
+* If parser->lazyFuncBodies is set bodies of global funcs are only matched
+* by braces and such funcs get nfSmmLazyBody flag instead of a body.
+*/
+PSmmAst smmParse(PSmmParser parser);
 
-union SmmAstNode {
-	struct {
-		SmmAstNodeKind kind;
-		uint32_t isIdent : 1;
-		uint32_t isConst : 1;
-		uint32_t isBinOp : 1;
-		PSmmToken token;
-		PSmmTypeInfo type;
-		PSmmAstNode next;
-		PSmmAstNode left;
-		PSmmAstNode right;
-	};
-	struct SmmAstDeclNode asDecl;
-	struct SmmAstIdentNode asIdent;
-	struct SmmAstScopeNode asScope;
-	struct SmmAstBlockNode asBlock;
-	struct SmmAstParamNode asParam;
-	struct SmmAstFuncDefNode asFunc;
-	struct SmmAstCallNode asCall;
-	struct SmmAstIfWhileNode asIfWhile;
-};
+/**
+* Returns parser that reads the same skipped bodies as the given one but has
+* its own copy of global symbols and adds nodes through the given AST view.
+* Bodies of different funcs can then be parsed on different threads using
+* such parsers with their own messages and allocators.
+*/
+PSmmParser smmCreateFuncBodyParser(PSmmParser parser, PSmmAst view, PSmmMsgs msgs, PIbsAllocator allocator);
 
-PSmmAstNode smmGetZeroValNode(struct SmmFilePos filePos, PSmmTypeInfo varType, PIbsAllocator a);
-void* smmNewAstNode(SmmAstNodeKind kind, PIbsAllocator a);
-PSmmParser smmCreateParser(PSmmLexer lex, PSmmMsgs msgs, PIbsAllocator allocator);
-PSmmAstNode smmParse(PSmmParser parser);
+/**
+* Parses the body of the given func whose parsing was skipped. Body is parsed
+* as if it was at the end of the module so all the global symbols are visible
+* to it. Parser and tokens it got must still be alive.
+*/
+void smmParseFuncBody(PSmmParser parser, SmmAstNode func);
@@ -2,208 +2,203 @@
 
 #include <assert.h>
 
-static PSmmAstNode getCastNode(PIbsAllocator a, PSmmAstNode node, PSmmTypeInfo parentType) {
+static SmmAstNode getCastNode(PSmmAst ast, SmmAstNode node, PSmmTypeInfo parentType) {
 	assert(parentType->kind != tiSmmSoftFloat64);
-	PSmmAstNode cast = ibsAlloc(a, sizeof(union SmmAstNode));
-	cast->kind = nkSmmCast;
-	cast->left = node;
-	cast->type = parentType;
-	cast->next = node->next;
-	node->next = NULL;
+	SmmAstNode cast = smmNewAstNode(ast, nkSmmCast);
+	ast->lefts[cast] = node;
+	ast->types[cast] = parentType->kind;
 	return cast;
 }
 
-static PSmmAstNode* fixExpressionTypes(
-		PSmmAstNode* nodeField,
+static SmmAstNode* fixExpressionTypes(
+		PSmmAst ast,
+		SmmAstNode* nodeField,
 		PSmmTypeInfo parentType,
 		bool isParentCast,
 		PSmmMsgs msgs,
 		PIbsAllocator a) {
-	PSmmAstNode cast = NULL;
-	PSmmAstNode node = *nodeField;
-	if (parentType->isInt && node->type->isFloat) {
+	SmmAstNode cast = 0;
+	SmmAstNode node = *nodeField;
+	PSmmTypeInfo nodeType = &builtInTypes[ast->types[node]];
+	PSmmToken token = ast->tokens[node];
+	if (parentType->isInt && nodeType->isFloat) {
 		//if parent is int and node is float then warning and cast
-		PSmmTypeInfo type = node->type;
+		PSmmTypeInfo type = nodeType;
 		// If we need to cast arbitrary float expression to int we will treat expression as float32
-		if (type->kind == tiSmmSoftFloat64) type -= 2;
+		if (type->kind == tiSmmSoftFloat64) type = &builtInTypes[tiSmmFloat32];
 		if (!isParentCast) {
-			cast = getCastNode(a, node, parentType);
-			smmPostMessage(msgs, wrnSmmConversionDataLoss, node->token->filePos, type->name, parentType->name);
+			cast = getCastNode(ast, node, parentType);
+			smmPostMessage(msgs, wrnSmmConversionDataLoss, token->offset, type->name, parentType->name);
 		}
-	} else if (parentType->isFloat && node->type->isInt) {
+	} else if (parentType->isFloat && nodeType->isInt) {
 		// if parent is float and node is int change it if it is literal or cast it otherwise
-		if (node->kind == nkSmmInt) {
-			node->kind = nkSmmFloat;
-			node->type = parentType;
-			node->token->floatVal = (double)node->token->uintVal;
+		if (ast->kinds[node] == nkSmmInt) {
+			ast->kinds[node] = nkSmmFloat;
+			ast->types[node] = parentType->kind;
+			token->floatVal = (double)token->uintVal;
 		} else {
-			if (!isParentCast) cast = getCastNode(a, node, parentType);
+			if (!isParentCast) cast = getCastNode(ast, node, parentType);
 		}
-	} else if (parentType->isInt && node->type->isInt) {
+	} else if (parentType->isInt && nodeType->isInt) {
 		// if both are ints just fix the sizes
-		if (parentType->isUnsigned == node->type->isUnsigned) {
-			if (parentType->kind > node->type->kind) {
-				if (node->kind == nkSmmInt || node->isBinOp) {
-					node->type = parentType; // if literal or operator
+		if (parentType->isUnsigned == nodeType->isUnsigned) {
+			if (parentType->kind > nodeType->kind) {
+				if (ast->kinds[node] == nkSmmInt || (ast->flags[node] & nfSmmBinOp)) {
+					ast->types[node] = parentType->kind; // if literal or operator
 				} else {
-					if (!isParentCast) cast = getCastNode(a, node, parentType);
+					if (!isParentCast) cast = getCastNode(ast, node, parentType);
 				}
 			} else { // if parent type < node type
-				if (node->kind == nkSmmInt) {
+				if (ast->kinds[node] == nkSmmInt) {
 					switch (parentType->kind) {
-					case tiSmmUInt8: node->token->uintVal = (uint8_t)node->token->uintVal; break;
-					case tiSmmUInt16: node->token->uintVal = (uint16_t)node->token->uintVal; break;
-					case tiSmmUInt32: node->token->uintVal = (uint32_t)node->token->uintVal; break;
-					case tiSmmInt8: node->token->sintVal = (int8_t)node->token->sintVal; break;
-					case tiSmmInt16: node->token->sintVal = (int16_t)node->token->sintVal; break;
-					case tiSmmInt32: node->token->sintVal = (int32_t)node->token->sintVal; break;
+					case tiSmmUInt8: token->uintVal = (uint8_t)token->uintVal; break;
+					case tiSmmUInt16: token->uintVal = (uint16_t)token->uintVal; break;
+					case tiSmmUInt32: token->uintVal = (uint32_t)token->uintVal; break;
+					case tiSmmInt8: token->sintVal = (int8_t)token->sintVal; break;
+					case tiSmmInt16: token->sintVal = (int16_t)token->sintVal; break;
+					case tiSmmInt32: token->sintVal = (int32_t)token->sintVal; break;
 					default: break;
 					}
-					smmPostMessage(msgs, wrnSmmConversionDataLoss, node->token->filePos,
-						node->type->name, parentType->name);
-					node->type = parentType;
+					smmPostMessage(msgs, wrnSmmConversionDataLoss, token->offset,
+						nodeType->name, parentType->name);
+					ast->types[node] = parentType->kind;
 				} else {
 					// No warning because operations on big numbers can give small numbers
-					if (!isParentCast) cast = getCastNode(a, node, parentType);
+					if (!isParentCast) cast = getCastNode(ast, node, parentType);
 				}
 			}
 		} else { // if one is uint and other is int
-			if (node->kind != nkSmmInt) { // If it is not int literal
-				if (!isParentCast) cast = getCastNode(a, node, parentType);
+			if (ast->kinds[node] != nkSmmInt) { // If it is not int literal
+				if (!isParentCast) cast = getCastNode(ast, node, parentType);
 			} else {
-				int64_t oldVal = node->token->sintVal;
+				int64_t oldVal = token->sintVal;
 				switch (parentType->kind) {
-				case tiSmmUInt8: node->token->uintVal = (uint8_t)node->token->sintVal; break;
-				case tiSmmUInt16: node->token->uintVal = (uint16_t)node->token->sintVal; break;
-				case tiSmmUInt32: node->token->uintVal = (uint32_t)node->token->sintVal; break;
-				case tiSmmInt8: node->token->sintVal = (int8_t)node->token->uintVal; break;
-				case tiSmmInt16: node->token->sintVal = (int16_t)node->token->uintVal; break;
-				case tiSmmInt32: node->token->sintVal = (int32_t)node->token->uintVal; break;
+				case tiSmmUInt8: token->uintVal = (uint8_t)token->sintVal; break;
+				case tiSmmUInt16: token->uintVal = (uint16_t)token->sintVal; break;
+				case tiSmmUInt32: token->uintVal = (uint32_t)token->sintVal; break;
+				case tiSmmInt8: token->sintVal = (int8_t)token->uintVal; break;
+				case tiSmmInt16: token->sintVal = (int16_t)token->uintVal; break;
+				case tiSmmInt32: token->sintVal = (int32_t)token->uintVal; break;
 				default: break;
 				}
-				if (oldVal < 0 || oldVal != node->token->sintVal) {
-					smmPostMessage(msgs, wrnSmmConversionDataLoss, node->token->filePos, node->type->name, parentType->name);
+				if (oldVal < 0 || oldVal != token->sintVal) {
+					smmPostMessage(msgs, wrnSmmConversionDataLoss, token->offset, nodeType->name, parentType->name);
 				}
-				node->token->kind = tkSmmUInt;
-				node->type = parentType;
+				token->kind = tkSmmUInt;
+				ast->types[node] = parentType->kind;
 			}
 		}
-	} else if ((parentType->isFloat && node->type->isFloat)) {
+	} else if ((parentType->isFloat && nodeType->isFloat)) {
 		// if both are floats just fix the sizes
-		if (node->type->kind == tiSmmSoftFloat64) {
-			node->type = parentType;
+		if (nodeType->kind == tiSmmSoftFloat64) {
+			ast->types[node] = parentType->kind;
 		} else { // if they are different size
-			if (!isParentCast) cast = getCastNode(a, node, parentType);
+			if (!isParentCast) cast = getCastNode(ast, node, parentType);
 		}
-	} else if (parentType->kind == tiSmmBool && node->type->kind != tiSmmBool) {
+	} else if (parentType->kind == tiSmmBool && nodeType->kind != tiSmmBool) {
 		// If parent is bool but node is not bool we need to add compare with 0
-		switch (node->kind) {
+		switch (ast->kinds[node]) {
 		case nkSmmInt: case nkSmmFloat:
-			node->type = parentType;
-			node->token->boolVal = node->token->sintVal != 0;
+			ast->types[node] = parentType->kind;
+			token->boolVal = token->sintVal != 0;
 			break;
 		default:
 			{
-				PSmmToken zeroToken = ibsAlloc(a, sizeof(struct SmmToken));
-				zeroToken->filePos = node->token->filePos;
+				PSmmToken zeroToken = ibsAllocTagged(a, sizeof(struct SmmToken), "token");
+				zeroToken->offset = token->offset;
 				zeroToken->kind = tkSmmInt;
 				zeroToken->repr = "0";
+				zeroToken->length = 1;
 
-				PSmmToken notEqToken = ibsAlloc(a, sizeof(struct SmmToken));
-				notEqToken->filePos = node->token->filePos;
+				PSmmToken notEqToken = ibsAllocTagged(a, sizeof(struct SmmToken), "token");
+				notEqToken->offset = token->offset;
 				notEqToken->kind = tkSmmNotEq;
 				notEqToken->repr = "!=";
+				notEqToken->length = 2;
 
-				PSmmAstNode zeroNode = ibsAlloc(a, sizeof(union SmmAstNode));
-				zeroNode->isConst = true;
-				zeroNode->kind = nkSmmInt;
-				zeroNode->token = zeroToken;
-				zeroNode->type = node->type;
-				if (zeroNode->type->isFloat) {
+				SmmAstNode zeroNode = smmNewAstNode(ast, nkSmmInt);
+				ast->flags[zeroNode] = nfSmmConst;
+				ast->tokens[zeroNode] = zeroToken;
+				ast->types[zeroNode] = nodeType->kind;
+				if (nodeType->isFloat) {
 					zeroToken->kind = tkSmmFloat;
 				}
 
-				PSmmAstNode notEqNode = ibsAlloc(a, sizeof(union SmmAstNode));
-				notEqNode->isBinOp = true;
-				notEqNode->isConst = node->isConst;
-				notEqNode->kind = nkSmmNotEq;
-				notEqNode->left = node;
-				notEqNode->right = zeroNode;
-				notEqNode->token = notEqToken;
-				notEqNode->type = parentType;
+				SmmAstNode notEqNode = smmNewAstNode(ast, nkSmmNotEq);
+				ast->flags[notEqNode] = nfSmmBinOp | (ast->flags[node] & nfSmmConst);
+				ast->lefts[notEqNode] = node;
+				ast->rights[notEqNode] = zeroNode;
+				ast->tokens[notEqNode] = notEqToken;
+				ast->types[notEqNode] = parentType->kind;
 				*nodeField = notEqNode;
 				break;
 			}
 		}
-	} else if (parentType->kind != tiSmmBool && node->type->kind == tiSmmBool && !isParentCast) {
+	} else if (parentType->kind != tiSmmBool && nodeType->kind == tiSmmBool && !isParentCast) {
 		// If parent is not bool but node is we issue an error
-		smmPostMessage(msgs, errSmmUnexpectedBool, node->token->filePos);
+		smmPostMessage(msgs, errSmmUnexpectedBool, token->offset);
 	}
 
-	if (node->type->kind == tiSmmSoftFloat64) {
-		node->type -= 2; // Change to float32
+	if (ast->types[node] == tiSmmSoftFloat64) {
+		ast->types[node] = tiSmmFloat32;
 	}
 
 	if (cast) {
 		*nodeField = cast;
-		nodeField = &cast->left;
+		nodeField = &ast->lefts[cast];
 	}
 
 	return nodeField;
 }
 
 static void processExpression(
-		PSmmAstNode* exprField,
+		PSmmAst ast,
+		SmmAstNode* exprField,
 		PSmmTypeInfo parentType,
 		bool isParentCast,
 		PSmmMsgs msgs,
 		PIbsAllocator a) {
-	PSmmAstNode expr = *exprField;
+	SmmAstNode expr = *exprField;
 
-	if (parentType != expr->type) {
-		exprField = fixExpressionTypes(exprField, parentType, isParentCast, msgs, a);
+	if (parentType->kind != ast->types[expr]) {
+		exprField = fixExpressionTypes(ast, exprField, parentType, isParentCast, msgs, a);
 	}
 
-	switch (expr->kind) {
+	PSmmTypeInfo exprType = &builtInTypes[ast->types[expr]];
+	switch (ast->kinds[expr]) {
 	case nkSmmAdd: case nkSmmFAdd: case nkSmmSub: case nkSmmFSub:
 	case nkSmmMul: case nkSmmFMul: case nkSmmUDiv: case nkSmmSDiv: case nkSmmFDiv:
 	case nkSmmURem: case nkSmmSRem: case nkSmmFRem:
 	case nkSmmAndOp: case nkSmmOrOp: case nkSmmXorOp:
-		processExpression(&expr->left, expr->type, false, msgs, a);
-		processExpression(&expr->right, expr->type, false, msgs, a);
+		processExpression(ast, &ast->lefts[expr], exprType, false, msgs, a);
+		processExpression(ast, &ast->rights[expr], exprType, false, msgs, a);
 		break;
 	case nkSmmEq: case nkSmmNotEq: case nkSmmGt: case nkSmmGtEq: case nkSmmLt: case nkSmmLtEq:
 		{
-			PSmmTypeInfo newParentType;
-			if (expr->left->type->kind > expr->right->type->kind) newParentType = expr->left->type;
-			else newParentType = expr->right->type;
-			processExpression(&expr->left, newParentType, false, msgs, a);
-			processExpression(&expr->right, newParentType, false, msgs, a);
+			SmmTypInfoKind leftKind = ast->types[ast->lefts[expr]];
+			SmmTypInfoKind rightKind = ast->types[ast->rights[expr]];
+			PSmmTypeInfo newParentType = &builtInTypes[leftKind > rightKind ? leftKind : rightKind];
+			processExpression(ast, &ast->lefts[expr], newParentType, false, msgs, a);
+			processExpression(ast, &ast->rights[expr], newParentType, false, msgs, a);
 			break;
 		}
 	case nkSmmNeg: case nkSmmNot:
-		processExpression(&expr->left, expr->type, false, msgs, a);
+		processExpression(ast, &ast->lefts[expr], exprType, false, msgs, a);
 		break;
 	case nkSmmCast:
-		processExpression(&expr->left, expr->type, true, msgs, a);
-		if (expr->type == expr->left->type) {
+		processExpression(ast, &ast->lefts[expr], exprType, true, msgs, a);
+		if (ast->types[expr] == ast->types[ast->lefts[expr]]) {
 			 // Cast was succesfully lowered so it is not needed any more
-			*exprField = expr->left;
-			expr = NULL;
+			*exprField = ast->lefts[expr];
 		}
 		break;
 	case nkSmmCall:
 		{
-			PSmmAstCallNode callNode = (PSmmAstCallNode)expr;
-			if (callNode->params) {
-				size_t paramCount = callNode->params->count;
-				PSmmAstParamNode astParam = callNode->params;
-				PSmmAstNode* astArg = &callNode->args;
-				for (size_t i = 0; i < paramCount; i++) {
-					processExpression(astArg, astParam->type, false, msgs, a);
-					astArg = &(*astArg)->next;
-					astParam = astParam->next;
-				}
+			uint32_t paramCount = ast->extras[ast->params[expr]];
+			SmmAstNode* astParams = &ast->extras[ast->params[expr] + 1];
+			SmmAstNode* astArgs = &ast->extras[ast->args[expr] + 1];
+			for (uint32_t i = 0; i < paramCount; i++) {
+				processExpression(ast, &astArgs[i], &builtInTypes[ast->types[astParams[i]]], false, msgs, a);
 			}
 			break;
 		}
@@ -217,85 +212,104 @@ static void processExpression(
 	}
 }
 
-static void processLocalSymbols(PSmmAstDeclNode decl, PSmmMsgs msgs, PIbsAllocator a) {
+static void processLocalSymbols(PSmmAst ast, SmmAstNode decl, PSmmMsgs msgs, PIbsAllocator a) {
 	while (decl) {
-		if (decl->left->left->kind == nkSmmConst) {
-			processExpression(&decl->left->right, decl->left->type, false, msgs, a);
+		SmmAstNode assignment = ast->lefts[decl];
+		if (ast->kinds[ast->lefts[assignment]] == nkSmmConst) {
+			processExpression(ast, &ast->rights[assignment], &builtInTypes[ast->types[assignment]], false, msgs, a);
 		}
-		decl = decl->nextDecl;
+		decl = ast->nextDecls[decl];
 	}
 }
 
-static void processBlock(PSmmAstBlockNode block, PSmmMsgs msgs, PIbsAllocator a);
-static void processStatement(PSmmAstNode* stmtField, PSmmMsgs msgs, PIbsAllocator a);
+static void processBlock(PSmmAst ast, SmmAstNode block, PSmmMsgs msgs, PIbsAllocator a);
+static void processStatement(PSmmAst ast, SmmAstNode* stmtField, PSmmMsgs msgs, PIbsAllocator a);
 
-static void processIfWhile(PSmmAstIfWhileNode stmt, PSmmMsgs msgs, PIbsAllocator a) {
-	processExpression(&stmt->cond, &builtInTypes[tiSmmBool], false, msgs, a);
-	processStatement(&stmt->body, msgs, a);
-	if (stmt->elseBody) {
-		processStatement(&stmt->elseBody, msgs, a);
+static void processIfWhile(PSmmAst ast, SmmAstNode stmt, PSmmMsgs msgs, PIbsAllocator a) {
+	SmmAstNode* branches = &ast->extras[ast->branches[stmt]];
+	processExpression(ast, &ast->conds[stmt], &builtInTypes[tiSmmBool], false, msgs, a);
+	processStatement(ast, &branches[0], msgs, a);
+	if (branches[1]) {
+		processStatement(ast, &branches[1], msgs, a);
 	}
 }
 
-static void processStatement(PSmmAstNode* stmtField, PSmmMsgs msgs, PIbsAllocator a) {
-	PSmmAstNode stmt = *stmtField;
-	switch (stmt->kind) {
+static void processStatement(PSmmAst ast, SmmAstNode* stmtField, PSmmMsgs msgs, PIbsAllocator a) {
+	SmmAstNode stmt = *stmtField;
+	switch (ast->kinds[stmt]) {
 	case nkSmmBlock:
-		{
-			PSmmAstBlockNode newBlock = (PSmmAstBlockNode)stmt;
-			processLocalSymbols(newBlock->scope->decls, msgs, a);
-			processBlock(newBlock, msgs, a);
-			break;
-		}
+		processLocalSymbols(ast, ast->decls[ast->scopes[stmt]], msgs, a);
+		processBlock(ast, stmt, msgs, a);
+		break;
 	case nkSmmAssignment:
-		assert(stmt->type == stmt->left->type);
-		processExpression(&stmt->right, stmt->type, false, msgs, a);
+		assert(ast->types[stmt] == ast->types[ast->lefts[stmt]]);
+		processExpression(ast, &ast->rights[stmt], &builtInTypes[ast->types[stmt]], false, msgs, a);
 		break;
-	case nkSmmIf: case nkSmmWhile: processIfWhile((PSmmAstIfWhileNode)stmt, msgs, a); break;
+	case nkSmmIf: case nkSmmWhile: processIfWhile(ast, stmt, msgs, a); break;
 	case nkSmmDecl:
-		assert(stmt->left->kind == nkSmmAssignment);
-		assert(stmt->left->type == stmt->left->left->type);
-		processExpression(&stmt->left->right, stmt->left->type, false, msgs, a);
-		break;
+		{
+			SmmAstNode assignment = ast->lefts[stmt];
+			assert(ast->kinds[assignment] == nkSmmAssignment);
+			assert(ast->types[assignment] == ast->types[ast->lefts[assignment]]);
+			processExpression(ast, &ast->rights[assignment], &builtInTypes[ast->types[assignment]], false, msgs, a);
+			break;
+		}
 	case nkSmmReturn:
-		if (stmt->left) processExpression(&stmt->left, stmt->type, false, msgs, a);
+		if (ast->lefts[stmt]) processExpression(ast, &ast->lefts[stmt], &builtInTypes[ast->types[stmt]], false, msgs, a);
 		break;
 	default:
 		// We treat softFloat as float32
-		if (stmt->type->kind == tiSmmSoftFloat64) stmt->type -= 2;
-		processExpression(stmtField, stmt->type, stmt->kind == nkSmmCast, msgs, a); break;
+		if (ast->types[stmt] == tiSmmSoftFloat64) ast->types[stmt] = tiSmmFloat32;
+		processExpression(ast, stmtField, &builtInTypes[ast->types[stmt]], ast->kinds[stmt] == nkSmmCast, msgs, a); break;
 	}
 }
 
-static void processBlock(PSmmAstBlockNode block, PSmmMsgs msgs, PIbsAllocator a) {
-	PSmmAstNode* stmtField = &block->stmts;
-	while (*stmtField) {
-		processStatement(stmtField, msgs, a);
-		stmtField = &(*stmtField)->next;
+static void processBlock(PSmmAst ast, SmmAstNode block, PSmmMsgs msgs, PIbsAllocator a) {
+	uint32_t stmtCount = ast->extras[ast->stmts[block]];
+	SmmAstNode* stmts = &ast->extras[ast->stmts[block] + 1];
+	for (uint32_t i = 0; i < stmtCount; i++) {
+		processStatement(ast, &stmts[i], msgs, a);
 	}
 }
 
-static void processGlobalSymbols(PSmmAstDeclNode decl, PSmmMsgs msgs, PIbsAllocator a) {
+static void processFuncBody(PSmmAst ast, SmmAstNode func, PSmmMsgs msgs, PIbsAllocator a) {
+	SmmAstNode body = ast->bodies[func];
+	if (body) {
+		processLocalSymbols(ast, ast->decls[ast->scopes[body]], msgs, a);
+		processBlock(ast, body, msgs, a);
+	}
+}
+
+static void processGlobalSymbols(PSmmAst ast, SmmAstNode decl, bool withFuncBodies, PSmmMsgs msgs, PIbsAllocator a) {
 	while (decl) {
-		if (decl->left->kind == nkSmmFunc) {
-			PSmmAstFuncDefNode funcNode = (PSmmAstFuncDefNode)decl->left;
-			if (funcNode->body) {
-				processLocalSymbols(funcNode->body->scope->decls, msgs, a);
-				processBlock(funcNode->body, msgs, a);
-			}
+		SmmAstNode declared = ast->lefts[decl];
+		if (ast->kinds[declared] == nkSmmFunc) {
+			if (withFuncBodies) processFuncBody(ast, declared, msgs, a);
 		} else {
-			assert(decl->left->right && "Global var must have initializer");
-			assert(decl->left->left->type == decl->left->type);
-			processExpression(&decl->left->right, decl->left->type, false, msgs, a);
+			assert(ast->rights[declared] && "Global var must have initializer");
+			assert(ast->types[ast->lefts[declared]] == ast->types[declared]);
+			processExpression(ast, &ast->rights[declared], &builtInTypes[ast->types[declared]], false, msgs, a);
 		}
-		decl = decl->nextDecl;
+		decl = ast->nextDecls[decl];
 	}
 }
 
-void smmExecuteSemPass(PSmmAstNode module, PSmmMsgs msgs, PIbsAllocator a) {
-	PSmmAstBlockNode globalBlock = (PSmmAstBlockNode)module->next;
-	assert(globalBlock->kind == nkSmmBlock);
-	processGlobalSymbols(globalBlock->scope->decls, msgs, a);
+static void processGlobals(PSmmAst ast, bool withFuncBodies, PSmmMsgs msgs, PIbsAllocator a) {
+	SmmAstNode globalBlock = ast->nexts[ast->program];
+	assert(ast->kinds[globalBlock] == nkSmmBlock);
+	processGlobalSymbols(ast, ast->decls[ast->scopes[globalBlock]], withFuncBodies, msgs, a);
+
+	processBlock(ast, globalBlock, msgs, a);
+}
+
+void smmExecuteSemPass(PSmmAst ast, PSmmMsgs msgs, PIbsAllocator a) {
+	processGlobals(ast, true, msgs, a);
+}
+
+void smmExecuteGlobalSemPass(PSmmAst ast, PSmmMsgs msgs, PIbsAllocator a) {
+	processGlobals(ast, false, msgs, a);
+}
 
-	processBlock(globalBlock, msgs, a);
+void smmExecuteFuncSemPass(PSmmAst ast, SmmAstNode func, PSmmMsgs msgs, PIbsAllocator a) {
+	processFuncBody(ast, func, msgs, a);
 }
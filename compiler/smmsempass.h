@@ -4,4 +4,16 @@
 #include "ibsallocator.h"
 #include "smmparser.h"
 
-void smmExecuteSemPass(PSmmAstNode module, PSmmMsgs msgs, PIbsAllocator a);
+void smmExecuteSemPass(PSmmAst ast, PSmmMsgs msgs, PIbsAllocator a);
+
+/**
+* Does the same as smmExecuteSemPass except for func bodies which are then
+* processed by smmExecuteFuncSemPass.
+*/
+void smmExecuteGlobalSemPass(PSmmAst ast, PSmmMsgs msgs, PIbsAllocator a);
+
+/**
+* Processes the body of the given global func. Only nodes of that body are
+* changed so bodies of different funcs can be processed on different threads.
+*/
+void smmExecuteFuncSemPass(PSmmAst ast, SmmAstNode func, PSmmMsgs msgs, PIbsAllocator a);
@@ -0,0 +1,463 @@
+#include "smmserver.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include "ibsthread.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+/********************************************************
+Private
+*********************************************************/
+
+#define SERVER_MAGIC 0x534d4d53
+// Requests bigger than this are rejected
+#define MAX_SOURCE_SIZE (256 * 1024 * 1024)
+#define MAX_NAME_SIZE 4096
+// When cached results take more than this all of them are dropped
+#define MAX_CACHE_SIZE (256 * 1024 * 1024)
+#define CACHE_BUCKET_COUNT 4096
+// Constants of all generated modules stay in LLVM context so we start a new one after this many compiles
+#define COMPILES_PER_CONTEXT 1000
+// Client that doesn't send or take any data for this long is disconnected so it can't hold up a worker
+#define CLIENT_TIMEOUT_SECONDS 30
+
+enum { rfSmmLazyFuncBodies = 1, rfSmmParallelPasses = 2, rfSmmStop = 4, rfSmmLexerThread = 8 };
+enum { rsfSmmHasIR = 1, rsfSmmCached = 2 };
+
+// Name and source follow the request
+struct Request {
+	uint32_t magic;
+	uint32_t flags;
+	uint32_t threadCount;
+	uint32_t nameSize;
+	uint32_t srcSize;
+};
+
+// Messages and IR follow the response
+struct Response {
+	uint32_t magic;
+	uint32_t flags;
+	uint32_t errorCount;
+	uint32_t msgsSize;
+	uint32_t irSize;
+};
+
+#ifndef _WIN32
+
+struct CacheEntry {
+	struct CacheEntry* next;
+	uint64_t hash;
+	uint32_t flags;
+	char* name;
+	char* src;
+	uint32_t srcSize;
+	struct Response response;
+	char* msgs;
+	char* ir;
+};
+
+struct Server {
+	int fd;
+	const char* socketPath;
+	uint32_t workerCount;
+	atomic_bool stopping;
+	PIbsMutex lock; // Taken while cache is used
+	PIbsAllocator cacheAllocator;
+	struct CacheEntry* cache[CACHE_BUCKET_COUNT];
+};
+
+/**
+ * Each worker accepts connections on its own thread and compiles with its
+ * own context so workers only share the cache.
+ */
+struct Worker {
+	PSmmContext ctx;
+	uint32_t compileCount; // Since LLVM context was last reset
+	PIbsAllocator a; // Reset after each request
+};
+
+// Pipe signals are turned off for each send so server doesn't change how the process handles them
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+static uint64_t hashBytes(uint64_t hash, const char* bytes, size_t size) {
+	// 64 bit FNV-1a
+	for (size_t i = 0; i < size; i++) {
+		hash ^= (uint8_t)bytes[i];
+		hash *= 1099511628211u;
+	}
+	return hash;
+}
+
+static bool writeAll(int fd, const void* data, size_t size) {
+	const char* cur = data;
+	while (size > 0) {
+		ssize_t written = send(fd, cur, size, SEND_FLAGS);
+		if (written < 0 && errno == EINTR) continue;
+		if (written <= 0) return false;
+		cur += written;
+		size -= written;
+	}
+	return true;
+}
+
+static bool readAll(int fd, void* data, size_t size) {
+	char* cur = data;
+	while (size > 0) {
+		ssize_t got = read(fd, cur, size);
+		if (got < 0 && errno == EINTR) continue;
+		if (got <= 0) return false;
+		cur += got;
+		size -= got;
+	}
+	return true;
+}
+
+static bool initAddress(struct sockaddr_un* addr, const char* socketPath) {
+	memset(addr, 0, sizeof(struct sockaddr_un));
+	addr->sun_family = AF_UNIX;
+	if (strlen(socketPath) >= sizeof(addr->sun_path)) return false;
+	strcpy(addr->sun_path, socketPath);
+	return true;
+}
+
+static void disablePipeSignal(int fd) {
+#ifdef SO_NOSIGPIPE
+	int on = 1;
+	setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#else
+	(void)fd;
+#endif
+}
+
+static int connectToServer(const char* socketPath) {
+	struct sockaddr_un addr;
+	if (!initAddress(&addr, socketPath)) return -1;
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) return -1;
+	disablePipeSignal(fd);
+	if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static char* copyToCache(struct Server* server, const char* data, size_t size) {
+	if (!data) return NULL;
+	char* res = ibsAlloc(server->cacheAllocator, size + 1);
+	memcpy(res, data, size);
+	return res;
+}
+
+static struct CacheEntry* findInCache(struct Server* server, uint64_t hash, uint32_t flags,
+		const char* name, const char* src, uint32_t srcSize) {
+	struct CacheEntry* entry = server->cache[hash % CACHE_BUCKET_COUNT];
+	while (entry) {
+		if (entry->hash == hash && entry->flags == flags && entry->srcSize == srcSize &&
+				strcmp(entry->name, name) == 0 && memcmp(entry->src, src, srcSize) == 0) {
+			return entry;
+		}
+		entry = entry->next;
+	}
+	return NULL;
+}
+
+/**
+ * Must be called while holding the lock.
+ */
+static void addToCache(struct Server* server, uint64_t hash, struct Request* req, const char* name, const char* src,
+		struct Response* response, const char* msgs, const char* ir) {
+	if (server->cacheAllocator->totalSize > MAX_CACHE_SIZE) {
+		ibsSimpleAllocatorReset(server->cacheAllocator);
+		memset(server->cache, 0, sizeof(server->cache));
+	}
+	struct CacheEntry* entry = ibsAlloc(server->cacheAllocator, sizeof(struct CacheEntry));
+	entry->hash = hash;
+	entry->flags = req->flags;
+	entry->name = copyToCache(server, name, req->nameSize);
+	entry->src = copyToCache(server, src, req->srcSize);
+	entry->srcSize = req->srcSize;
+	entry->response = *response;
+	entry->msgs = copyToCache(server, msgs, response->msgsSize);
+	entry->ir = copyToCache(server, ir, response->irSize);
+	entry->next = server->cache[hash % CACHE_BUCKET_COUNT];
+	server->cache[hash % CACHE_BUCKET_COUNT] = entry;
+}
+
+/**
+ * Copies the cached data into the worker's allocator so the cache can be
+ * dropped by another worker while the response is being sent.
+ */
+static char* copyFromCache(struct Worker* worker, const char* data, size_t size) {
+	if (!data) return NULL;
+	char* res = ibsAlloc(worker->a, size + 1);
+	memcpy(res, data, size);
+	return res;
+}
+
+static void compile(struct Worker* worker, struct Request* req, const char* name, const char* src,
+		struct Response* response, const char** msgs, const char** ir) {
+	if (worker->compileCount++ == COMPILES_PER_CONTEXT) {
+		smmContextReset(worker->ctx);
+		worker->compileCount = 1;
+	}
+	struct SmmCompileOptions options = { name };
+	options.lazyFuncBodies = (req->flags & rfSmmLazyFuncBodies) != 0;
+	options.parallelPasses = (req->flags & rfSmmParallelPasses) != 0;
+	options.threadCount = req->threadCount;
+	options.useLexerThread = (req->flags & rfSmmLexerThread) != 0;
+	struct SmmCompileResult res;
+	smmCompileBuffer(worker->ctx, src, req->srcSize, &options, &res);
+	*msgs = smmFormatMessages(&res.msgs, res.msgs.a);
+	*ir = res.ir;
+	memset(response, 0, sizeof(struct Response));
+	response->magic = SERVER_MAGIC;
+	response->errorCount = res.msgs.errorCount;
+	response->msgsSize = (uint32_t)strlen(*msgs);
+	if (res.ir) {
+		response->flags = rsfSmmHasIR;
+		response->irSize = (uint32_t)res.irSize;
+	}
+}
+
+/**
+ * Returns false if it was a stop request.
+ */
+static bool handleRequest(struct Server* server, struct Worker* worker, int client) {
+	struct Request req;
+	if (!readAll(client, &req, sizeof(req)) || req.magic != SERVER_MAGIC) return true;
+	if (req.flags & rfSmmStop) {
+		struct Response response = { SERVER_MAGIC };
+		writeAll(client, &response, sizeof(response));
+		return false;
+	}
+	if (req.nameSize > MAX_NAME_SIZE || req.srcSize > MAX_SOURCE_SIZE) return true;
+
+	char* name = ibsAlloc(worker->a, req.nameSize + 1);
+	char* src = ibsAlloc(worker->a, req.srcSize + 1);
+	if (!readAll(client, name, req.nameSize) || !readAll(client, src, req.srcSize)) return true;
+
+	// Thread count doesn't change the result so it is not part of the key
+	uint64_t hash = hashBytes(14695981039346656037u, (const char*)&req.flags, sizeof(req.flags));
+	hash = hashBytes(hash, name, req.nameSize + 1);
+	hash = hashBytes(hash, src, req.srcSize);
+
+	struct Response response;
+	const char* msgs;
+	const char* ir;
+	ibsMutexLock(server->lock);
+	struct CacheEntry* entry = findInCache(server, hash, req.flags, name, src, req.srcSize);
+	if (entry) {
+		response = entry->response;
+		response.flags |= rsfSmmCached;
+		msgs = copyFromCache(worker, entry->msgs, response.msgsSize);
+		ir = copyFromCache(worker, entry->ir, response.irSize);
+	}
+	ibsMutexUnlock(server->lock);
+	if (!entry) {
+		// Compiling outside of the lock lets other workers compile and use the cache meanwhile
+		compile(worker, &req, name, src, &response, &msgs, &ir);
+		ibsMutexLock(server->lock);
+		addToCache(server, hash, &req, name, src, &response, msgs, ir);
+		ibsMutexUnlock(server->lock);
+	}
+	if (writeAll(client, &response, sizeof(response)) && writeAll(client, msgs, response.msgsSize)) {
+		writeAll(client, ir, response.irSize);
+	}
+	return true;
+}
+
+static void setClientTimeouts(int client) {
+	struct timeval timeout = { CLIENT_TIMEOUT_SECONDS, 0 };
+	setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+/**
+ * Only the user that started the server may use it. Socket file is only
+ * accessible to that user but not all systems check that on connect so peer
+ * credentials are checked too.
+ */
+static bool isClientOwner(int client) {
+#ifdef __linux__
+	struct ucred cred;
+	socklen_t size = sizeof(cred);
+	return getsockopt(client, SOL_SOCKET, SO_PEERCRED, &cred, &size) == 0 && cred.uid == geteuid();
+#else
+	uid_t uid;
+	gid_t gid;
+	return getpeereid(client, &uid, &gid) == 0 && uid == geteuid();
+#endif
+}
+
+static void runWorker(void* data, uint32_t index) {
+	struct Server* server = data;
+	struct Worker worker = { smmContextCreate() };
+	worker.a = ibsChunkedAllocatorCreate("request", 1024 * 1024);
+	while (!atomic_load(&server->stopping)) {
+		int client = accept(server->fd, NULL, NULL);
+		if (client < 0) {
+			if (errno == EINTR) continue;
+			break;
+		}
+		if (atomic_load(&server->stopping)) {
+			close(client);
+			break;
+		}
+		if (!isClientOwner(client)) {
+			close(client);
+			continue;
+		}
+		disablePipeSignal(client);
+		setClientTimeouts(client);
+		bool stop = !handleRequest(server, &worker, client);
+		close(client);
+		ibsSimpleAllocatorReset(worker.a);
+		if (stop) {
+			atomic_store(&server->stopping, true);
+			// Other workers are waiting in accept so each of them gets a connection that wakes it up
+			for (uint32_t i = 1; i < server->workerCount; i++) {
+				int fd = connectToServer(server->socketPath);
+				if (fd >= 0) close(fd);
+			}
+		}
+	}
+	ibsSimpleAllocatorFree(worker.a);
+	smmContextFree(worker.ctx);
+}
+
+/**
+ * Returns true if there is no file at the path or it is a socket no server
+ * listens on anymore, in which case it is deleted.
+ */
+static bool removeStaleSocket(const char* socketPath) {
+	struct stat st;
+	if (lstat(socketPath, &st) != 0) return errno == ENOENT;
+	if (!S_ISSOCK(st.st_mode)) return false;
+	int fd = connectToServer(socketPath);
+	if (fd >= 0) {
+		close(fd);
+		return false;
+	}
+	return unlink(socketPath) == 0;
+}
+
+static bool sendRequest(int fd, struct Request* req, const char* name, const char* src) {
+	return writeAll(fd, req, sizeof(struct Request)) && writeAll(fd, name, req->nameSize) && writeAll(fd, src, req->srcSize);
+}
+
+#endif // ifndef _WIN32
+
+/********************************************************
+Public
+*********************************************************/
+
+#ifdef _WIN32
+
+bool smmServe(const char* socketPath, uint32_t workerCount) {
+	return false;
+}
+
+bool smmServerCompile(const char* socketPath, const char* src, size_t len, PSmmCompileOptions options,
+		PSmmServerResult res, PIbsAllocator a) {
+	return false;
+}
+
+bool smmServerStop(const char* socketPath) {
+	return false;
+}
+
+#else
+
+bool smmServe(const char* socketPath, uint32_t workerCount) {
+	struct sockaddr_un addr;
+	if (!initAddress(&addr, socketPath) || !removeStaleSocket(socketPath)) return false;
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) return false;
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+		close(fd);
+		return false;
+	}
+	// Nobody can connect before listen so others never get a chance to use the socket
+	if (chmod(socketPath, S_IRUSR | S_IWUSR) != 0 || listen(fd, 64) != 0) {
+		close(fd);
+		unlink(socketPath);
+		return false;
+	}
+
+	struct Server* server = calloc(1, sizeof(struct Server));
+	server->fd = fd;
+	server->socketPath = socketPath;
+	server->workerCount = workerCount ? workerCount : ibsCpuCount();
+	atomic_init(&server->stopping, false);
+	server->lock = ibsMutexCreate();
+	server->cacheAllocator = ibsChunkedAllocatorCreate("serverCache", 1024 * 1024);
+	ibsParallelFor(server->workerCount, server->workerCount, runWorker, server);
+	close(fd);
+	unlink(socketPath);
+	ibsSimpleAllocatorFree(server->cacheAllocator);
+	ibsMutexFree(server->lock);
+	free(server);
+	return true;
+}
+
+bool smmServerCompile(const char* socketPath, const char* src, size_t len, PSmmCompileOptions options,
+		PSmmServerResult res, PIbsAllocator a) {
+	struct SmmCompileOptions defaultOptions = { "buffer" };
+	if (!options) options = &defaultOptions;
+	memset(res, 0, sizeof(struct SmmServerResult));
+	if (len > MAX_SOURCE_SIZE || strlen(options->moduleName) > MAX_NAME_SIZE) return false;
+	int fd = connectToServer(socketPath);
+	if (fd < 0) return false;
+
+	struct Request req = { SERVER_MAGIC };
+	if (options->lazyFuncBodies) req.flags |= rfSmmLazyFuncBodies;
+	if (options->parallelPasses) req.flags |= rfSmmParallelPasses;
+	if (options->useLexerThread) req.flags |= rfSmmLexerThread;
+	req.threadCount = options->threadCount;
+	req.nameSize = (uint32_t)strlen(options->moduleName);
+	req.srcSize = (uint32_t)len;
+
+	struct Response response;
+	bool ok = sendRequest(fd, &req, options->moduleName, src) &&
+		readAll(fd, &response, sizeof(response)) && response.magic == SERVER_MAGIC;
+	if (ok) {
+		char* msgs = ibsAlloc(a, response.msgsSize + 1);
+		ok = readAll(fd, msgs, response.msgsSize);
+		res->msgs = msgs;
+		res->errorCount = response.errorCount;
+		res->cached = (response.flags & rsfSmmCached) != 0;
+	}
+	if (ok && (response.flags & rsfSmmHasIR)) {
+		char* ir = ibsAlloc(a, response.irSize + 1);
+		ok = readAll(fd, ir, response.irSize);
+		res->ir = ir;
+	}
+	close(fd);
+	return ok;
+}
+
+bool smmServerStop(const char* socketPath) {
+	int fd = connectToServer(socketPath);
+	if (fd < 0) return false;
+	struct Request req = { SERVER_MAGIC, rfSmmStop };
+	struct Response response;
+	bool ok = writeAll(fd, &req, sizeof(req)) && readAll(fd, &response, sizeof(response));
+	close(fd);
+	return ok;
+}
+
+#endif
@@ -0,0 +1,56 @@
+#pragma once
+
+/**
+* Compile server that keeps one compilation context warm between requests so
+* build systems don't pay for starting a new compiler for each file. Server
+* listens on a Unix domain socket with a number of workers, each on its own
+* thread with its own compilation context, so parallel builds are served in
+* parallel. Each request carries a module name, options and source and gets
+* back messages and LLVM assembly. Results are also kept in memory, shared by
+* all workers, keyed by a hash of everything in the request so compiling the
+* same source again only returns the stored result. Clients that stop
+* sending or receiving data are disconnected after a timeout. Only the user
+* that started the server can connect to it.
+*
+* Client side functions are used by `summus --client` which behaves the same
+* as the summus executable but does the work through the server.
+*
+* Unix domain sockets are only used on non Windows systems so on Windows all
+* functions just fail.
+*/
+
+#include "ibscommon.h"
+#include "ibsallocator.h"
+#include "smmcompiler.h"
+
+/**
+* Result received from the server. Strings are taken from the allocator given
+* to smmServerCompile.
+*/
+struct SmmServerResult {
+	const char* ir; // NULL if compilation failed
+	const char* msgs; // Formatted as smmFlushMessages prints them
+	uint32_t errorCount;
+	bool cached; // If server had the result of the same request stored
+};
+typedef struct SmmServerResult* PSmmServerResult;
+
+/**
+* Listens on the given socket path until a stop request is received. If
+* workerCount is 0 one worker per processor is used. Socket file left by a
+* server that is not running anymore is replaced. Returns false if it can't
+* listen, which includes the case when another server is running on the path.
+*/
+bool smmServe(const char* socketPath, uint32_t workerCount);
+
+/**
+* Sends the source to the server for compilation. Options can be NULL. Returns
+* false if server can't be reached or the connection fails.
+*/
+bool smmServerCompile(const char* socketPath, const char* src, size_t len, PSmmCompileOptions options,
+	PSmmServerResult res, PIbsAllocator a);
+
+/**
+* Asks the server to stop and returns false if it can't be reached.
+*/
+bool smmServerStop(const char* socketPath);
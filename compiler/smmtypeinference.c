@@ -4,65 +4,83 @@
 #include <string.h>
 
 struct TIData {
-	PIbsDict idents;
+	PSmmAst ast;
+	PIbsSymTable idents;
 	PSmmMsgs msgs;
-	PSmmAstDeclNode funcDecls;
+	SmmAstNode funcDecls;
+	uint32_t parsedBodyCount; // Number of func bodies parsed on demand
 	uint32_t isInMainCode : 1;
 	uint32_t acceptOnlyConsts : 1;
+	uint32_t parseLazyBodies : 1; // If not set skipped bodies are left for someone else to parse
 };
 typedef struct TIData* PTIData;
 
-static PSmmTypeInfo processExpression(PSmmAstNode expr, PTIData tidata, PIbsAllocator a);
-static bool processStatement(PSmmAstNode stmt, PTIData tidata, PIbsAllocator a);
-static void processBlock(PSmmAstBlockNode block, PTIData tidata, PIbsAllocator a);
+static PSmmTypeInfo processExpression(SmmAstNode expr, PTIData tidata, PIbsAllocator a);
+static bool processStatement(SmmAstNode stmt, PTIData tidata, PIbsAllocator a);
+static void processBlock(SmmAstNode block, PTIData tidata, PIbsAllocator a);
 
-static PSmmToken newToken(int kind, const char* repr, struct SmmFilePos filePos, PIbsAllocator a) {
-	PSmmToken res = ibsAlloc(a, sizeof(struct SmmToken));
+static PSmmToken newToken(int kind, const char* repr, uint32_t offset, PIbsAllocator a) {
+	PSmmToken res = ibsAllocTagged(a, sizeof(struct SmmToken), "token");
 	res->kind = kind;
 	res->repr = repr;
-	res->filePos = filePos;
+	res->length = (uint32_t)strlen(repr);
+	res->offset = offset;
 	return res;
 }
 
+static SmmAstNode getDecl(PTIData tidata, uint32_t atom) {
+	return (SmmAstNode)(uintptr_t)ibsSymTableGet(tidata->idents, atom);
+}
+
+static void bindDecl(PTIData tidata, uint32_t atom, SmmAstNode decl) {
+	ibsSymTableBind(tidata->idents, atom, (void*)(uintptr_t)decl);
+}
+
+static void setConst(PSmmAst ast, SmmAstNode node, bool isConst) {
+	if (isConst) ast->flags[node] |= nfSmmConst;
+	else ast->flags[node] &= ~nfSmmConst;
+}
+
 #define FUNC_SIGNATURE_LENGTH 4 * 1024
 
-static char* getFuncsSignatureAsString(PSmmAstFuncDefNode funcs, char* buf) {
-	PSmmAstFuncDefNode curFunc = funcs;
+static char* getFuncsSignatureAsString(PSmmAst ast, SmmAstNode funcs, char* buf) {
+	SmmAstNode curFunc = funcs;
 	size_t len = 0;
 	while (curFunc) {
-		size_t l = strlen(curFunc->token->repr);
-		strncpy(&buf[len], curFunc->token->repr, l);
+		size_t l = ast->tokens[curFunc]->length;
+		strncpy(&buf[len], ast->tokens[curFunc]->repr, l);
 		len += l;
 		buf[len++] = '(';
-		PSmmAstParamNode curParam = curFunc->params;
-		while (curParam) {
-			l = strlen(curParam->type->name);
-			strncpy(&buf[len], curParam->type->name, l);
+		uint32_t paramCount = ast->extras[ast->params[curFunc]];
+		SmmAstNode* params = &ast->extras[ast->params[curFunc] + 1];
+		for (uint32_t i = 0; i < paramCount; i++) {
+			const char* typeName = builtInTypes[ast->types[params[i]]].name;
+			l = strlen(typeName);
+			strncpy(&buf[len], typeName, l);
 			len += l;
 			buf[len++] = ',';
-			curParam = curParam->next;
 		}
 		if (buf[len - 1] != '(') len--;
 		buf[len++] = ')';
 		buf[len++] = '\n';
 		buf[len++] = ' ';
-		curFunc = curFunc->nextOverload;
+		curFunc = ast->nextOverloads[curFunc];
 	}
 	buf[len - 1] = 0;
 	return buf;
 }
 
-static char* getFuncCallAsString(const char* name, PSmmAstNode args, char* buf) {
+static char* getFuncCallAsString(PSmmAst ast, const char* name, uint32_t args, char* buf) {
 	size_t len = strlen(name);
 	strncpy(buf, name, len);
 	buf[len++] = '(';
-	PSmmAstNode curArg = args;
-	while (curArg) {
-		size_t l = strlen(curArg->type->name);
-		strncpy(&buf[len], curArg->type->name, l);
+	uint32_t argCount = ast->extras[args];
+	for (uint32_t i = 1; i <= argCount; i++) {
+		const char* typeName = builtInTypes[ast->types[ast->extras[args + i]]].name;
+		size_t l = strlen(typeName);
+		strncpy(&buf[len], typeName, l);
 		len += l;
 		buf[len++] = ',';
-		curArg = curArg->next;
 	}
 	if (buf[len - 1] != '(') len--;
 	buf[len] = ')';
@@ -70,7 +88,8 @@ static char* getFuncCallAsString(const char* name, PSmmAstNode args, char* buf)
 }
 
 static bool isUpcastPossible(PSmmTypeInfo srcType, PSmmTypeInfo dstType) {
-	if (!srcType || !dstType || srcType->kind == tiSmmVoid || dstType->kind == tiSmmVoid) return false;
+	if (srcType->kind == tiSmmNone || dstType->kind == tiSmmNone) return false;
+	if (srcType->kind == tiSmmVoid || dstType->kind == tiSmmVoid) return false;
 	bool bothInts = dstType->isInt && srcType->isInt && (dstType->isUnsigned == srcType->isUnsigned);
 	bool bothFloats = dstType->isFloat && srcType->isFloat;
 	bool floatAndSoftFloat = srcType->kind == tiSmmSoftFloat64 && dstType->isFloat;
@@ -79,40 +98,46 @@ static bool isUpcastPossible(PSmmTypeInfo srcType, PSmmTypeInfo dstType) {
 	return sameKindAndDstBigger || intToFloat;
 }
 
-static PSmmAstFuncDefNode findFuncWithMatchingParams(PSmmAstNode argNode, PSmmAstFuncDefNode curFunc, bool softMatch) {
-	PSmmAstFuncDefNode softFunc = NULL;
+static SmmAstNode findFuncWithMatchingParams(PSmmAst ast, uint32_t args, SmmAstNode curFunc, bool softMatch) {
+	SmmAstNode softFunc = 0;
+	uint32_t argCount = ast->extras[args];
+	SmmAstNode* astArgs = &ast->extras[args + 1];
 	while (curFunc) {
-		PSmmAstNode curArg = argNode;
-		PSmmAstParamNode curParam = curFunc->params;
-		PSmmAstFuncDefNode tmpSoftFunc = NULL;
-		while (curParam && curArg) {
-			bool differentTypes = curParam->type->kind != curArg->type->kind;
+		uint32_t paramCount = ast->extras[ast->params[curFunc]];
+		SmmAstNode* astParams = &ast->extras[ast->params[curFunc] + 1];
+		SmmAstNode tmpSoftFunc = 0;
+		// Only params that have args are compared so soft match doesn't depend on arity
+		// and calls to a func whose erroneous params were dropped still match it
+		uint32_t count = paramCount < argCount ? paramCount : argCount;
+		uint32_t i = 0;
+		for (; i < count; i++) {
+			PSmmTypeInfo paramType = &builtInTypes[ast->types[astParams[i]]];
+			PSmmTypeInfo argType = &builtInTypes[ast->types[astArgs[i]]];
+			bool differentTypes = paramType->kind != argType->kind;
 			if (differentTypes) {
-				if (isUpcastPossible(curArg->type, curParam->type)) {
+				if (isUpcastPossible(argType, paramType)) {
 					tmpSoftFunc = curFunc;
 				} else {
-					tmpSoftFunc = NULL;
+					tmpSoftFunc = 0;
 					break;
 				}
 			}
-			curParam = curParam->next;
-			curArg = curArg->next;
 		}
-		if (!curParam && !curArg && !tmpSoftFunc) {
+		if (i == paramCount && i == argCount && !tmpSoftFunc) {
 			break;
 		} else {
 			if (tmpSoftFunc) softFunc = tmpSoftFunc;
-			curFunc = curFunc->nextOverload;
+			curFunc = ast->nextOverloads[curFunc];
 		}
 	}
 	if (curFunc) return curFunc;
-	if (!softMatch) return NULL;
+	if (!softMatch) return 0;
 	return softFunc;
 }
 
 /**
 * When func node is read from identDict it is linked with other overloaded funcs (funcs
-* with same name but different parameters) over the nextOverload pointer. Each func node
+* with same name but different parameters) over the nextOverload link. Each func node
 * has a list of params nodes. The given node also has a list of concrete args with which
 * it is called. This function goes through all overloaded funcs and tries to match given
 * arguments with each function's parameters. If exact match is not found but a match
@@ -120,6 +145,8 @@ static PSmmAstFuncDefNode findFuncWithMatchingParams(PSmmAstNode argNode, PSmmAs
 * to int32 but not to uint32) that func will be used. If there are multiple such funcs
 * we will say that it is undefined which one will be called (because compiler
 * implementation can change) and that explicit casts should be used in such cases.
+* If body of the found func was skipped by the parser it is parsed now unless
+* bodies are parsed separately.
 *
 * Example:
 * func : (int32, float64, bool) -> int8;
@@ -137,21 +164,27 @@ static PSmmAstFuncDefNode findFuncWithMatchingParams(PSmmAstNode argNode, PSmmAs
 *                   ___float64                          softFloat64___
 *               bool                                                  bool
 */
-static void resolveCall(PSmmAstCallNode node, PSmmAstFuncDefNode curFunc, PSmmMsgs msgs) {
-	PSmmAstFuncDefNode foundFunc = findFuncWithMatchingParams(node->args, curFunc, true);
+static void resolveCall(PTIData tidata, SmmAstNode node, SmmAstNode curFunc) {
+	PSmmAst ast = tidata->ast;
+	SmmAstNode foundFunc = findFuncWithMatchingParams(ast, ast->args[node], curFunc, true);
+	PSmmToken token = ast->tokens[node];
 	if (foundFunc) {
-		node->returnType = foundFunc->returnType;
-		node->params = foundFunc->params;
-		node->token->stringVal = foundFunc->token->stringVal; // Copy mangled name
+		ast->types[node] = ast->types[foundFunc];
+		ast->params[node] = ast->params[foundFunc];
+		token->stringVal = ast->tokens[foundFunc]->stringVal; // Copy mangled name
+		if (tidata->parseLazyBodies && (ast->flags[foundFunc] & nfSmmLazyBody)) {
+			smmParseFuncBody(ast->parser, foundFunc);
+			tidata->parsedBodyCount++;
+		}
 		return;
 	}
-	node->returnType = &builtInTypes[tiSmmUnknown];
+	ast->types[node] = tiSmmUnknown;
 	// Report error that we got a call with certain arguments but expected one of...
 	char callWithArgsBuf[FUNC_SIGNATURE_LENGTH] = { 0 };
 	char funcSignatures[8 * FUNC_SIGNATURE_LENGTH] = { 0 };
-	char* callWithArgs = getFuncCallAsString(node->token->repr, node->args, callWithArgsBuf);
-	char* signatures = getFuncsSignatureAsString(curFunc, funcSignatures);
-	smmPostMessage(msgs, errSmmGotBadArgs, node->token->filePos, callWithArgs, signatures);
+	char* callWithArgs = getFuncCallAsString(ast, token->repr, ast->args[node], callWithArgsBuf);
+	char* signatures = getFuncsSignatureAsString(ast, curFunc, funcSignatures);
+	smmPostMessage(tidata->msgs, errSmmGotBadArgs, token->offset, callWithArgs, signatures);
 }
 
 static PSmmTypeInfo getCommonTypeFromOperands(PSmmTypeInfo leftType, PSmmTypeInfo rightType) {
@@ -172,311 +205,317 @@ static PSmmTypeInfo getCommonTypeFromOperands(PSmmTypeInfo leftType, PSmmTypeInf
 	return type;
 }
 
-static void fixDivModOperandTypes(PSmmAstNode expr, PIbsAllocator a) {
-	PSmmAstNode* goodField = NULL;
-	PSmmAstNode* badField = NULL;
-	if (expr->left->type->isInt) {
-		goodField = &expr->left;
-		badField = &expr->right;
-	} else if (expr->right->type->isInt) {
-		goodField = &expr->right;
-		badField = &expr->left;
+static SmmAstNode newCastNode(PSmmAst ast, SmmAstNode node, PSmmTypeInfo type, PIbsAllocator a) {
+	SmmAstNode cast = smmNewAstNode(ast, nkSmmCast);
+	ast->types[cast] = type->kind;
+	ast->tokens[cast] = newToken(tkSmmIdent, type->name, ast->tokens[node]->offset, a);
+	ast->lefts[cast] = node;
+	return cast;
+}
+
+static void fixDivModOperandTypes(PSmmAst ast, SmmAstNode expr, PIbsAllocator a) {
+	SmmAstNode* goodField = NULL;
+	SmmAstNode* badField = NULL;
+	if (builtInTypes[ast->types[ast->lefts[expr]]].isInt) {
+		goodField = &ast->lefts[expr];
+		badField = &ast->rights[expr];
+	} else if (builtInTypes[ast->types[ast->rights[expr]]].isInt) {
+		goodField = &ast->rights[expr];
+		badField = &ast->lefts[expr];
 	}
 
 	if (!goodField) {
 		// Neither operand is int so we cast both to int32
-		PSmmAstNode cast = smmNewAstNode(nkSmmCast, a);
-		cast->type = &builtInTypes[tiSmmInt32];
-		cast->token = newToken(tkSmmIdent, cast->type->name, expr->left->token->filePos, a);
-		cast->left = expr->left;
-		expr->left = cast;
-		cast = smmNewAstNode(nkSmmCast, a);
-		cast->type = &builtInTypes[tiSmmInt32];
-		cast->token = newToken(tkSmmIdent, cast->type->name, expr->right->token->filePos, a);
-		cast->left = expr->right;
-		expr->right = cast;
-	} else if ((*badField)->kind == nkSmmFloat) {
+		ast->lefts[expr] = newCastNode(ast, ast->lefts[expr], &builtInTypes[tiSmmInt32], a);
+		ast->rights[expr] = newCastNode(ast, ast->rights[expr], &builtInTypes[tiSmmInt32], a);
+	} else if (ast->kinds[*badField] == nkSmmFloat) {
 		// if bad node is literal we need to convert it
-		PSmmAstNode bad = *badField;
-		PSmmAstNode good = *goodField;
-		bad->kind = nkSmmInt;
-		bad->token->kind = tkSmmInt;
-		if (bad->token->floatVal >= 0 && good->type->isUnsigned) {
-			bad->token->uintVal = (uint64_t)bad->token->floatVal;
-			bad->type = good->type;
+		SmmAstNode bad = *badField;
+		PSmmTypeInfo goodType = &builtInTypes[ast->types[*goodField]];
+		PSmmToken badToken = ast->tokens[bad];
+		ast->kinds[bad] = nkSmmInt;
+		badToken->kind = tkSmmInt;
+		if (badToken->floatVal >= 0 && goodType->isUnsigned) {
+			badToken->uintVal = (uint64_t)badToken->floatVal;
+			ast->types[bad] = goodType->kind;
 		} else {
-			bad->token->sintVal = (int64_t)bad->token->floatVal;
-			if (good->type->sizeInBytes > 4) {
-				bad->type = &builtInTypes[tiSmmInt64];
+			badToken->sintVal = (int64_t)badToken->floatVal;
+			if (goodType->sizeInBytes > 4) {
+				ast->types[bad] = tiSmmInt64;
 			} else {
-				bad->type = &builtInTypes[tiSmmInt32];
+				ast->types[bad] = tiSmmInt32;
 			}
 		}
 	} else {
 		// Otherwise we need to cast it
-		PSmmAstNode cast = smmNewAstNode(nkSmmCast, a);
-		cast->type = (*goodField)->type;
-		if (cast->type->sizeInBytes < 4) cast->type = &builtInTypes[tiSmmInt32];
-		cast->token = newToken(tkSmmIdent, cast->type->name, (*badField)->token->filePos, a);
-		cast->left = *badField;
-		*badField = cast;
+		PSmmTypeInfo type = &builtInTypes[ast->types[*goodField]];
+		if (type->sizeInBytes < 4) type = &builtInTypes[tiSmmInt32];
+		*badField = newCastNode(ast, *badField, type, a);
 	}
 }
 
-static PSmmTypeInfo deduceTypeFrom(PSmmAstNode val) {
+static PSmmTypeInfo deduceTypeFrom(PSmmAst ast, SmmAstNode val) {
 	// If right value is just another variable or func call just copy its type
 	// but if it is expression then try to be a bit smarter.
-	if (val->kind == nkSmmIdent || val->kind == nkSmmParam || val->kind == nkSmmCall || !val->type) {
-		return val->type;
+	SmmAstNodeKind kind = ast->kinds[val];
+	PSmmTypeInfo type = &builtInTypes[ast->types[val]];
+	if (kind == nkSmmIdent || kind == nkSmmParam || kind == nkSmmCall || type->kind == tiSmmNone) {
+		return type;
 	} else {
-		switch (val->type->kind) {
+		switch (type->kind) {
 		case tiSmmSoftFloat64: return &builtInTypes[tiSmmFloat32];
 		case tiSmmInt8: case tiSmmInt16: return &builtInTypes[tiSmmInt32];
 		case tiSmmUInt8: case tiSmmUInt16: return &builtInTypes[tiSmmUInt32];
-		default: return val->type;
+		default: return type;
 		}
 	}
 }
 
-static char* getMangledName(PSmmAstFuncDefNode func, PIbsAllocator a) {
+static char* getMangledName(PSmmAst ast, SmmAstNode func, PIbsAllocator a) {
 	char* buf = ibsStartAlloc(a);
 	char* curbuf = buf;
 
 	// Copy func name
-	size_t len = strlen(func->token->repr);
-	memcpy(curbuf, func->token->repr, len);
+	size_t len = ast->tokens[func]->length;
+	memcpy(curbuf, ast->tokens[func]->repr, len);
 	curbuf += len;
 
 	// Copy param type names delimited with '_'
-	PSmmAstParamNode param = func->params;
-	while (param) {
+	uint32_t paramCount = ast->extras[ast->params[func]];
+	SmmAstNode* params = &ast->extras[ast->params[func] + 1];
+	for (uint32_t i = 0; i < paramCount; i++) {
 		*curbuf = '_';
 		curbuf++;
-		len = strlen(param->type->name);
-		memcpy(curbuf, param->type->name, len);
+		const char* typeName = builtInTypes[ast->types[params[i]]].name;
+		len = strlen(typeName);
+		memcpy(curbuf, typeName, len);
 		curbuf += len;
-		param = param->next;
 	}
-	ibsEndAlloc(a, curbuf - buf + 1);
+	ibsEndAllocTagged(a, curbuf - buf + 1, "mangled name");
 	return buf;
 }
 
-static void processDeclarationWithExpr(PSmmAstDeclNode decl, PTIData tidata, PIbsAllocator a) {
-	PSmmAstNode assignment = decl->left;
-	PSmmAstIdentNode ident = &assignment->left->asIdent;
-	if (decl->isBeingProcessed) {
-		smmPostMessage(tidata->msgs, errSmmCircularDefinition, ident->token->filePos, ident->token->repr);
-		ident->type = &builtInTypes[tiSmmUnknown];
-		assignment->type = ident->type;
+static void processDeclarationWithExpr(SmmAstNode decl, PTIData tidata, PIbsAllocator a) {
+	PSmmAst ast = tidata->ast;
+	SmmAstNode assignment = ast->lefts[decl];
+	SmmAstNode ident = ast->lefts[assignment];
+	if (ast->flags[decl] & nfSmmBeingProcessed) {
+		smmPostMessage(tidata->msgs, errSmmCircularDefinition, ast->tokens[ident]->offset, ast->tokens[ident]->repr);
+		ast->types[ident] = tiSmmUnknown;
+		ast->types[assignment] = tiSmmUnknown;
 		return;
 	}
-	if (decl->isProcessed) {
+	if (ast->flags[decl] & nfSmmProcessed) {
 		return;
 	}
-	if (!assignment->right) {
-		ident->type = &builtInTypes[tiSmmUnknown];
-		assignment->type = ident->type;
+	if (!ast->rights[assignment]) {
+		ast->types[ident] = tiSmmUnknown;
+		ast->types[assignment] = tiSmmUnknown;
 		return;
 	}
-	decl->isBeingProcessed = true;
-	PSmmAstNode typeNode = assignment->right;
+	ast->flags[decl] |= nfSmmBeingProcessed;
+	SmmAstNode typeNode = ast->rights[assignment];
 	processExpression(typeNode, tidata, a);
-	if (!ident->type) {
-		ident->type = deduceTypeFrom(typeNode);
-		assignment->type = ident->type;
+	if (ast->types[ident] == tiSmmNone) {
+		ast->types[ident] = deduceTypeFrom(ast, typeNode)->kind;
+		ast->types[assignment] = ast->types[ident];
 	}
-	decl->isBeingProcessed = false;
-	decl->isProcessed = true;
+	ast->flags[decl] &= ~nfSmmBeingProcessed;
+	ast->flags[decl] |= nfSmmProcessed;
 }
 
-static bool addDeclIfNew(PSmmAstDeclNode decl, PTIData tidata) {
-	if (decl->left->kind != nkSmmFunc) {
-		PSmmAstIdentNode newIdent = &decl->left->left->asIdent;
-		PSmmAstNode existing = ibsDictGet(tidata->idents, newIdent->token->repr);
+static bool addDeclIfNew(SmmAstNode decl, PTIData tidata) {
+	PSmmAst ast = tidata->ast;
+	if (ast->kinds[ast->lefts[decl]] != nkSmmFunc) {
+		SmmAstNode newIdent = ast->lefts[ast->lefts[decl]];
+		PSmmToken identToken = ast->tokens[newIdent];
+		SmmAstNode existing = getDecl(tidata, identToken->atom);
 		if (existing) {
-			uintptr_t exLevel = 0;
-			if (existing->left->left->isIdent) {
-				exLevel = existing->left->left->asIdent.level;
+			uint32_t exLevel = 0;
+			if (ast->kinds[existing] == nkSmmParam) {
+				exLevel = ast->levels[existing];
+			} else if (ast->flags[ast->lefts[ast->lefts[existing]]] & nfSmmIdent) {
+				exLevel = ast->levels[ast->lefts[ast->lefts[existing]]];
 			} else {
 				assert(false && "Got unexpected node kind");
 			}
-			if (newIdent->level == exLevel) {
-				smmPostMessage(tidata->msgs, errSmmRedefinition, newIdent->token->filePos, newIdent->token->repr);
+			if (ast->levels[newIdent] == exLevel) {
+				smmPostMessage(tidata->msgs, errSmmRedefinition, identToken->offset, identToken->repr);
 				return false;
 			}
 		}
-		ibsDictPush(tidata->idents, newIdent->token->repr, decl);
+		bindDecl(tidata, identToken->atom, decl);
 		return true;
 	}
 
-	PSmmAstFuncDefNode newfunc = (PSmmAstFuncDefNode)decl->left;
-	PSmmAstNode existingDecl = ibsDictGet(tidata->idents, newfunc->token->repr);
+	SmmAstNode newfunc = ast->lefts[decl];
+	PSmmToken funcToken = ast->tokens[newfunc];
+	SmmAstNode existingDecl = getDecl(tidata, funcToken->atom);
 	if (!existingDecl) {
-		ibsDictPush(tidata->idents, newfunc->token->repr, decl);
+		bindDecl(tidata, funcToken->atom, decl);
 		return true;
 	}
 
-	PSmmAstFuncDefNode existingFunc = (PSmmAstFuncDefNode)existingDecl->left;
+	SmmAstNode existingFunc = ast->lefts[existingDecl];
 
-	if (existingFunc->kind != nkSmmFunc) {
-		smmPostMessage(tidata->msgs, errSmmRedefinition, newfunc->token->filePos, newfunc->token->repr);
+	if (ast->kinds[existingFunc] != nkSmmFunc) {
+		smmPostMessage(tidata->msgs, errSmmRedefinition, funcToken->offset, funcToken->repr);
 		return false;
 	}
 
-	if (findFuncWithMatchingParams((PSmmAstNode)newfunc->params, existingFunc, false)) {
-		smmPostMessage(tidata->msgs, errSmmFuncRedefinition, newfunc->token->filePos);
+	if (findFuncWithMatchingParams(ast, ast->params[newfunc], existingFunc, false)) {
+		smmPostMessage(tidata->msgs, errSmmFuncRedefinition, funcToken->offset);
 		return false;
 	}
 
-	PSmmAstFuncDefNode* nextOverloadField = &existingFunc->nextOverload;
+	SmmAstNode* nextOverloadField = &ast->nextOverloads[existingFunc];
 	while (*nextOverloadField) {
-		nextOverloadField = &(*nextOverloadField)->nextOverload;
+		nextOverloadField = &ast->nextOverloads[*nextOverloadField];
 	}
 	*nextOverloadField = newfunc;
 	return true;
 }
 
-static PSmmTypeInfo processExpression(PSmmAstNode expr, PTIData tidata, PIbsAllocator a) {
+static PSmmTypeInfo processExpression(SmmAstNode expr, PTIData tidata, PIbsAllocator a) {
+	PSmmAst ast = tidata->ast;
 	PSmmTypeInfo resType = NULL;
 
 	PSmmTypeInfo leftType = NULL;
 	PSmmTypeInfo rightType = NULL;
+	PSmmToken token = ast->tokens[expr];
 
-	switch (expr->kind) {
+	switch (ast->kinds[expr]) {
 	case nkSmmAdd: case nkSmmFAdd: case nkSmmSub: case nkSmmFSub:
 	case nkSmmMul: case nkSmmFMul: case nkSmmUDiv: case nkSmmSDiv: case nkSmmFDiv:
 	case nkSmmURem: case nkSmmSRem: case nkSmmFRem:
 	case nkSmmAndOp: case nkSmmOrOp: case nkSmmXorOp:
 	case nkSmmEq: case nkSmmNotEq: case nkSmmGt: case nkSmmGtEq: case nkSmmLt: case nkSmmLtEq:
-		if (expr->type && expr->type->kind != tiSmmBool) {
-			return expr->type;
+		if (ast->types[expr] != tiSmmNone && ast->types[expr] != tiSmmBool) {
+			return &builtInTypes[ast->types[expr]];
 		}
-		leftType = processExpression(expr->left, tidata, a);
-		rightType = processExpression(expr->right, tidata, a);
-		expr->isConst = expr->left->isConst && expr->right->isConst;
+		leftType = processExpression(ast->lefts[expr], tidata, a);
+		rightType = processExpression(ast->rights[expr], tidata, a);
+		setConst(ast, expr, (ast->flags[ast->lefts[expr]] & ast->flags[ast->rights[expr]]) & nfSmmConst);
 		resType = getCommonTypeFromOperands(leftType, rightType);
-		if (!expr->type) expr->type = resType;
+		if (ast->types[expr] == tiSmmNone) ast->types[expr] = resType->kind;
 		break;
 	case nkSmmNeg: case nkSmmNot: case nkSmmCast:
-		leftType = processExpression(expr->left, tidata, a);
-		expr->isConst = expr->left->isConst;
+		leftType = processExpression(ast->lefts[expr], tidata, a);
+		setConst(ast, expr, ast->flags[ast->lefts[expr]] & nfSmmConst);
 		break;
 	default: break;
 	}
 
-	switch (expr->kind) {
+	switch (ast->kinds[expr]) {
 	case nkSmmAdd: case nkSmmSub:
-		if (resType->kind >= tiSmmFloat32) expr->kind++; // Add to FAdd, Sub to FSub
+		if (resType->kind >= tiSmmFloat32) ast->kinds[expr]++; // Add to FAdd, Sub to FSub
 		break;
 	case nkSmmMul:
-		if (resType->kind >= tiSmmFloat32) expr->kind = nkSmmFMul;
+		if (resType->kind >= tiSmmFloat32) ast->kinds[expr] = nkSmmFMul;
 		break;
 	case nkSmmSDiv: case nkSmmSRem:
-		if (resType->isUnsigned) expr->kind--; // Signed op to unsigned op
+		if (resType->isUnsigned) ast->kinds[expr]--; // Signed op to unsigned op
 		if (resType->kind >= tiSmmFloat32) {
-			char buf[4];
-			smmPostMessage(tidata->msgs, errSmmBadOperandsType, expr->token->filePos, smmTokenToString(expr->token, buf), resType->name);
-			fixDivModOperandTypes(expr, a);
-			expr->type = getCommonTypeFromOperands(expr->left->type, expr->right->type);
+			char buf[SMM_TOKEN_STRING_BUF_SIZE];
+			smmPostMessage(tidata->msgs, errSmmBadOperandsType, token->offset, smmTokenToString(token, buf), resType->name);
+			fixDivModOperandTypes(ast, expr, a);
+			PSmmTypeInfo newLeftType = &builtInTypes[ast->types[ast->lefts[expr]]];
+			PSmmTypeInfo newRightType = &builtInTypes[ast->types[ast->rights[expr]]];
+			ast->types[expr] = getCommonTypeFromOperands(newLeftType, newRightType)->kind;
 		}
 		break;
 	case nkSmmFDiv: case nkSmmFRem:
-		if (resType->kind < tiSmmFloat32) expr->type = &builtInTypes[tiSmmSoftFloat64];
+		if (resType->kind < tiSmmFloat32) ast->types[expr] = tiSmmSoftFloat64;
 		break;
 	case nkSmmEq: case nkSmmNotEq: case nkSmmGt: case nkSmmGtEq: case nkSmmLt: case nkSmmLtEq:
 		{
 			if (!leftType->isInt || !rightType->isInt) break;
 			if (leftType->isUnsigned == rightType->isUnsigned) break;
 
-			smmPostMessage(tidata->msgs, wrnSmmComparingSignedAndUnsigned, expr->token->filePos);
+			smmPostMessage(tidata->msgs, wrnSmmComparingSignedAndUnsigned, token->offset);
 
-			PSmmAstNode castNode = smmNewAstNode(nkSmmCast, a);
-			castNode->isConst = expr->isConst;
-			castNode->type = resType;
-			if (leftType->isUnsigned) {
-				castNode->left = expr->left;
-				castNode->token = expr->left->token;
-				expr->left = castNode;
-			} else {
-				castNode->left = expr->right;
-				castNode->token = expr->right->token;
-				expr->right = castNode;
-			}
+			SmmAstNode castNode = smmNewAstNode(ast, nkSmmCast);
+			ast->flags[castNode] = ast->flags[expr] & nfSmmConst;
+			ast->types[castNode] = resType->kind;
+			SmmAstNode* operandField = leftType->isUnsigned ? &ast->lefts[expr] : &ast->rights[expr];
+			ast->lefts[castNode] = *operandField;
+			ast->tokens[castNode] = ast->tokens[*operandField];
+			*operandField = castNode;
 			break;
 		}
 	case nkSmmNeg:
-		expr->type = leftType;
-		if (expr->type->isUnsigned) {
-			expr->type = &builtInTypes[expr->type->kind - tiSmmUInt8 + tiSmmInt8];
-		} else if (expr->type->kind == tiSmmBool) {
-			expr->type = &builtInTypes[tiSmmInt32]; // Next pass should handle this
+		ast->types[expr] = leftType->kind;
+		if (leftType->isUnsigned) {
+			ast->types[expr] = leftType->kind - tiSmmUInt8 + tiSmmInt8;
+		} else if (leftType->kind == tiSmmBool) {
+			ast->types[expr] = tiSmmInt32; // Next pass should handle this
 		}
 		break;
 	case nkSmmCall:
 		{
-			PSmmAstCallNode callNode = (PSmmAstCallNode)expr;
-			PSmmAstNode funcDefDecl = ibsDictGet(tidata->idents, callNode->token->repr);
+			SmmAstNode funcDefDecl = getDecl(tidata, token->atom);
 			if (!funcDefDecl) {
-				smmPostMessage(tidata->msgs, errSmmUndefinedIdentifier, callNode->token->filePos, callNode->token->repr);
-				expr->type = &builtInTypes[tiSmmUnknown];
-			} else if (funcDefDecl->kind == nkSmmParam || funcDefDecl->left->kind != nkSmmFunc) {
-				smmPostMessage(tidata->msgs, errSmmNotAFunction, callNode->token->filePos, callNode->token->repr);
-				expr->type = &builtInTypes[tiSmmUnknown];
+				smmPostMessage(tidata->msgs, errSmmUndefinedIdentifier, token->offset, token->repr);
+				ast->types[expr] = tiSmmUnknown;
+			} else if (ast->kinds[funcDefDecl] == nkSmmParam || ast->kinds[ast->lefts[funcDefDecl]] != nkSmmFunc) {
+				smmPostMessage(tidata->msgs, errSmmNotAFunction, token->offset, token->repr);
+				ast->types[expr] = tiSmmUnknown;
 			} else {
-				PSmmAstNode astArg = callNode->args;
-				while (astArg) {
-					processExpression(astArg, tidata, a);
-					astArg = astArg->next;
+				uint32_t argCount = ast->extras[ast->args[expr]];
+				SmmAstNode* astArgs = &ast->extras[ast->args[expr] + 1];
+				for (uint32_t i = 0; i < argCount; i++) {
+					processExpression(astArgs[i], tidata, a);
 				}
-				resolveCall(callNode, (PSmmAstFuncDefNode)funcDefDecl->left, tidata->msgs);
+				resolveCall(tidata, expr, ast->lefts[funcDefDecl]);
 				if (tidata->acceptOnlyConsts) {
-					smmPostMessage(tidata->msgs, errSmmNonConstInConstExpression, expr->token->filePos);
+					smmPostMessage(tidata->msgs, errSmmNonConstInConstExpression, token->offset);
 				}
 			}
 			break;
 		}
 	case nkSmmIdent:
 		{
-			PSmmAstDeclNode decl = ibsDictGet(tidata->idents, expr->token->repr);
+			SmmAstNode decl = getDecl(tidata, token->atom);
 			if (!decl) {
-				smmPostMessage(tidata->msgs, errSmmUndefinedIdentifier, expr->token->filePos, expr->token->repr);
-				expr->type = &builtInTypes[tiSmmUnknown];
-			} else if (decl->kind == nkSmmParam) {
+				smmPostMessage(tidata->msgs, errSmmUndefinedIdentifier, token->offset, token->repr);
+				ast->types[expr] = tiSmmUnknown;
+			} else if (ast->kinds[decl] == nkSmmParam) {
 				if (tidata->acceptOnlyConsts) {
-					smmPostMessage(tidata->msgs, errSmmNonConstInConstExpression, expr->token->filePos);
+					smmPostMessage(tidata->msgs, errSmmNonConstInConstExpression, token->offset);
 				}
-				expr->type = ((PSmmAstParamNode)decl)->type;
+				ast->types[expr] = ast->types[decl];
 			} else {
-				if (decl->left->left->kind == nkSmmConst) {
-					expr->kind = nkSmmConst;
-					expr->isConst = true;
+				SmmAstNode assignment = ast->lefts[decl];
+				if (ast->kinds[ast->lefts[assignment]] == nkSmmConst) {
+					ast->kinds[expr] = nkSmmConst;
+					ast->flags[expr] |= nfSmmConst;
 					processDeclarationWithExpr(decl, tidata, a);
 				} else if (tidata->acceptOnlyConsts) {
-					smmPostMessage(tidata->msgs, errSmmNonConstInConstExpression, expr->token->filePos);
-				} else if (!decl->left->type) {
+					smmPostMessage(tidata->msgs, errSmmNonConstInConstExpression, token->offset);
+				} else if (ast->types[assignment] == tiSmmNone) {
 					assert(false && "This should not happen any more, I think!");
 					processDeclarationWithExpr(decl, tidata, a);
 				}
-				if (!expr->type) {
-					expr->type = decl->left->type;
-					if (!expr->type) {
-						expr->type = &builtInTypes[tiSmmUnknown];
+				if (ast->types[expr] == tiSmmNone) {
+					ast->types[expr] = ast->types[assignment];
+					if (ast->types[expr] == tiSmmNone) {
+						ast->types[expr] = tiSmmUnknown;
 					}
 				}
 			}
 			break;
 		}
 	case nkSmmConst:
-		if (!expr->type) {
-			PSmmAstDeclNode decl = ibsDictGet(tidata->idents, expr->token->repr);
+		if (ast->types[expr] == tiSmmNone) {
+			SmmAstNode decl = getDecl(tidata, token->atom);
 			if (!decl) {
-				smmPostMessage(tidata->msgs, errSmmUndefinedIdentifier, expr->token->filePos, expr->token->repr);
-				expr->type = &builtInTypes[tiSmmUnknown];
+				smmPostMessage(tidata->msgs, errSmmUndefinedIdentifier, token->offset, token->repr);
+				ast->types[expr] = tiSmmUnknown;
 			} else {
-				if (!decl->left->type) {
+				if (ast->types[ast->lefts[decl]] == tiSmmNone) {
 					processDeclarationWithExpr(decl, tidata, a);
 				}
-				expr->type = decl->left->type;
+				ast->types[expr] = ast->types[ast->lefts[decl]];
 			}
 		}
 		break;
@@ -489,113 +528,123 @@ static PSmmTypeInfo processExpression(PSmmAstNode expr, PTIData tidata, PIbsAllo
 		assert(false && "Got unexpected node type in processExpression");
 		break;
 	}
-	return expr->type;
+	return &builtInTypes[ast->types[expr]];
 }
 
-static void processLocalSymbols(PSmmAstDeclNode decl, PTIData tidata, PIbsAllocator a) {
-	PSmmAstDeclNode origDecl = decl;
+static void processLocalSymbols(SmmAstNode decl, PTIData tidata, PIbsAllocator a) {
+	PSmmAst ast = tidata->ast;
+	SmmAstNode origDecl = decl;
 	while (decl) {
-		if (decl->left->left->isConst) {
+		if (ast->flags[ast->lefts[ast->lefts[decl]]] & nfSmmConst) {
 			addDeclIfNew(decl, tidata);
 		}
-		decl = decl->nextDecl;
+		decl = ast->nextDecls[decl];
 	}
 	// We can't join these two loops since earlier decl can use const from the later one
 	tidata->acceptOnlyConsts = true;
 	decl = origDecl;
 	while (decl) {
-		if (decl->left->left->isConst) {
+		if (ast->flags[ast->lefts[ast->lefts[decl]]] & nfSmmConst) {
 			processDeclarationWithExpr(decl, tidata, a);
 		}
-		decl = decl->nextDecl;
+		decl = ast->nextDecls[decl];
 	}
 	tidata->acceptOnlyConsts = false;
 }
 
 // Returns false if this statement should be removed
-static bool processAssignment(PSmmAstNode stmt, PTIData tidata, PIbsAllocator a) {
-	PSmmAstDeclNode decl = ibsDictGet(tidata->idents, stmt->left->token->repr);
+static bool processAssignment(SmmAstNode stmt, PTIData tidata, PIbsAllocator a) {
+	PSmmAst ast = tidata->ast;
+	SmmAstNode lval = ast->lefts[stmt];
+	PSmmToken lvalToken = ast->tokens[lval];
+	SmmAstNode decl = getDecl(tidata, lvalToken->atom);
 	if (!decl) {
-		smmPostMessage(tidata->msgs, errSmmUndefinedIdentifier, stmt->left->token->filePos, stmt->left->token->repr);
+		smmPostMessage(tidata->msgs, errSmmUndefinedIdentifier, lvalToken->offset, lvalToken->repr);
 		return false;
 	}
-	if (decl->left != stmt) {
-		PSmmToken origToken = stmt->left->token;
-		*stmt->left = *decl->left->left;
-		stmt->left->token = origToken;
-	} else if (decl->isProcessed) {
+	if (ast->lefts[decl] != stmt) {
+		smmCopyAstNode(ast, lval, ast->lefts[ast->lefts[decl]]);
+		ast->tokens[lval] = lvalToken;
+	} else if (ast->flags[decl] & nfSmmProcessed) {
 		return true;
 	}
-	if (stmt->left->kind == nkSmmConst) {
-		smmPostMessage(tidata->msgs, errSmmCantAssignToConst, stmt->token->filePos);
+	if (ast->kinds[lval] == nkSmmConst) {
+		smmPostMessage(tidata->msgs, errSmmCantAssignToConst, ast->tokens[stmt]->offset);
 	}
-	if (!stmt->right) return false;
-	stmt->type = stmt->left->type;
-	processExpression(stmt->right, tidata, a);
+	if (!ast->rights[stmt]) return false;
+	ast->types[stmt] = ast->types[lval];
+	processExpression(ast->rights[stmt], tidata, a);
 
 	return true;
 }
 
-static void processReturn(PSmmAstNode stmt, PTIData tidata, PIbsAllocator a) {
-	assert(stmt && stmt->type);
-	PSmmTypeInfo retType = stmt->type;
-	if (stmt->left) {
-		PSmmTypeInfo exprType = processExpression(stmt->left, tidata, a);
-		if (exprType == &builtInTypes[tiSmmVoid]) {
+static void processReturn(SmmAstNode stmt, PTIData tidata, PIbsAllocator a) {
+	PSmmAst ast = tidata->ast;
+	assert(stmt && ast->types[stmt] != tiSmmNone);
+	PSmmTypeInfo retType = &builtInTypes[ast->types[stmt]];
+	SmmAstNode expr = ast->lefts[stmt];
+	if (expr) {
+		PSmmTypeInfo exprType = processExpression(expr, tidata, a);
+		if (exprType->kind == tiSmmVoid) {
 			// This can happen if we use return funcThatReturnsNothing();
-			smmPostMessage(tidata->msgs, errSmmInvalidExprUsed, stmt->left->token->filePos);
-		} else if (retType == &builtInTypes[tiSmmVoid]) {
-			smmPostMessage(tidata->msgs, errSmmNoReturnValueNeeded, stmt->token->filePos);
+			smmPostMessage(tidata->msgs, errSmmInvalidExprUsed, ast->tokens[expr]->offset);
+		} else if (retType->kind == tiSmmVoid) {
+			smmPostMessage(tidata->msgs, errSmmNoReturnValueNeeded, ast->tokens[stmt]->offset);
 		} else if (retType->kind == tiSmmUnknown) {
-			stmt->type = deduceTypeFrom(stmt->left);
+			ast->types[stmt] = deduceTypeFrom(ast, expr)->kind;
 		} else if (exprType->kind != tiSmmUnknown && exprType != retType && !isUpcastPossible(exprType, retType)) {
 			PSmmTypeInfo ltype = exprType;
-			if (ltype == &builtInTypes[tiSmmSoftFloat64]) ltype = &builtInTypes[tiSmmFloat32];
-			smmPostMessage(tidata->msgs, errSmmBadReturnStmtType, stmt->token->filePos, ltype->name, retType->name);
+			if (ltype->kind == tiSmmSoftFloat64) ltype = &builtInTypes[tiSmmFloat32];
+			smmPostMessage(tidata->msgs, errSmmBadReturnStmtType, ast->tokens[stmt]->offset, ltype->name, retType->name);
 		}
 		return;
 	}
 
 	if (retType->kind != tiSmmVoid && retType->kind != tiSmmUnknown) {
-		smmPostMessage(tidata->msgs, errSmmFuncMustReturnValue, stmt->token->filePos);
+		smmPostMessage(tidata->msgs, errSmmFuncMustReturnValue, ast->tokens[stmt]->offset);
 	}
 }
 
-static bool processStatement(PSmmAstNode stmt, PTIData tidata, PIbsAllocator a) {
-	switch (stmt->kind) {
+static bool processStatement(SmmAstNode stmt, PTIData tidata, PIbsAllocator a) {
+	PSmmAst ast = tidata->ast;
+	switch (ast->kinds[stmt]) {
 	case nkSmmBlock:
 		{
-			PSmmAstBlockNode newBlock = (PSmmAstBlockNode)stmt;
-			processLocalSymbols(newBlock->scope->decls, tidata, a);
-			processBlock(newBlock, tidata, a);
+			uint32_t scopeMark = ibsSymTableMark(tidata->idents);
+			processLocalSymbols(ast->decls[ast->scopes[stmt]], tidata, a);
+			processBlock(stmt, tidata, a);
+			ibsSymTableRestore(tidata->idents, scopeMark);
 			break;
 		}
 	case nkSmmAssignment: return processAssignment(stmt, tidata, a);
 	case nkSmmReturn: processReturn(stmt, tidata, a); break;
 	case nkSmmIf: case nkSmmWhile:
-		processExpression(stmt->asIfWhile.cond, tidata, a);
-		processStatement(stmt->asIfWhile.body, tidata, a);
-		if (stmt->asIfWhile.elseBody) {
-			processStatement(stmt->asIfWhile.elseBody, tidata, a);
+		{
+			SmmAstNode* branches = &ast->extras[ast->branches[stmt]];
+			processExpression(ast->conds[stmt], tidata, a);
+			processStatement(branches[0], tidata, a);
+			if (branches[1]) {
+				processStatement(branches[1], tidata, a);
+			}
+			break;
 		}
-		break;
 	case nkSmmDecl:
 		{
-			PSmmAstNode assignment = stmt->left;
-			PSmmAstIdentNode ident = &assignment->left->asIdent;
-			if (!stmt->asDecl.isProcessed) {
-				processExpression(assignment->right, tidata, a);
-				stmt->asDecl.isProcessed = true;
+			SmmAstNode assignment = ast->lefts[stmt];
+			SmmAstNode ident = ast->lefts[assignment];
+			if (!(ast->flags[stmt] & nfSmmProcessed)) {
+				processExpression(ast->rights[assignment], tidata, a);
+				ast->flags[stmt] |= nfSmmProcessed;
 			} else {
 				assert(false && "This should not happen");
 			}
-			if (!ident->type) {
-				ident->type = deduceTypeFrom(assignment->right);
-				assignment->type = ident->type;
+			if (ast->types[ident] == tiSmmNone) {
+				ast->types[ident] = deduceTypeFrom(ast, ast->rights[assignment])->kind;
+				ast->types[assignment] = ast->types[ident];
 			} else {
 				// Type was explicitly given in source code
 			}
-			ibsDictPush(tidata->idents, ident->token->repr, stmt);
+			bindDecl(tidata, ast->tokens[ident]->atom, stmt);
 			break;
 		}
 	default:
@@ -605,116 +654,141 @@ static bool processStatement(PSmmAstNode stmt, PTIData tidata, PIbsAllocator a)
 	return true;
 }
 
-static void processBlock(PSmmAstBlockNode block, PTIData tidata, PIbsAllocator a) {
-	PSmmAstNode* stmtField = &block->stmts;
-	while (*stmtField) {
-		PSmmAstNode stmt = *stmtField;
-		if (!processStatement(stmt, tidata, a)) {
-			// This means the statement should be discarded
-			*stmtField = stmt->next;
-		}
-		stmtField = &stmt->next;
-	}
-
-	if (block->scope->level > 0) {
-		PSmmAstDeclNode decl = block->scope->decls;
-		while (decl) {
-			ibsDictPop(tidata->idents, decl->left->left->token->repr);
-			decl = decl->nextDecl;
+static void processBlock(SmmAstNode block, PTIData tidata, PIbsAllocator a) {
+	PSmmAst ast = tidata->ast;
+	uint32_t stmtCount = ast->extras[ast->stmts[block]];
+	SmmAstNode* stmts = &ast->extras[ast->stmts[block] + 1];
+	uint32_t keptCount = 0;
+	for (uint32_t i = 0; i < stmtCount; i++) {
+		// If false is returned the statement should be discarded
+		if (processStatement(stmts[i], tidata, a)) {
+			stmts[keptCount++] = stmts[i];
 		}
 	}
+	if (stmtCount > 0) ast->extras[ast->stmts[block]] = keptCount;
 }
 
-static PSmmAstDeclNode processGlobalSymbols(PSmmAstDeclNode decl, PTIData tidata, PIbsAllocator a) {
-	PSmmAstDeclNode funcDecl = NULL;
-	PSmmAstDeclNode* funcDeclField = &funcDecl;
-	PSmmAstDeclNode varDecl = NULL;
-	PSmmAstDeclNode* varDeclField = &varDecl;
+static SmmAstNode processGlobalSymbols(SmmAstNode decl, PTIData tidata, PIbsAllocator a) {
+	PSmmAst ast = tidata->ast;
+	SmmAstNode funcDecl = 0;
+	SmmAstNode* funcDeclField = &funcDecl;
+	SmmAstNode varDecl = 0;
+	SmmAstNode* varDeclField = &varDecl;
 	// Sort decls so vars and constants are before functions
 	while (decl) {
 		if (addDeclIfNew(decl, tidata)) {
-			if (decl->left->kind == nkSmmFunc) {
+			SmmAstNode declared = ast->lefts[decl];
+			if (ast->kinds[declared] == nkSmmFunc) {
 				*funcDeclField = decl;
-				funcDeclField = &decl->nextDecl;
-				PSmmAstFuncDefNode funcNode = &decl->left->asFunc;
-				if (funcNode->body) {
-					funcNode->token->stringVal = getMangledName(funcNode, a);
+				funcDeclField = &ast->nextDecls[decl];
+				if (ast->bodies[declared] || (ast->flags[declared] & nfSmmLazyBody)) {
+					ast->tokens[declared]->stringVal = getMangledName(ast, declared, a);
 				}
 				else {
 					// If function has no body we assume it is external C func and we don't mangle the name
-					funcNode->token->stringVal = (char*)funcNode->token->repr;
+					ast->tokens[declared]->stringVal = (char*)ast->tokens[declared]->repr;
 				}
 			} else {
 				*varDeclField = decl;
-				varDeclField = &decl->nextDecl;
+				varDeclField = &ast->nextDecls[decl];
 			}
 		}
-		decl = decl->nextDecl;
+		decl = ast->nextDecls[decl];
 	}
 	*varDeclField = funcDecl; // Chain funcDecl at the end of var and const decls
 	tidata->funcDecls = funcDecl;
-	*funcDeclField = NULL;
+	*funcDeclField = 0;
 
 	decl = varDecl;
 	tidata->acceptOnlyConsts = true;
-	while (decl && decl->left->kind != nkSmmFunc) {
-		if (decl->left->left->kind == nkSmmConst) {
+	while (decl && ast->kinds[ast->lefts[decl]] != nkSmmFunc) {
+		if (ast->kinds[ast->lefts[ast->lefts[decl]]] == nkSmmConst) {
 			processDeclarationWithExpr(decl, tidata, a);
 		}
-		decl = decl->nextDecl;
+		decl = ast->nextDecls[decl];
 	}
 	tidata->acceptOnlyConsts = false;
 
 	decl = varDecl;
-	while (decl && decl->left->kind != nkSmmFunc) {
-		// We remove vars here and add them back when we actually come to decl statement
+	while (decl && ast->kinds[ast->lefts[decl]] != nkSmmFunc) {
+		// We hide vars here and add them back when we actually come to decl statement
 		// so we can detect if var is used before it is declared
-		if (decl->left->left->kind != nkSmmConst) {
-			ibsDictPop(tidata->idents, decl->left->left->token->repr);
+		SmmAstNode var = ast->lefts[ast->lefts[decl]];
+		if (ast->kinds[var] != nkSmmConst) {
+			bindDecl(tidata, ast->tokens[var]->atom, 0);
 		}
-		decl = decl->nextDecl;
+		decl = ast->nextDecls[decl];
 	}
 
 	return varDecl;
 }
 
+static void processFuncBody(SmmAstNode funcNode, PTIData tidata, PIbsAllocator a) {
+	PSmmAst ast = tidata->ast;
+	SmmAstNode body = ast->bodies[funcNode];
+	if (!body || (ast->flags[funcNode] & nfSmmProcessed)) return;
+	ast->flags[funcNode] |= nfSmmProcessed;
+	uint32_t scopeMark = ibsSymTableMark(tidata->idents);
+	uint32_t paramCount = ast->extras[ast->params[funcNode]];
+	SmmAstNode* params = &ast->extras[ast->params[funcNode] + 1];
+	for (uint32_t i = 0; i < paramCount; i++) {
+		bindDecl(tidata, ast->tokens[params[i]]->atom, params[i]);
+	}
+	processLocalSymbols(ast->decls[ast->scopes[body]], tidata, a);
+	processBlock(body, tidata, a);
+	ibsSymTableRestore(tidata->idents, scopeMark);
+}
+
 void processFuncDecls(PTIData tidata, PIbsAllocator a) {
-	PSmmAstDeclNode decl = tidata->funcDecls;
+	PSmmAst ast = tidata->ast;
 	tidata->isInMainCode = false;
-	while (decl) {
-		PSmmAstFuncDefNode funcNode = &decl->left->asFunc;
-		if (funcNode->body) {
-			PSmmAstParamNode param = funcNode->params;
-			while (param) {
-				ibsDictPush(tidata->idents, param->token->repr, param);
-				param = param->next;
-			}
-			processLocalSymbols(funcNode->body->scope->decls, tidata, a);
-			processBlock(funcNode->body, tidata, a);
-			param = funcNode->params;
-			while (param) {
-				ibsDictPop(tidata->idents, param->token->repr);
-				param = param->next;
-			}
+	// Calls in processed bodies can cause more bodies to be parsed so we repeat until there are no new ones
+	uint32_t parsedBodyCount;
+	do {
+		parsedBodyCount = tidata->parsedBodyCount;
+		SmmAstNode decl = tidata->funcDecls;
+		while (decl) {
+			processFuncBody(ast->lefts[decl], tidata, a);
+			decl = ast->nextDecls[decl];
 		}
-		decl = decl->nextDecl;
-	}
+	} while (parsedBodyCount != tidata->parsedBodyCount);
 	tidata->isInMainCode = true;
 }
 
-void smmExecuteTypeInferencePass(PSmmAstNode module, PSmmMsgs msgs, PIbsAllocator a) {
-	PSmmAstBlockNode globalBlock = (PSmmAstBlockNode)module->next;
-	assert(globalBlock->kind == nkSmmBlock);
+static void processGlobals(PTIData tidata, PIbsAllocator a) {
+	PSmmAst ast = tidata->ast;
+	SmmAstNode globalBlock = ast->nexts[ast->program];
+	assert(ast->kinds[globalBlock] == nkSmmBlock);
 
-	PIbsAllocator tmpa = ibsSimpleAllocatorCreate("TypeInferenceTmp", a->size);
-	PIbsDict idents = ibsDictCreate(tmpa);
-	struct TIData tidata = { idents, msgs, NULL, true };
+	SmmAstNode globalScope = ast->scopes[globalBlock];
+	ast->decls[globalScope] = processGlobalSymbols(ast->decls[globalScope], tidata, a);
 
-	globalBlock->scope->decls = processGlobalSymbols(globalBlock->scope->decls, &tidata, a);
+	processBlock(globalBlock, tidata, a);
+}
+
+void smmExecuteTypeInferencePass(PSmmAst ast, PSmmMsgs msgs, PIbsAllocator a) {
+	PIbsAllocator tmpa = ibsVirtualAllocatorCreate("TypeInferenceTmp", IBS_DEFAULT_VIRTUAL_SIZE, false);
+	PIbsSymTable idents = ibsSymTableCreate(tmpa);
+	struct TIData tidata = { ast, idents, msgs, 0, 0, true, false, true };
 
-	processBlock(globalBlock, &tidata, a);
+	processGlobals(&tidata, a);
 
 	processFuncDecls(&tidata, a);
 
 	ibsSimpleAllocatorFree(tmpa);
 }
+
+PIbsSymTable smmExecuteGlobalTypeInference(PSmmAst ast, PSmmMsgs msgs, PIbsAllocator a) {
+	PIbsSymTable idents = ibsSymTableCreate(a);
+	struct TIData tidata = { ast, idents, msgs, 0, 0, true, false, false };
+
+	processGlobals(&tidata, a);
+
+	return idents;
+}
+
+void smmExecuteFuncTypeInference(PSmmAst ast, SmmAstNode func, PIbsSymTable globals, PSmmMsgs msgs, PIbsAllocator a) {
+	PIbsSymTable idents = ibsSymTableCopy(globals, a);
+	struct TIData tidata = { ast, idents, msgs, 0, 0, false, false, false };
+	processFuncBody(func, &tidata, a);
+}
@@ -5,4 +5,19 @@
 #include "smmmsgs.h"
 #include "smmparser.h"
 
-void smmExecuteTypeInferencePass(PSmmAstNode module, PSmmMsgs msgs, PIbsAllocator a);
+void smmExecuteTypeInferencePass(PSmmAst ast, PSmmMsgs msgs, PIbsAllocator a);
+
+/**
+* Does the same as smmExecuteTypeInferencePass except for func bodies which
+* are then processed by smmExecuteFuncTypeInference. Bodies skipped by the
+* parser are not parsed on demand. Returns the table of global symbols that
+* func bodies see.
+*/
+PIbsSymTable smmExecuteGlobalTypeInference(PSmmAst ast, PSmmMsgs msgs, PIbsAllocator a);
+
+/**
+* Processes the body of the given global func. Global symbols and other global
+* nodes are only read so bodies of different funcs can be processed on different
+* threads, each with its own AST view, messages and allocator.
+*/
+void smmExecuteFuncTypeInference(PSmmAst ast, SmmAstNode func, PIbsSymTable globals, PSmmMsgs msgs, PIbsAllocator a);
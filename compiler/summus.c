@@ -1,12 +1,15 @@
 #include "ibscommon.h"
 #include "ibsallocator.h"
 #include "ibsdictionary.h"
+#include "ibsfile.h"
 #include "smmmsgs.h"
-#include "smmlexer.h"
 #include "smmparser.h"
 #include "smmtypeinference.h"
-#include "smmsempass.h"
 #include "smmllvmcodegen.h"
+#include "smmcompiler.h"
+#include "smmserver.h"
+#include "smmcache.h"
+#include "smmbatch.h"
 #include "../utility/smmgvpass.h"
 
 #include <assert.h>
@@ -15,90 +18,259 @@
 #include <string.h>
 #include <time.h>
 
-static PSmmAstNode loadModule(const char* filename, PSmmMsgs msgs, PIbsAllocator a) {
-	char* buf = NULL;
-	char filebuf[64 * 1024] = { 0 };
-	FILE* f = fopen(filename, "rb");
-	if (!f) {
-		printf("Can't find %s !\n", filename);
-		exit(EXIT_FAILURE);
-	}
-	fread(filebuf, 1, 64 * 1024, f);
-	fclose(f);
-	buf = filebuf;
-	PSmmLexer lex = smmCreateLexer(buf, filename, msgs, a);
+/**
+ * Prints messages and writes IR to the output file, or to stdout if it is
+ * not given, the same way for results that are compiled, cached or received
+ * from the compile server.
+ */
+static int writeResult(const char* msgs, uint32_t errorCount, const char* ir, const char* outFile) {
+	fputs(msgs, stdout);
+	if (errorCount > 0) return EXIT_FAILURE;
+	if (!ir) {
+		printf("\nERROR: Module compilation failed!\n");
+		return EXIT_FAILURE;
+	}
+	if (!outFile) {
+		fputs(ir, stdout);
+		return EXIT_SUCCESS;
+	}
+	if (!ibsFileWrite(outFile, ir)) {
+		printf("ERROR: Failed to open %s for writing!\n", outFile);
+		return EXIT_FAILURE;
+	}
+	printf("\nModule saved to %s\n", outFile);
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Messages are printed in order in which files were given once all of them
+ * are compiled.
+ */
+static int compileBatch(PSmmBatchFile files, uint32_t fileCount, PSmmCompileOptions options, PSmmCache cache,
+		uint32_t jobCount) {
+	double seconds = smmCompileBatch(files, fileCount, options, cache, jobCount);
+
+	uint32_t failedCount = 0;
+	for (uint32_t i = 0; i < fileCount; i++) {
+		PSmmBatchFile file = &files[i];
+		if (file->msgs) fputs(file->msgs, stdout);
+		if (file->error) printf("ERROR: %s: %s\n", file->error, file->inFile);
+		if (file->failed) failedCount++;
+	}
+
+	printf("\nCompiled %u files in %.3fs, %u failed\n", fileCount, seconds, failedCount);
+	for (uint32_t i = 0; i < fileCount; i++) {
+		PSmmBatchFile file = &files[i];
+		const char* status = file->failed ? "FAILED" : "ok    ";
+		printf("%9.3fs %s %s%s\n", file->seconds, status, file->inFile, file->cached ? " (cached)" : "");
+	}
+	smmFreeBatch(files, fileCount);
+	return failedCount ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ * Compiles the file through the compile server and prints the same output
+ * that compiling it directly would.
+ */
+static int compileOnServer(const char* socketPath, const char* inFile, const char* outFile,
+		PSmmCompileOptions options, PIbsAllocator a) {
+	PIbsFile file = ibsFileOpen(inFile, a);
+	if (!file) {
+		printf("Can't find %s !\n", inFile);
+		return EXIT_FAILURE;
+	}
+	struct SmmServerResult res;
+	options->moduleName = inFile;
+	bool received = smmServerCompile(socketPath, file->data, file->size, options, &res, a);
+	ibsFileClose(file);
+	if (!received) {
+		printf("ERROR: Failed to get response from compile server at %s\n", socketPath);
+		return EXIT_FAILURE;
+	}
+	return writeResult(res.msgs, res.errorCount, res.ir, outFile);
+}
 
-	PSmmParser parser = smmCreateParser(lex, msgs, a);
+static void printCacheStats(PSmmCache cache, const char* cacheDir) {
+	struct SmmCacheStats stats = smmCacheGetStats(cache);
+	uint64_t lookups = stats.hits + stats.misses;
+	printf("Cache %s: %llu hits, %llu misses (%.1f%% hit rate), %llu stores, %llu evictions, %.1fMB\n",
+		cacheDir, (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+		lookups ? stats.hits * 100.0 / lookups : 0.0, (unsigned long long)stats.stores,
+		(unsigned long long)stats.evictions, stats.size / (1024.0 * 1024.0));
+}
 
-	return smmParse(parser);
+/**
+ * Runs the passes up to the one after which the AST should be printed and
+ * prints it as a graphviz graph.
+ */
+static int printPassGraph(const char* outFile, bool pp[3], PSmmCompileOptions options, PIbsAllocator a) {
+	const char* inFile = options->moduleName;
+	PIbsFile file = ibsFileOpen(inFile, a);
+	if (!file) {
+		printf("Can't find %s !\n", inFile);
+		return EXIT_FAILURE;
+	}
+	FILE* out = stdout;
+	if (outFile) {
+		out = fopen(outFile, "wb");
+		if (!out) {
+			printf("ERROR: Failed to open %s for writing!\n", outFile);
+			ibsFileClose(file);
+			return EXIT_FAILURE;
+		}
+	}
+
+	struct SmmMsgs msgs = { 0 };
+	msgs.a = a;
+	PIbsAllocator lexerAllocator = NULL;
+	if (options->useLexerThread) lexerAllocator = ibsChunkedAllocatorCreate("lexer", 1024 * 1024);
+	PSmmAst module;
+	if (pp[2] && !pp[0] && !pp[1]) {
+		module = smmCheckSource(file->data, options, lexerAllocator, &msgs, a);
+	} else {
+		module = smmParseSource(file->data, options, lexerAllocator, &msgs, a);
+		if (module && pp[1] && !pp[0]) smmExecuteTypeInferencePass(module, &msgs, a);
+	}
+	// Token reprs point into the file so it is closed only after the graph is printed
+	if (module) smmExecuteGVPass(module, out);
+	ibsFileClose(file);
+	if (outFile) fclose(out);
+	return module ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 int main(int argc, char* argv[]) {
 	bool pp[3] = { false };
-	const char* inFile = NULL;
+	struct SmmCompileOptions options = { 0 };
+	PSmmCache cache = NULL;
+	bool batchMode = false;
+	uint32_t jobCount = 0;
+	const char* outDir = NULL;
 	const char* outFile = NULL;
+	const char* serveSocket = NULL;
+	const char* clientSocket = NULL;
+	bool stopServer = false;
+	const char* cacheDir = getenv("SUMMUS_CACHE_DIR");
+	uint64_t cacheSizeMB = 1024;
+	bool cacheStats = false;
+	PIbsAllocator a = ibsChunkedAllocatorCreate("main", 1024 * 1024);
+	const char** inFiles = ibsAlloc(a, argc * sizeof(char*));
+	uint32_t inFileCount = 0;
 	for (int i = 1; i < argc; i++) {
 		if (strcmp("-pp1", argv[i]) == 0) pp[0] = true;
 		else if (strcmp("-pp2", argv[i]) == 0) pp[1] = true;
 		else if (strcmp("-pp3", argv[i]) == 0) pp[2] = true;
-		else if (strcmp("-o", argv[i]) == 0) {
+		else if (strcmp("-lexthread", argv[i]) == 0) options.useLexerThread = true;
+		else if (strcmp("-lazybodies", argv[i]) == 0) options.lazyFuncBodies = true;
+		else if (strcmp("-threads", argv[i]) == 0) {
+			i++;
+			if (i < argc) options.threadCount = (uint32_t)atoi(argv[i]);
+			options.parallelPasses = true;
+		} else if (strcmp("-j", argv[i]) == 0) {
+			i++;
+			if (i < argc) jobCount = (uint32_t)atoi(argv[i]);
+			batchMode = true;
+		} else if (strcmp("-outdir", argv[i]) == 0) {
+			i++;
+			if (i < argc) outDir = argv[i];
+			batchMode = true;
+		} else if (strcmp("-o", argv[i]) == 0) {
 			i++;
 			if (i < argc) outFile = argv[i];
+		} else if (strcmp("--serve", argv[i]) == 0) {
+			i++;
+			if (i < argc) serveSocket = argv[i];
+		} else if (strcmp("--client", argv[i]) == 0) {
+			i++;
+			if (i < argc) clientSocket = argv[i];
+		} else if (strcmp("--stop", argv[i]) == 0) {
+			stopServer = true;
+		} else if (strcmp("-cachedir", argv[i]) == 0) {
+			i++;
+			if (i < argc) cacheDir = argv[i];
+		} else if (strcmp("-cachesize", argv[i]) == 0) {
+			i++;
+			if (i < argc) cacheSizeMB = (uint64_t)atoll(argv[i]);
+		} else if (strcmp("-cachestats", argv[i]) == 0) {
+			cacheStats = true;
 		} else if (argv[i][0] == '-') {
 			printf("ERROR: Got unknown parameter %s\n", argv[i]);
 			return EXIT_FAILURE;
-		} else if (!inFile) {
-			inFile = argv[i];
 		} else {
-			printf("ERROR: Got extra parameter %s\n", argv[i]);
+			inFiles[inFileCount++] = argv[i];
 		}
 	}
-	if (inFile == NULL) {
-		printf("ERROR: File to compile not given\n");
+	if (options.lazyFuncBodies && options.parallelPasses) {
+		// Parallel passes process every body so they can't skip bodies of funcs that are not called
+		printf("ERROR: -lazybodies can't be used together with -threads\n");
 		return EXIT_FAILURE;
 	}
-	PIbsAllocator a = ibsSimpleAllocatorCreate("main", 1024 * 1024);
-	
-	struct SmmMsgs msgs = { 0 };
-	msgs.a = a;
-
-	PSmmAstNode module = loadModule(inFile, &msgs, a);
-
-	FILE* out = stdout;
-	if (outFile) {
-		out = fopen(outFile, "wb");
-		if (!out) {
-			printf("ERROR: Failed to open %s for writing!\n", outFile);
-		}
-	}
-
-	if (pp[0]) {
-		smmExecuteGVPass(module, out);
-		return EXIT_SUCCESS;
+	if (serveSocket) {
+		if (smmServe(serveSocket, jobCount)) return EXIT_SUCCESS;
+		printf("ERROR: Failed to start compile server at %s\n", serveSocket);
+		return EXIT_FAILURE;
 	}
-	smmExecuteTypeInferencePass(module, &msgs, a);
-	if (pp[1]) {
-		smmExecuteGVPass(module, out);
-		return EXIT_SUCCESS;
+	if (clientSocket && stopServer) {
+		if (smmServerStop(clientSocket)) return EXIT_SUCCESS;
+		printf("ERROR: Failed to reach compile server at %s\n", clientSocket);
+		return EXIT_FAILURE;
 	}
-
-	smmExecuteSemPass(module, &msgs, a);
-	if (pp[2]) {
-		smmExecuteGVPass(module, out);
-		return EXIT_SUCCESS;
+	if (cacheDir && cacheDir[0]) {
+		cache = smmCacheOpen(cacheDir, cacheSizeMB * 1024 * 1024);
+		if (!cache) {
+			printf("ERROR: Failed to open compile cache at %s\n", cacheDir);
+			return EXIT_FAILURE;
+		}
 	}
-
-	smmFlushMessages(&msgs);
-
-	if (smmHadErrors(&msgs)) {
+	if (inFileCount == 0) {
+		if (cacheStats && cache) {
+			printCacheStats(cache, cacheDir);
+			smmCacheClose(cache);
+			return EXIT_SUCCESS;
+		}
+		printf("ERROR: File to compile not given\n");
 		return EXIT_FAILURE;
 	}
 
-	if (smmExecuteLLVMCodeGenPass(module, out, a)) {
-		if (outFile) printf("\nModule saved to %s\n", outFile);
-		return EXIT_SUCCESS;
+	int res;
+	if (batchMode || inFileCount > 1) {
+		if (outFile || clientSocket || pp[0] || pp[1] || pp[2]) {
+			printf("ERROR: -o, -pp and --client options can only be used when compiling one file\n");
+			return EXIT_FAILURE;
+		}
+		PSmmBatchFile files = smmCreateBatch(inFiles, inFileCount, outDir, a);
+		uint32_t first, second;
+		if (smmFindSameOutFiles(files, inFileCount, &first, &second, a)) {
+			printf("ERROR: %s and %s would both be compiled to %s\n", files[first].inFile, files[second].inFile,
+				files[first].outFile);
+			return EXIT_FAILURE;
+		}
+		res = compileBatch(files, inFileCount, &options, cache, jobCount);
+	} else if (clientSocket) {
+		if (pp[0] || pp[1] || pp[2]) {
+			printf("ERROR: -pp options can't be used with compile server\n");
+			return EXIT_FAILURE;
+		}
+		res = compileOnServer(clientSocket, inFiles[0], outFile, &options, a);
+	} else if (pp[0] || pp[1] || pp[2]) {
+		options.moduleName = inFiles[0];
+		res = printPassGraph(outFile, pp, &options, a);
+	} else {
+		PIbsFile file = ibsFileOpen(inFiles[0], a);
+		if (!file) {
+			printf("Can't find %s !\n", inFiles[0]);
+			res = EXIT_FAILURE;
+		} else {
+			struct SmmCacheEntry result;
+			options.moduleName = inFiles[0];
+			smmCompileFile(&options, cache, file, &result, a);
+			ibsFileClose(file);
+			res = writeResult(result.msgs, result.errorCount, result.ir, outFile);
+		}
 	}
 
-	printf("\nERROR: Module compilation failed!\n");
-	return EXIT_FAILURE;
+	if (cache) {
+		if (cacheStats) printCacheStats(cache, cacheDir);
+		smmCacheClose(cache);
+	}
+	return res;
 }
@@ -1,4 +1,4 @@
 #!/bin/bash
 
 mkdir -p bin
-gcc -std=c11 -Wno-unused-result `llvm-config --cflags` compiler/*.c utility/*c `llvm-config --ldflags --libs core analysis native bitwriter --system-libs` -lstdc++ -lm -o bin/summus
+gcc -std=c11 -Wno-unused-result `llvm-config --cflags` compiler/*.c utility/*c `llvm-config --ldflags --libs core analysis native bitwriter --system-libs` -lstdc++ -lm -pthread -o bin/summus
@@ -0,0 +1,6 @@
+#!/bin/bash
+
+mkdir -p bin/lib
+cd bin/lib
+clang++ -std=c11 -c `llvm-config --cflags` -x c ../../compiler/?[!u]*.c
+ar rcs ../libsummus.a *.o
@@ -0,0 +1,6 @@
+#!/bin/bash
+
+mkdir -p bin/lib
+cd bin/lib
+gcc -std=c11 -c -Wno-unused-result `llvm-config --cflags` ../../compiler/?[!u]*.c
+ar rcs ../libsummus.a *.o
@@ -0,0 +1,5 @@
+#!/bin/bash
+
+# Builds tests with thread sanitizer so races between concurrent compilations are reported
+mkdir -p bin
+gcc -std=c11 -g -O1 -fsanitize=thread -Wno-unused-result `llvm-config --cflags` compiler/?[!u]*.c tests/*.c `llvm-config --ldflags --libs core analysis native bitwriter --system-libs` -lstdc++ -lm -pthread -o bin/testSummusTsan
@@ -13,15 +13,37 @@
 #define cd chdir
 #endif
 
+CuSuite* IbsAllocatorGetSuite();
+CuSuite* IbsDictionaryGetSuite();
+CuSuite* IbsSymTableGetSuite();
+CuSuite* IbsScanGetSuite();
+CuSuite* IbsNumbersGetSuite();
+CuSuite* IbsThreadGetSuite();
+CuSuite* IbsSha256GetSuite();
 CuSuite* SmmLexerGetSuite();
 CuSuite* SmmParserGetSuite();
+CuSuite* SmmCompilerGetSuite();
+CuSuite* SmmServerGetSuite();
+CuSuite* SmmCacheGetSuite();
+CuSuite* SmmBatchGetSuite();
 
 int RunAllTests(void) {
 	CuString *output = CuStringNew();
 	CuSuite* suite = CuSuiteNew();
 
+	CuSuiteAddSuite(suite, IbsAllocatorGetSuite());
+	CuSuiteAddSuite(suite, IbsDictionaryGetSuite());
+	CuSuiteAddSuite(suite, IbsSymTableGetSuite());
+	CuSuiteAddSuite(suite, IbsScanGetSuite());
+	CuSuiteAddSuite(suite, IbsNumbersGetSuite());
+	CuSuiteAddSuite(suite, IbsThreadGetSuite());
+	CuSuiteAddSuite(suite, IbsSha256GetSuite());
 	CuSuiteAddSuite(suite, SmmLexerGetSuite());
 	CuSuiteAddSuite(suite, SmmParserGetSuite());
+	CuSuiteAddSuite(suite, SmmCompilerGetSuite());
+	CuSuiteAddSuite(suite, SmmServerGetSuite());
+	CuSuiteAddSuite(suite, SmmCacheGetSuite());
+	CuSuiteAddSuite(suite, SmmBatchGetSuite());
 
 	CuSuiteRun(suite);
 	CuSuiteSummary(suite, output);
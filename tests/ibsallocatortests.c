@@ -0,0 +1,153 @@
+#include "../compiler/ibscommon.h"
+#include "CuTest.h"
+#include "../compiler/ibsallocator.h"
+
+#include <string.h>
+
+static void TestChunkedGrowth(CuTest *tc) {
+	PIbsAllocator a = ibsChunkedAllocatorCreate("chunkedTest", 64 * 1024);
+	size_t firstSize = a->size;
+	uint8_t* first = ibsAlloc(a, 1000);
+	CuAssertPtrNotNull(tc, first);
+	first[999] = 1;
+
+	// Fill more than the first chunk to make sure new chunks get linked in
+	int count = (int)(firstSize / 1000) * 4;
+	for (int i = 0; i < count; i++) {
+		uint8_t* mem = ibsAlloc(a, 1000);
+		CuAssertPtrNotNull(tc, mem);
+		CuAssertIntEquals(tc, 0, mem[0] | mem[999]);
+		CuAssertIntEquals(tc, 0, (int)((uintptr_t)mem & 0x7));
+		mem[999] = 1;
+	}
+	CuAssertTrue(tc, a->chunks != NULL);
+	CuAssertTrue(tc, a->totalSize > firstSize);
+	CuAssertTrue(tc, a->chunkSize > firstSize);
+	CuAssertTrue(tc, a->peakSize == a->totalSize);
+	CuAssertTrue(tc, a->used == (size_t)(count + 1) * 1000);
+
+	ibsSimpleAllocatorReset(a);
+	CuAssertTrue(tc, a->chunks == NULL);
+	CuAssertTrue(tc, a->size == firstSize);
+	CuAssertTrue(tc, a->totalSize == firstSize);
+	CuAssertTrue(tc, a->peakSize > firstSize);
+	CuAssertIntEquals(tc, 0, (int)a->used);
+	CuAssertPtrEquals(tc, first, ibsAlloc(a, 8));
+	CuAssertIntEquals(tc, 0, first[999]);
+
+	ibsSimpleAllocatorFree(a);
+}
+
+static void TestChunkedOversized(CuTest *tc) {
+	PIbsAllocator a = ibsChunkedAllocatorCreate("oversizedTest", 64 * 1024);
+	uint8_t* mem = ibsAlloc(a, 100);
+	size_t freeBefore = a->free;
+	uint8_t* big = ibsAlloc(a, 1024 * 1024);
+	CuAssertPtrNotNull(tc, big);
+	big[1024 * 1024 - 1] = 1;
+	// Oversized allocation shouldn't change the current chunk
+	CuAssertTrue(tc, a->free == freeBefore);
+	CuAssertPtrEquals(tc, mem + 104, ibsAlloc(a, 8));
+	ibsSimpleAllocatorFree(a);
+}
+
+static void TestChunkedStartAlloc(CuTest *tc) {
+	PIbsAllocator a = ibsChunkedAllocatorCreate("startAllocTest", 64 * 1024);
+	ibsAlloc(a, a->free - 16);
+	char* buf = ibsStartAlloc(a);
+	CuAssertTrue(tc, a->reserved >= IBS_MIN_START_ALLOC_SIZE);
+	memset(buf, 'a', IBS_MIN_START_ALLOC_SIZE - 1);
+	ibsEndAlloc(a, IBS_MIN_START_ALLOC_SIZE);
+	CuAssertIntEquals(tc, IBS_MIN_START_ALLOC_SIZE - 1, (int)strlen(buf));
+	CuAssertTrue(tc, (uint8_t*)buf + IBS_MIN_START_ALLOC_SIZE == (uint8_t*)ibsAlloc(a, 8));
+	ibsSimpleAllocatorFree(a);
+}
+
+static void TestVirtualCommitAndReset(CuTest *tc) {
+	PIbsAllocator a = ibsVirtualAllocatorCreate("virtualTest", 64 * 1024 * 1024, false);
+	CuAssertIntEquals(tc, ibsAllocatorVirtual, a->kind);
+	size_t committed = a->committed;
+	uint8_t* first = ibsAlloc(a, 1000);
+	first[999] = 1;
+	for (int i = 0; i < 1000; i++) {
+		uint8_t* mem = ibsAlloc(a, 1000);
+		CuAssertIntEquals(tc, 0, mem[0] | mem[999]);
+		mem[999] = 1;
+	}
+	CuAssertTrue(tc, a->committed > committed);
+	CuAssertTrue(tc, a->committed < 2 * 1024 * 1024);
+
+	char* buf = ibsStartAlloc(a);
+	memset(buf, 'a', IBS_MIN_START_ALLOC_SIZE - 1);
+	ibsEndAlloc(a, IBS_MIN_START_ALLOC_SIZE);
+
+	ibsSimpleAllocatorReset(a);
+	CuAssertIntEquals(tc, 0, (int)a->used);
+	CuAssertPtrEquals(tc, first, ibsAlloc(a, 1000));
+	CuAssertIntEquals(tc, 0, first[999]);
+	for (int i = 0; i < 1000; i++) ibsAlloc(a, 1000);
+	CuAssertPtrEquals(tc, buf, ibsStartAlloc(a));
+	CuAssertIntEquals(tc, 0, buf[0]);
+	ibsEndAlloc(a, 0);
+	ibsSimpleAllocatorFree(a);
+}
+
+static void TestMarkRelease(CuTest *tc) {
+	PIbsAllocator a = ibsSimpleAllocatorCreate("markTest", 64 * 1024);
+	ibsAlloc(a, 100);
+	struct IbsAllocatorMark mark = ibsMark(a);
+	size_t used = a->used;
+	uint8_t* mem = ibsAlloc(a, 1000);
+	memset(mem, 0xff, 1000);
+	ibsRelease(a, mark);
+	CuAssertTrue(tc, a->used == used);
+#ifndef NDEBUG
+	CuAssertIntEquals(tc, IBS_POISON_BYTE, mem[0]);
+#endif
+	// Reused memory must again be zeroed
+	uint8_t* again = ibsAlloc(a, 10);
+	CuAssertPtrEquals(tc, mem, again);
+	CuAssertIntEquals(tc, 0, again[0] | again[9]);
+	char* buf = ibsStartAlloc(a);
+	CuAssertIntEquals(tc, 0, buf[0] | buf[989]);
+	ibsEndAlloc(a, 0);
+	ibsSimpleAllocatorFree(a);
+}
+
+static void TestChunkedMarkRelease(CuTest *tc) {
+	PIbsAllocator a = ibsChunkedAllocatorCreate("chunkedMarkTest", 64 * 1024);
+	uint8_t* first = ibsAlloc(a, 100);
+	struct IbsAllocatorMark mark = ibsMark(a);
+	size_t totalSize = a->totalSize;
+	for (int i = 0; i < 1000; i++) {
+		uint8_t* mem = ibsAlloc(a, 1000);
+		memset(mem, 0xff, 1000);
+	}
+	ibsAlloc(a, 1024 * 1024);
+	CuAssertTrue(tc, a->totalSize > totalSize);
+	ibsRelease(a, mark);
+	CuAssertTrue(tc, a->chunks == NULL);
+	CuAssertTrue(tc, a->totalSize == totalSize);
+	uint8_t* mem = ibsAlloc(a, 2000);
+	CuAssertPtrEquals(tc, first + 104, mem);
+	for (int i = 0; i < 2000; i++) {
+		if (mem[i] != 0) {
+			CuFail(tc, "Memory after release is not zeroed");
+			break;
+		}
+	}
+	ibsSimpleAllocatorFree(a);
+}
+
+CuSuite* IbsAllocatorGetSuite() {
+	CuSuite* suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, TestChunkedGrowth);
+	SUITE_ADD_TEST(suite, TestChunkedOversized);
+	SUITE_ADD_TEST(suite, TestChunkedStartAlloc);
+	SUITE_ADD_TEST(suite, TestVirtualCommitAndReset);
+	SUITE_ADD_TEST(suite, TestMarkRelease);
+	SUITE_ADD_TEST(suite, TestChunkedMarkRelease);
+
+	return suite;
+}
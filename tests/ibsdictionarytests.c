@@ -0,0 +1,73 @@
+#include "../compiler/ibscommon.h"
+#include "CuTest.h"
+#include "../compiler/ibsdictionary.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define KEY_COUNT 5000
+
+static void checkDictOperations(CuTest *tc, PIbsDict dict) {
+	int values[4] = { 0 };
+	CuAssertPtrEquals(tc, NULL, ibsDictGet(dict, "key"));
+	ibsDictPut(dict, "key", &values[0]);
+	ibsDictPut(dict, "keyLonger", &values[1]);
+	ibsDictPut(dict, "ke", &values[2]);
+	CuAssertPtrEquals(tc, &values[0], ibsDictGet(dict, "key"));
+	CuAssertPtrEquals(tc, &values[1], ibsDictGet(dict, "keyLonger"));
+	CuAssertPtrEquals(tc, &values[2], ibsDictGet(dict, "ke"));
+	CuAssertPtrEquals(tc, NULL, ibsDictGet(dict, "k"));
+	CuAssertPtrEquals(tc, NULL, ibsDictGet(dict, ""));
+
+	ibsDictPush(dict, "key", &values[3]);
+	CuAssertPtrEquals(tc, &values[3], ibsDictGet(dict, "key"));
+	CuAssertPtrEquals(tc, &values[3], ibsDictPop(dict, "key"));
+	CuAssertPtrEquals(tc, &values[0], ibsDictPop(dict, "key"));
+	CuAssertPtrEquals(tc, NULL, ibsDictGet(dict, "key"));
+	CuAssertPtrEquals(tc, NULL, ibsDictPop(dict, "key"));
+	CuAssertPtrNotNull(tc, ibsDictGetEntry(dict, "key"));
+	ibsDictPush(dict, "key", &values[0]);
+	CuAssertPtrEquals(tc, &values[0], ibsDictGet(dict, "key"));
+
+	// Check that keys don't get lost as dict grows
+	PIbsAllocator a = dict->a;
+	char** keys = ibsAlloc(a, KEY_COUNT * sizeof(char*));
+	for (int i = 0; i < KEY_COUNT; i++) {
+		keys[i] = ibsAlloc(a, 16);
+		sprintf(keys[i], "ident%d", i);
+		ibsDictPut(dict, keys[i], keys[i]);
+	}
+	for (int i = 0; i < KEY_COUNT; i++) {
+		// Trie remembers last key pointer so we need a new buffer for each lookup
+		char* buf = ibsAlloc(a, 16);
+		sprintf(buf, "ident%d", i);
+		if (ibsDictGet(dict, buf) != keys[i]) {
+			CuFail(tc, buf);
+		}
+	}
+	CuAssertPtrEquals(tc, &values[1], ibsDictGet(dict, "keyLonger"));
+}
+
+static void TestTrieDict(CuTest *tc) {
+	PIbsAllocator a = ibsChunkedAllocatorCreate("trieDictTest", 64 * 1024);
+	checkDictOperations(tc, ibsDictCreate(a));
+	ibsSimpleAllocatorFree(a);
+}
+
+static void TestHashDict(CuTest *tc) {
+	PIbsAllocator a = ibsChunkedAllocatorCreate("hashDictTest", 64 * 1024);
+	PIbsDict dict = ibsHashDictCreate(a);
+	checkDictOperations(tc, dict);
+	CuAssertIntEquals(tc, 0, (int)((uintptr_t)dict->buckets & 63));
+	CuAssertIntEquals(tc, KEY_COUNT + 3, (int)dict->count);
+	ibsSimpleAllocatorFree(a);
+}
+
+CuSuite* IbsDictionaryGetSuite() {
+	CuSuite* suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, TestTrieDict);
+	SUITE_ADD_TEST(suite, TestHashDict);
+
+	return suite;
+}
@@ -0,0 +1,84 @@
+#include "../compiler/ibscommon.h"
+#include "CuTest.h"
+#include "../compiler/ibsnumbers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Numbers that take every conversion path: fast path, Eisel-Lemire and slow
+ * decimal conversion, including exact half way cases, subnormals and overflows.
+ */
+static const char* hardNumbers[] = {
+	"0", "0.0", "000.000e10", "1", "1.5", "0.1", "3.14159", "123e25", "1e23",
+	"9007199254740993", "9007199254740992.5", "7.2057594037927933e16",
+	"1.7976931348623157e308", "1.7976931348623158e308", "1.7976931348623159e308", "2e308",
+	"2.2250738585072011e-308", "2.2250738585072014e-308", "4.9406564584124654e-324",
+	"2.4703282292062327e-324", "2.4703282292062328e-324", "1e-400", "1e100000",
+	"1.00000000000000011102230246251565404236316680908203125",
+	"1.00000000000000011102230246251565404236316680908203124",
+	"1.00000000000000011102230246251565404236316680908203126",
+	"1.000000000000000111022302462515654042363166809082031250000000000000000000001",
+	"123456789012345678901234567890e-20", "18446744073709551615", "18446744073709551616e-5",
+};
+
+static void checkNumber(CuTest* tc, const char* str) {
+	const char* end;
+	char* expEnd;
+	double expected = strtod(str, &expEnd);
+	double res = ibsParseDouble(str, &end);
+	CuAssert(tc, str, memcmp(&expected, &res, sizeof(res)) == 0);
+	CuAssertPtrEquals_Msg(tc, str, expEnd, (void*)end);
+}
+
+static void TestParseDouble(CuTest *tc) {
+	for (size_t i = 0; i < sizeof(hardNumbers) / sizeof(hardNumbers[0]); i++) {
+		checkNumber(tc, hardNumbers[i]);
+	}
+
+	const char* end;
+	const char* str = "1.e3";
+	CuAssertTrue(tc, ibsParseDouble(str, &end) == 1.0);
+	CuAssertPtrEquals(tc, (void*)&str[1], (void*)end);
+	str = "2e+x";
+	CuAssertTrue(tc, ibsParseDouble(str, &end) == 2.0);
+	CuAssertPtrEquals(tc, (void*)&str[1], (void*)end);
+	str = "x";
+	ibsParseDouble(str, &end);
+	CuAssertPtrEquals(tc, (void*)str, (void*)end);
+
+	char buf[128];
+	srand(42);
+	for (int iter = 0; iter < 20000; iter++) {
+		int p = 0;
+		int length = 1 + rand() % 30;
+		for (int i = 0; i < length; i++) buf[p++] = '0' + rand() % 10;
+		if (rand() % 2) {
+			buf[p++] = '.';
+			length = 1 + rand() % 30;
+			for (int i = 0; i < length; i++) buf[p++] = '0' + rand() % 10;
+		}
+		if (rand() % 2) p += sprintf(&buf[p], "e%d", rand() % 700 - 350);
+		buf[p] = 0;
+		checkNumber(tc, buf);
+	}
+}
+
+static void TestParseEightDigits(CuTest *tc) {
+	CuAssertIntEquals(tc, 12345678, ibsParseEightDigits("12345678"));
+	CuAssertIntEquals(tc, 99999999, ibsParseEightDigits("999999990"));
+	CuAssertIntEquals(tc, 1, ibsParseEightDigits("00000001"));
+	CuAssertIntEquals(tc, 0x12345678, ibsParseEightHexDigits("12345678"));
+	CuAssertTrue(tc, 0xABCDEF09 == ibsParseEightHexDigits("abcdef09"));
+	CuAssertTrue(tc, 0xFACE0B0A == ibsParseEightHexDigits("FaCe0b0A"));
+}
+
+CuSuite* IbsNumbersGetSuite() {
+	CuSuite* suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, TestParseDouble);
+	SUITE_ADD_TEST(suite, TestParseEightDigits);
+
+	return suite;
+}
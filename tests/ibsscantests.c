@@ -0,0 +1,80 @@
+#include "../compiler/ibscommon.h"
+#include "CuTest.h"
+#include "../compiler/ibsscan.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BUF_SIZE 256
+
+static const char chars[] = " \t\r\n\v\f/\\\"'`azAZ09_@[{-\x80\xff";
+
+/**
+ * Checks all functions with the given implementation against the scalar one
+ * on buffers of random chars starting at different alignments.
+ */
+static void checkImpl(CuTest* tc, IbsScanImpl impl) {
+	// Buffer is aligned so we can test all offsets within SIMD block
+	static char bufMem[BUF_SIZE + 128];
+	char* buf = (char*)(((uintptr_t)bufMem + 63) & ~(uintptr_t)63);
+	char msg[64];
+	srand(42);
+	for (int iter = 0; iter < 2000; iter++) {
+		int length = rand() % BUF_SIZE;
+		int start = rand() % 64;
+		// Runs of the same char class are more interesting than pure random chars
+		int charRange = 1 + rand() % (sizeof(chars) - 1);
+		for (int i = 0; i < length; i++) {
+			buf[start + i] = chars[rand() % charRange];
+		}
+		buf[start + length] = 0;
+		const char* p = &buf[start];
+		const char* end = p + (length ? rand() % length : 0);
+		char termChar = "\"'`"[iter % 3];
+
+		ibsScanSetImpl(ibsScanScalar);
+		const char* expWhite = ibsScanWhitespace(p);
+		const char* expAlNum = ibsScanAlNum(p);
+		const char* expLineEnd = ibsScanLineEnd(p);
+		const char* expStringPart = ibsScanStringPart(p, termChar);
+		uint32_t expCount = ibsScanCountChar(p, end, '\n');
+
+		ibsScanSetImpl(impl);
+		sprintf(msg, "impl %d iteration %d", impl, iter);
+		CuAssertPtrEquals_Msg(tc, msg, (void*)expWhite, (void*)ibsScanWhitespace(p));
+		CuAssertPtrEquals_Msg(tc, msg, (void*)expAlNum, (void*)ibsScanAlNum(p));
+		CuAssertPtrEquals_Msg(tc, msg, (void*)expLineEnd, (void*)ibsScanLineEnd(p));
+		CuAssertPtrEquals_Msg(tc, msg, (void*)expStringPart, (void*)ibsScanStringPart(p, termChar));
+		CuAssertIntEquals_Msg(tc, msg, expCount, ibsScanCountChar(p, end, '\n'));
+	}
+}
+
+static void TestScanScalar(CuTest *tc) {
+	IbsScanImpl origImpl = ibsScanGetImpl();
+	ibsScanSetImpl(ibsScanScalar);
+	const char* buf = " \t\r\n\v\fident09 next\n";
+	CuAssertPtrEquals(tc, (void*)&buf[6], (void*)ibsScanWhitespace(buf));
+	CuAssertPtrEquals(tc, (void*)&buf[13], (void*)ibsScanAlNum(&buf[6]));
+	CuAssertPtrEquals(tc, (void*)&buf[3], (void*)ibsScanLineEnd(buf));
+	CuAssertPtrEquals(tc, (void*)&buf[2], (void*)ibsScanStringPart(buf, '"'));
+	CuAssertIntEquals(tc, 2, ibsScanCountChar(buf, &buf[19], '\n'));
+	CuAssertIntEquals(tc, 1, ibsScanCountChar(buf, &buf[18], '\n'));
+	ibsScanSetImpl(origImpl);
+}
+
+static void TestScanSIMD(CuTest *tc) {
+	IbsScanImpl origImpl = ibsScanGetImpl();
+	if (ibsScanSetImpl(ibsScanSSE2)) checkImpl(tc, ibsScanSSE2);
+	if (ibsScanSetImpl(ibsScanAVX2)) checkImpl(tc, ibsScanAVX2);
+	ibsScanSetImpl(origImpl);
+}
+
+CuSuite* IbsScanGetSuite() {
+	CuSuite* suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, TestScanScalar);
+	SUITE_ADD_TEST(suite, TestScanSIMD);
+
+	return suite;
+}
@@ -0,0 +1,52 @@
+#include "../compiler/ibscommon.h"
+#include "CuTest.h"
+#include "../compiler/ibssha256.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static void hashToHex(const uint8_t* hash, char* hex) {
+	for (int i = 0; i < IBS_SHA256_SIZE; i++) {
+		sprintf(hex + i * 2, "%02x", hash[i]);
+	}
+}
+
+static void assertHash(CuTest* tc, const char* expected, const char* data) {
+	struct IbsSha256 sha;
+	uint8_t hash[IBS_SHA256_SIZE];
+	char hex[IBS_SHA256_SIZE * 2 + 1];
+	ibsSha256Init(&sha);
+	ibsSha256Update(&sha, data, strlen(data));
+	ibsSha256Final(&sha, hash);
+	hashToHex(hash, hex);
+	CuAssertStrEquals(tc, expected, hex);
+
+	// Giving data in pieces of different sizes must give the same hash
+	for (size_t step = 1; step < 70; step += 3) {
+		ibsSha256Init(&sha);
+		size_t length = strlen(data);
+		for (size_t i = 0; i < length; i += step) {
+			ibsSha256Update(&sha, data + i, i + step <= length ? step : length - i);
+		}
+		ibsSha256Final(&sha, hash);
+		hashToHex(hash, hex);
+		CuAssertStrEquals(tc, expected, hex);
+	}
+}
+
+static void TestSha256(CuTest *tc) {
+	assertHash(tc, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855", "");
+	assertHash(tc, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", "abc");
+	assertHash(tc, "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1",
+		"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq");
+	assertHash(tc, "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1",
+		"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu");
+}
+
+CuSuite* IbsSha256GetSuite() {
+	CuSuite* suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, TestSha256);
+
+	return suite;
+}
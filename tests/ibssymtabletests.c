@@ -0,0 +1,95 @@
+#include "../compiler/ibscommon.h"
+#include "CuTest.h"
+#include "../compiler/ibsatomtable.h"
+#include "../compiler/ibssymtable.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define ATOM_COUNT 5000
+
+static uint32_t intern(PIbsAtomTable atoms, const char* str, size_t length) {
+	return ibsAtomIntern(atoms, str, length, ibsAtomHash(str, length));
+}
+
+static void TestAtomTable(CuTest *tc) {
+	PIbsAllocator a = ibsChunkedAllocatorCreate("atomTableTest", 64 * 1024);
+	PIbsAtomTable atoms = ibsAtomTableCreate(a);
+	uint32_t key = intern(atoms, "key", 3);
+	CuAssertIntEquals(tc, 1, key);
+	CuAssertIntEquals(tc, key, intern(atoms, "keyLonger", 3));
+	CuAssertIntEquals(tc, 0, ibsAtomFind(atoms, "ke", 2, ibsAtomHash("ke", 2)));
+	CuAssertIntEquals(tc, 2, intern(atoms, "keyLonger", 9));
+	CuAssertStrEquals(tc, "key", ibsAtomName(atoms, key));
+
+	// Check that atoms don't get lost as table grows
+	char buf[16];
+	for (int i = 0; i < ATOM_COUNT; i++) {
+		int length = sprintf(buf, "ident%d", i);
+		CuAssertIntEquals(tc, i + 3, intern(atoms, buf, length));
+	}
+	for (int i = 0; i < ATOM_COUNT; i++) {
+		int length = sprintf(buf, "ident%d", i);
+		uint32_t atom = ibsAtomFind(atoms, buf, length, ibsAtomHash(buf, length));
+		if (atom != (uint32_t)i + 3 || strcmp(ibsAtomName(atoms, atom), buf) != 0) {
+			CuFail(tc, buf);
+		}
+	}
+	ibsSimpleAllocatorFree(a);
+}
+
+static void TestSymTable(CuTest *tc) {
+	PIbsAllocator a = ibsChunkedAllocatorCreate("symTableTest", 64 * 1024);
+	PIbsSymTable table = ibsSymTableCreate(a);
+	int values[3] = { 0 };
+	CuAssertPtrEquals(tc, NULL, ibsSymTableGet(table, 1));
+	ibsSymTableBind(table, 1, &values[0]);
+	ibsSymTableBind(table, 2, &values[1]);
+
+	uint32_t mark = ibsSymTableMark(table);
+	ibsSymTableBind(table, 1, &values[2]);
+	ibsSymTableBind(table, 3, &values[2]);
+	CuAssertPtrEquals(tc, &values[2], ibsSymTableGet(table, 1));
+	CuAssertPtrEquals(tc, &values[1], ibsSymTableGet(table, 2));
+
+	uint32_t innerMark = ibsSymTableMark(table);
+	ibsSymTableBind(table, ATOM_COUNT, &values[0]);
+	ibsSymTableBind(table, 1, &values[1]);
+	CuAssertPtrEquals(tc, &values[0], ibsSymTableGet(table, ATOM_COUNT));
+	ibsSymTableRestore(table, innerMark);
+	CuAssertPtrEquals(tc, NULL, ibsSymTableGet(table, ATOM_COUNT));
+	CuAssertPtrEquals(tc, &values[2], ibsSymTableGet(table, 1));
+
+	ibsSymTableRestore(table, mark);
+	CuAssertPtrEquals(tc, &values[0], ibsSymTableGet(table, 1));
+	CuAssertPtrEquals(tc, &values[1], ibsSymTableGet(table, 2));
+	CuAssertPtrEquals(tc, NULL, ibsSymTableGet(table, 3));
+
+	// Copy starts with the same bindings but changing it doesn't change the original
+	PIbsSymTable copy = ibsSymTableCopy(table, a);
+	CuAssertPtrEquals(tc, &values[0], ibsSymTableGet(copy, 1));
+	uint32_t copyMark = ibsSymTableMark(copy);
+	ibsSymTableBind(copy, 2, &values[2]);
+	CuAssertPtrEquals(tc, &values[2], ibsSymTableGet(copy, 2));
+	CuAssertPtrEquals(tc, &values[1], ibsSymTableGet(table, 2));
+	ibsSymTableRestore(copy, copyMark);
+	CuAssertPtrEquals(tc, &values[1], ibsSymTableGet(copy, 2));
+
+	// Check that log can grow
+	for (int i = 0; i < ATOM_COUNT; i++) {
+		ibsSymTableBind(table, 1 + i % 7, &values[i % 3]);
+	}
+	ibsSymTableRestore(table, mark);
+	CuAssertPtrEquals(tc, &values[0], ibsSymTableGet(table, 1));
+	CuAssertPtrEquals(tc, NULL, ibsSymTableGet(table, 7));
+	ibsSimpleAllocatorFree(a);
+}
+
+CuSuite* IbsSymTableGetSuite() {
+	CuSuite* suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, TestAtomTable);
+	SUITE_ADD_TEST(suite, TestSymTable);
+
+	return suite;
+}
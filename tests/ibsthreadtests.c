@@ -0,0 +1,35 @@
+#include "../compiler/ibscommon.h"
+#include "CuTest.h"
+#include "../compiler/ibsthread.h"
+
+#define TASK_COUNT 1000
+
+static void markTask(void* data, uint32_t index) {
+	uint32_t* counts = data;
+	counts[index]++;
+}
+
+static void TestParallelFor(CuTest *tc) {
+	static uint32_t counts[TASK_COUNT];
+	ibsParallelFor(TASK_COUNT, 4, markTask, counts);
+	for (int i = 0; i < TASK_COUNT; i++) {
+		CuAssertIntEquals(tc, 1, counts[i]);
+	}
+
+	// More threads than tasks and default number of threads
+	ibsParallelFor(3, 8, markTask, counts);
+	ibsParallelFor(TASK_COUNT, 0, markTask, counts);
+	CuAssertIntEquals(tc, 3, counts[0]);
+	CuAssertIntEquals(tc, 3, counts[2]);
+	CuAssertIntEquals(tc, 2, counts[3]);
+	CuAssertIntEquals(tc, 2, counts[TASK_COUNT - 1]);
+	CuAssertTrue(tc, ibsCpuCount() >= 1);
+}
+
+CuSuite* IbsThreadGetSuite() {
+	CuSuite* suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, TestParallelFor);
+
+	return suite;
+}
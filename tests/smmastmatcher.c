@@ -1,39 +1,45 @@
 #include "smmastmatcher.h"
 #include <assert.h>
+#include <string.h>
 
 static const char* NODES_DONT_MATCH = "Node kinds don't match";
 static const char* NODES_TYPES_DONT_MATCH = "Node's types don't match";
 static const char* NODES_REPRS_DONT_MATCH = "Nodes representations don't match";
 
-static void processStatement(CuTest* tc, PSmmAstNode exStmt, PSmmAstNode gotStmt);
-static void processBlock(CuTest* tc, PSmmAstBlockNode exBlock, PSmmAstBlockNode gotBlock);
+static PSmmAst exAst;
+static PSmmAst gotAst;
 
-static void assertNodeFlagsEqual(CuTest* tc, PSmmAstNode ex, PSmmAstNode got) {
-	CuAssertUIntEquals_Msg(tc, "Ident flag doesn't match", ex->isIdent, got->isIdent);
-	CuAssertUIntEquals_Msg(tc, "Const flag doesn't match", ex->isConst, got->isConst);
-	CuAssertUIntEquals_Msg(tc, "BinOp flag doesn't match", ex->isBinOp, got->isBinOp);
+static void processStatement(CuTest* tc, SmmAstNode exStmt, SmmAstNode gotStmt);
+static void processBlock(CuTest* tc, SmmAstNode exBlock, SmmAstNode gotBlock);
+
+static void assertNodeFlagsEqual(CuTest* tc, SmmAstNode ex, SmmAstNode got) {
+	uint8_t exFlags = exAst->flags[ex];
+	uint8_t gotFlags = gotAst->flags[got];
+	CuAssertUIntEquals_Msg(tc, "Ident flag doesn't match", exFlags & nfSmmIdent, gotFlags & nfSmmIdent);
+	CuAssertUIntEquals_Msg(tc, "Const flag doesn't match", exFlags & nfSmmConst, gotFlags & nfSmmConst);
+	CuAssertUIntEquals_Msg(tc, "BinOp flag doesn't match", exFlags & nfSmmBinOp, gotFlags & nfSmmBinOp);
+	CuAssertUIntEquals_Msg(tc, "EndsWithReturn flag doesn't match", exFlags & nfSmmEndsWithReturn, gotFlags & nfSmmEndsWithReturn);
 }
 
-static void assertNodesEqual(CuTest* tc, PSmmAstNode ex, PSmmAstNode got) {
-	CuAssertIntEquals_Msg(tc, NODES_DONT_MATCH, ex->kind, got->kind);
-	if (ex->type && got->type) {
-		CuAssertIntEquals_Msg(tc, NODES_TYPES_DONT_MATCH, ex->type->kind, got->type->kind);
-	} else {
-		CuAssertPtrEquals_Msg(tc, NODES_TYPES_DONT_MATCH, ex->type, got->type);
-	}
+static void assertNodesEqual(CuTest* tc, SmmAstNode ex, SmmAstNode got) {
+	CuAssertIntEquals_Msg(tc, NODES_DONT_MATCH, exAst->kinds[ex], gotAst->kinds[got]);
+	CuAssertIntEquals_Msg(tc, NODES_TYPES_DONT_MATCH, exAst->types[ex], gotAst->types[got]);
 	assertNodeFlagsEqual(tc, ex, got);
-	if (got->kind == nkSmmCast) return;
-	if (got->token && ex->token) {
-		CuAssertStrEquals_Msg(tc, NODES_REPRS_DONT_MATCH, ex->token->repr, got->token->repr);
+	if (gotAst->kinds[got] == nkSmmCast) return;
+	PSmmToken exToken = exAst->tokens[ex];
+	PSmmToken gotToken = gotAst->tokens[got];
+	if (gotToken && exToken) {
+		CuAssertIntEquals_Msg(tc, NODES_REPRS_DONT_MATCH, exToken->length, gotToken->length);
+		CuAssert(tc, NODES_REPRS_DONT_MATCH, strncmp(exToken->repr, gotToken->repr, exToken->length) == 0);
 	} else {
-		CuAssertPtrEquals_Msg(tc, "Token presence not matched", ex->token, got->token);
+		CuAssertPtrEquals_Msg(tc, "Token presence not matched", exToken, gotToken);
 	}
 }
 
-static void processExpression(CuTest* tc, PSmmAstNode exExpr, PSmmAstNode gotExpr) {
+static void processExpression(CuTest* tc, SmmAstNode exExpr, SmmAstNode gotExpr) {
 	assertNodesEqual(tc, exExpr, gotExpr);
 
-	switch (gotExpr->kind) {
+	switch (gotAst->kinds[gotExpr]) {
 	case nkSmmAdd: case nkSmmFAdd: case nkSmmSub: case nkSmmFSub:
 	case nkSmmMul: case nkSmmFMul: case nkSmmUDiv: case nkSmmSDiv: case nkSmmFDiv:
 	case nkSmmURem: case nkSmmSRem: case nkSmmFRem:
@@ -41,41 +47,37 @@ static void processExpression(CuTest* tc, PSmmAstNode exExpr, PSmmAstNode gotExp
 	case nkSmmXorOp:
 	case nkSmmEq: case nkSmmNotEq: case nkSmmGt: case nkSmmGtEq: case nkSmmLt: case nkSmmLtEq:
 		{
-			processExpression(tc, exExpr->left, gotExpr->left);
-			processExpression(tc, exExpr->left, gotExpr->left);
+			processExpression(tc, exAst->lefts[exExpr], gotAst->lefts[gotExpr]);
+			processExpression(tc, exAst->lefts[exExpr], gotAst->lefts[gotExpr]);
 			break;
 		}
 	case nkSmmNeg: case nkSmmNot: case nkSmmCast:
 		{
-			processExpression(tc, exExpr->left, gotExpr->left);
+			processExpression(tc, exAst->lefts[exExpr], gotAst->lefts[gotExpr]);
 			break;
 		}
 	case nkSmmCall:
 		{
-			PSmmAstCallNode exCallNode = (PSmmAstCallNode)exExpr;
-			PSmmAstCallNode gotCallNode = (PSmmAstCallNode)gotExpr;
-			PSmmAstNode exArg = exCallNode->args;
-			PSmmAstNode gotArg = gotCallNode->args;
-			while (gotArg) {
-				CuAssertPtrNotNullMsg(tc, "Got unexpected arg in call", exArg);
-				processExpression(tc, exArg, gotArg);
-				exArg = exArg->next;
-				gotArg = gotArg->next;
+			uint32_t argCount = gotAst->extras[gotAst->args[gotExpr]];
+			CuAssertUIntEquals_Msg(tc, "Call args don't match", exAst->extras[exAst->args[exExpr]], argCount);
+			SmmAstNode* exArgs = &exAst->extras[exAst->args[exExpr] + 1];
+			SmmAstNode* gotArgs = &gotAst->extras[gotAst->args[gotExpr] + 1];
+			for (uint32_t i = 0; i < argCount; i++) {
+				processExpression(tc, exArgs[i], gotArgs[i]);
 			}
-			CuAssertPtrEquals_Msg(tc, "Call args don't match", exArg, gotArg);
 			break;
 		}
 	case nkSmmParam: case nkSmmIdent: case nkSmmConst:
 		// No additional matching needed
 		break;
 	case nkSmmInt:
-		CuAssertUIntEquals_Msg(tc, "Int values does not match", exExpr->token->uintVal, gotExpr->token->uintVal);
+		CuAssertUIntEquals_Msg(tc, "Int values does not match", exAst->tokens[exExpr]->uintVal, gotAst->tokens[gotExpr]->uintVal);
 		break;
 	case nkSmmFloat:
-		CuAssertDblEquals_Msg(tc, "Float values does not match", exExpr->token->floatVal, gotExpr->token->floatVal, 0);
+		CuAssertDblEquals_Msg(tc, "Float values does not match", exAst->tokens[exExpr]->floatVal, gotAst->tokens[gotExpr]->floatVal, 0);
 		break;
 	case nkSmmBool:
-		CuAssertUIntEquals_Msg(tc, "Bool values does not match", exExpr->token->boolVal, gotExpr->token->boolVal);
+		CuAssertUIntEquals_Msg(tc, "Bool values does not match", exAst->tokens[exExpr]->boolVal, gotAst->tokens[gotExpr]->boolVal);
 		break;
 	default:
 		assert(false && "Got unexpected node type in processExpression");
@@ -83,54 +85,56 @@ static void processExpression(CuTest* tc, PSmmAstNode exExpr, PSmmAstNode gotExp
 	}
 }
 
-static void processLocalSymbols(CuTest* tc, PSmmAstDeclNode exDecl, PSmmAstDeclNode gotDecl) {
+static void processLocalSymbols(CuTest* tc, SmmAstNode exDecl, SmmAstNode gotDecl) {
 	while (gotDecl) {
-		CuAssertPtrNotNullMsg(tc, "Got more global declarations than expected", exDecl);
-		CuAssertIntEquals_Msg(tc, NODES_DONT_MATCH, exDecl->kind, gotDecl->kind);
-		CuAssertPtrEquals_Msg(tc, NODES_TYPES_DONT_MATCH, exDecl->left->left->type, gotDecl->left->left->type);
-		assertNodeFlagsEqual(tc, (PSmmAstNode)exDecl, (PSmmAstNode)gotDecl);
-
-		assertNodesEqual(tc, exDecl->left, gotDecl->left);
-		assertNodesEqual(tc, exDecl->left->left, gotDecl->left->left);
-		if (gotDecl->left->left->kind == nkSmmConst) {
-			processExpression(tc, exDecl->left->right, gotDecl->left->right);
+		CuAssert(tc, "Got more local declarations than expected", exDecl != 0);
+		CuAssertIntEquals_Msg(tc, NODES_DONT_MATCH, exAst->kinds[exDecl], gotAst->kinds[gotDecl]);
+		SmmAstNode exAssignment = exAst->lefts[exDecl];
+		SmmAstNode gotAssignment = gotAst->lefts[gotDecl];
+		CuAssertIntEquals_Msg(tc, NODES_TYPES_DONT_MATCH, exAst->types[exAst->lefts[exAssignment]], gotAst->types[gotAst->lefts[gotAssignment]]);
+		assertNodeFlagsEqual(tc, exDecl, gotDecl);
+
+		assertNodesEqual(tc, exAssignment, gotAssignment);
+		assertNodesEqual(tc, exAst->lefts[exAssignment], gotAst->lefts[gotAssignment]);
+		if (gotAst->kinds[gotAst->lefts[gotAssignment]] == nkSmmConst) {
+			processExpression(tc, exAst->rights[exAssignment], gotAst->rights[gotAssignment]);
 		}
-		exDecl = exDecl->nextDecl;
-		gotDecl = gotDecl->nextDecl;
+		exDecl = exAst->nextDecls[exDecl];
+		gotDecl = gotAst->nextDecls[gotDecl];
 	}
 }
 
-static void processAssignment(CuTest* tc, PSmmAstNode exStmt, PSmmAstNode gotStmt) {
-	assertNodesEqual(tc, exStmt->left, gotStmt->left);
-	processExpression(tc, exStmt->right, gotStmt->right);
+static void processAssignment(CuTest* tc, SmmAstNode exStmt, SmmAstNode gotStmt) {
+	assertNodesEqual(tc, exAst->lefts[exStmt], gotAst->lefts[gotStmt]);
+	processExpression(tc, exAst->rights[exStmt], gotAst->rights[gotStmt]);
 }
 
-static void processReturn(CuTest* tc, PSmmAstNode exStmt, PSmmAstNode gotStmt) {
-	if (gotStmt->left) {
-		CuAssertPtrNotNullMsg(tc, "Got unexpected return expression", exStmt);
-		processExpression(tc, exStmt->left, gotStmt->left);
+static void processReturn(CuTest* tc, SmmAstNode exStmt, SmmAstNode gotStmt) {
+	if (gotAst->lefts[gotStmt]) {
+		CuAssert(tc, "Got unexpected return expression", exAst->lefts[exStmt] != 0);
+		processExpression(tc, exAst->lefts[exStmt], gotAst->lefts[gotStmt]);
 	} else {
-		CuAssertPtrEquals_Msg(tc, "No expected return expression", exStmt->left, gotStmt->left);
+		CuAssertUIntEquals_Msg(tc, "No expected return expression", exAst->lefts[exStmt], gotAst->lefts[gotStmt]);
 	}
 }
 
-static void processStatement(CuTest* tc, PSmmAstNode exStmt, PSmmAstNode gotStmt) {
-	CuAssertPtrNotNullMsg(tc, "Got more statements than expected", exStmt);
+static void processStatement(CuTest* tc, SmmAstNode exStmt, SmmAstNode gotStmt) {
+	CuAssert(tc, "Got more statements than expected", exStmt != 0);
 	assertNodesEqual(tc, exStmt, gotStmt);
-	switch (gotStmt->kind) {
+	switch (gotAst->kinds[gotStmt]) {
 	case nkSmmBlock:
 		{
-			PSmmAstBlockNode newExBlock = (PSmmAstBlockNode)exStmt;
-			PSmmAstBlockNode newGotBlock = (PSmmAstBlockNode)gotStmt;
-			CuAssertIntEquals_Msg(tc, NODES_DONT_MATCH, newExBlock->scope->kind, newGotBlock->scope->kind);
-			processLocalSymbols(tc, newExBlock->scope->decls, newGotBlock->scope->decls);
-			processBlock(tc, newExBlock, newGotBlock);
+			SmmAstNode exScope = exAst->scopes[exStmt];
+			SmmAstNode gotScope = gotAst->scopes[gotStmt];
+			CuAssertIntEquals_Msg(tc, NODES_DONT_MATCH, exAst->kinds[exScope], gotAst->kinds[gotScope]);
+			processLocalSymbols(tc, exAst->decls[exScope], gotAst->decls[gotScope]);
+			processBlock(tc, exStmt, gotStmt);
 			break;
 		}
 	case nkSmmAssignment: processAssignment(tc, exStmt, gotStmt); break;
 	case nkSmmDecl:
-		assertNodesEqual(tc, exStmt->left, gotStmt->left);
-		processAssignment(tc, exStmt->left, gotStmt->left);
+		assertNodesEqual(tc, exAst->lefts[exStmt], gotAst->lefts[gotStmt]);
+		processAssignment(tc, exAst->lefts[exStmt], gotAst->lefts[gotStmt]);
 		break;
 	case nkSmmReturn: processReturn(tc, exStmt, gotStmt); break;
 	default:
@@ -138,68 +142,72 @@ static void processStatement(CuTest* tc, PSmmAstNode exStmt, PSmmAstNode gotStmt
 	}
 }
 
-static void processBlock(CuTest* tc, PSmmAstBlockNode exBlock, PSmmAstBlockNode gotBlock) {
-	PSmmAstNode exStmt = exBlock->stmts;
-	PSmmAstNode gotStmt = gotBlock->stmts;
-	while (gotStmt) {
-		processStatement(tc, exStmt, gotStmt);
-		exStmt = exStmt->next;
-		gotStmt = gotStmt->next;
+static void processBlock(CuTest* tc, SmmAstNode exBlock, SmmAstNode gotBlock) {
+	uint32_t stmtCount = gotAst->extras[gotAst->stmts[gotBlock]];
+	CuAssertUIntEquals_Msg(tc, "Statement counts don't match", exAst->extras[exAst->stmts[exBlock]], stmtCount);
+	SmmAstNode* exStmts = &exAst->extras[exAst->stmts[exBlock] + 1];
+	SmmAstNode* gotStmts = &gotAst->extras[gotAst->stmts[gotBlock] + 1];
+	for (uint32_t i = 0; i < stmtCount; i++) {
+		processStatement(tc, exStmts[i], gotStmts[i]);
 	}
 }
 
-static void processGlobalSymbols(CuTest* tc, PSmmAstDeclNode exDecl, PSmmAstDeclNode gotDecl) {
+static void processGlobalSymbols(CuTest* tc, SmmAstNode exDecl, SmmAstNode gotDecl) {
 	while (gotDecl) {
-		CuAssertPtrNotNullMsg(tc, "Got more global declarations than expected", exDecl);
-		CuAssertIntEquals_Msg(tc, NODES_DONT_MATCH, exDecl->kind, gotDecl->kind);
-
-		assertNodesEqual(tc, exDecl->left, gotDecl->left);
-		if (gotDecl->left->kind == nkSmmFunc) {
-			assertNodesEqual(tc, exDecl->left, gotDecl->left);
-			PSmmAstFuncDefNode exFuncNode = (PSmmAstFuncDefNode)exDecl->left;
-			PSmmAstFuncDefNode gotFuncNode = (PSmmAstFuncDefNode)gotDecl->left;
-			PSmmAstParamNode exParam = exFuncNode->params;
-			PSmmAstParamNode gotParam = gotFuncNode->params;
-			while (gotParam) {
-				CuAssertPtrNotNullMsg(tc, "Got more parameters than expected", exDecl);
-				assertNodesEqual(tc, (PSmmAstNode)exParam, (PSmmAstNode)gotParam);
-				exParam = exParam->next;
-				gotParam = gotParam->next;
-			}
-			CuAssertPtrEquals_Msg(tc, "Unexpected number of parameters", exParam, gotParam);
-			if (exFuncNode->params) {
-				CuAssertUIntEquals_Msg(tc, "Unexpected parameters count", exFuncNode->params->count, gotFuncNode->params->count);
+		CuAssert(tc, "Got more global declarations than expected", exDecl != 0);
+		CuAssertIntEquals_Msg(tc, NODES_DONT_MATCH, exAst->kinds[exDecl], gotAst->kinds[gotDecl]);
+
+		SmmAstNode exDeclared = exAst->lefts[exDecl];
+		SmmAstNode gotDeclared = gotAst->lefts[gotDecl];
+		assertNodesEqual(tc, exDeclared, gotDeclared);
+		if (gotAst->kinds[gotDeclared] == nkSmmFunc) {
+			uint32_t paramCount = gotAst->extras[gotAst->params[gotDeclared]];
+			CuAssertUIntEquals_Msg(tc, "Unexpected number of parameters", exAst->extras[exAst->params[exDeclared]], paramCount);
+			SmmAstNode* exParams = &exAst->extras[exAst->params[exDeclared] + 1];
+			SmmAstNode* gotParams = &gotAst->extras[gotAst->params[gotDeclared] + 1];
+			for (uint32_t i = 0; i < paramCount; i++) {
+				assertNodesEqual(tc, exParams[i], gotParams[i]);
 			}
-			if (gotFuncNode->body) {
-				CuAssertPtrNotNullMsg(tc, "Unexpected function body", exFuncNode->body);
-				CuAssertIntEquals_Msg(tc, NODES_DONT_MATCH, exFuncNode->body->kind, gotFuncNode->body->kind);
-				CuAssertIntEquals_Msg(tc, NODES_DONT_MATCH, exFuncNode->body->scope->kind, gotFuncNode->body->scope->kind);
-				processLocalSymbols(tc, exFuncNode->body->scope->decls, gotFuncNode->body->scope->decls);
-				processBlock(tc, exFuncNode->body, gotFuncNode->body);
+			SmmAstNode exBody = exAst->bodies[exDeclared];
+			SmmAstNode gotBody = gotAst->bodies[gotDeclared];
+			if (gotBody) {
+				CuAssert(tc, "Unexpected function body", exBody != 0);
+				CuAssertIntEquals_Msg(tc, NODES_DONT_MATCH, exAst->kinds[exBody], gotAst->kinds[gotBody]);
+				SmmAstNode exScope = exAst->scopes[exBody];
+				SmmAstNode gotScope = gotAst->scopes[gotBody];
+				CuAssertIntEquals_Msg(tc, NODES_DONT_MATCH, exAst->kinds[exScope], gotAst->kinds[gotScope]);
+				processLocalSymbols(tc, exAst->decls[exScope], gotAst->decls[gotScope]);
+				processBlock(tc, exBody, gotBody);
 			} else {
-				CuAssertPtrEquals_Msg(tc, "No expected function body", exFuncNode->body, gotFuncNode->body);
+				CuAssertUIntEquals_Msg(tc, "No expected function body", exBody, gotBody);
 			}
 		} else {
-			CuAssertPtrEquals_Msg(tc, NODES_TYPES_DONT_MATCH, exDecl->left->left->type, gotDecl->left->left->type);
-			assertNodesEqual(tc, exDecl->left->left, gotDecl->left->left);
-			CuAssertPtrNotNullMsg(tc, "Global decl must have initializer", gotDecl->left->right);
-			if (exDecl->left->left->isConst) {
-				processExpression(tc, exDecl->left->right, gotDecl->left->right);
+			SmmAstNode exVar = exAst->lefts[exDeclared];
+			SmmAstNode gotVar = gotAst->lefts[gotDeclared];
+			CuAssertIntEquals_Msg(tc, NODES_TYPES_DONT_MATCH, exAst->types[exVar], gotAst->types[gotVar]);
+			assertNodesEqual(tc, exVar, gotVar);
+			CuAssert(tc, "Global decl must have initializer", gotAst->rights[gotDeclared] != 0);
+			if (exAst->flags[exVar] & nfSmmConst) {
+				processExpression(tc, exAst->rights[exDeclared], gotAst->rights[gotDeclared]);
 			}
 		}
-		exDecl = exDecl->nextDecl;
-		gotDecl = gotDecl->nextDecl;
+		exDecl = exAst->nextDecls[exDecl];
+		gotDecl = gotAst->nextDecls[gotDecl];
 	}
 }
 
-void smmAssertASTEquals(CuTest* tc, PSmmAstNode ex, PSmmAstNode got) {
-	CuAssertIntEquals_Msg(tc, NODES_DONT_MATCH, ex->kind, got->kind);
-	CuAssertStrEquals_Msg(tc, "Module names don't match", ex->token->repr, got->token->repr);
-	PSmmAstBlockNode exBlock = (PSmmAstBlockNode)ex->next;
-	PSmmAstBlockNode gotBlock = (PSmmAstBlockNode)got->next;
-	CuAssertIntEquals_Msg(tc, NODES_DONT_MATCH, exBlock->kind, gotBlock->kind);
-	CuAssertIntEquals_Msg(tc, NODES_DONT_MATCH, exBlock->scope->kind, gotBlock->scope->kind);
-	processGlobalSymbols(tc, exBlock->scope->decls, gotBlock->scope->decls);
+void smmAssertASTEquals(CuTest* tc, PSmmAst ex, PSmmAst got) {
+	exAst = ex;
+	gotAst = got;
+	CuAssertIntEquals_Msg(tc, NODES_DONT_MATCH, ex->kinds[ex->program], got->kinds[got->program]);
+	CuAssertStrEquals_Msg(tc, "Module names don't match", ex->tokens[ex->program]->repr, got->tokens[got->program]->repr);
+	SmmAstNode exBlock = ex->nexts[ex->program];
+	SmmAstNode gotBlock = got->nexts[got->program];
+	CuAssertIntEquals_Msg(tc, NODES_DONT_MATCH, ex->kinds[exBlock], got->kinds[gotBlock]);
+	SmmAstNode exScope = ex->scopes[exBlock];
+	SmmAstNode gotScope = got->scopes[gotBlock];
+	CuAssertIntEquals_Msg(tc, NODES_DONT_MATCH, ex->kinds[exScope], got->kinds[gotScope]);
+	processGlobalSymbols(tc, ex->decls[exScope], got->decls[gotScope]);
 
 	processBlock(tc, exBlock, gotBlock);
 }
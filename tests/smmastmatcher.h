@@ -6,6 +6,6 @@
 #include "CuTest.h"
 #include <stdio.h>
 
-void smmAssertASTEquals(CuTest* tc, PSmmAstNode ex, PSmmAstNode got);
+void smmAssertASTEquals(CuTest* tc, PSmmAst ex, PSmmAst got);
 
 #endif
@@ -5,22 +5,47 @@
 #include <stdlib.h>
 #include <string.h>
 
-static void processStatement(PSmmAstNode* stmt, PSmmLexer lex, PIbsAllocator a);
-static void processBlock(PSmmAstBlockNode block, PSmmLexer lex, PIbsAllocator a);
+static void processStatement(SmmAstNode* stmt, PSmmLexer lex, PIbsAllocator a);
+static void processBlock(SmmAstNode block, PSmmLexer lex, PIbsAllocator a);
 
 static PSmmToken lastToken;
 static PIbsDict typeDict;
+static PSmmAst ast;
+// Stack of nodes read for lists that are not yet complete
+static SmmAstNode* children;
+static uint32_t childCount;
+static uint32_t childCapacity;
 
-static void readFlags(PSmmAstNode node, PSmmToken token) {
-	// We must do it this way instead of having a union with uint32 field
-	// because bit positions are compiler dependent
+static void pushChild(SmmAstNode node) {
+	if (childCount == childCapacity) {
+		childCapacity = childCapacity ? childCapacity * 2 : 256;
+		children = realloc(children, childCapacity * sizeof(SmmAstNode));
+	}
+	children[childCount++] = node;
+}
+
+static uint32_t popChildren(uint32_t firstChild) {
+	uint32_t count = childCount - firstChild;
+	childCount = firstChild;
+	return smmNewAstList(ast, &children[firstChild], count);
+}
+
+static void readFlags(SmmAstNode node, PSmmToken token) {
 	uint32_t flags = (uint32_t)token->uintVal;
-	node->isIdent = flags & 1;
-	node->isConst = (flags & 2) > 0;
-	node->isBinOp = (flags & 4) > 0;
+	if (ast->kinds[node] == nkSmmBlock) {
+		// Blocks only have endsWithReturn flag which is written as the first bit
+		ast->flags[node] = (flags & 1) ? nfSmmEndsWithReturn : 0;
+	} else {
+		ast->flags[node] = flags & (nfSmmBinOp | nfSmmConst | nfSmmIdent);
+	}
+}
+
+static uint8_t readType(PSmmToken token) {
+	PSmmTypeInfo type = ibsDictGet(typeDict, token->repr);
+	return type ? type->kind : tiSmmNone;
 }
 
-static void processExpression(PSmmAstNode* exprField, PSmmLexer lex, PIbsAllocator a) {
+static void processExpression(SmmAstNode* exprField, PSmmLexer lex, PIbsAllocator a) {
 	SmmAstNodeKind kind = 0;
 	PSmmToken exprToken = lastToken;
 	lastToken = smmGetNextToken(lex);
@@ -88,12 +113,17 @@ static void processExpression(PSmmAstNode* exprField, PSmmLexer lex, PIbsAllocat
 		assert(false && "Tried to parse unknown node kind");
 	}
 
-	PSmmAstNode expr = smmNewAstNode(kind, a);
-	expr->token = exprToken;
-	if (expr->kind == nkSmmUDiv || expr->kind == nkSmmSDiv) expr->token->repr = "div";
-	else if (expr->kind == nkSmmURem || expr->kind == nkSmmSRem) expr->token->repr = "mod";
+	SmmAstNode expr = smmNewAstNode(ast, kind);
+	ast->tokens[expr] = exprToken;
+	if (kind == nkSmmUDiv || kind == nkSmmSDiv) {
+		exprToken->repr = "div";
+		exprToken->length = 3;
+	} else if (kind == nkSmmURem || kind == nkSmmSRem) {
+		exprToken->repr = "mod";
+		exprToken->length = 3;
+	}
 	
-	switch (expr->kind) {
+	switch (kind) {
 	case nkSmmAdd: case nkSmmFAdd: case nkSmmSub: case nkSmmFSub:
 	case nkSmmMul: case nkSmmFMul: case nkSmmUDiv: case nkSmmSDiv: case nkSmmFDiv:
 	case nkSmmURem: case nkSmmSRem: case nkSmmFRem:
@@ -103,11 +133,11 @@ static void processExpression(PSmmAstNode* exprField, PSmmLexer lex, PIbsAllocat
 		{
 			readFlags(expr, smmGetNextToken(lex));
 			smmGetNextToken(lex); // skip ':'
-			expr->type = ibsDictGet(typeDict, smmGetNextToken(lex)->repr);
+			ast->types[expr] = readType(smmGetNextToken(lex));
 			lastToken = smmGetNextToken(lex);
-			processExpression(&expr->left, lex, a);
+			processExpression(&ast->lefts[expr], lex, a);
 			lastToken = smmGetNextToken(lex);
-			processExpression(&expr->right, lex, a);
+			processExpression(&ast->rights[expr], lex, a);
 			break;
 		}
 	case nkSmmNeg: case nkSmmNot: case nkSmmCast:
@@ -115,36 +145,41 @@ static void processExpression(PSmmAstNode* exprField, PSmmLexer lex, PIbsAllocat
 			readFlags(expr, smmGetNextToken(lex));
 			smmGetNextToken(lex); // skip ':'
 			PSmmToken typeToken = smmGetNextToken(lex);
-			expr->type = ibsDictGet(typeDict, typeToken->repr);
-			if (expr->kind == nkSmmNeg) expr->token->repr = "-";
-			else if (expr->kind == nkSmmCast) expr->token = typeToken;
+			ast->types[expr] = readType(typeToken);
+			if (kind == nkSmmNeg) {
+				exprToken->repr = "-";
+				exprToken->length = 1;
+			} else if (kind == nkSmmCast) {
+				ast->tokens[expr] = typeToken;
+			}
 			lastToken = smmGetNextToken(lex);
-			processExpression(&expr->left, lex, a);
+			processExpression(&ast->lefts[expr], lex, a);
 			break;
 		}
 	case nkSmmCall:
 		{
-			PSmmAstCallNode callNode = (PSmmAstCallNode)expr;
-			callNode->token = lastToken;
+			ast->tokens[expr] = lastToken;
 			smmGetNextToken(lex); // skip ':'
 			readFlags(expr, smmGetNextToken(lex));
 			smmGetNextToken(lex); // skip ':'
-			callNode->returnType = ibsDictGet(typeDict, smmGetNextToken(lex)->repr);
+			ast->types[expr] = readType(smmGetNextToken(lex));
 			smmGetNextToken(lex); // skip '('
 			lastToken = smmGetNextToken(lex);
-			PSmmAstNode arg = NULL;
+			uint32_t firstArg = childCount;
+			SmmAstNode arg = 0;
 			if (lastToken->kind != ')') {
 				processExpression(&arg, lex, a);
-				callNode->args = arg;
+				pushChild(arg);
 			}
 			lastToken = smmGetNextToken(lex);
 			while (lastToken->kind == ',') {
 				lastToken = smmGetNextToken(lex);
-				processExpression(&arg->next, lex, a);
+				processExpression(&arg, lex, a);
+				pushChild(arg);
 				lastToken = smmGetNextToken(lex);
-				arg = arg->next;
 			}
-			if (callNode->args) smmGetNextToken(lex); // Skip one more ')'
+			ast->args[expr] = popChildren(firstArg);
+			if (ast->args[expr]) smmGetNextToken(lex); // Skip one more ')'
 			break;
 		}
 	case nkSmmParam: case nkSmmIdent: case nkSmmConst:
@@ -152,12 +187,13 @@ static void processExpression(PSmmAstNode* exprField, PSmmLexer lex, PIbsAllocat
 		{
 			readFlags(expr, smmGetNextToken(lex));
 			smmGetNextToken(lex); // skip ':'
-			expr->token = smmGetNextToken(lex);
-			if (expr->kind == nkSmmFloat && expr->token->kind != tkSmmFloat) {
-				expr->token->floatVal = (double)expr->token->uintVal;
+			PSmmToken valToken = smmGetNextToken(lex);
+			ast->tokens[expr] = valToken;
+			if (kind == nkSmmFloat && valToken->kind != tkSmmFloat) {
+				valToken->floatVal = (double)valToken->uintVal;
 			}
 			smmGetNextToken(lex); // skip ':'
-			expr->type = ibsDictGet(typeDict, smmGetNextToken(lex)->repr);
+			ast->types[expr] = readType(smmGetNextToken(lex));
 			break;
 		}
 	default:
@@ -167,97 +203,108 @@ static void processExpression(PSmmAstNode* exprField, PSmmLexer lex, PIbsAllocat
 	*exprField = expr;
 }
 
-static void processLocalSymbols(PSmmAstScopeNode scope, PSmmLexer lex, PIbsAllocator a) {
-	PSmmAstDeclNode decl = NULL;
+static PSmmToken newAssignToken(PIbsAllocator a) {
+	PSmmToken token = ibsAlloc(a, sizeof(struct SmmToken));
+	token->kind = '=';
+	token->repr = "=";
+	token->length = 1;
+	return token;
+}
+
+static void processLocalSymbols(SmmAstNode scope, PSmmLexer lex, PIbsAllocator a) {
+	SmmAstNode decl = 0;
 	if (lastToken->kind == ':') {
-		decl = smmNewAstNode(nkSmmDecl, a);
-		scope->decls = decl;
+		decl = smmNewAstNode(ast, nkSmmDecl);
+		ast->decls[scope] = decl;
 	}
 	while (decl) {
-		decl->left = smmNewAstNode(nkSmmAssignment, a);
-		decl->left->left = smmNewAstNode(nkSmmIdent, a);
-		decl->left->left->token = smmGetNextToken(lex);
+		SmmAstNode assignment = smmNewAstNode(ast, nkSmmAssignment);
+		SmmAstNode var = smmNewAstNode(ast, nkSmmIdent);
+		ast->lefts[decl] = assignment;
+		ast->lefts[assignment] = var;
+		ast->tokens[var] = smmGetNextToken(lex);
 		smmGetNextToken(lex); // skip ':'
-		readFlags(decl->left->left, smmGetNextToken(lex));
+		readFlags(var, smmGetNextToken(lex));
 		smmGetNextToken(lex); // skip ':'
-		decl->left->type = ibsDictGet(typeDict, smmGetNextToken(lex)->repr);
-		decl->left->left->type = decl->left->type;
-		if (decl->left->left->isConst) {
-			decl->left->left->kind = nkSmmConst;
-			decl->left->token = smmGetNextToken(lex); // We assign '=' but change it
-			decl->left->token->repr = ":";
+		ast->types[assignment] = readType(smmGetNextToken(lex));
+		ast->types[var] = ast->types[assignment];
+		if (ast->flags[var] & nfSmmConst) {
+			ast->kinds[var] = nkSmmConst;
+			PSmmToken token = smmGetNextToken(lex); // We assign '=' but change it
+			token->repr = ":";
+			token->length = 1;
+			ast->tokens[assignment] = token;
 			lastToken = smmGetNextToken(lex);
-			processExpression(&decl->left->right, lex, a);
+			processExpression(&ast->rights[assignment], lex, a);
 		} else {
-			decl->left->token = ibsAlloc(a, sizeof(struct SmmToken));
-			decl->left->token->kind = '=';
-			decl->left->token->repr = "=";
+			ast->tokens[assignment] = newAssignToken(a);
 		}
 		lastToken = smmGetNextToken(lex);
 		if (lastToken->kind == ':') {
-			decl->nextDecl = smmNewAstNode(nkSmmDecl, a);
+			ast->nextDecls[decl] = smmNewAstNode(ast, nkSmmDecl);
 		}
 		
-		decl = decl->nextDecl;
+		decl = ast->nextDecls[decl];
 	}
 }
 
-static void processAssignment(PSmmAstNode stmt, PSmmLexer lex, PIbsAllocator a) {
-	stmt->kind = nkSmmAssignment;
-	stmt->token = lastToken;
-	stmt->left = smmNewAstNode(nkSmmIdent, a);
-	stmt->left->token = smmGetNextToken(lex);
+static void processAssignment(SmmAstNode stmt, PSmmLexer lex, PIbsAllocator a) {
+	ast->kinds[stmt] = nkSmmAssignment;
+	ast->tokens[stmt] = lastToken;
+	SmmAstNode lval = smmNewAstNode(ast, nkSmmIdent);
+	ast->lefts[stmt] = lval;
+	ast->tokens[lval] = smmGetNextToken(lex);
 	smmGetNextToken(lex); // skip ':'
-	readFlags(stmt->left, smmGetNextToken(lex));
+	readFlags(lval, smmGetNextToken(lex));
 	smmGetNextToken(lex); // skip ':'
-	if (stmt->left->isConst) stmt->left->kind = nkSmmConst;
-	stmt->left->type = ibsDictGet(typeDict, smmGetNextToken(lex)->repr);
-	stmt->type = stmt->left->type;
+	if (ast->flags[lval] & nfSmmConst) ast->kinds[lval] = nkSmmConst;
+	ast->types[lval] = readType(smmGetNextToken(lex));
+	ast->types[stmt] = ast->types[lval];
 	lastToken = smmGetNextToken(lex);
-	processExpression(&stmt->right, lex, a);
+	processExpression(&ast->rights[stmt], lex, a);
 	lastToken = smmGetNextToken(lex);
 }
 
-static void processReturn(PSmmAstNode stmt, PSmmLexer lex, PIbsAllocator a) {
-	stmt->kind = nkSmmReturn;
-	stmt->token = lastToken;
+static void processReturn(SmmAstNode stmt, PSmmLexer lex, PIbsAllocator a) {
+	ast->kinds[stmt] = nkSmmReturn;
+	ast->tokens[stmt] = lastToken;
 	lastToken = smmGetNextToken(lex);
 	if (lastToken->kind == ':') {
-		stmt->type = ibsDictGet(typeDict, smmGetNextToken(lex)->repr);
+		ast->types[stmt] = readType(smmGetNextToken(lex));
 		lastToken = smmGetNextToken(lex);
 		if (!lastToken->isFirstOnLine) {
-			processExpression(&stmt->left, lex, a);
+			processExpression(&ast->lefts[stmt], lex, a);
 			lastToken = smmGetNextToken(lex);
 		}
 	}
 }
 
-static void processStatement(PSmmAstNode* stmt, PSmmLexer lex, PIbsAllocator a) {
+static void processStatement(SmmAstNode* stmt, PSmmLexer lex, PIbsAllocator a) {
 	switch (lastToken->kind) {
 	case '{':
 		{
-			PSmmAstBlockNode newBlock = smmNewAstNode(nkSmmBlock, a);
-			*stmt = (PSmmAstNode)newBlock;
-			newBlock->scope = smmNewAstNode(nkSmmScope, a);
+			SmmAstNode newBlock = smmNewAstNode(ast, nkSmmBlock);
+			*stmt = newBlock;
+			ast->scopes[newBlock] = smmNewAstNode(ast, nkSmmScope);
 			lastToken = smmGetNextToken(lex);
-			processLocalSymbols(newBlock->scope, lex, a);
+			processLocalSymbols(ast->scopes[newBlock], lex, a);
 			processBlock(newBlock, lex, a);
 			lastToken = smmGetNextToken(lex);
 			break;
 		}
 	case '=':
-		*stmt = smmNewAstNode(nkSmmAssignment, a);
+		*stmt = smmNewAstNode(ast, nkSmmAssignment);
 		processAssignment(*stmt, lex, a);
 		break;
 	case ':':
-		*stmt = smmNewAstNode(nkSmmDecl, a);
-		(*stmt)->token = lastToken;
-		(*stmt)->left = smmNewAstNode(nkSmmAssignment, a);
+		*stmt = smmNewAstNode(ast, nkSmmDecl);
+		ast->tokens[*stmt] = lastToken;
+		ast->lefts[*stmt] = smmNewAstNode(ast, nkSmmAssignment);
 		lastToken = smmGetNextToken(lex);
-		processAssignment((*stmt)->left, lex, a);
+		processAssignment(ast->lefts[*stmt], lex, a);
 		break;
 	case tkSmmReturn:
-		*stmt = smmNewAstNode(nkSmmBlock, a);
+		*stmt = smmNewAstNode(ast, nkSmmReturn);
 		processReturn(*stmt, lex, a);
 		break;
 	default:
@@ -267,68 +314,65 @@ static void processStatement(PSmmAstNode* stmt, PSmmLexer lex, PIbsAllocator a)
 	}
 }
 
-static void processBlock(PSmmAstBlockNode block, PSmmLexer lex, PIbsAllocator a) {
-	PSmmAstNode* stmt = &block->stmts;
+static void processBlock(SmmAstNode block, PSmmLexer lex, PIbsAllocator a) {
+	uint32_t firstStmt = childCount;
 	assert(lastToken->kind == tkSmmIdent && lastToken->repr[0] == 'b');
 	smmGetNextToken(lex); // Skip ':'
-	readFlags((PSmmAstNode)block, smmGetNextToken(lex));
+	readFlags(block, smmGetNextToken(lex));
 	lastToken = smmGetNextToken(lex);
 	while (lastToken->kind != tkSmmEof && lastToken->kind != '}' &&
 			!(lastToken->kind == tkSmmIdent && strcmp(lastToken->repr, "ENDMODULE") == 0)) {
-		processStatement(stmt, lex, a);
-		stmt = &(*stmt)->next;
+		SmmAstNode stmt = 0;
+		processStatement(&stmt, lex, a);
+		pushChild(stmt);
 	}
+	ast->stmts[block] = popChildren(firstStmt);
 }
 
-static void processGlobalSymbols(PSmmAstScopeNode scope, PSmmLexer lex, PIbsAllocator a) {
-	PSmmAstDeclNode decl = NULL;
+static void processGlobalSymbols(SmmAstNode scope, PSmmLexer lex, PIbsAllocator a) {
+	SmmAstNode decl = 0;
 	if (lastToken->kind == ':') {
-		decl = smmNewAstNode(nkSmmDecl, a);
-		scope->decls = decl;
+		decl = smmNewAstNode(ast, nkSmmDecl);
+		ast->decls[scope] = decl;
 	}
 	while (decl) {
-		decl->left = smmNewAstNode(nkSmmAssignment, a);
-		decl->left->token = smmGetNextToken(lex);
+		SmmAstNode declared = smmNewAstNode(ast, nkSmmAssignment);
+		ast->lefts[decl] = declared;
+		ast->tokens[declared] = smmGetNextToken(lex);
 		smmGetNextToken(lex); // skip ':'
-		readFlags(decl->left, smmGetNextToken(lex));
+		readFlags(declared, smmGetNextToken(lex));
 		lastToken = smmGetNextToken(lex); // skip ':'
 		if (lastToken->kind == ':') {
-			decl->left->type = ibsDictGet(typeDict, smmGetNextToken(lex)->repr);
+			ast->types[declared] = readType(smmGetNextToken(lex));
 			lastToken = smmGetNextToken(lex);
 		}
 		if (lastToken->kind == '(') {
-			decl->left->kind = nkSmmFunc;
-			PSmmAstFuncDefNode funcNode = (PSmmAstFuncDefNode)decl->left;
+			ast->kinds[declared] = nkSmmFunc;
 
-			PSmmAstParamNode param = NULL;
-			uintptr_t paramCount = 0;
+			uint32_t firstParam = childCount;
 			lastToken = smmGetNextToken(lex);
-			if (lastToken->kind != ')') {
-				param = smmNewAstNode(nkSmmParam, a);
-				funcNode->params = param;
-			}
-			while (param) {
-				paramCount++;
-				param->token = lastToken;
+			bool hasNextParam = lastToken->kind != ')';
+			while (hasNextParam) {
+				SmmAstNode param = smmNewAstNode(ast, nkSmmParam);
+				ast->tokens[param] = lastToken;
 				smmGetNextToken(lex); // skip ':'
-				readFlags((PSmmAstNode)param, smmGetNextToken(lex));
+				readFlags(param, smmGetNextToken(lex));
 				smmGetNextToken(lex); // skip ':'
-				param->type = ibsDictGet(typeDict, smmGetNextToken(lex)->repr);
+				ast->types[param] = readType(smmGetNextToken(lex));
+				pushChild(param);
 				lastToken = smmGetNextToken(lex);
-				if (lastToken->kind == ',') {
-					param->next = smmNewAstNode(nkSmmParam, a);
-					lastToken = smmGetNextToken(lex);
-				}
-				param = param->next;
+				hasNextParam = lastToken->kind == ',';
+				if (hasNextParam) lastToken = smmGetNextToken(lex);
 			}
-			if (paramCount > 0) funcNode->params->count = paramCount;
+			ast->params[declared] = popChildren(firstParam);
 			lastToken = smmGetNextToken(lex);
 			if (lastToken->kind == '{') {
-				funcNode->body = smmNewAstNode(nkSmmBlock, a);
-				funcNode->body->scope = smmNewAstNode(nkSmmScope, a);
+				SmmAstNode body = smmNewAstNode(ast, nkSmmBlock);
+				ast->bodies[declared] = body;
+				ast->scopes[body] = smmNewAstNode(ast, nkSmmScope);
 				lastToken = smmGetNextToken(lex);
-				processLocalSymbols(funcNode->body->scope, lex, a);
-				processBlock(funcNode->body, lex, a);
+				processLocalSymbols(ast->scopes[body], lex, a);
+				processBlock(body, lex, a);
 				lastToken = smmGetNextToken(lex);
 			} else if (lastToken->kind == ';') {
 				lastToken = smmGetNextToken(lex);
@@ -336,28 +380,28 @@ static void processGlobalSymbols(PSmmAstScopeNode scope, PSmmLexer lex, PIbsAllo
 				assert(false && "Got function that is followed by unknown token");
 			}
 		} else {
-			PSmmAstNode newLeft = smmNewAstNode(nkSmmAssignment, a);
-			newLeft->left = decl->left;
-			decl->left = newLeft;
-			decl->left->type = decl->left->left->type;
+			// What we read is actually the var so we put it under a new assignment
+			SmmAstNode assignment = smmNewAstNode(ast, nkSmmAssignment);
+			ast->lefts[assignment] = declared;
+			ast->lefts[decl] = assignment;
+			ast->types[assignment] = ast->types[declared];
 			if (lastToken->repr[0] == '=') {
-				decl->left->left->kind = nkSmmConst;
-				decl->left->token = lastToken;
-				decl->left->token->repr = ":";
+				ast->kinds[declared] = nkSmmConst;
+				ast->tokens[assignment] = lastToken;
+				lastToken->repr = ":";
+				lastToken->length = 1;
 				lastToken = smmGetNextToken(lex);
-				processExpression(&decl->left->right, lex, a);
+				processExpression(&ast->rights[assignment], lex, a);
 				lastToken = smmGetNextToken(lex);
 			} else {
-				decl->left->left->kind = nkSmmIdent;
-				decl->left->token = ibsAlloc(a, sizeof(struct SmmToken));
-				decl->left->token->kind = '=';
-				decl->left->token->repr = "=";
+				ast->kinds[declared] = nkSmmIdent;
+				ast->tokens[assignment] = newAssignToken(a);
 			}
 		}
 		if (lastToken->kind == ':') {
-			decl->nextDecl = smmNewAstNode(nkSmmDecl, a);
+			ast->nextDecls[decl] = smmNewAstNode(ast, nkSmmDecl);
 		}
-		decl = decl->nextDecl;
+		decl = ast->nextDecls[decl];
 	}
 }
 
@@ -366,31 +410,34 @@ void initTypeDict() {
 
 	PIbsAllocator a = ibsSimpleAllocatorCreate("TYPEDICT", 4 * 1024);
 	typeDict = ibsDictCreate(a);
-	PSmmTypeInfo typeInfo = &builtInTypes[0];
-	typeInfo->name = "unknown"; // Instead of "/unknown/"
-	builtInTypes[tiSmmVoid].name = "void"; // Instead of "/void/"
-	do {
-		ibsDictPut(typeDict, typeInfo->name, typeInfo);
-		typeInfo++;
-	} while (typeInfo->kind != tiSmmSoftFloat64);
-	ibsDictPut(typeDict, "sfloat64", typeInfo);
+	PSmmTypeInfo typeInfo = &builtInTypes[tiSmmUnknown];
+	ibsDictPut(typeDict, "unknown", (void*)typeInfo); // Instead of "/unknown/"
+	ibsDictPut(typeDict, "void", (void*)&builtInTypes[tiSmmVoid]); // Instead of "/void/"
+	for (typeInfo += 2; typeInfo->kind != tiSmmSoftFloat64; typeInfo++) {
+		ibsDictPut(typeDict, typeInfo->name, (void*)typeInfo);
+	}
+	ibsDictPut(typeDict, "sfloat64", (void*)typeInfo);
 }
 
-PSmmAstNode smmLoadAst(PSmmLexer lex, PIbsAllocator a) {
+PSmmAst smmLoadAst(PSmmLexer lex, PIbsAllocator a) {
 	initTypeDict();
-	PSmmAstNode module = smmNewAstNode(nkSmmProgram, a);
-	module->token = smmGetNextToken(lex);
+	ast = smmCreateAst(a);
+	SmmAstNode module = smmNewAstNode(ast, nkSmmProgram);
+	ast->program = module;
+	ast->tokens[module] = smmGetNextToken(lex);
 
-	PSmmAstBlockNode globalBlock = smmNewAstNode(nkSmmBlock, a);
-	module->next = (PSmmAstNode)globalBlock;
-	globalBlock->scope = smmNewAstNode(nkSmmScope, a);
+	SmmAstNode globalBlock = smmNewAstNode(ast, nkSmmBlock);
+	ast->nexts[module] = globalBlock;
+	ast->scopes[globalBlock] = smmNewAstNode(ast, nkSmmScope);
 
 	lastToken = smmGetNextToken(lex);
-	processGlobalSymbols(globalBlock->scope, lex, a);
+	processGlobalSymbols(ast->scopes[globalBlock], lex, a);
 
 	processBlock(globalBlock, lex, a);
 
 	ibsDictGet(typeDict, "whatever"); // Just to reset internal lastKey var so it doesn't point to invalid memory
 
-	return module;
+	PSmmAst res = ast;
+	ast = NULL;
+	return res;
 }
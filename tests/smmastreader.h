@@ -6,6 +6,6 @@
 #include "../compiler/smmparser.h"
 #include <stdio.h>
 
-PSmmAstNode smmLoadAst(PSmmLexer lex, PIbsAllocator a);
+PSmmAst smmLoadAst(PSmmLexer lex, PIbsAllocator a);
 
 #endif
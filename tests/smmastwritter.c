@@ -5,17 +5,28 @@
 #include <stdlib.h>
 #include <string.h>
 
-static void processStatement(PSmmAstNode stmt, int level, FILE* f, PIbsAllocator a);
-static void processBlock(PSmmAstBlockNode block, int level, FILE* f, PIbsAllocator a);
+static void processStatement(PSmmAst ast, SmmAstNode stmt, int level, FILE* f, PIbsAllocator a);
+static void processBlock(PSmmAst ast, SmmAstNode block, int level, FILE* f, PIbsAllocator a);
 
-static uint32_t getFlags(PSmmAstNode node) {
-	// We must do it this way instead of having a union with uint32 field
-	// because bit positions are compiler dependent
-	return (node->isBinOp << 2) | (node->isConst << 1) | node->isIdent;
+static uint32_t getFlags(PSmmAst ast, SmmAstNode node) {
+	// Blocks only have endsWithReturn flag which is written as the first bit
+	if (ast->kinds[node] == nkSmmBlock) return (ast->flags[node] & nfSmmEndsWithReturn) != 0;
+	return ast->flags[node] & (nfSmmBinOp | nfSmmConst | nfSmmIdent);
 }
 
-static void processExpression(PSmmAstNode expr, FILE* f, PIbsAllocator a) {
-	switch (expr->kind) {
+static const char* typeName(PSmmAst ast, SmmAstNode node) {
+	// This is how we want these written instead of "/sfloat64/", "/unknown/" and "/void/"
+	switch (ast->types[node]) {
+	case tiSmmSoftFloat64: return "sfloat64";
+	case tiSmmUnknown: return "unknown";
+	case tiSmmVoid: return "void";
+	default: return builtInTypes[ast->types[node]].name;
+	}
+}
+
+static void processExpression(PSmmAst ast, SmmAstNode expr, FILE* f, PIbsAllocator a) {
+	PSmmToken token = ast->tokens[expr];
+	switch (ast->kinds[expr]) {
 	case nkSmmAdd: case nkSmmFAdd: case nkSmmSub: case nkSmmFSub:
 	case nkSmmMul: case nkSmmFMul: case nkSmmUDiv: case nkSmmSDiv: case nkSmmFDiv:
 	case nkSmmURem: case nkSmmSRem: case nkSmmFRem:
@@ -23,50 +34,46 @@ static void processExpression(PSmmAstNode expr, FILE* f, PIbsAllocator a) {
 	case nkSmmXorOp:
 	case nkSmmEq: case nkSmmNotEq: case nkSmmGt: case nkSmmGtEq: case nkSmmLt: case nkSmmLtEq:
 		{
-			fprintf(f, "%s:%u:%s ", nodeKindToString[expr->kind], getFlags(expr), expr->type->name);
+			fprintf(f, "%s:%u:%s ", nodeKindToString[ast->kinds[expr]], getFlags(ast, expr), typeName(ast, expr));
 
-			processExpression(expr->left, f, a);
-			processExpression(expr->right, f, a);
+			processExpression(ast, ast->lefts[expr], f, a);
+			processExpression(ast, ast->rights[expr], f, a);
 			break;
 		}
 	case nkSmmNeg:
 		{
-			fprintf(f, "neg:%u:%s ", getFlags(expr), expr->type->name);
-			processExpression(expr->left, f, a);
+			fprintf(f, "neg:%u:%s ", getFlags(ast, expr), typeName(ast, expr));
+			processExpression(ast, ast->lefts[expr], f, a);
 			break;
 		}
 	case nkSmmNot:
 		{
-			fprintf(f, "%s:%u:%s ", expr->token->repr, getFlags(expr), expr->type->name);
-			processExpression(expr->left, f, a);
+			fprintf(f, "%s:%u:%s ", token->repr, getFlags(ast, expr), typeName(ast, expr));
+			processExpression(ast, ast->lefts[expr], f, a);
 			break;
 		}
 	case nkSmmCast:
 		{
-			fprintf(f, "%s:%u:%s ", nodeKindToString[expr->kind], getFlags(expr), expr->type->name);
-			processExpression(expr->left, f, a);
+			fprintf(f, "%s:%u:%s ", nodeKindToString[ast->kinds[expr]], getFlags(ast, expr), typeName(ast, expr));
+			processExpression(ast, ast->lefts[expr], f, a);
 			break;
 		}
 	case nkSmmCall:
 		{
-			PSmmAstCallNode callNode = (PSmmAstCallNode)expr;
-			fprintf(f, "(%s:%u:%s(", callNode->token->repr, getFlags(expr), callNode->returnType->name);
-			if (callNode->args) {
-				PSmmAstNode astArg = callNode->args;
-				processExpression(astArg, f, a);
-				astArg = astArg->next;
-				while (astArg) {
-					fputs(", ", f);
-					processExpression(astArg, f, a);
-					astArg = astArg->next;
-				}
+			fprintf(f, "(%s:%u:%s(", token->repr, getFlags(ast, expr), typeName(ast, expr));
+			uint32_t argCount = ast->extras[ast->args[expr]];
+			SmmAstNode* astArgs = &ast->extras[ast->args[expr] + 1];
+			for (uint32_t i = 0; i < argCount; i++) {
+				if (i > 0) fputs(", ", f);
+				processExpression(ast, astArgs[i], f, a);
 			}
 			fputs(")) ", f);
 			break;
 		}
 	case nkSmmInt: case nkSmmFloat:
 	case nkSmmParam: case nkSmmIdent: case nkSmmConst: case nkSmmBool:
-		fprintf(f, "%s:%u:%s:%s ", nodeKindToString[expr->kind], getFlags(expr), expr->token->repr, expr->type->name);
+		fprintf(f, "%s:%u:%.*s:%s ", nodeKindToString[ast->kinds[expr]], getFlags(ast, expr),
+			(int)token->length, token->repr, typeName(ast, expr));
 		break;
 	default:
 		assert(false && "Got unexpected node type in processExpression");
@@ -74,132 +81,131 @@ static void processExpression(PSmmAstNode expr, FILE* f, PIbsAllocator a) {
 	}
 }
 
-static void processLocalSymbols(PSmmAstDeclNode decl, int level, FILE* f, PIbsAllocator a) {
+static void processLocalSymbols(PSmmAst ast, SmmAstNode decl, int level, FILE* f, PIbsAllocator a) {
 	while (decl) {
+		SmmAstNode assignment = ast->lefts[decl];
+		SmmAstNode var = ast->lefts[assignment];
 		if (level) fprintf(f, "%*s", level, " ");
 		fputs(": ", f);
-		if (decl->left->left->kind == nkSmmIdent) {
-			fprintf(f, "%s:%u:%s", decl->left->left->token->repr, getFlags(decl->left->left), decl->left->left->type->name);
-		} else if (decl->left->left->kind == nkSmmConst) {
-			fprintf(f, "%s:%u:%s = ", decl->left->left->token->repr, getFlags(decl->left->left), decl->left->left->type->name);
-			processExpression(decl->left->right, f, a);
+		if (ast->kinds[var] == nkSmmIdent) {
+			fprintf(f, "%s:%u:%s", ast->tokens[var]->repr, getFlags(ast, var), typeName(ast, var));
+		} else if (ast->kinds[var] == nkSmmConst) {
+			fprintf(f, "%s:%u:%s = ", ast->tokens[var]->repr, getFlags(ast, var), typeName(ast, var));
+			processExpression(ast, ast->rights[assignment], f, a);
 		} else {
 			assert(false && "Declaration of unknown node kind");
 		}
 		fputs("\n", f);
-		decl = decl->nextDecl;
+		decl = ast->nextDecls[decl];
 	}
 }
 
-static void processAssignment(PSmmAstNode stmt, FILE* f, PIbsAllocator a) {
-	fprintf(f, "= %s:%u:%s  ", stmt->left->token->repr, getFlags(stmt->left), stmt->left->type->name);
-	processExpression(stmt->right, f, a);
+static void processAssignment(PSmmAst ast, SmmAstNode stmt, FILE* f, PIbsAllocator a) {
+	SmmAstNode lval = ast->lefts[stmt];
+	fprintf(f, "= %s:%u:%s  ", ast->tokens[lval]->repr, getFlags(ast, lval), typeName(ast, lval));
+	processExpression(ast, ast->rights[stmt], f, a);
 	fputs("\n", f);
 }
 
-static void processReturn(PSmmAstNode stmt, FILE* f, PIbsAllocator a) {
-	if (stmt->type) {
-		fprintf(f, "%s:%s ", nodeKindToString[stmt->kind], stmt->type->name);
+static void processReturn(PSmmAst ast, SmmAstNode stmt, FILE* f, PIbsAllocator a) {
+	if (ast->types[stmt] != tiSmmNone) {
+		fprintf(f, "%s:%s ", nodeKindToString[ast->kinds[stmt]], typeName(ast, stmt));
 	} else {
-		fputs(nodeKindToString[stmt->kind], f);
+		fputs(nodeKindToString[ast->kinds[stmt]], f);
 	}
-	if (stmt->left) {
-		processExpression(stmt->left, f, a);
+	if (ast->lefts[stmt]) {
+		processExpression(ast, ast->lefts[stmt], f, a);
 	}
 	fputs("\n", f);
 }
 
-static void processStatement(PSmmAstNode stmt, int level, FILE* f, PIbsAllocator a) {
+static void processStatement(PSmmAst ast, SmmAstNode stmt, int level, FILE* f, PIbsAllocator a) {
 	if (level) fprintf(f, "%*s", level, " ");
-	switch (stmt->kind) {
+	switch (ast->kinds[stmt]) {
 	case nkSmmBlock:
-		{
-			PSmmAstBlockNode newBlock = (PSmmAstBlockNode)stmt;
-			fputs("{\n", f);
-			processLocalSymbols(newBlock->scope->decls, level + 4, f, a);
-			processBlock(newBlock, level + 4, f, a);
-			fputs("}\n", f);
-			break;
-		}
-	case nkSmmAssignment: processAssignment(stmt, f, a); break;
-	case nkSmmReturn: processReturn(stmt, f, a); break;
+		fputs("{\n", f);
+		processLocalSymbols(ast, ast->decls[ast->scopes[stmt]], level + 4, f, a);
+		processBlock(ast, stmt, level + 4, f, a);
+		fputs("}\n", f);
+		break;
+	case nkSmmAssignment: processAssignment(ast, stmt, f, a); break;
+	case nkSmmReturn: processReturn(ast, stmt, f, a); break;
 	case nkSmmDecl:
 		{
-			assert(!stmt->left->left->isConst);
-			assert(stmt->left->kind == nkSmmAssignment);
+			SmmAstNode assignment = ast->lefts[stmt];
+			assert(!(ast->flags[ast->lefts[assignment]] & nfSmmConst));
+			assert(ast->kinds[assignment] == nkSmmAssignment);
 			fputs(": ", f);
-			processAssignment(stmt->left, f, a);
+			processAssignment(ast, assignment, f, a);
 			break;
 		}
 	default:
-		processExpression(stmt, f, a);
+		processExpression(ast, stmt, f, a);
 		fputs("\n", f);
 		break;
 	}
 }
 
-static void processBlock(PSmmAstBlockNode block, int level, FILE* f, PIbsAllocator a) {
-	PSmmAstNode stmt = block->stmts;
+static void processBlock(PSmmAst ast, SmmAstNode block, int level, FILE* f, PIbsAllocator a) {
+	uint32_t stmtCount = ast->extras[ast->stmts[block]];
+	SmmAstNode* stmts = &ast->extras[ast->stmts[block] + 1];
 	if (level) fprintf(f, "%*s", level, " ");
-	fprintf(f, "blockFlags:%u\n", getFlags((PSmmAstNode)block));
-	while (stmt) {
-		processStatement(stmt, level, f, a);
-		stmt = stmt->next;
+	fprintf(f, "blockFlags:%u\n", getFlags(ast, block));
+	for (uint32_t i = 0; i < stmtCount; i++) {
+		processStatement(ast, stmts[i], level, f, a);
 	}
 }
 
-static void processGlobalSymbols(PSmmAstDeclNode decl, FILE* f, PIbsAllocator a) {
+static void processGlobalSymbols(PSmmAst ast, SmmAstNode decl, FILE* f, PIbsAllocator a) {
 	while (decl) {
+		SmmAstNode declared = ast->lefts[decl];
 		fputs(": ", f);
-		if (decl->left->kind == nkSmmFunc) {
-			PSmmAstFuncDefNode funcNode = (PSmmAstFuncDefNode)decl->left;
-			if (funcNode->returnType) {
-				fprintf(f, "%s:%u:%s(", funcNode->token->repr, getFlags(decl->left), funcNode->returnType->name);
+		if (ast->kinds[declared] == nkSmmFunc) {
+			const char* funcName = ast->tokens[declared]->repr;
+			if (ast->types[declared] != tiSmmNone) {
+				fprintf(f, "%s:%u:%s(", funcName, getFlags(ast, declared), typeName(ast, declared));
 			} else {
-				fprintf(f, "%s:%u(", funcNode->token->repr, getFlags(decl->left));
+				fprintf(f, "%s:%u(", funcName, getFlags(ast, declared));
 			}
 
-			PSmmAstParamNode param = funcNode->params;
-			if (param) {
-				fprintf(f, "%s:%u:%s", param->token->repr, getFlags((PSmmAstNode)param), param->type->name);
-				param = param->next;
-				while (param) {
-					fprintf(f, ", %s:%u:%s", param->token->repr, getFlags((PSmmAstNode)param), param->type->name);
-					param = param->next;
-				}
+			uint32_t paramCount = ast->extras[ast->params[declared]];
+			SmmAstNode* params = &ast->extras[ast->params[declared] + 1];
+			for (uint32_t i = 0; i < paramCount; i++) {
+				if (i > 0) fputs(", ", f);
+				SmmAstNode param = params[i];
+				fprintf(f, "%s:%u:%s", ast->tokens[param]->repr, getFlags(ast, param), typeName(ast, param));
 			}
 			fputs(")", f);
-			if (funcNode->body) {
+			SmmAstNode body = ast->bodies[declared];
+			if (body) {
 				fputs("\n{\n", f);
-				processLocalSymbols(funcNode->body->scope->decls, 4, f, a);
-				processBlock(funcNode->body, 4, f, a);
+				processLocalSymbols(ast, ast->decls[ast->scopes[body]], 4, f, a);
+				processBlock(ast, body, 4, f, a);
 				fputs("}\n", f);
 			} else {
 				fputs(";\n", f);
 			}
 		} else {
-			assert(decl->left->right && "Global var must have initializer");
-			fprintf(f, "%s:%u:%s ", decl->left->left->token->repr, getFlags(decl->left->left), decl->left->left->type->name);
-			if (decl->left->left->kind == nkSmmConst) {
+			SmmAstNode var = ast->lefts[declared];
+			assert(ast->rights[declared] && "Global var must have initializer");
+			fprintf(f, "%s:%u:%s ", ast->tokens[var]->repr, getFlags(ast, var), typeName(ast, var));
+			if (ast->kinds[var] == nkSmmConst) {
 				fputs("= ", f);
-				processExpression(decl->left->right, f, a);
+				processExpression(ast, ast->rights[declared], f, a);
 			}
 			fputs("\n", f);
 		}
-		decl = decl->nextDecl;
+		decl = ast->nextDecls[decl];
 	}
 }
 
-void smmOutputAst(PSmmAstNode module, FILE* f, PIbsAllocator a) {
-	builtInTypes[tiSmmSoftFloat64].name = "sfloat64"; // This is how we want it written instead of "/sfloat64/"
-	builtInTypes[tiSmmUnknown].name = "unknown"; // This is how we want it written instead of "/unknown/"
-	builtInTypes[tiSmmVoid].name = "void"; // This is how we want it written instead of "/void/"
-	const char* moduleName = module->token->repr;
+void smmOutputAst(PSmmAst ast, FILE* f, PIbsAllocator a) {
+	const char* moduleName = ast->tokens[ast->program]->repr;
 	fprintf(f, "MODULE %s\n", moduleName);
 
-	PSmmAstBlockNode globalBlock = (PSmmAstBlockNode)module->next;
-	assert(globalBlock->kind == nkSmmBlock);
-	processGlobalSymbols(globalBlock->scope->decls, f, a);
+	SmmAstNode globalBlock = ast->nexts[ast->program];
+	assert(ast->kinds[globalBlock] == nkSmmBlock);
+	processGlobalSymbols(ast, ast->decls[ast->scopes[globalBlock]], f, a);
 
-	processBlock(globalBlock, 0, f, a);
+	processBlock(ast, globalBlock, 0, f, a);
 }
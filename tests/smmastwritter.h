@@ -6,6 +6,6 @@
 #include "../compiler/smmparser.h"
 #include <stdio.h>
 
-void smmOutputAst(PSmmAstNode module, FILE* f, PIbsAllocator a);
+void smmOutputAst(PSmmAst ast, FILE* f, PIbsAllocator a);
 
 #endif
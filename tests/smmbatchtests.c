@@ -0,0 +1,97 @@
+#include "../compiler/ibscommon.h"
+#include "CuTest.h"
+#include "../compiler/smmbatch.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define MAX_DIR_SIZE 256
+
+static void TestBatchOutFiles(CuTest *tc) {
+	PIbsAllocator a = ibsChunkedAllocatorCreate("batchTest", 64 * 1024);
+	const char* inFiles[] = { "a/x.smm", "b\\y.smm", "b/x.smm", "z" };
+
+	// Without outDir output is next to the input so same names in different directories are fine
+	PSmmBatchFile files = smmCreateBatch(inFiles, 4, NULL, a);
+	CuAssertStrEquals(tc, "a/x.ll", files[0].outFile);
+	CuAssertStrEquals(tc, "b\\y.ll", files[1].outFile);
+	CuAssertStrEquals(tc, "z.ll", files[3].outFile);
+	uint32_t first, second;
+	CuAssertTrue(tc, !smmFindSameOutFiles(files, 4, &first, &second, a));
+
+	files = smmCreateBatch(inFiles, 4, "out", a);
+	CuAssertStrEquals(tc, "out/x.ll", files[0].outFile);
+	CuAssertStrEquals(tc, "out/y.ll", files[1].outFile);
+	CuAssertTrue(tc, smmFindSameOutFiles(files, 4, &first, &second, a));
+	CuAssertIntEquals(tc, 0, first);
+	CuAssertIntEquals(tc, 2, second);
+	CuAssertTrue(tc, !smmFindSameOutFiles(files, 2, &first, &second, a));
+	ibsSimpleAllocatorFree(a);
+}
+
+static void TestCompileBatch(CuTest *tc) {
+	PIbsAllocator a = ibsChunkedAllocatorCreate("batchTest", 64 * 1024);
+	// Each run writes to its own directory, named by process ID, so runs don't mix outputs
+	char outDir[MAX_DIR_SIZE];
+#ifdef _WIN32
+	snprintf(outDir, MAX_DIR_SIZE, "summusTestBatch%u", (uint32_t)_getpid());
+	CuAssertIntEquals(tc, 0, _mkdir(outDir));
+#else
+	snprintf(outDir, MAX_DIR_SIZE, "/tmp/summusTestBatch%u", (uint32_t)getpid());
+	CuAssertIntEquals(tc, 0, mkdir(outDir, 0777));
+#endif
+
+	const char* inFiles[] = { "test.smm", "samples/sample0010.smm", "missing.smm" };
+	PSmmBatchFile files = smmCreateBatch(inFiles, 3, outDir, a);
+	struct SmmCompileOptions options = { 0 };
+	smmCompileBatch(files, 3, &options, NULL, 2);
+
+	// Output of a good file must be the same as when it is compiled on its own
+	CuAssertTrue(tc, !files[0].failed);
+	PIbsFile src = ibsFileOpen("test.smm", a);
+	CuAssertPtrNotNull(tc, src);
+	options.moduleName = "test.smm";
+	struct SmmCacheEntry expected;
+	smmCompileFile(&options, NULL, src, &expected, a);
+	ibsFileClose(src);
+	CuAssertStrEquals(tc, expected.msgs, files[0].msgs);
+	PIbsFile out = ibsFileOpen(files[0].outFile, a);
+	CuAssertPtrNotNull(tc, out);
+	CuAssertStrEquals(tc, expected.ir, out->data);
+	ibsFileClose(out);
+
+	// File with errors has messages and no output
+	CuAssertTrue(tc, files[1].failed);
+	CuAssertPtrEquals(tc, NULL, (void*)files[1].error);
+	CuAssertPtrNotNull(tc, strstr(files[1].msgs, "samples/sample0010.smm"));
+	CuAssertPtrEquals(tc, NULL, ibsFileOpen(files[1].outFile, a));
+
+	CuAssertTrue(tc, files[2].failed);
+	CuAssertPtrNotNull(tc, files[2].error);
+
+	smmFreeBatch(files, 3);
+	remove(files[0].outFile);
+#ifdef _WIN32
+	_rmdir(outDir);
+#else
+	rmdir(outDir);
+#endif
+	ibsSimpleAllocatorFree(a);
+}
+
+CuSuite* SmmBatchGetSuite() {
+	CuSuite* suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, TestBatchOutFiles);
+	SUITE_ADD_TEST(suite, TestCompileBatch);
+
+	return suite;
+}
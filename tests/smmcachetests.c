@@ -0,0 +1,323 @@
+#include "../compiler/ibscommon.h"
+#include "CuTest.h"
+#include "../compiler/smmcache.h"
+#include "../compiler/smmcompiler.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#include <sys/types.h>
+#include <sys/utime.h>
+#else
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+#define MAX_DIR_SIZE 256
+
+/**
+ * Each run uses its own cache directory, named by process ID, so tests
+ * running at the same time don't share entries or stats.
+ */
+static void getCacheDir(char* dir) {
+#ifdef _WIN32
+	snprintf(dir, MAX_DIR_SIZE, "summusTestCache%u", (uint32_t)_getpid());
+#else
+	snprintf(dir, MAX_DIR_SIZE, "/tmp/summusTestCache%u", (uint32_t)getpid());
+#endif
+}
+
+static void removeCacheDir(const char* dir) {
+	char path[MAX_DIR_SIZE * 2];
+#ifdef _WIN32
+	snprintf(path, sizeof(path), "%s/*", dir);
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileA(path, &data);
+	if (find != INVALID_HANDLE_VALUE) {
+		do {
+			if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+			snprintf(path, sizeof(path), "%s/%s", dir, data.cFileName);
+			remove(path);
+		} while (FindNextFileA(find, &data));
+		FindClose(find);
+	}
+	_rmdir(dir);
+#else
+	DIR* d = opendir(dir);
+	if (d) {
+		struct dirent* entry;
+		while ((entry = readdir(d)) != NULL) {
+			if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+			snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+			remove(path);
+		}
+		closedir(d);
+	}
+	rmdir(dir);
+#endif
+}
+
+static void getEntryPath(const char* dir, PSmmCacheKey key, char* path) {
+	int length = sprintf(path, "%s/", dir);
+	for (int i = 0; i < IBS_SHA256_SIZE; i++) {
+		length += sprintf(path + length, "%02x", key->hash[i]);
+	}
+	strcpy(path + length, ".smmc");
+}
+
+static bool fileExists(const char* path) {
+	FILE* f = fopen(path, "rb");
+	if (f) fclose(f);
+	return f != NULL;
+}
+
+static void createFile(const char* path, time_t modifiedTime) {
+	FILE* f = fopen(path, "wb");
+	if (!f) return;
+	fputs("partial", f);
+	fclose(f);
+#ifdef _WIN32
+	struct _utimbuf times = { modifiedTime, modifiedTime };
+	_utime(path, &times);
+#else
+	struct utimbuf times = { modifiedTime, modifiedTime };
+	utime(path, &times);
+#endif
+}
+
+static void TestCachePutGet(CuTest *tc) {
+	PIbsAllocator a = ibsChunkedAllocatorCreate("cacheTest", 64 * 1024);
+	char dir[MAX_DIR_SIZE];
+	getCacheDir(dir);
+	PSmmCache cache = smmCacheOpen(dir, 64 * 1024 * 1024);
+	CuAssertPtrNotNull(tc, cache);
+
+	const char* src = "a := 0;\n";
+	struct SmmCompileOptions options = { "test.smm" };
+	struct SmmCacheKey key = smmCacheGetKey(cache, &options, src, strlen(src));
+	struct SmmCacheEntry entry;
+	CuAssertTrue(tc, !smmCacheGet(cache, &key, &entry, a));
+
+	struct SmmCacheEntry stored = { "warning: some warning\n", "; ModuleID = 'test.smm'\n", 0 };
+	smmCachePut(cache, &key, &stored);
+	CuAssertTrue(tc, smmCacheGet(cache, &key, &entry, a));
+	CuAssertStrEquals(tc, stored.msgs, entry.msgs);
+	CuAssertStrEquals(tc, stored.ir, entry.ir);
+	CuAssertIntEquals(tc, 0, entry.errorCount);
+
+	// Options that don't change the output must give the same entry
+	options.useLexerThread = true;
+	struct SmmCacheKey otherKey = smmCacheGetKey(cache, &options, src, strlen(src));
+	CuAssertTrue(tc, memcmp(&key, &otherKey, sizeof(key)) == 0);
+
+	// Same source with different module name or mode must not give the same entry
+	options.moduleName = "other.smm";
+	otherKey = smmCacheGetKey(cache, &options, src, strlen(src));
+	CuAssertTrue(tc, !smmCacheGet(cache, &otherKey, &entry, a));
+	options.moduleName = "test.smm";
+	options.lazyFuncBodies = true;
+	otherKey = smmCacheGetKey(cache, &options, src, strlen(src));
+	CuAssertTrue(tc, !smmCacheGet(cache, &otherKey, &entry, a));
+
+	// Results with errors have no IR
+	stored.ir = NULL;
+	stored.errorCount = 2;
+	smmCachePut(cache, &otherKey, &stored);
+	CuAssertTrue(tc, smmCacheGet(cache, &otherKey, &entry, a));
+	CuAssertStrEquals(tc, stored.msgs, entry.msgs);
+	CuAssertPtrEquals(tc, NULL, (void*)entry.ir);
+	CuAssertIntEquals(tc, 2, entry.errorCount);
+
+	struct SmmCacheStats stats = smmCacheGetStats(cache);
+	CuAssertTrue(tc, stats.hits == 2);
+	CuAssertTrue(tc, stats.misses == 3);
+	CuAssertTrue(tc, stats.stores == 2);
+	smmCacheClose(cache);
+
+	// Stats must be kept in the cache directory
+	cache = smmCacheOpen(dir, 64 * 1024 * 1024);
+	CuAssertPtrNotNull(tc, cache);
+	struct SmmCacheStats reopened = smmCacheGetStats(cache);
+	CuAssertTrue(tc, reopened.hits == stats.hits);
+	CuAssertTrue(tc, reopened.stores == stats.stores);
+	CuAssertTrue(tc, reopened.size == stats.size);
+	CuAssertTrue(tc, smmCacheGet(cache, &key, &entry, a));
+	smmCacheClose(cache);
+	removeCacheDir(dir);
+	ibsSimpleAllocatorFree(a);
+}
+
+static void TestCacheEviction(CuTest *tc) {
+	PIbsAllocator a = ibsChunkedAllocatorCreate("cacheTest", 64 * 1024);
+	uint64_t maxSize = 16 * 1024;
+	char dir[MAX_DIR_SIZE];
+	getCacheDir(dir);
+	PSmmCache cache = smmCacheOpen(dir, maxSize);
+	CuAssertPtrNotNull(tc, cache);
+
+	char ir[1024];
+	memset(ir, 'x', sizeof(ir) - 1);
+	ir[sizeof(ir) - 1] = 0;
+	struct SmmCacheEntry stored = { "", ir, 0 };
+	struct SmmCacheKey keys[40];
+	char src[100];
+	struct SmmCompileOptions options = { "test.smm" };
+	for (int i = 0; i < 40; i++) {
+		snprintf(src, sizeof(src), "a := %d;\n", i);
+		keys[i] = smmCacheGetKey(cache, &options, src, strlen(src));
+		smmCachePut(cache, &keys[i], &stored);
+	}
+
+	struct SmmCacheStats stats = smmCacheGetStats(cache);
+	CuAssertTrue(tc, stats.evictions > 0);
+	CuAssertTrue(tc, stats.size <= maxSize);
+	// Last stored entry is the most recently used one so it must be kept
+	struct SmmCacheEntry entry;
+	CuAssertTrue(tc, smmCacheGet(cache, &keys[39], &entry, a));
+	CuAssertStrEquals(tc, ir, entry.ir);
+	smmCacheClose(cache);
+	removeCacheDir(dir);
+	ibsSimpleAllocatorFree(a);
+}
+
+/**
+ * Lazy bodies skip errors in funcs that are never called while parallel
+ * passes report them so results of the two modes must never be mixed up.
+ */
+static void TestCacheKeyModes(CuTest *tc) {
+	PIbsAllocator a = ibsChunkedAllocatorCreate("cacheTest", 64 * 1024);
+	char dir[MAX_DIR_SIZE];
+	getCacheDir(dir);
+	PSmmCache cache = smmCacheOpen(dir, 64 * 1024 * 1024);
+	CuAssertPtrNotNull(tc, cache);
+	PSmmContext ctx = smmContextCreate();
+
+	const char* src = "a := 0;\nunused :: (b: int32) -> int32 { return b + missing; }\n";
+	size_t len = strlen(src);
+	struct SmmCompileOptions lazyOptions = { "test.smm", true, false };
+	struct SmmCompileOptions parallelOptions = { "test.smm", false, true, 2 };
+	struct SmmCacheKey lazyKey = smmCacheGetKey(cache, &lazyOptions, src, len);
+	struct SmmCacheKey parallelKey = smmCacheGetKey(cache, &parallelOptions, src, len);
+	CuAssertTrue(tc, memcmp(&lazyKey, &parallelKey, sizeof(lazyKey)) != 0);
+
+	struct SmmCompileResult res;
+	CuAssertTrue(tc, smmCompileBuffer(ctx, src, len, &lazyOptions, &res));
+	struct SmmCacheEntry stored = { smmFormatMessages(&res.msgs, a), res.ir, res.msgs.errorCount };
+	smmCachePut(cache, &lazyKey, &stored);
+
+	struct SmmCacheEntry entry;
+	CuAssertTrue(tc, !smmCacheGet(cache, &parallelKey, &entry, a));
+	CuAssertTrue(tc, !smmCompileBuffer(ctx, src, len, &parallelOptions, &res));
+	stored.msgs = smmFormatMessages(&res.msgs, a);
+	stored.ir = NULL;
+	stored.errorCount = res.msgs.errorCount;
+	smmCachePut(cache, &parallelKey, &stored);
+
+	CuAssertTrue(tc, smmCacheGet(cache, &lazyKey, &entry, a));
+	CuAssertIntEquals(tc, 0, entry.errorCount);
+	CuAssertPtrNotNull(tc, entry.ir);
+	CuAssertTrue(tc, smmCacheGet(cache, &parallelKey, &entry, a));
+	CuAssertIntEquals(tc, 1, entry.errorCount);
+	CuAssertPtrEquals(tc, NULL, (void*)entry.ir);
+	CuAssertPtrNotNull(tc, strstr(entry.msgs, "missing"));
+
+	smmContextFree(ctx);
+	smmCacheClose(cache);
+	removeCacheDir(dir);
+	ibsSimpleAllocatorFree(a);
+}
+
+static void TestCacheCorruptEntry(CuTest *tc) {
+	PIbsAllocator a = ibsChunkedAllocatorCreate("cacheTest", 64 * 1024);
+	char dir[MAX_DIR_SIZE];
+	getCacheDir(dir);
+	PSmmCache cache = smmCacheOpen(dir, 64 * 1024 * 1024);
+	CuAssertPtrNotNull(tc, cache);
+
+	const char* src = "a := 0;\n";
+	struct SmmCompileOptions options = { "test.smm" };
+	struct SmmCacheKey key = smmCacheGetKey(cache, &options, src, strlen(src));
+	struct SmmCacheEntry stored = { "", "; ModuleID = 'test.smm'\n", 0 };
+	smmCachePut(cache, &key, &stored);
+
+	// Entry whose header asks for far more than the file holds must be rejected and deleted
+	char path[MAX_DIR_SIZE * 2];
+	getEntryPath(dir, &key, path);
+	CuAssertTrue(tc, fileExists(path));
+	FILE* f = fopen(path, "r+b");
+	CuAssertPtrNotNull(tc, f);
+	uint32_t header[5] = { 0x43434d53, 0, 0x7fffffff, 0, 0 };
+	fwrite(header, sizeof(header), 1, f);
+	fclose(f);
+	struct SmmCacheEntry entry;
+	CuAssertTrue(tc, !smmCacheGet(cache, &key, &entry, a));
+	CuAssertTrue(tc, !fileExists(path));
+
+	// Truncated entry is rejected as well
+	smmCachePut(cache, &key, &stored);
+	f = fopen(path, "wb");
+	CuAssertPtrNotNull(tc, f);
+	fwrite(header, sizeof(header) - 1, 1, f);
+	fclose(f);
+	CuAssertTrue(tc, !smmCacheGet(cache, &key, &entry, a));
+	CuAssertTrue(tc, !fileExists(path));
+
+	smmCacheClose(cache);
+	removeCacheDir(dir);
+	ibsSimpleAllocatorFree(a);
+}
+
+static void TestCacheStaleTmpFiles(CuTest *tc) {
+	PIbsAllocator a = ibsChunkedAllocatorCreate("cacheTest", 64 * 1024);
+	char dir[MAX_DIR_SIZE];
+	getCacheDir(dir);
+	uint64_t maxSize = 16 * 1024;
+	PSmmCache cache = smmCacheOpen(dir, maxSize);
+	CuAssertPtrNotNull(tc, cache);
+
+	// Temporary files left by processes that died while writing are deleted by cleanup
+	// once they are old enough but files that are still being written are kept
+	char stalePath[MAX_DIR_SIZE * 2];
+	char freshPath[MAX_DIR_SIZE * 2];
+	sprintf(stalePath, "%s/%s", dir, "0123.tmp.1.1");
+	sprintf(freshPath, "%s/%s", dir, "4567.tmp.1.2");
+	createFile(stalePath, time(NULL) - 24 * 60 * 60);
+	createFile(freshPath, time(NULL));
+
+	char ir[1024];
+	memset(ir, 'x', sizeof(ir) - 1);
+	ir[sizeof(ir) - 1] = 0;
+	struct SmmCacheEntry stored = { "", ir, 0 };
+	struct SmmCompileOptions options = { "test.smm" };
+	char src[100];
+	for (int i = 0; i < 20; i++) {
+		snprintf(src, sizeof(src), "a := %d;\n", i);
+		struct SmmCacheKey key = smmCacheGetKey(cache, &options, src, strlen(src));
+		smmCachePut(cache, &key, &stored);
+	}
+	CuAssertTrue(tc, smmCacheGetStats(cache).evictions > 0);
+	CuAssertTrue(tc, !fileExists(stalePath));
+	CuAssertTrue(tc, fileExists(freshPath));
+
+	smmCacheClose(cache);
+	removeCacheDir(dir);
+	ibsSimpleAllocatorFree(a);
+}
+
+CuSuite* SmmCacheGetSuite() {
+	CuSuite* suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, TestCachePutGet);
+	SUITE_ADD_TEST(suite, TestCacheEviction);
+	SUITE_ADD_TEST(suite, TestCacheKeyModes);
+	SUITE_ADD_TEST(suite, TestCacheCorruptEntry);
+	SUITE_ADD_TEST(suite, TestCacheStaleTmpFiles);
+
+	return suite;
+}
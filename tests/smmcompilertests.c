@@ -0,0 +1,68 @@
+#include "../compiler/ibscommon.h"
+#include "CuTest.h"
+#include "../compiler/smmcompiler.h"
+#include "../compiler/smmllvmcodegen.h"
+#include "../compiler/ibsfile.h"
+
+#include <string.h>
+
+#define COMPILE_COUNT 50
+
+static void TestCompileBuffer(CuTest *tc) {
+	PIbsAllocator a = ibsChunkedAllocatorCreate("compilerTest", 64 * 1024);
+	PIbsFile file = ibsFileOpen("test.smm", a);
+	CuAssertPtrNotNull(tc, file);
+	struct SmmMsgs msgs = { 0 };
+	msgs.a = a;
+	struct SmmCompileOptions options = { "test.smm" };
+	PSmmAst module = smmCheckSource(file->data, &options, NULL, &msgs, a);
+	CuAssertIntEquals(tc, 0, msgs.errorCount);
+	const char* expected = smmGenerateLLVMIR(module, NULL, NULL, a);
+	CuAssertPtrNotNull(tc, expected);
+	smmFreeAst(module);
+
+	// Same context used many times must give the same result as compiling without it
+	PSmmContext ctx = smmContextCreate();
+	struct SmmCompileResult res;
+	for (int i = 0; i < COMPILE_COUNT; i++) {
+		if (i == COMPILE_COUNT / 2) smmContextReset(ctx);
+		options.parallelPasses = i % 2;
+		options.useLexerThread = i % 3 == 0;
+		CuAssertTrue(tc, smmCompileBuffer(ctx, file->data, file->size, &options, &res));
+		CuAssertStrEquals(tc, expected, res.ir);
+		CuAssertIntEquals(tc, strlen(expected), res.irSize);
+		CuAssertIntEquals(tc, 0, res.msgs.errorCount);
+	}
+
+	// Source doesn't have to be zero terminated and errors are reported in result
+	const char* src = "a : int32 = 1;\nb : int32 = c; garbage";
+	CuAssertTrue(tc, smmCompileBuffer(ctx, src, strchr(src, ';') + 1 - src, NULL, &res));
+	CuAssertPtrNotNull(tc, strstr(res.ir, "ModuleID = 'buffer'"));
+	CuAssertIntEquals(tc, 0, res.msgs.errorCount);
+	CuAssertTrue(tc, !smmCompileBuffer(ctx, src, strlen(src), NULL, &res));
+	CuAssertPtrEquals(tc, NULL, (void*)res.ir);
+	CuAssertTrue(tc, res.msgs.errorCount > 0);
+	CuAssertStrEquals(tc, "buffer", res.msgs.items->filePos.filename);
+
+	// Empty source fails without any messages
+	CuAssertTrue(tc, !smmCompileBuffer(ctx, "", 0, NULL, &res));
+	CuAssertIntEquals(tc, 0, res.msgs.errorCount);
+
+	// Parallel passes process every body so they can't be combined with lazy bodies
+	options.lazyFuncBodies = true;
+	options.parallelPasses = true;
+	options.useLexerThread = false;
+	CuAssertTrue(tc, !smmCompileBuffer(ctx, file->data, file->size, &options, &res));
+	CuAssertPtrEquals(tc, NULL, (void*)res.ir);
+
+	smmContextFree(ctx);
+	ibsSimpleAllocatorFree(a);
+}
+
+CuSuite* SmmCompilerGetSuite() {
+	CuSuite* suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, TestCompileBuffer);
+
+	return suite;
+}
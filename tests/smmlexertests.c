@@ -2,8 +2,16 @@
 #include "CuTest.h"
 #include "../compiler/smmlexer.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 static PIbsAllocator a;
 
+static void assertRepr(CuTest* tc, const char* expected, PSmmToken token) {
+	CuAssertIntEquals(tc, (int)strlen(expected), token->length);
+	CuAssert(tc, "Token repr doesn't match", strncmp(expected, token->repr, token->length) == 0);
+}
+
 static void TestParseIdent(CuTest *tc) {
 	char buf[] = "whatever and something or whatever again";
 	struct SmmMsgs msgs = { 0 };
@@ -35,6 +43,25 @@ static void TestParseIdent(CuTest *tc) {
 	CuAssertStrEquals(tc, "again", token->repr);
 }
 
+static void TestParseKeywords(CuTest *tc) {
+	char buf[] = "div mod not and or xor return while do if then else false true dov iF truee retur";
+	int expected[] = {
+		tkSmmIntDiv, tkSmmIntMod, tkSmmNot, tkSmmAndOp, tkSmmOrOp, tkSmmXorOp, tkSmmReturn,
+		tkSmmWhile, tkSmmDo, tkSmmIf, tkSmmThen, tkSmmElse, tkSmmBool, tkSmmBool,
+		tkSmmIdent, tkSmmIdent, tkSmmIdent, tkSmmIdent, tkSmmEof
+	};
+	struct SmmMsgs msgs = { 0 };
+	msgs.a = a;
+	PSmmLexer lex = smmCreateLexer(buf, "TestParseKeywords", &msgs, a);
+	for (int i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+		PSmmToken token = smmGetNextToken(lex);
+		CuAssertIntEquals(tc, expected[i], token->kind);
+		if (token->kind == tkSmmBool) {
+			CuAssertIntEquals(tc, token->repr[0] == 't', token->boolVal);
+		}
+	}
+}
+
 static void TestParseHexNumber(CuTest *tc) {
 	char buf[] = "0x0 0x1234abcd 0x567890ef 0xffffffff 0x100000000 0xFFFFFFFFFFFFFFFF "
 		"0x10000000000000000 0xxrg 0x123asd 0x123.324 ";
@@ -346,7 +373,7 @@ static void TestParseChar(CuTest *tc) {
 static void assertStringToken(CuTest* tc, const char* expected, PSmmLexer lex) {
 	PSmmToken token = smmGetNextToken(lex);
 	CuAssertIntEquals(tc, '"', token->kind);
-	CuAssertStrEquals(tc, "\"", token->repr);
+	assertRepr(tc, "\"", token);
 	
 	token = smmGetNextStringToken(lex, '"', soSmmLeaveWhitespace);
 	CuAssertIntEquals(tc, tkSmmString, token->kind);
@@ -354,7 +381,7 @@ static void assertStringToken(CuTest* tc, const char* expected, PSmmLexer lex) {
 
 	token = smmGetNextToken(lex);
 	CuAssertIntEquals(tc, '"', token->kind);
-	CuAssertStrEquals(tc, "\"", token->repr);
+	assertRepr(tc, "\"", token);
 }
 
 static void assertRawStringToken(CuTest* tc, const char* startDelim, const char* expected, PSmmLexer lex) {
@@ -362,7 +389,7 @@ static void assertRawStringToken(CuTest* tc, const char* startDelim, const char*
 	if (startDelim[1] != 0) termChar = &startDelim[1];
 	PSmmToken token = smmGetNextToken(lex);
 	CuAssertIntEquals(tc, *termChar, token->kind);
-	CuAssertStrEquals(tc, startDelim, token->repr);
+	assertRepr(tc, startDelim, token);
 	
 	token = smmGetNextStringToken(lex, *termChar, token->sintVal);
 	CuAssertIntEquals(tc, tkSmmString, token->kind);
@@ -370,7 +397,7 @@ static void assertRawStringToken(CuTest* tc, const char* startDelim, const char*
 
 	token = smmGetNextToken(lex);
 	CuAssertIntEquals(tc, *termChar, token->kind);
-	CuAssertStrEquals(tc, termChar, token->repr);
+	assertRepr(tc, termChar, token);
 }
 
 static void TestParseString(CuTest *tc) {
@@ -418,7 +445,7 @@ static void TestParseString(CuTest *tc) {
 	if (startDelim[1] != 0) termChar = &startDelim[1];
 	PSmmToken token = smmGetNextToken(lex);
 	CuAssertIntEquals(tc, *termChar, token->kind);
-	CuAssertStrEquals(tc, startDelim, token->repr);
+	assertRepr(tc, startDelim, token);
 
 	CuAssertPtrEquals_Msg(tc, "Got unexpected error reported", NULL, curMsg->next);
 	
@@ -430,17 +457,165 @@ static void TestParseString(CuTest *tc) {
 	CuAssertIntEquals_Msg(tc, "Expected message not received", errSmmUnclosedString, curMsg->type);
 }
 
+static void assertTokenPos(CuTest* tc, PSmmToken token, PSmmLexer lex, uint32_t lineNumber, uint32_t lineOffset) {
+	struct SmmFilePos filePos = smmGetFilePos(&lex->lines, token->offset);
+	CuAssertIntEquals(tc, lineNumber, filePos.lineNumber);
+	CuAssertIntEquals(tc, lineOffset, filePos.lineOffset);
+}
+
+static void TestFilePos(CuTest *tc) {
+	char buf[] = "a\nbb cc\r\n  d // comment\n\r\n\re \"two\nlines\" f";
+	struct SmmMsgs msgs = { 0 };
+	msgs.a = a;
+	PSmmLexer lex = smmCreateLexer(buf, "TestFilePos", &msgs, a);
+	assertTokenPos(tc, smmGetNextToken(lex), lex, 1, 1);
+	assertTokenPos(tc, smmGetNextToken(lex), lex, 2, 1);
+	assertTokenPos(tc, smmGetNextToken(lex), lex, 2, 4);
+	assertTokenPos(tc, smmGetNextToken(lex), lex, 3, 3);
+	assertTokenPos(tc, smmGetNextToken(lex), lex, 5, 1);
+	assertTokenPos(tc, smmGetNextToken(lex), lex, 5, 3);
+	assertTokenPos(tc, smmGetNextStringToken(lex, '"', soSmmLeaveWhitespace), lex, 5, 4);
+	assertTokenPos(tc, smmGetNextToken(lex), lex, 6, 6);
+	assertTokenPos(tc, smmGetNextToken(lex), lex, 6, 8);
+	CuAssertStrEquals(tc, "TestFilePos", smmGetFilePos(&lex->lines, 0).filename);
+}
+
+static void assertSameToken(CuTest* tc, PSmmToken expected, PSmmToken token) {
+	CuAssertIntEquals(tc, expected->kind, token->kind);
+	CuAssertIntEquals(tc, expected->offset, token->offset);
+	CuAssertIntEquals(tc, expected->length, token->length);
+	CuAssertIntEquals(tc, expected->isFirstOnLine, token->isFirstOnLine);
+	CuAssertIntEquals(tc, expected->atom, token->atom);
+	CuAssertTrue(tc, expected->uintVal == token->uintVal);
+}
+
+static void assertSameLinesAndMsgs(CuTest* tc, PSmmMsgs expectedMsgs, PSmmMsgs msgs) {
+	PSmmLineIndex expectedLines = expectedMsgs->lines;
+	CuAssertIntEquals(tc, expectedLines->count, msgs->lines->count);
+	for (uint32_t i = 0; i < expectedLines->count; i++) {
+		CuAssertIntEquals(tc, expectedLines->starts[i], msgs->lines->starts[i]);
+	}
+
+	CuAssertIntEquals(tc, expectedMsgs->errorCount, msgs->errorCount);
+	PSmmMsg expectedMsg = expectedMsgs->items;
+	for (PSmmMsg msg = msgs->items; msg; msg = msg->next) {
+		CuAssertIntEquals(tc, expectedMsg->type, msg->type);
+		CuAssertIntEquals(tc, expectedMsg->filePos.lineNumber, msg->filePos.lineNumber);
+		CuAssertIntEquals(tc, expectedMsg->filePos.lineOffset, msg->filePos.lineOffset);
+		CuAssertStrEquals(tc, expectedMsg->text, msg->text);
+		expectedMsg = expectedMsg->next;
+	}
+}
+
+/**
+ * Checks that smmTokenize gives the same tokens, line starts and messages as
+ * calling smmGetNextToken until eof.
+ */
+static void assertSameAsStreamed(CuTest* tc, char* buf, PIbsAllocator a) {
+	struct SmmMsgs msgs = { 0 };
+	msgs.a = a;
+	PSmmLexer lex = smmCreateLexer(buf, "tokenized", &msgs, a);
+	uint32_t count;
+	PSmmToken tokens = smmTokenize(lex, a, &count);
+	CuAssertIntEquals(tc, tkSmmEof, tokens[count - 1].kind);
+	CuAssertPtrEquals(tc, &tokens[count - 1], lex->lastToken);
+
+	struct SmmMsgs streamedMsgs = { 0 };
+	streamedMsgs.a = a;
+	PSmmLexer streamedLex = smmCreateLexer(buf, "tokenized", &streamedMsgs, a);
+	for (uint32_t i = 0; i < count; i++) {
+		assertSameToken(tc, smmGetNextToken(streamedLex), &tokens[i]);
+	}
+	assertSameLinesAndMsgs(tc, &streamedMsgs, &msgs);
+}
+
+/**
+ * Generates source of at least given size with lines that test guesses
+ * parallel lexing makes about what is before each chunk. Minus at the start
+ * of a line can be a sign or an operator, @ can take a newline as its char
+ * and \n\r is a single newline.
+ */
+static char* generateTrickySource(size_t size, PIbsAllocator a) {
+	const char* lines[] = {
+		"x = a\n", "-1 + b\n", "-2.5e3 c\n", "d = @\n", "  // comment -3\n", "\n",
+		"e = 5;\r\n", "f\n\r", "-\n", "if x then y; else z;\n", "\"-4 string\"\n", "\r\n",
+	};
+	// Lines with errors are rare so there aren't too many messages
+	const char* errorLines[] = { "$ invalid\n", "-99999999999999999999\n", "g -0x\n" };
+	char* buf = ibsAlloc(a, size + 64);
+	size_t pos = 0;
+	srand(15);
+	while (pos < size) {
+		const char* line = lines[rand() % (sizeof(lines) / sizeof(lines[0]))];
+		if (rand() % 1000 == 0) line = errorLines[rand() % (sizeof(errorLines) / sizeof(errorLines[0]))];
+		size_t length = strlen(line);
+		memcpy(&buf[pos], line, length);
+		pos += length;
+	}
+	return buf;
+}
+
+static void TestTokenize(CuTest *tc) {
+	const char* line = "a1 = -2.5 + 0x1F * b; // comment\n";
+	size_t lineLength = strlen(line);
+	int lineCount = 200; // Enough lines so the token array has to grow
+	char* buf = ibsAlloc(a, lineLength * lineCount + 1);
+	for (int i = 0; i < lineCount; i++) {
+		memcpy(&buf[i * lineLength], line, lineLength);
+	}
+	assertSameAsStreamed(tc, buf, a);
+}
+
+static void TestTokenizeInParallel(CuTest *tc) {
+	PIbsAllocator ta = ibsChunkedAllocatorCreate("tokenizeTest", 16 * 1024 * 1024);
+	assertSameAsStreamed(tc, generateTrickySource(3 * 1024 * 1024 / 2, ta), ta);
+	ibsSimpleAllocatorFree(ta);
+}
+
+static void TestTokenPipe(CuTest *tc) {
+	PIbsAllocator ta = ibsChunkedAllocatorCreate("tokenPipeTest", 16 * 1024 * 1024);
+	PIbsAllocator lexerAllocator = ibsChunkedAllocatorCreate("tokenPipeLexer", 1024 * 1024);
+	char* buf = generateTrickySource(256 * 1024, ta);
+
+	struct SmmMsgs msgs = { 0 };
+	msgs.a = ta;
+	PSmmLexer lex = smmCreateLexer(buf, "piped", &msgs, ta);
+	PSmmTokenPipe pipe = smmCreateTokenPipe(lex, &msgs, lexerAllocator, ta);
+
+	struct SmmMsgs streamedMsgs = { 0 };
+	streamedMsgs.a = ta;
+	PSmmLexer streamedLex = smmCreateLexer(buf, "piped", &streamedMsgs, ta);
+	PSmmToken token;
+	do {
+		token = smmGetNextPipedToken(pipe);
+		assertSameToken(tc, smmGetNextToken(streamedLex), token);
+	} while (token->kind != tkSmmEof);
+	CuAssertPtrEquals(tc, token, smmGetNextPipedToken(pipe));
+	smmCloseTokenPipe(pipe);
+	assertSameLinesAndMsgs(tc, &streamedMsgs, &msgs);
+
+	ibsSimpleAllocatorFree(lexerAllocator);
+	ibsSimpleAllocatorFree(ta);
+}
+
 static void TestTokenToString(CuTest *tc) {
-	struct SmmToken token = { 0, 0, 0, "repr" };
-	char buf[4] = { 0 };
+	struct SmmToken token = { 0, 0, 0, 0, "repr and more", 4 };
+	char buf[SMM_TOKEN_STRING_BUF_SIZE] = { 0 };
 	const char* res = smmTokenToString(&token, buf);
 	CuAssertStrEquals(tc, "repr", res);
-	CuAssertStrEquals(tc, "", buf);
+	CuAssertPtrEquals(tc, buf, res);
+
+	char longRepr[SMM_TOKEN_STRING_BUF_SIZE * 2];
+	memset(longRepr, '1', sizeof(longRepr));
+	token.repr = longRepr;
+	token.length = sizeof(longRepr);
+	res = smmTokenToString(&token, buf);
+	CuAssertIntEquals(tc, SMM_TOKEN_STRING_BUF_SIZE - 1, (int)strlen(res));
+	CuAssertStrEquals(tc, "...", &res[SMM_TOKEN_STRING_BUF_SIZE - 4]);
 
 	token.kind = tkSmmIdent;
 	res = smmTokenToString(&token, buf);
 	CuAssertStrEquals(tc, "identifier", res);
-	CuAssertStrEquals(tc, "", buf);
 
 	token.kind = '+';
 	res = smmTokenToString(&token, buf);
@@ -453,12 +628,17 @@ CuSuite* SmmLexerGetSuite() {
 	CuSuite* suite = CuSuiteNew();
 
 	SUITE_ADD_TEST(suite, TestParseIdent);
+	SUITE_ADD_TEST(suite, TestParseKeywords);
 	SUITE_ADD_TEST(suite, TestParseHexNumber);
 	SUITE_ADD_TEST(suite, TestParseNumber);
 	SUITE_ADD_TEST(suite, TestParseNegNumber);
 	SUITE_ADD_TEST(suite, TestParseString);
 	SUITE_ADD_TEST(suite, TestParseChar);
 	SUITE_ADD_TEST(suite, TestTokenToString);
+	SUITE_ADD_TEST(suite, TestFilePos);
+	SUITE_ADD_TEST(suite, TestTokenize);
+	SUITE_ADD_TEST(suite, TestTokenizeInParallel);
+	SUITE_ADD_TEST(suite, TestTokenPipe);
 
 	return suite;
 }
@@ -3,6 +3,10 @@
 #include "../compiler/smmparser.h"
 #include "../compiler/smmtypeinference.h"
 #include "../compiler/smmsempass.h"
+#include "../compiler/smmparallelpasses.h"
+#include "../compiler/smmllvmcodegen.h"
+#include "../compiler/ibsfile.h"
+#include "../compiler/ibsthread.h"
 #include "smmastwritter.h"
 #include "smmastreader.h"
 #include "smmastmatcher.h"
@@ -19,21 +23,35 @@ static PIbsDict msgTypeStrToEnum;
 
 #define SAMPLE_FORMAT "sample%.4d"
 
-static PSmmAstNode loadModule(const char* filename, const char* moduleName, PSmmMsgs msgs, PIbsAllocator a) {
-	char filebuf[64 * 1024] = { 0 };
-	FILE* f = fopen(filename, "rb");
-	if (!f) {
+/**
+ * Parses the given file using the lexer thread if lexerAllocator is given or
+ * tokenizing the whole file first otherwise.
+ */
+static PSmmAst loadModule(const char* filename, const char* moduleName, bool lazyFuncBodies,
+		PSmmMsgs msgs, PIbsAllocator lexerAllocator, PIbsAllocator a) {
+	PIbsFile file = ibsFileOpen(filename, a);
+	if (!file) {
 		printf("Can't find %s!\n", filename);
 		exit(EXIT_FAILURE);
 	}
-	fread(filebuf, 1, 64 * 1024, f);
-	fclose(f);
 
-	PSmmLexer lex = smmCreateLexer(filebuf, moduleName, msgs, a);
+	PSmmLexer lex = smmCreateLexer(file->data, moduleName, msgs, a);
 
-	PSmmParser parser = smmCreateParser(lex, msgs, a);
+	if (lexerAllocator) {
+		PSmmTokenPipe pipe = smmCreateTokenPipe(lex, msgs, lexerAllocator, a);
+		PSmmParser parser = smmCreateParserFromPipe(lex, pipe, msgs, a);
+		parser->lazyFuncBodies = lazyFuncBodies;
+		PSmmAst module = smmParse(parser);
+		smmCloseTokenPipe(pipe);
+		return module;
+	}
 
-	PSmmAstNode module = smmParse(parser);
+	uint32_t tokenCount;
+	PSmmToken tokens = smmTokenize(lex, a, &tokenCount);
+	PSmmParser parser = smmCreateParserFromTokens(lex, tokens, tokenCount, msgs, a);
+	parser->lazyFuncBodies = lazyFuncBodies;
+
+	PSmmAst module = smmParse(parser);
 
 	return module;
 }
@@ -61,6 +79,18 @@ static void checkMsgs(CuTest* tc, PSmmLexer lex, PSmmMsgs msgs) {
 	CuAssertIntEquals_Msg(tc, "Number of reported messages not matched", msgCount, rcvCount);
 }
 
+static void assertSameMsgs(CuTest* tc, PSmmMsgs expectedMsgs, PSmmMsgs msgs) {
+	CuAssertIntEquals_Msg(tc, "Number of errors differs", expectedMsgs->errorCount, msgs->errorCount);
+	CuAssertIntEquals_Msg(tc, "Number of warnings differs", expectedMsgs->warningCount, msgs->warningCount);
+	PSmmMsg expectedMsg = expectedMsgs->items;
+	for (PSmmMsg msg = msgs->items; msg; msg = msg->next) {
+		CuAssertIntEquals(tc, expectedMsg->type, msg->type);
+		CuAssertIntEquals(tc, expectedMsg->filePos.lineNumber, msg->filePos.lineNumber);
+		CuAssertIntEquals(tc, expectedMsg->filePos.lineOffset, msg->filePos.lineOffset);
+		expectedMsg = expectedMsg->next;
+	}
+}
+
 static void writeReceivedMsgs(FILE* f, PSmmMsgs msgs) {
 	PSmmMsg curMsg = msgs->items;
 	while (curMsg) {
@@ -80,8 +110,16 @@ static void TestSample(CuTest *tc) {
 	PIbsAllocator a = ibsSimpleAllocatorCreate(baseName, 1024 * 1024);
 	struct SmmMsgs msgs = { 0 };
 	msgs.a = a;
-	PSmmAstNode module = loadModule(inFileName, baseName, &msgs, a);
+	PSmmAst module = loadModule(inFileName, baseName, false, &msgs, NULL, a);
 	if (!module) return;
+
+	// Parsing with tokens from lexer thread must give the same result
+	PIbsAllocator lexerAllocator = ibsChunkedAllocatorCreate("lexer", 64 * 1024);
+	struct SmmMsgs pipedMsgs = { 0 };
+	pipedMsgs.a = a;
+	PSmmAst pipedModule = loadModule(inFileName, baseName, false, &pipedMsgs, lexerAllocator, a);
+	smmAssertASTEquals(tc, module, pipedModule);
+	assertSameMsgs(tc, &msgs, &pipedMsgs);
 	smmExecuteTypeInferencePass(module, &msgs, a);
 	FILE* f = fopen(outFileName, "rb");
 	if (!f) {
@@ -102,15 +140,14 @@ static void TestSample(CuTest *tc) {
 		fclose(f);
 		printf("Generated new test data for %s\n", baseName);
 	} else {
-		char filebuf[64 * 1024] = { 0 };
-		fread(filebuf, 1, 64 * 1024, f);
 		fclose(f);
+		PIbsFile astFile = ibsFileOpen(outFileName, a);
 		struct SmmMsgs tmpMsgs = { 0 };
 		tmpMsgs.a = a;
-		PSmmLexer lex = smmCreateLexer(filebuf, baseName, &tmpMsgs, a);
+		PSmmLexer lex = smmCreateLexer(astFile->data, baseName, &tmpMsgs, a);
 		CuAssertPtrEquals_Msg(tc, "Error while parsing ast file", NULL, tmpMsgs.items);
 		checkMsgs(tc, lex, &msgs);
-		PSmmAstNode refModule = smmLoadAst(lex, a);
+		PSmmAst refModule = smmLoadAst(lex, a);
 		smmAssertASTEquals(tc, refModule, module);
 		refModule = NULL;
 		if (msgs.errorCount == 0) {
@@ -120,12 +157,214 @@ static void TestSample(CuTest *tc) {
 			refModule = smmLoadAst(lex, a);
 			smmAssertASTEquals(tc, refModule, module);
 		}
+		ibsFileClose(astFile);
 	}
 
 	ibsSimpleAllocatorPrintInfo(a);
+	ibsSimpleAllocatorFree(lexerAllocator);
+	ibsSimpleAllocatorFree(a);
+}
+
+static SmmAstNode findFunc(PSmmAst ast, const char* name) {
+	SmmAstNode globalScope = ast->scopes[ast->nexts[ast->program]];
+	for (SmmAstNode decl = ast->decls[globalScope]; decl; decl = ast->nextDecls[decl]) {
+		SmmAstNode declared = ast->lefts[decl];
+		if (ast->kinds[declared] == nkSmmFunc && strcmp(ast->tokens[declared]->repr, name) == 0) return declared;
+	}
+	return 0;
+}
+
+static void TestLazyFuncBodies(CuTest *tc) {
+	static char src[] =
+		"used :: (a: int32) -> int32 { return a * 2; }\n"
+		"unused :: (a: int32) -> int32 { if a > 0 then { return a; } return -a; }\n"
+		"caller :: () -> int32 { return used(3); }\n"
+		"x := caller();\n";
+	PIbsAllocator a = ibsSimpleAllocatorCreate("lazyBodies", 256 * 1024);
+	PIbsAllocator lexerAllocator = ibsChunkedAllocatorCreate("lexer", 64 * 1024);
+	for (int usePipe = 0; usePipe < 2; usePipe++) {
+		struct SmmMsgs msgs = { 0 };
+		msgs.a = a;
+		PSmmLexer lex = smmCreateLexer(src, "lazyBodies", &msgs, a);
+		PSmmParser parser;
+		PSmmTokenPipe pipe = NULL;
+		if (usePipe) {
+			pipe = smmCreateTokenPipe(lex, &msgs, lexerAllocator, a);
+			parser = smmCreateParserFromPipe(lex, pipe, &msgs, a);
+		} else {
+			uint32_t tokenCount;
+			PSmmToken tokens = smmTokenize(lex, a, &tokenCount);
+			parser = smmCreateParserFromTokens(lex, tokens, tokenCount, &msgs, a);
+		}
+		parser->lazyFuncBodies = true;
+		PSmmAst ast = smmParse(parser);
+		if (pipe) smmCloseTokenPipe(pipe);
+
+		SmmAstNode used = findFunc(ast, "used");
+		SmmAstNode unused = findFunc(ast, "unused");
+		SmmAstNode caller = findFunc(ast, "caller");
+		CuAssertTrue(tc, used && unused && caller);
+		CuAssertTrue(tc, ast->flags[used] & ast->flags[unused] & ast->flags[caller] & nfSmmLazyBody);
+		CuAssertUIntEquals(tc, 0, ast->bodies[used]);
+
+		smmExecuteTypeInferencePass(ast, &msgs, a);
+		CuAssertIntEquals(tc, 0, msgs.errorCount);
+		CuAssertTrue(tc, !(ast->flags[caller] & nfSmmLazyBody) && ast->bodies[caller]);
+		CuAssertTrue(tc, !(ast->flags[used] & nfSmmLazyBody) && ast->bodies[used]);
+		CuAssertTrue(tc, (ast->flags[unused] & nfSmmLazyBody) && !ast->bodies[unused]);
+		CuAssertUIntEquals(tc, 1, ast->extras[ast->stmts[ast->bodies[used]]]);
+
+		smmExecuteSemPass(ast, &msgs, a);
+		CuAssertIntEquals(tc, 0, msgs.errorCount);
+		smmFreeAst(ast);
+	}
+	ibsSimpleAllocatorFree(lexerAllocator);
+	ibsSimpleAllocatorFree(a);
+}
+
+static void TestDuplicateParams(CuTest *tc) {
+	// Duplicate param is dropped from the signature but calls must still match the func
+	static char src[] =
+		"dup :: (a: int32, a: int32) -> int32 { return a; }\n"
+		"x := dup(1, 2);\n";
+	PIbsAllocator a = ibsSimpleAllocatorCreate("duplicateParams", 256 * 1024);
+	struct SmmMsgs msgs = { 0 };
+	msgs.a = a;
+	PSmmLexer lex = smmCreateLexer(src, "duplicateParams", &msgs, a);
+	uint32_t tokenCount;
+	PSmmToken tokens = smmTokenize(lex, a, &tokenCount);
+	PSmmParser parser = smmCreateParserFromTokens(lex, tokens, tokenCount, &msgs, a);
+	PSmmAst ast = smmParse(parser);
+	CuAssertIntEquals(tc, 1, msgs.errorCount);
+	SmmAstNode dup = findFunc(ast, "dup");
+	CuAssertTrue(tc, dup != 0);
+	CuAssertUIntEquals(tc, 1, ast->extras[ast->params[dup]]);
+
+	smmExecuteTypeInferencePass(ast, &msgs, a);
+	CuAssertIntEquals(tc, 1, msgs.errorCount);
+	smmFreeAst(ast);
 	ibsSimpleAllocatorFree(a);
 }
 
+static void TestParallelPasses(CuTest *tc) {
+	// Running passes on func bodies in parallel must give the same result as running them in order
+	for (int i = 1; ; i++) {
+		char baseName[20] = { 0 };
+		snprintf(baseName, 20, SAMPLE_FORMAT, i);
+		char inFileName[30] = { 0 };
+		snprintf(inFileName, 30, "samples/%s.smm", baseName);
+		FILE* f = fopen(inFileName, "rb");
+		if (!f) break;
+		fclose(f);
+
+		PIbsAllocator a = ibsSimpleAllocatorCreate(baseName, 1024 * 1024);
+		struct SmmMsgs msgs = { 0 };
+		msgs.a = a;
+		PSmmAst module = loadModule(inFileName, baseName, false, &msgs, NULL, a);
+		if (module) {
+			smmExecuteTypeInferencePass(module, &msgs, a);
+			smmExecuteSemPass(module, &msgs, a);
+
+			struct SmmMsgs parallelMsgs = { 0 };
+			parallelMsgs.a = a;
+			PSmmAst parallelModule = loadModule(inFileName, baseName, true, &parallelMsgs, NULL, a);
+			smmExecuteParallelPasses(parallelModule, &parallelMsgs, 4, a);
+			smmAssertASTEquals(tc, module, parallelModule);
+			assertSameMsgs(tc, &msgs, &parallelMsgs);
+			smmFreeAst(parallelModule);
+			smmFreeAst(module);
+		}
+		ibsSimpleAllocatorFree(a);
+	}
+}
+
+#define COMPILE_COPIES 4
+
+struct CompileTask {
+	const char* fileName;
+	const char* moduleName;
+	PSmmAst module;
+	struct SmmMsgs msgs;
+	char* code;
+	PIbsAllocator a;
+	PIbsAllocator lexerAllocator; // Tokens from the lexer thread are kept in it
+};
+
+/**
+ * Compiles a file all the way to LLVM IR which is kept in memory.
+ */
+static void compileFile(struct CompileTask* task, bool useLexerThread) {
+	task->a = ibsSimpleAllocatorCreate(task->moduleName, 1024 * 1024);
+	task->msgs.a = task->a;
+	if (useLexerThread) task->lexerAllocator = ibsSimpleAllocatorCreate("lexer", 64 * 1024);
+	task->module = loadModule(task->fileName, task->moduleName, false, &task->msgs, task->lexerAllocator, task->a);
+	smmExecuteTypeInferencePass(task->module, &task->msgs, task->a);
+	smmExecuteSemPass(task->module, &task->msgs, task->a);
+	if (smmHadErrors(&task->msgs)) return;
+	task->code = smmGenerateLLVMIR(task->module, NULL, NULL, task->a);
+}
+
+static void runCompileTask(void* data, uint32_t index) {
+	// Every other copy uses the lexer thread so more threads are racing
+	compileFile(&((struct CompileTask*)data)[index], index % 2);
+}
+
+static void TestConcurrentCompiles(CuTest *tc) {
+	// Compiling the same files on many threads at once must give the same
+	// results as compiling them one by one
+	char names[100][20] = { 0 };
+	char fileNames[100][30] = { 0 };
+	int fileCount = 0;
+	for (int i = 1; fileCount < 99; i++) {
+		snprintf(names[fileCount], 20, SAMPLE_FORMAT, i);
+		snprintf(fileNames[fileCount], 30, "samples/%s.smm", names[fileCount]);
+		FILE* f = fopen(fileNames[fileCount], "rb");
+		if (!f) break;
+		fclose(f);
+		fileCount++;
+	}
+	// AST matcher doesn't know about if and while statements in test.smm so we only compare its code
+	int sampleCount = fileCount;
+	strcpy(names[fileCount], "test");
+	strcpy(fileNames[fileCount], "test.smm");
+	fileCount++;
+
+	struct CompileTask expected[100] = { 0 };
+	for (int i = 0; i < fileCount; i++) {
+		expected[i].fileName = fileNames[i];
+		expected[i].moduleName = names[i];
+		compileFile(&expected[i], false);
+	}
+
+	uint32_t taskCount = fileCount * COMPILE_COPIES;
+	struct CompileTask* tasks = calloc(taskCount, sizeof(struct CompileTask));
+	for (uint32_t i = 0; i < taskCount; i++) {
+		tasks[i].fileName = fileNames[i % fileCount];
+		tasks[i].moduleName = names[i % fileCount];
+	}
+	ibsParallelFor(taskCount, 8, runCompileTask, tasks);
+
+	for (uint32_t i = 0; i < taskCount; i++) {
+		struct CompileTask* exp = &expected[i % fileCount];
+		if ((int)(i % fileCount) < sampleCount) smmAssertASTEquals(tc, exp->module, tasks[i].module);
+		assertSameMsgs(tc, &exp->msgs, &tasks[i].msgs);
+		if (exp->code) {
+			CuAssertPtrNotNull(tc, tasks[i].code);
+			CuAssertStrEquals(tc, exp->code, tasks[i].code);
+		} else {
+			CuAssertPtrEquals(tc, NULL, tasks[i].code);
+		}
+		smmFreeAst(tasks[i].module);
+		ibsSimpleAllocatorFree(tasks[i].a);
+		if (tasks[i].lexerAllocator) ibsSimpleAllocatorFree(tasks[i].lexerAllocator);
+	}
+	for (int i = 0; i < fileCount; i++) {
+		smmFreeAst(expected[i].module);
+		ibsSimpleAllocatorFree(expected[i].a);
+	}
+	free(tasks);
+}
+
 static void loadMsgStrings(PIbsAllocator a) {
 	if (msgTypeStrToEnum) return;
 	msgTypeStrToEnum = ibsDictCreate(a);
@@ -173,5 +412,9 @@ CuSuite* SmmParserGetSuite() {
 			break;
 		}
 	}
+	SUITE_ADD_TEST(suite, TestLazyFuncBodies);
+	SUITE_ADD_TEST(suite, TestDuplicateParams);
+	SUITE_ADD_TEST(suite, TestParallelPasses);
+	SUITE_ADD_TEST(suite, TestConcurrentCompiles);
 	return suite;
 }
@@ -0,0 +1,122 @@
+#include "../compiler/ibscommon.h"
+#include "CuTest.h"
+#include "../compiler/smmserver.h"
+#include "../compiler/ibsfile.h"
+#include "../compiler/ibsthread.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// How many times we try to connect while server thread is starting
+#define CONNECT_TRIES 100000
+
+struct ServerThread {
+	char socketPath[64];
+	bool served;
+};
+
+static void runServer(void* data) {
+	struct ServerThread* server = data;
+	server->served = smmServe(server->socketPath, 2);
+}
+
+/**
+ * Connects to the server and sends only the start of a request as a client
+ * that got stuck would.
+ */
+static int connectStalledClient(const char* socketPath) {
+	struct sockaddr_un addr = { 0 };
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, socketPath);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) return -1;
+	if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || write(fd, "SMMS", 4) != 4) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void TestServer(CuTest *tc) {
+	// Socket is named by process id so test runs at the same time don't use each other's server
+	struct ServerThread server = { { 0 } };
+	snprintf(server.socketPath, sizeof(server.socketPath), "/tmp/summusTestServer%u.sock", (uint32_t)getpid());
+	const char* socketPath = server.socketPath;
+	PIbsThread thread = ibsThreadStart(runServer, &server);
+	CuAssertPtrNotNull(tc, thread);
+
+	PIbsAllocator a = ibsChunkedAllocatorCreate("serverTest", 64 * 1024);
+	PIbsFile file = ibsFileOpen("test.smm", a);
+	struct SmmCompileOptions options = { "test.smm" };
+	struct SmmCompileResult expected;
+	PSmmContext ctx = smmContextCreate();
+	CuAssertTrue(tc, smmCompileBuffer(ctx, file->data, file->size, &options, &expected));
+
+	struct SmmServerResult res;
+	bool connected = false;
+	for (int i = 0; i < CONNECT_TRIES && !connected; i++) {
+		connected = smmServerCompile(socketPath, file->data, file->size, &options, &res, a);
+		if (!connected) ibsThreadYield();
+	}
+	CuAssertTrue(tc, connected);
+	CuAssertTrue(tc, !res.cached);
+	// Only the user that started the server may connect to it
+	struct stat st;
+	CuAssertIntEquals(tc, 0, stat(socketPath, &st));
+	CuAssertIntEquals(tc, S_IRUSR | S_IWUSR, st.st_mode & 0777);
+	CuAssertStrEquals(tc, expected.ir, res.ir);
+	CuAssertStrEquals(tc, smmFormatMessages(&expected.msgs, a), res.msgs);
+
+	// Same request is answered from the cache but different options are not
+	CuAssertTrue(tc, smmServerCompile(socketPath, file->data, file->size, &options, &res, a));
+	CuAssertTrue(tc, res.cached);
+	CuAssertStrEquals(tc, expected.ir, res.ir);
+	options.parallelPasses = true;
+	CuAssertTrue(tc, smmServerCompile(socketPath, file->data, file->size, &options, &res, a));
+	CuAssertTrue(tc, !res.cached);
+	CuAssertStrEquals(tc, expected.ir, res.ir);
+
+	// Another server must not take over the socket of a running one
+	CuAssertTrue(tc, !smmServe(socketPath, 1));
+
+	// Stalled client only holds up one worker while others keep serving
+	int stalled = connectStalledClient(socketPath);
+	CuAssertTrue(tc, stalled >= 0);
+	options.parallelPasses = false;
+	CuAssertTrue(tc, smmServerCompile(socketPath, file->data, file->size, &options, &res, a));
+	CuAssertStrEquals(tc, expected.ir, res.ir);
+	close(stalled);
+
+	const char* src = "a : int32 = b;";
+	CuAssertTrue(tc, smmServerCompile(socketPath, src, strlen(src), NULL, &res, a));
+	CuAssertPtrEquals(tc, NULL, (void*)res.ir);
+	CuAssertIntEquals(tc, 1, res.errorCount);
+	CuAssertStrEquals(tc, "ERROR (at buffer:1:13): identifier 'b' is undefined\n", res.msgs);
+
+	CuAssertTrue(tc, smmServerStop(socketPath));
+	ibsThreadJoin(thread);
+	CuAssertTrue(tc, server.served);
+	CuAssertTrue(tc, !smmServerStop(socketPath));
+	unlink(socketPath);
+
+	smmContextFree(ctx);
+	ibsSimpleAllocatorFree(a);
+}
+
+#endif
+
+CuSuite* SmmServerGetSuite() {
+	CuSuite* suite = CuSuiteNew();
+
+#ifndef _WIN32
+	SUITE_ADD_TEST(suite, TestServer);
+#endif
+
+	return suite;
+}
@@ -4,40 +4,36 @@
 
 #define STMT_COLOR "palegreen"
 
-static uint32_t id(void* n) {
-	return ((uintptr_t)n) & 0xffff;
-}
-
-static const char* typeName(PSmmTypeInfo type) {
-	if (type) return type->name;
+static const char* typeName(PSmmAst ast, SmmAstNode n) {
+	if (ast->types[n] != tiSmmNone) return builtInTypes[ast->types[n]].name;
 	return "noType";
 }
 
-static void printNode(void* n, const char* label, const char* color, FILE* f) {
+static void printNode(SmmAstNode n, const char* label, const char* color, FILE* f) {
 	if (color == NULL) {
-		fprintf(f, "  n%.5x [label=\"%s\"];\n", id(n), label);
+		fprintf(f, "  n%.5x [label=\"%s\"];\n", n, label);
 	} else {
-		fprintf(f, "  n%.5x [label=\"%s\", fillcolor=\"%s\"];\n", id(n), label, color);
+		fprintf(f, "  n%.5x [label=\"%s\", fillcolor=\"%s\"];\n", n, label, color);
 	}
 }
 
-static void printEdge(void* n1, void* n2, const char* compass, FILE* f) {
-	fprintf(f, "  n%.5x:%s -> n%.5x;\n", id(n1), compass, id(n2));
+static void printEdge(SmmAstNode n1, SmmAstNode n2, const char* compass, FILE* f) {
+	fprintf(f, "  n%.5x:%s -> n%.5x;\n", n1, compass, n2);
 }
 
-static void printNodeConn(void* n1, void *n2, const char* label, const char* compass, FILE* f) {
+static void printNodeConn(SmmAstNode n1, SmmAstNode n2, const char* label, const char* compass, FILE* f) {
 	printNode(n2, label, NULL, f);
 	printEdge(n1, n2, compass, f);
 }
 
-static void printColorNodeConn(void* n1, void *n2, const char* label, const char* color, const char* compass, FILE* f) {
+static void printColorNodeConn(SmmAstNode n1, SmmAstNode n2, const char* label, const char* color, const char* compass, FILE* f) {
 	printNode(n2, label, color, f);
 	printEdge(n1, n2, compass, f);
 }
 
-static void processExpression(void* parent, PSmmAstNode expr, const char* pcompass, FILE* f) {
+static void processExpression(PSmmAst ast, SmmAstNode parent, SmmAstNode expr, const char* pcompass, FILE* f) {
 
-	switch (expr->kind) {
+	switch (ast->kinds[expr]) {
 	case nkSmmAdd: case nkSmmFAdd: case nkSmmSub: case nkSmmFSub:
 	case nkSmmMul: case nkSmmFMul: case nkSmmUDiv: case nkSmmSDiv: case nkSmmFDiv:
 	case nkSmmURem: case nkSmmSRem: case nkSmmFRem:
@@ -45,39 +41,36 @@ static void processExpression(void* parent, PSmmAstNode expr, const char* pcompa
 	case nkSmmXorOp:
 	case nkSmmEq: case nkSmmNotEq: case nkSmmGt: case nkSmmGtEq: case nkSmmLt: case nkSmmLtEq:
 		{
-			processExpression(expr, expr->right, "se", f);
+			processExpression(ast, expr, ast->rights[expr], "se", f);
 			//fallthrough
 		}
 	case nkSmmNeg: case nkSmmNot: case nkSmmCast:
 		{
 			char buf[100] = { 0 };
-			sprintf(buf, "%s: %s", nodeKindToString[expr->kind], typeName(expr->type));
+			sprintf(buf, "%s: %s", nodeKindToString[ast->kinds[expr]], typeName(ast, expr));
 			if (pcompass[0] == 's' && pcompass[1] == 0) {
 				printColorNodeConn(parent, expr, buf, STMT_COLOR, pcompass, f);
 			} else {
 				printNodeConn(parent, expr, buf, pcompass, f);
 			}
-			processExpression(expr, expr->left, "sw", f);
+			processExpression(ast, expr, ast->lefts[expr], "sw", f);
 			break;
 		}
 	case nkSmmCall:
 		{
 			char buf[100] = { 0 };
-			sprintf(buf, "call %s: %s", expr->token->repr, typeName(expr->type));
+			sprintf(buf, "call %s: %s", ast->tokens[expr]->repr, typeName(ast, expr));
 			if (pcompass[0] == 's' && pcompass[1] == 0) {
 				printColorNodeConn(parent, expr, buf, STMT_COLOR, pcompass, f);
 			} else {
 				printNodeConn(parent, expr, buf, pcompass, f);
 			}
-			PSmmAstCallNode callNode = (PSmmAstCallNode)expr;
-			if (callNode->args) {
-				void* prevArg = callNode;
-				PSmmAstNode astArg = callNode->args;
-				while (astArg) {
-					processExpression(prevArg, astArg, "se", f);
-					prevArg = astArg;
-					astArg = astArg->next;
-				}
+			SmmAstNode prevArg = expr;
+			uint32_t argCount = ast->extras[ast->args[expr]];
+			SmmAstNode* astArgs = &ast->extras[ast->args[expr] + 1];
+			for (uint32_t i = 0; i < argCount; i++) {
+				processExpression(ast, prevArg, astArgs[i], "se", f);
+				prevArg = astArgs[i];
 			}
 			break;
 		}
@@ -85,7 +78,8 @@ static void processExpression(void* parent, PSmmAstNode expr, const char* pcompa
 	case nkSmmInt: case nkSmmFloat: case nkSmmBool:
 		{
 			char buf[100] = { 0 };
-			sprintf(buf, "%s: %s", expr->token->repr, typeName(expr->type));
+			PSmmToken token = ast->tokens[expr];
+			sprintf(buf, "%.*s: %s", (int)token->length, token->repr, typeName(ast, expr));
 			if (pcompass[0] == 's' && pcompass[1] == 0) {
 				printColorNodeConn(parent, expr, buf, STMT_COLOR, pcompass, f);
 			} else {
@@ -99,149 +93,154 @@ static void processExpression(void* parent, PSmmAstNode expr, const char* pcompa
 	}
 }
 
-static void processAssignment(void* parent, PSmmAstNode stmt, const char* dir, FILE* f) {
+static void processAssignment(PSmmAst ast, SmmAstNode parent, SmmAstNode stmt, const char* dir, FILE* f) {
 	char buf[100] = { 0 };
-	sprintf(buf, "= %s", typeName(stmt->type));
-	if (((PSmmAstNode)parent)->kind == nkSmmDecl) {
+	sprintf(buf, "= %s", typeName(ast, stmt));
+	if (ast->kinds[parent] == nkSmmDecl) {
 		printNodeConn(parent, stmt, buf, dir, f);
 	} else {
 		printColorNodeConn(parent, stmt, buf, STMT_COLOR, dir, f);
 	}
-	sprintf(buf, "%s: %s", stmt->left->token->repr, typeName(stmt->left->type));
-	printNodeConn(stmt, stmt->left, buf, "sw", f);
-	processExpression(stmt, stmt->right, "se", f);
+	SmmAstNode lval = ast->lefts[stmt];
+	sprintf(buf, "%s: %s", ast->tokens[lval]->repr, typeName(ast, lval));
+	printNodeConn(stmt, lval, buf, "sw", f);
+	processExpression(ast, stmt, ast->rights[stmt], "se", f);
 }
 
-static void processLocalSymbols(PSmmAstScopeNode scope, FILE* f) {
-	void* prevDecl = scope;
-	PSmmAstDeclNode decl = scope->decls;
+static void processLocalSymbols(PSmmAst ast, SmmAstNode scope, FILE* f) {
+	SmmAstNode prevDecl = scope;
+	SmmAstNode decl = ast->decls[scope];
 	while (decl) {
 		printNodeConn(prevDecl, decl, "decl", "s", f);
-		if (decl->left->kind == nkSmmAssignment) {
-			if (decl->left->left->isConst) {
-				processAssignment(decl, decl->left, "se", f);
+		SmmAstNode assignment = ast->lefts[decl];
+		if (ast->kinds[assignment] == nkSmmAssignment) {
+			if (ast->flags[ast->lefts[assignment]] & nfSmmConst) {
+				processAssignment(ast, decl, assignment, "se", f);
 			} else {
-				printEdge(decl, decl->left->left, "se", f);
+				printEdge(decl, ast->lefts[assignment], "se", f);
 			}
 		} else {
 			assert(false && "Declaration of unknown node kind");
 		}
 		prevDecl = decl;
-		decl = decl->nextDecl;
+		decl = ast->nextDecls[decl];
 	}
 }
 
-static void processReturn(void* parent, PSmmAstNode stmt, const char* dir, FILE* f) {
+static void processReturn(PSmmAst ast, SmmAstNode parent, SmmAstNode stmt, const char* dir, FILE* f) {
 	char buf[100] = { 0 };
-	sprintf(buf, "return: %s", typeName(stmt->type));
+	sprintf(buf, "return: %s", typeName(ast, stmt));
 	printColorNodeConn(parent, stmt, buf, STMT_COLOR, dir, f);
-	if (stmt->left)	processExpression(stmt, stmt->left, "sw", f);
+	if (ast->lefts[stmt])	processExpression(ast, stmt, ast->lefts[stmt], "sw", f);
 }
 
-static void processBlock(PSmmAstBlockNode block, FILE* f);
+static void processBlock(PSmmAst ast, SmmAstNode block, FILE* f);
 
-static PSmmAstNode processStatement(PSmmAstNode prevStmt, PSmmAstNode stmt, const char* dir, FILE* f) {
-	switch (stmt->kind) {
+static SmmAstNode processStatement(PSmmAst ast, SmmAstNode prevStmt, SmmAstNode stmt, const char* dir, FILE* f) {
+	switch (ast->kinds[stmt]) {
 	case nkSmmBlock:
-		{
-			printColorNodeConn(prevStmt, stmt, "block", STMT_COLOR, dir, f);
-			PSmmAstBlockNode newBlock = (PSmmAstBlockNode)stmt;
-			printNodeConn(newBlock, newBlock->scope, "scope", "sw", f);
-			processLocalSymbols(newBlock->scope, f);
-			processBlock(newBlock, f);
-			return stmt;
-		}
+		printColorNodeConn(prevStmt, stmt, "block", STMT_COLOR, dir, f);
+		printNodeConn(stmt, ast->scopes[stmt], "scope", "sw", f);
+		processLocalSymbols(ast, ast->scopes[stmt], f);
+		processBlock(ast, stmt, f);
+		return stmt;
 	case nkSmmAssignment:
-		processAssignment(prevStmt, stmt, dir, f);
+		processAssignment(ast, prevStmt, stmt, dir, f);
 		return stmt;
 	case nkSmmReturn:
-		processReturn(prevStmt, stmt, dir, f);
+		processReturn(ast, prevStmt, stmt, dir, f);
 		return stmt;
 	case nkSmmIf:
-		printColorNodeConn(prevStmt, stmt, "if", STMT_COLOR, "sw", f);
-		processExpression(stmt, stmt->asIfWhile.cond, "w", f);
-		processStatement(stmt, stmt->asIfWhile.body, "sw", f);
-		if (stmt->asIfWhile.elseBody) {
-			processStatement(stmt, stmt->asIfWhile.elseBody, "se", f);
+		{
+			SmmAstNode* branches = &ast->extras[ast->branches[stmt]];
+			printColorNodeConn(prevStmt, stmt, "if", STMT_COLOR, "sw", f);
+			processExpression(ast, stmt, ast->conds[stmt], "w", f);
+			processStatement(ast, stmt, branches[0], "sw", f);
+			if (branches[1]) {
+				processStatement(ast, stmt, branches[1], "se", f);
+			}
+			return stmt;
 		}
-		return stmt;
 	case nkSmmWhile:
 		printColorNodeConn(prevStmt, stmt, "while", STMT_COLOR, "sw", f);
-		processExpression(stmt, stmt->asIfWhile.cond, "sw", f);
-		processStatement(stmt, stmt->asIfWhile.body, "se", f);
+		processExpression(ast, stmt, ast->conds[stmt], "sw", f);
+		processStatement(ast, stmt, ast->extras[ast->branches[stmt]], "se", f);
 		return stmt;
 	case nkSmmDecl:
-		if (stmt->left->left->isConst) {
+		if (ast->flags[ast->lefts[ast->lefts[stmt]]] & nfSmmConst) {
 			assert(false && "Const declaration should not appear as statements");
 		} else {
 			// Var declarations should appear as statements because initial value needs to be assigned
-			processAssignment(prevStmt, stmt->left, dir, f);
+			processAssignment(ast, prevStmt, ast->lefts[stmt], dir, f);
 		}
-		return stmt->left;
+		return ast->lefts[stmt];
 	default:
-		processExpression(prevStmt, stmt, dir, f);
+		processExpression(ast, prevStmt, stmt, dir, f);
 		return stmt;
 	}
 }
 
-static void processBlock(PSmmAstBlockNode block, FILE* f) {
-	void* prevStmt = block;
-	PSmmAstNode stmt = block->stmts;
-	while (stmt) {
+static void processBlock(PSmmAst ast, SmmAstNode block, FILE* f) {
+	SmmAstNode prevStmt = block;
+	uint32_t stmtCount = ast->extras[ast->stmts[block]];
+	SmmAstNode* stmts = &ast->extras[ast->stmts[block] + 1];
+	for (uint32_t i = 0; i < stmtCount; i++) {
 		const char* dir = "s";
-		if (stmt == block->stmts) dir = "se";
-		prevStmt = processStatement(prevStmt, stmt, dir, f);
-		stmt = stmt->next;
+		if (i == 0) dir = "se";
+		prevStmt = processStatement(ast, prevStmt, stmts[i], dir, f);
 	}
 }
 
-static void processGlobalSymbols(PSmmAstScopeNode scope, FILE* f) {
-	PSmmAstDeclNode prevDecl = (PSmmAstDeclNode)scope;
-	PSmmAstDeclNode decl = scope->decls;
+static void processGlobalSymbols(PSmmAst ast, SmmAstNode scope, FILE* f) {
+	SmmAstNode prevDecl = scope;
+	SmmAstNode decl = ast->decls[scope];
 	while (decl) {
 		printNodeConn(prevDecl, decl, "decl", "s", f);
-		if (decl->left->kind == nkSmmFunc) {
-			PSmmAstFuncDefNode funcNode = (PSmmAstFuncDefNode)decl->left;
+		SmmAstNode declared = ast->lefts[decl];
+		if (ast->kinds[declared] == nkSmmFunc) {
 			char buf[200] = { 0 };
-			sprintf(buf, "func %s -> %s", funcNode->token->repr, funcNode->returnType->name);
-			printNodeConn(decl, funcNode, buf, "sw", f);
-			void * prevParam = funcNode;
-			PSmmAstParamNode curParam = funcNode->params;
-			while (curParam) {
-				sprintf(buf, "%s: %s", curParam->token->repr, typeName(curParam->type));
-				printNodeConn(prevParam, curParam, buf, "sw", f);
-				prevParam = curParam;
-				curParam = curParam->next;
+			sprintf(buf, "func %s -> %s", ast->tokens[declared]->repr, builtInTypes[ast->types[declared]].name);
+			printNodeConn(decl, declared, buf, "sw", f);
+			SmmAstNode prevParam = declared;
+			uint32_t paramCount = ast->extras[ast->params[declared]];
+			SmmAstNode* params = &ast->extras[ast->params[declared] + 1];
+			for (uint32_t i = 0; i < paramCount; i++) {
+				sprintf(buf, "%s: %s", ast->tokens[params[i]]->repr, typeName(ast, params[i]));
+				printNodeConn(prevParam, params[i], buf, "sw", f);
+				prevParam = params[i];
 			}
-			if (funcNode->body) {
-				printColorNodeConn(funcNode, funcNode->body, "funcBody", STMT_COLOR, "s", f);
-				printNodeConn(funcNode->body, funcNode->body->scope, "scope", "sw", f);
-				processLocalSymbols(funcNode->body->scope, f);
-				processBlock(funcNode->body, f);
+			SmmAstNode body = ast->bodies[declared];
+			if (body) {
+				printColorNodeConn(declared, body, "funcBody", STMT_COLOR, "s", f);
+				printNodeConn(body, ast->scopes[body], "scope", "sw", f);
+				processLocalSymbols(ast, ast->scopes[body], f);
+				processBlock(ast, body, f);
 			}
-		} else if (decl->left->left->isConst) {
-			processAssignment(decl, decl->left, "se", f);
-			assert(decl->left->right && "Global var must have initializer");
+		} else if (ast->flags[ast->lefts[declared]] & nfSmmConst) {
+			processAssignment(ast, decl, declared, "se", f);
+			assert(ast->rights[declared] && "Global var must have initializer");
 		} else {
-			assert(decl->left->right && "Global var must have initializer");
+			assert(ast->rights[declared] && "Global var must have initializer");
 
-			printNodeConn(decl, decl->left->left, decl->left->left->token->repr, "se", f);
+			SmmAstNode var = ast->lefts[declared];
+			printNodeConn(decl, var, ast->tokens[var]->repr, "se", f);
 		}
 		prevDecl = decl;
-		decl = decl->nextDecl;
+		decl = ast->nextDecls[decl];
 	}
 }
 
-void smmExecuteGVPass(PSmmAstNode module, FILE* f) {
-	const char* moduleName = module->token->repr;
+void smmExecuteGVPass(PSmmAst ast, FILE* f) {
+	SmmAstNode module = ast->program;
+	const char* moduleName = ast->tokens[module]->repr;
 	fprintf(f, "digraph \"%s\" {\n  node [ style = filled ]\n", moduleName);
 	printNode(module, moduleName, "mediumaquamarine", f);
-	PSmmAstBlockNode globalBlock = (PSmmAstBlockNode)module->next;
+	SmmAstNode globalBlock = ast->nexts[module];
 	printColorNodeConn(module, globalBlock, "globalBlock", STMT_COLOR, "s", f);
-	assert(globalBlock->kind == nkSmmBlock);
-	printNodeConn(globalBlock, globalBlock->scope, "globalScope", "sw", f);
-	processGlobalSymbols(globalBlock->scope, f);
+	assert(ast->kinds[globalBlock] == nkSmmBlock);
+	printNodeConn(globalBlock, ast->scopes[globalBlock], "globalScope", "sw", f);
+	processGlobalSymbols(ast, ast->scopes[globalBlock], f);
 
-	processBlock(globalBlock, f);
+	processBlock(ast, globalBlock, f);
 	fputs("}\n", f);
 }
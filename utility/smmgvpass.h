@@ -6,4 +6,4 @@
 
 #include <stdio.h>
 
-void smmExecuteGVPass(PSmmAstNode module, FILE* f);
+void smmExecuteGVPass(PSmmAst ast, FILE* f);